@@ -0,0 +1,48 @@
+#include "CanCapture.h"
+#include <string.h>
+
+void CanCaptureBuffer::record(uint32_t timestampMs, uint32_t identifier, bool extended, bool rtr, uint8_t length, const uint8_t *data)
+{
+    if (count == Capacity)
+    {
+        dropped++;
+        return;
+    }
+
+    CanCaptureRecord &rec = records[(head + count) % Capacity];
+    rec.timestampMs = timestampMs;
+    rec.identifier = identifier;
+    rec.flags = (extended ? CAN_CAPTURE_FLAG_EXTENDED : 0) | (rtr ? CAN_CAPTURE_FLAG_RTR : 0);
+    rec.length = length > 8 ? 8 : length;
+    rec.reserved[0] = 0;
+    rec.reserved[1] = 0;
+    memset(rec.data, 0, sizeof(rec.data));
+    memcpy(rec.data, data, rec.length);
+    count++;
+    recorded++;
+}
+
+size_t CanCaptureBuffer::drain(CanCaptureRecord *out, size_t maxRecords)
+{
+    size_t n = count < maxRecords ? count : maxRecords;
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = records[head];
+        head = (head + 1) % Capacity;
+    }
+    count -= n;
+    return n;
+}
+
+void CanCaptureBuffer::clear()
+{
+    head = 0;
+    count = 0;
+}
+
+void CanCaptureBuffer::fillHeader(CanCaptureHeader &header)
+{
+    memcpy(header.magic, CAN_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAN_CAPTURE_VERSION;
+    header.recordSize = sizeof(CanCaptureRecord);
+}
@@ -0,0 +1,63 @@
+#ifndef CANCAPTURE_H
+#define CANCAPTURE_H
+
+// Binary CAN capture format shared by the gateway and the host replay tool.
+//
+// A capture file starts with a CanCaptureHeader followed by CanCaptureRecords,
+// all little endian (native byte order of the ESP32 and x86/ARM hosts).
+// Capture chunks streamed over MQTT contain records only.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CAN_CAPTURE_MAGIC "HCAP"
+#define CAN_CAPTURE_VERSION 1
+
+#define CAN_CAPTURE_FLAG_EXTENDED 0x01
+#define CAN_CAPTURE_FLAG_RTR 0x02
+
+struct CanCaptureHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t recordSize;
+};
+
+struct CanCaptureRecord
+{
+    uint32_t timestampMs;  // millis() at reception
+    uint32_t identifier;
+    uint8_t flags;         // CAN_CAPTURE_FLAG_*
+    uint8_t length;
+    uint8_t reserved[2];
+    uint8_t data[8];
+};
+
+static_assert(sizeof(CanCaptureHeader) == 8, "Capture header layout must not change");
+static_assert(sizeof(CanCaptureRecord) == 20, "Capture record layout must not change");
+
+// Fixed-size ring buffer filled from the receive path and drained in chunks
+// by the sinks, so recording a frame is only a copy
+class CanCaptureBuffer
+{
+public:
+    static const size_t Capacity = 256;
+
+    void record(uint32_t timestampMs, uint32_t identifier, bool extended, bool rtr, uint8_t length, const uint8_t *data);
+    // Copies up to maxRecords of the oldest records to out and removes them from the buffer
+    size_t drain(CanCaptureRecord *out, size_t maxRecords);
+    size_t size() const { return count; }
+    void clear();
+
+    static void fillHeader(CanCaptureHeader &header);
+
+    uint32_t recorded = 0;
+    uint32_t dropped = 0;  // Records lost because the sink did not keep up
+
+private:
+    CanCaptureRecord records[Capacity];
+    size_t head = 0;
+    size_t count = 0;
+};
+
+#endif // CANCAPTURE_H
@@ -0,0 +1,59 @@
+#include "CanFilter.h"
+#include "HovalProtocol.h"
+
+bool CanSenderFilter::addSender(uint16_t sender)
+{
+    if (contains(sender) || count == MaxSenders)
+    {
+        return false;
+    }
+    list[count++] = sender;
+    return true;
+}
+
+bool CanSenderFilter::contains(uint16_t sender) const
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (list[i] == sender)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CanSenderFilter::compute()
+{
+    if (count == 0)
+    {
+        code = 0;
+        mask = 0x1FFFFFFF;
+        acceptAll = true;
+        exact = false;
+        return;
+    }
+
+    // Sender bits that differ between the senders become "don't care"
+    uint16_t common = 0xFFFF;
+    for (size_t i = 1; i < count; i++)
+    {
+        common &= ~(list[i] ^ list[0]);
+    }
+    code = list[0] & common;
+    mask = 0x1FFF0000 | (uint16_t)~common;
+    acceptAll = common == 0;
+
+    // The mask matches 2^(don't care sender bits) senders; exact if those are just ours
+    uint8_t dontCare = 0;
+    for (uint16_t bits = (uint16_t)~common; bits; bits &= bits - 1)
+    {
+        dontCare++;
+    }
+    exact = !acceptAll && (1u << dontCare) == count;
+}
+
+bool CanSenderFilter::accepts(uint32_t identifier) const
+{
+    return count == 0 || contains(HOVAL_SENDER(identifier));
+}
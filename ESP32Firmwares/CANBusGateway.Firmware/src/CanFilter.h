@@ -0,0 +1,52 @@
+#ifndef CANFILTER_H
+#define CANFILTER_H
+
+// Hardware acceptance filter for the Hoval answers of the configured datapoints.
+//
+// In single filter mode the TWAI controller compares all 29 identifier bits of
+// extended frames but none of their data bytes. Unit, function group and
+// datapoint id are in the payload, so the filter can only select the senders
+// (identifier bits 0-15) that answer for the configured datapoints; the
+// message id and priority bits stay "don't care" so segmented messages pass.
+// Senders the mask can't separate from the wanted ones are rejected in software.
+
+#include <stdint.h>
+#include <stddef.h>
+
+class CanSenderFilter
+{
+public:
+    static const size_t MaxSenders = 8;
+
+    // Returns true if the sender is new and was added, false if known or the set is full
+    bool addSender(uint16_t sender);
+    bool contains(uint16_t sender) const;
+    size_t senderCount() const { return count; }
+    const uint16_t *senders() const { return list; }
+
+    // Recomputes code and mask from the sender set
+    void compute();
+
+    // Identifier bits that must match, and the mask of "don't care" identifier bits
+    uint32_t code = 0;
+    uint32_t mask = 0x1FFFFFFF;
+    // No sender known yet, or the senders differ in every bit: nothing to filter in hardware
+    bool acceptAll = true;
+    // The mask matches exactly the sender set, no software check needed
+    bool exact = false;
+
+    // What the hardware filter lets through
+    bool hardwareAccepts(uint32_t identifier) const { return ((identifier ^ code) & ~mask & 0x1FFFFFFF) == 0; }
+    // Full check, used as software filter for whatever the mask can't express; accepts all while no sender is known
+    bool accepts(uint32_t identifier) const;
+
+    // Values for twai_filter_config_t in single filter mode (ID in bits 31-3, RTR and unused bits don't care)
+    uint32_t acceptanceCode() const { return code << 3; }
+    uint32_t acceptanceMask() const { return (mask << 3) | 0x7; }
+
+private:
+    uint16_t list[MaxSenders];
+    size_t count = 0;
+};
+
+#endif // CANFILTER_H
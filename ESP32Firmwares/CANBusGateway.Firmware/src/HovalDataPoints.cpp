@@ -0,0 +1,71 @@
+#include "HovalDataPoints.h"
+#include <math.h>
+#include <string.h>
+
+DataPointDefinition dataPointDefs[] = {
+  // Type: HOVAL_TYPE_U8 = 0, S16 = 1, U32 = 2, S32 = 3, STR = 4
+  // Write: minimum seconds between MQTT write commands, 0 = read-only; Min/Max: accepted values in the datapoint's unit
+  // Unit: not 0x1F or 0xC0-0xDF, those collide with the segment markers (HovalProtocol::isReservedUnitId)
+  //Id, Unit, FG,   FN,   DP-ID,     "Name",                   Type, Dec, "Unit", Refresh, SubCat, "Measurement", "Topic",           Write, Min,   Max }
+  {  1, 0x01, 0x00, 0x00, 0x0000,    "Aussenfühler Temperatur", 1,   1,   "°C", 60,    "WPAE", "Temperatur", "AF1_Aussenfuehler", 0,     0,     0 },
+  {  2, 0x01, 0x01, 0x00, 0x0002,    "Vorlauf-Ist Temperatur" , 1,   1,   "°C", 60,    "HK1",  "Temperatur", "Vorlauf_Ist",       0,     0,     0 },
+  {  3, 0x01, 0x0A, 0x01, 0x4E52,    "Wasserdruck"            , 1,   1,   "bar", 60,   "WEZ",  "Druck",      "Wasserdruck",       0,     0,     0 },
+  {  4, 0x81, 0x15, 0x00, 0x000F,    "Puffer PF"              , 1,   1,   "°C", 60,    "WEZ",  "Temperatur", "Puffer_PF",         0,     0,     0 },
+  {  5, 0x01, 0x01, 0x00, 0x0BEA,    "Raum-Soll Normal"       , 1,   1,   "°C", 300,   "HK1",  "Temperatur", "Raum_Soll_Normal",  300,   15.0f, 26.0f },
+};
+
+const size_t dataPointCount = sizeof(dataPointDefs) / sizeof(dataPointDefs[0]);
+
+DataPointDefinition *decodeHovalAnswer(const uint8_t *data, uint8_t length, time_t now)
+{
+  HovalMessage message;
+  if (!HovalProtocol::parseMessage(data, length, message) || message.operation != ANSWER)
+  {
+    return nullptr;
+  }
+
+  for (size_t i = 0; i < dataPointCount; i++) {
+    DataPointDefinition &dp = dataPointDefs[i];
+    if (dp.functionGroup == message.functionGroup &&
+        dp.functionNumber == message.functionNumber &&
+        (uint16_t)dp.dataPointId == message.dataPointId) {
+      HovalValue value;
+      if (!HovalProtocol::decodeValue(dp.type, message.value, message.valueLength, value)) {
+        return nullptr;
+      }
+      dp.value       = value.number;
+      dp.lastUpdated = now;
+      if (dp.type == HOVAL_TYPE_STR) {
+        strcpy(dp.text, value.text);
+      }
+      return &dp;
+    }
+  }
+  return nullptr;
+}
+
+DataPointDefinition *decodeHovalFrame(HovalReassembler &reassembler, uint32_t identifier,
+                                      const uint8_t *data, uint8_t length, uint32_t nowMs, time_t now)
+{
+  const uint8_t *message;
+  uint8_t messageLength;
+  if (!reassembler.addFrame(identifier, data, length, nowMs, message, messageLength)) {
+    return nullptr;
+  }
+  return decodeHovalAnswer(message, messageLength, now);
+}
+
+DataPointDefinition *findDataPointByTopicName(const char *topicName)
+{
+  for (size_t i = 0; i < dataPointCount; i++) {
+    if (strcmp(dataPointDefs[i].topicName, topicName) == 0) {
+      return &dataPointDefs[i];
+    }
+  }
+  return nullptr;
+}
+
+float scaledValue(const DataPointDefinition &dp)
+{
+  return dp.value / pow(10, dp.decimals);
+}
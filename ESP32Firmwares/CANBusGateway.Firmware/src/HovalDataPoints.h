@@ -0,0 +1,60 @@
+#ifndef HOVALDATAPOINTS_H
+#define HOVALDATAPOINTS_H
+
+#include <time.h>
+#include "HovalProtocol.h"
+
+// Heat pump data structure based on Hoval datapoints
+struct DataPointDefinition {
+  uint8_t  id;
+  uint8_t  unitId;
+  uint8_t  functionGroup;
+  uint8_t  functionNumber;
+  int16_t  dataPointId;
+  const char* dataPointName;
+  uint8_t  type;
+  uint8_t  decimals;
+  const char* unit;
+  uint16_t publishIntervalInSeconds;
+  // Topic levels for the per-datapoint mode; measurementType must be one the DataHub understands
+  const char* subCategory;
+  const char* measurementType;
+  const char* topicName;
+  // Allowlist for MQTT write commands: 0 = read-only, otherwise the minimum interval between two writes
+  uint16_t writeIntervalSeconds;
+  // Accepted write values in the datapoint's unit
+  float    writeMin;
+  float    writeMax;
+  int64_t  value;          // Raw value; for strings a hash of text, so changes show up here as well
+  time_t   lastUpdated;
+  time_t   lastPublished;
+  char     text[HOVAL_MAX_TEXT_LENGTH + 1];  // Value of HOVAL_TYPE_STR datapoints
+  // Runtime state of the per-datapoint mode
+  char     topic[96];      // Preformatted by buildDataPointTopics()
+  int64_t  publishedValue;
+  bool     published;
+  // Runtime state of the write path
+  int64_t  writeValue;      // Raw value of the pending write
+  uint32_t writeSentMs;     // millis() when the SET_REQUEST was sent
+  uint32_t readbackSentMs;  // millis() of the last read-back REQUEST, 0 = none sent yet
+  uint32_t lastWriteMs;
+  bool     writePending;
+  bool     written;         // lastWriteMs is valid
+};
+
+DataPointDefinition *findDataPointByTopicName(const char *topicName);
+
+extern DataPointDefinition dataPointDefs[];
+extern const size_t dataPointCount;
+
+// Looks up the datapoint an ANSWER message belongs to and stores its value decoded by the datapoint's type.
+// Returns the updated datapoint, or nullptr for other operations, unknown datapoints and short values.
+DataPointDefinition *decodeHovalAnswer(const uint8_t *data, uint8_t length, time_t now);
+
+// Feeds a received frame through the reassembler and decodes complete ANSWER messages
+DataPointDefinition *decodeHovalFrame(HovalReassembler &reassembler, uint32_t identifier,
+                                      const uint8_t *data, uint8_t length, uint32_t nowMs, time_t now);
+
+float scaledValue(const DataPointDefinition &dp);
+
+#endif // HOVALDATAPOINTS_H
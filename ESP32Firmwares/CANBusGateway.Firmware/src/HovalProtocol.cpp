@@ -0,0 +1,222 @@
+#include "HovalProtocol.h"
+
+bool HovalProtocol::parseMessage(const uint8_t *data, uint8_t length, HovalMessage &message)
+{
+    if (length < 6)
+    {
+        return false;
+    }
+
+    message.unitId = data[0];
+    message.operation = data[1];
+    message.functionGroup = data[2];
+    message.functionNumber = data[3];
+    message.dataPointId = (data[4] << 8) | data[5];
+    message.value = data + 6;
+    message.valueLength = length - 6;
+    return true;
+}
+
+bool HovalProtocol::isReservedUnitId(uint8_t unitId)
+{
+    return unitId == HOVAL_SEGMENT_START || (unitId & ~HOVAL_SEGMENT_INDEX_MASK) == HOVAL_SEGMENT_CONTINUATION;
+}
+
+uint8_t HovalProtocol::buildRequest(uint8_t unitId, uint8_t functionGroup, uint8_t functionNumber, uint16_t dataPointId, uint8_t *payload)
+{
+    if (isReservedUnitId(unitId))
+    {
+        return 0;
+    }
+    payload[0] = unitId;
+    payload[1] = REQUEST;
+    payload[2] = functionGroup;
+    payload[3] = functionNumber;
+    payload[4] = (uint8_t)(dataPointId >> 8);
+    payload[5] = (uint8_t)(dataPointId & 0xFF);
+    return 6;
+}
+
+uint8_t HovalProtocol::buildSetRequest(uint8_t unitId, uint8_t functionGroup, uint8_t functionNumber, uint16_t dataPointId,
+                                       uint8_t type, int64_t rawValue, uint8_t *payload)
+{
+    if (buildRequest(unitId, functionGroup, functionNumber, dataPointId, payload) == 0)
+    {
+        return 0;
+    }
+    payload[1] = SET_REQUEST;
+
+    switch (type)
+    {
+    case HOVAL_TYPE_U8:
+        if (rawValue < 0 || rawValue > 255) return 0;
+        payload[6] = (uint8_t)rawValue;
+        return 7;
+    case HOVAL_TYPE_S16:
+        if (rawValue < -32768 || rawValue > 32767) return 0;
+        payload[6] = (uint8_t)((uint16_t)rawValue >> 8);
+        payload[7] = (uint8_t)((uint16_t)rawValue & 0xFF);
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+bool HovalProtocol::decodeValue(uint8_t type, const uint8_t *data, uint8_t length, HovalValue &value)
+{
+    value.text[0] = '\0';
+    switch (type)
+    {
+    case HOVAL_TYPE_U8:
+        if (length < 1) return false;
+        value.number = data[0];
+        return true;
+    case HOVAL_TYPE_S16:
+        if (length < 2) return false;
+        value.number = (int16_t)((data[0] << 8) | data[1]);
+        return true;
+    case HOVAL_TYPE_U32:
+    case HOVAL_TYPE_S32:
+    {
+        if (length < 4) return false;
+        uint32_t raw = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+        value.number = type == HOVAL_TYPE_U32 ? (int64_t)raw : (int64_t)(int32_t)raw;
+        return true;
+    }
+    case HOVAL_TYPE_STR:
+    {
+        // Zero-terminated or filling the rest of the message
+        uint8_t n = 0;
+        while (n < length && n < HOVAL_MAX_TEXT_LENGTH && data[n] != 0)
+        {
+            value.text[n] = (char)data[n];
+            n++;
+        }
+        value.text[n] = '\0';
+        // FNV-1a hash as number, so changes can be detected like for numeric types
+        uint32_t hash = 2166136261u;
+        for (uint8_t i = 0; i < n; i++)
+        {
+            hash = (hash ^ (uint8_t)value.text[i]) * 16777619u;
+        }
+        value.number = hash;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool HovalReassembler::addFrame(uint32_t identifier, const uint8_t *data, uint8_t length, uint32_t nowMs,
+                                const uint8_t *&message, uint8_t &messageLength)
+{
+    expire(nowMs);
+    if (length == 0)
+    {
+        return false;
+    }
+
+    uint16_t sender = HOVAL_SENDER(identifier);
+    uint8_t messageId = HOVAL_MESSAGE_ID(identifier);
+
+    if (data[0] == HOVAL_SEGMENT_START)
+    {
+        uint8_t total = length >= 2 ? data[1] : 0;
+        if (total <= 6 || total > HOVAL_MAX_MESSAGE_LENGTH || length < 8)
+        {
+            invalid++;
+            return false;
+        }
+        Slot *slot = findSlot(sender, messageId);
+        if (!slot)
+        {
+            slot = allocateSlot(nowMs);
+        }
+        uint8_t segments = 1 + (total - 6 + 6) / 7;  // Start frame plus ceil((total - 6) / 7)
+        slot->used = true;
+        slot->sender = sender;
+        slot->messageId = messageId;
+        slot->length = total;
+        slot->startedMs = nowMs;
+        slot->receivedMask = 1;
+        slot->expectedMask = (1u << segments) - 1;
+        for (uint8_t i = 0; i < 6; i++)
+        {
+            slot->data[i] = data[2 + i];
+        }
+        return false;
+    }
+
+    if ((data[0] & ~HOVAL_SEGMENT_INDEX_MASK) == HOVAL_SEGMENT_CONTINUATION)
+    {
+        Slot *slot = findSlot(sender, messageId);
+        uint8_t index = data[0] & HOVAL_SEGMENT_INDEX_MASK;
+        if (!slot || index == 0 || !(slot->expectedMask & (1u << index)))
+        {
+            invalid++;
+            return false;
+        }
+        uint8_t offset = 6 + (index - 1) * 7;
+        for (uint8_t i = 1; i < length && offset < slot->length; i++)
+        {
+            slot->data[offset++] = data[i];
+        }
+        slot->receivedMask |= 1u << index;
+        if (slot->receivedMask != slot->expectedMask)
+        {
+            return false;
+        }
+        slot->used = false;
+        completed++;
+        message = slot->data;
+        messageLength = slot->length;
+        return true;
+    }
+
+    // Single-frame message
+    message = data;
+    messageLength = length;
+    return true;
+}
+
+HovalReassembler::Slot *HovalReassembler::findSlot(uint16_t sender, uint8_t messageId)
+{
+    for (Slot &slot : slots)
+    {
+        if (slot.used && slot.sender == sender && slot.messageId == messageId)
+        {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+HovalReassembler::Slot *HovalReassembler::allocateSlot(uint32_t nowMs)
+{
+    Slot *oldest = &slots[0];
+    for (Slot &slot : slots)
+    {
+        if (!slot.used)
+        {
+            return &slot;
+        }
+        if (nowMs - slot.startedMs > nowMs - oldest->startedMs)
+        {
+            oldest = &slot;
+        }
+    }
+    evicted++;
+    return oldest;
+}
+
+void HovalReassembler::expire(uint32_t nowMs)
+{
+    for (Slot &slot : slots)
+    {
+        if (slot.used && nowMs - slot.startedMs > TimeoutMs)
+        {
+            slot.used = false;
+            timedOut++;
+        }
+    }
+}
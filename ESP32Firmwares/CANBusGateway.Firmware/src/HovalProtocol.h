@@ -0,0 +1,128 @@
+#ifndef HOVALPROTOCOL_H
+#define HOVALPROTOCOL_H
+
+// Hoval TopTronic CAN protocol, kept free of Arduino dependencies so the
+// decoder can also run on the host (see src/replay)
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Hoval protocol constants based on panel settings
+#define HOVAL_NODE_ID 113  // From PROT_PORT "3 113"
+#define REQUEST 0x40
+#define ANSWER 0x42
+#define SET_REQUEST 0x46
+
+// Identifier used for our poll frames
+#define HOVAL_POLL_IDENTIFIER ((0x1FE << 16) | 0x0801)
+
+// Identifier layout: | 28-24 Message ID | 23-16 Priority | 15-8 Device type | 7-0 Device ID |
+#define HOVAL_MESSAGE_ID(identifier) (((identifier) >> 24) & 0x1F)
+#define HOVAL_SENDER(identifier) ((identifier) & 0xFFFF)
+
+// Datapoint types as used in the type column of the datapoint table
+enum HovalDataType : uint8_t
+{
+    HOVAL_TYPE_U8 = 0,
+    HOVAL_TYPE_S16 = 1,
+    HOVAL_TYPE_U32 = 2,
+    HOVAL_TYPE_S32 = 3,
+    HOVAL_TYPE_STR = 4,
+};
+
+// Payload layout of a message:
+// | 0 Unit ID | 1 Operation | 2 Function Group | 3 Function Number | 4-5 Datapoint ID | 6.. Value |
+//
+// Messages longer than one frame are segmented:
+// - start frame:        | 0 HOVAL_SEGMENT_START | 1 Message length | 2-7 Message bytes 0-5 |
+// - continuation frame: | 0 HOVAL_SEGMENT_CONTINUATION + n | 1-7 Message bytes 6+(n-1)*7 .. |
+// All frames of a message carry the same identifier.
+// Frames are told apart by their first byte alone, so a single frame of a
+// unit with id HOVAL_SEGMENT_START or 0xC0-0xDF would be taken for a segment:
+// those unit ids are reserved and never requested (isReservedUnitId()).
+#define HOVAL_SEGMENT_START 0x1F
+#define HOVAL_SEGMENT_CONTINUATION 0xC0
+#define HOVAL_SEGMENT_INDEX_MASK 0x1F
+
+#define HOVAL_MAX_MESSAGE_LENGTH 64
+#define HOVAL_MAX_TEXT_LENGTH 31
+
+struct HovalMessage
+{
+    uint8_t unitId;
+    uint8_t operation;
+    uint8_t functionGroup;
+    uint8_t functionNumber;
+    uint16_t dataPointId;
+    const uint8_t *value;  // Points into the message data, valid as long as that is
+    uint8_t valueLength;
+};
+
+// Decoded datapoint value; text is only used for HOVAL_TYPE_STR
+struct HovalValue
+{
+    int64_t number;
+    char text[HOVAL_MAX_TEXT_LENGTH + 1];
+};
+
+class HovalProtocol
+{
+public:
+    // Splits a message into its fields, returns false if it is too short to be a datapoint message
+    static bool parseMessage(const uint8_t *data, uint8_t length, HovalMessage &message);
+    // True for the unit ids that collide with the segment markers
+    static bool isReservedUnitId(uint8_t unitId);
+    // Fills the 6-byte payload of a REQUEST for the given datapoint. Returns the payload length,
+    // or 0 for a reserved unit id.
+    static uint8_t buildRequest(uint8_t unitId, uint8_t functionGroup, uint8_t functionNumber, uint16_t dataPointId, uint8_t *payload);
+    // Fills the payload of a SET_REQUEST writing a raw value. Returns the payload length, or 0 if the
+    // value does not fit the type, the type does not fit into a single frame (only U8 and S16 do)
+    // or the unit id is reserved.
+    static uint8_t buildSetRequest(uint8_t unitId, uint8_t functionGroup, uint8_t functionNumber, uint16_t dataPointId,
+                                   uint8_t type, int64_t rawValue, uint8_t *payload);
+    // Decodes a big-endian value of the given type, returns false if there are not enough bytes
+    static bool decodeValue(uint8_t type, const uint8_t *data, uint8_t length, HovalValue &value);
+};
+
+// Reassembles segmented messages, keyed by sender and message id.
+// Memory is bounded by a fixed number of slots; incomplete messages are
+// dropped after a timeout or when their slot is needed for a newer message.
+class HovalReassembler
+{
+public:
+    static const size_t SlotCount = 4;
+    static const uint32_t TimeoutMs = 1000;
+
+    // Feeds one frame. Returns true when a message is complete; message then points
+    // to the frame data (single-frame messages) or to the reassembly buffer, valid
+    // until the next call.
+    bool addFrame(uint32_t identifier, const uint8_t *data, uint8_t length, uint32_t nowMs,
+                  const uint8_t *&message, uint8_t &messageLength);
+
+    uint32_t completed = 0;  // Segmented messages reassembled
+    uint32_t timedOut = 0;   // Incomplete messages dropped after TimeoutMs
+    uint32_t evicted = 0;    // Incomplete messages dropped because all slots were in use
+    uint32_t invalid = 0;    // Continuation frames without start, bad lengths or indexes (also
+                             // single frames of a reserved unit id, which look like segments)
+
+private:
+    struct Slot
+    {
+        bool used = false;
+        uint16_t sender = 0;
+        uint8_t messageId = 0;
+        uint8_t length = 0;
+        uint32_t receivedMask = 0;  // Bit n set when segment n arrived (0 = start frame)
+        uint32_t expectedMask = 0;
+        uint32_t startedMs = 0;
+        uint8_t data[HOVAL_MAX_MESSAGE_LENGTH];
+    };
+
+    Slot slots[SlotCount];
+
+    Slot *findSlot(uint16_t sender, uint8_t messageId);
+    Slot *allocateSlot(uint32_t nowMs);
+    void expire(uint32_t nowMs);
+};
+
+#endif // HOVALPROTOCOL_H
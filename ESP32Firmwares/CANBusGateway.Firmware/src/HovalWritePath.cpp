@@ -0,0 +1,112 @@
+#include "HovalWritePath.h"
+#include <math.h>
+#include <stdlib.h>
+
+void HovalWritePath::request(DataPointDefinition &dp, const char *value, uint32_t nowMs)
+{
+    char *end = nullptr;
+    float requested = strtof(value, &end);
+    if (end == value)
+    {
+        report(dp, HovalWriteStatus::Invalid, NAN, -1);
+        return;
+    }
+    if (dp.writeIntervalSeconds == 0)
+    {
+        report(dp, HovalWriteStatus::Rejected, requested, -1);
+        return;
+    }
+    if (!(requested >= dp.writeMin && requested <= dp.writeMax))
+    {
+        report(dp, HovalWriteStatus::OutOfRange, requested, -1);
+        return;
+    }
+    if (dp.writePending || (dp.written && nowMs - dp.lastWriteMs < (uint32_t)dp.writeIntervalSeconds * 1000u))
+    {
+        report(dp, HovalWriteStatus::RateLimited, requested, -1);
+        return;
+    }
+
+    int64_t rawValue = llround(requested * pow(10, dp.decimals));
+    uint8_t payload[8];
+    uint8_t length = HovalProtocol::buildSetRequest(dp.unitId, dp.functionGroup, dp.functionNumber, dp.dataPointId,
+                                                    dp.type, rawValue, payload);
+    if (length == 0)
+    {
+        report(dp, HovalWriteStatus::Invalid, requested, -1);
+        return;
+    }
+    if (!sendFrame(payload, length))
+    {
+        report(dp, HovalWriteStatus::SendFailed, requested, -1);
+        return;
+    }
+
+    dp.writeValue = rawValue;
+    dp.writeSentMs = nowMs;
+    dp.readbackSentMs = 0;
+    dp.lastWriteMs = nowMs;
+    dp.written = true;
+    dp.writePending = true;
+}
+
+void HovalWritePath::process(uint32_t nowMs)
+{
+    for (size_t i = 0; i < dataPointCount; i++)
+    {
+        DataPointDefinition &dp = dataPointDefs[i];
+        if (!dp.writePending)
+        {
+            continue;
+        }
+        if (nowMs - dp.writeSentMs >= ConfirmTimeoutMs)
+        {
+            dp.writePending = false;
+            report(dp, HovalWriteStatus::Timeout, dp.writeValue / pow(10, dp.decimals), -1);
+            continue;
+        }
+        bool readbackDue = dp.readbackSentMs == 0
+            ? nowMs - dp.writeSentMs >= ReadbackDelayMs
+            : nowMs - dp.readbackSentMs >= ReadbackIntervalMs;
+        if (readbackDue && sendRequest(dp))
+        {
+            dp.readbackSentMs = nowMs;
+        }
+    }
+}
+
+void HovalWritePath::answerReceived(DataPointDefinition &dp, uint32_t nowMs)
+{
+    if (!dp.writePending || dp.readbackSentMs == 0)
+    {
+        return;
+    }
+    if (dp.value != dp.writeValue)
+    {
+        return; // Not applied yet, the next read-back will tell
+    }
+    dp.writePending = false;
+    report(dp, HovalWriteStatus::Confirmed, scaledValue(dp), (long)(nowMs - dp.writeSentMs));
+}
+
+const char *HovalWritePath::statusName(HovalWriteStatus status)
+{
+    switch (status)
+    {
+    case HovalWriteStatus::Confirmed: return "confirmed";
+    case HovalWriteStatus::Timeout: return "timeout";
+    case HovalWriteStatus::Invalid: return "invalid";
+    case HovalWriteStatus::Rejected: return "rejected";
+    case HovalWriteStatus::OutOfRange: return "out_of_range";
+    case HovalWriteStatus::RateLimited: return "rate_limited";
+    case HovalWriteStatus::SendFailed: return "send_failed";
+    }
+    return "unknown";
+}
+
+bool HovalWritePath::sendRequest(const DataPointDefinition &dp)
+{
+    uint8_t payload[8];
+    uint8_t length = HovalProtocol::buildRequest(dp.unitId, dp.functionGroup, dp.functionNumber, dp.dataPointId, payload);
+    return length != 0 && sendFrame(payload, length);
+}
@@ -0,0 +1,54 @@
+#ifndef HOVALWRITEPATH_H
+#define HOVALWRITEPATH_H
+
+// Write path of the gateway: a SET_REQUEST for an allowlisted datapoint,
+// confirmed by reading the datapoint back. Free of Arduino dependencies (the
+// time is passed in, frames and results go through callbacks) so a write can
+// be run through to its confirmation on the host (test/test_writepath).
+
+#include <functional>
+#include "HovalDataPoints.h"
+
+enum class HovalWriteStatus : uint8_t
+{
+    Confirmed,    // Read back with the written value
+    Timeout,      // Not confirmed within ConfirmTimeoutMs
+    Invalid,      // Not a number, or not encodable for the datapoint's type
+    Rejected,     // Datapoint is read-only
+    OutOfRange,   // Outside the datapoint's write range
+    RateLimited,  // A write is pending or the last one is too recent
+    SendFailed    // The SET_REQUEST could not be queued
+};
+
+class HovalWritePath
+{
+public:
+    static const uint32_t ReadbackDelayMs = 500;      // Give the controller time to apply the value
+    static const uint32_t ReadbackIntervalMs = 1000;  // Repeat the read-back until confirmed ...
+    static const uint32_t ConfirmTimeoutMs = 10000;   // ... or give up
+
+    // Sends a frame with HOVAL_POLL_IDENTIFIER, false if it could not be queued
+    typedef std::function<bool(const uint8_t *payload, uint8_t length)> SendFrame;
+    // Outcome of a write command; latencyMs is -1 unless confirmed
+    typedef std::function<void(const DataPointDefinition &dp, HovalWriteStatus status, float requestedValue, long latencyMs)> Report;
+
+    HovalWritePath(SendFrame sendFrame, Report report) : sendFrame(sendFrame), report(report) {}
+
+    // Write command with the new value as text, in the datapoint's unit
+    void request(DataPointDefinition &dp, const char *value, uint32_t nowMs);
+    // Sends the read-back requests of pending writes and expires unconfirmed ones; call from loop()
+    void process(uint32_t nowMs);
+    // Call for every decoded answer; answers after a read-back request confirm a pending write
+    void answerReceived(DataPointDefinition &dp, uint32_t nowMs);
+
+    // Status as published in the result JSON
+    static const char *statusName(HovalWriteStatus status);
+
+private:
+    SendFrame sendFrame;
+    Report report;
+
+    bool sendRequest(const DataPointDefinition &dp);
+};
+
+#endif // HOVALWRITEPATH_H
@@ -5,25 +5,29 @@
 #include <ESP32Ping.h>
 #include <ESP32-TWAI-CAN.hpp>
 #include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <base64.h>
 
 #include "AzureOTAUpdater.h"
 #include "MQTTClientLib.h"
 #include "WifiLib.h"
+#include "WiFiFastConnect.h"
+#include "DeviceTelemetry.h"
 #include "ESP32Helpers.h"
 #include "soc/soc.h"
 #include "soc/rtc_cntl_reg.h"
+#include "HovalProtocol.h"
+#include "HovalDataPoints.h"
+#include "CanCapture.h"
+#include "CanFilter.h"
+#include "HovalWritePath.h"
 
 // Pin configuration - define your CAN bus pins here
 #define CAN_RX_PIN 35
 #define CAN_TX_PIN 5
 
-// Hoval protocol constants based on panel settings
-#define HOVAL_NODE_ID 113  // From PROT_PORT "3 113"
-#define REQUEST 0x40
-#define ANSWER 0x42
-#define SET_REQUEST 0x46
-
 CanFrame rxFrame;
+HovalReassembler reassembler;
 
 const char *version = CANBUSGATEWAY_VERSION;
 String chipID = "";
@@ -31,6 +35,8 @@ String chipID = "";
 // WiFi credentials are read from environment variables and used during compile-time (see platformio.ini)
 // Set WIFI_PASSWORDS as environment variables on your dev-system following the pattern: WIFI_PASSWORDS="ssid1;password1|ssid2;password2"
 WifiLib wifiLib(WIFI_PASSWORDS);
+WiFiFastConnect wifiFast(WIFI_PASSWORDS);
+DeviceTelemetry telemetry;
 
 WiFiClient wifiClient;
 WiFiUDP ntpUDP;
@@ -43,41 +49,182 @@ static bool sendMQTTMessages = true;
 static bool mqttSuccess = false;
 
 static String baseTopic = "data";
+static String dataPointBaseTopic = "cangateway";
 static String sensorName = "HovalWP_M3";
+static String location = "M3";
 const String mqtt_broker = "smarthomepi2";
+const int mqtt_port = 32004;
 static String mqtt_OTAtopic = "OTAUpdate/CANBusGateway";
 static String mqtt_ConfigTopic = "config/CANBusGateway/{ID}/DeviceName";
+static String mqtt_LocationTopic = "config/CANBusGateway/{ID}/Location";
+static String mqtt_PublishModeTopic = "config/CANBusGateway/{ID}/PublishMode";
+static String mqtt_CaptureTopic = "config/CANBusGateway/{ID}/Capture";
+static String mqtt_CaptureDataTopic = "cangateway/capture/{ID}";
+static String mqtt_CommandsTopic = "commands/CANBusGateway/#";
+static const char *commandsTopicPrefix = "commands/CANBusGateway/";
 
 unsigned long lastDataPublishTime = 0;
 const unsigned long DATA_PUBLISH_INTERVAL = 60000; // Publish data every minute
 
-// Debug mode - set to true to log all CAN messages
-bool debugMode = true;
-
-// Heat pump data structure based on Hoval datapoints
-struct DataPointDefinition {
-  uint8_t  id;
-  uint8_t  unitId;
-  uint8_t  functionGroup;
-  uint8_t  functionNumber;
-  int16_t  dataPointId;
-  String   dataPointName;
-  uint8_t  type;
-  uint8_t  decimals;
-  String   unit;
-  uint16_t publishIntervalInSeconds;
-  uint32_t value;
-  time_t   lastUpdated;
-  time_t   lastPublished;
-};
-
-DataPointDefinition dataPointDefs[] = {
-  //Id, Unit, FG,   FN,   DP-ID,     "Name",                   Type, Dec, "Unit", Refresh }
-  {  1, 0x01, 0x00, 0x00, 0x0000,    "Aussenfühler Temperatur", 1,   1,   "°C", 60   },
-  {  2, 0x01, 0x01, 0x00, 0x0002,    "Vorlauf-Ist Temperatur" , 1,   1,   "°C", 60   },
-  {  3, 0x01, 0x0A, 0x01, 0x4E52,    "Wasserdruck"            , 1,   1,   "bar", 60   },
-  {  4, 0x81, 0x15, 0x00, 0x000F,    "Puffer PF"              , 1,   1,   "°C", 60   },
-};
+// Publishing modes
+// - PerDataPoint: one retained topic per datapoint
+//   (cangateway/{location}/{subCategory}/{measurementType}/{topicName}, plain value as payload),
+//   published only when the value changed or the heartbeat expired
+// - Document: all due datapoints in one JSON document on data/hoval/{sensorName}/data
+enum class PublishMode { PerDataPoint, Document };
+static PublishMode publishMode = PublishMode::PerDataPoint;
+const time_t DATAPOINT_HEARTBEAT_SECONDS = 600; // Republish unchanged values every 10 minutes
+static String documentTopic;
+
+// Debug mode - set to true for additional log output outside the receive path.
+// To analyse the raw bus traffic, record a capture instead (see README).
+bool debugMode = false;
+
+// CAN capture: frames are recorded into a ring buffer on reception and
+// drained in chunks to MQTT or a file on flash, away from the receive path
+enum class CaptureSink { Off, Mqtt, Flash };
+static CaptureSink captureSink = CaptureSink::Off;
+static CanCaptureBuffer captureBuffer;
+static const char *CAPTURE_FILE = "/capture.bin";
+const size_t CAPTURE_FILE_MAX_SIZE = 512 * 1024;
+const size_t CAPTURE_CHUNK_RECORDS = 32;      // 640 bytes per MQTT message / flash write
+const unsigned long CAPTURE_FLUSH_INTERVAL = 5000;
+static unsigned long lastCaptureFlush = 0;
+static File captureFile;
+static size_t captureDumpOffset = 0;          // Read position while the flash capture is being published
+static bool captureDumpActive = false;
+
+// Write path: a SET_REQUEST is confirmed by reading the datapoint back
+bool sendHovalFrame(const uint8_t *payload, uint8_t length);
+void publishWriteResult(const DataPointDefinition &dp, HovalWriteStatus status, float requestedValue, long latencyMs);
+HovalWritePath writePath(sendHovalFrame, publishWriteResult);
+
+// CAN acceptance filter, learned from the senders answering for the configured datapoints
+enum class CanFilterState { Learning, Audit, Active, Software };
+static CanFilterState canFilterState = CanFilterState::Learning;
+static CanSenderFilter senderFilter;
+static bool senderFilterChanged = false;
+static unsigned long canFilterStateSince = 0;
+const unsigned long CAN_FILTER_LEARN_TIMEOUT = 600000;    // Install what is known after 10 min even if datapoints never answered
+const unsigned long CAN_FILTER_AUDIT_INTERVAL = 3600000;  // Reopen the filter once an hour ...
+const unsigned long CAN_FILTER_AUDIT_DURATION = 10000;    // ... for 10 s to see what it rejects
+const unsigned long CAN_FILTER_STATS_INTERVAL = 600000;
+static uint32_t canFramesReceived = 0;
+static uint32_t canSoftwareRejected = 0;
+static uint32_t canAuditRejected = 0;  // Frames during audits the hardware filter would have rejected
+static unsigned long canAuditMs = 0;
+static unsigned long canFilteredMs = 0; // Time with the hardware filter installed
+static unsigned long lastCanFilterStats = 0;
+
+// Topics only change with the configuration, so they are built once here
+// instead of being concatenated on every publish cycle
+void buildDataPointTopics()
+{
+  for (size_t i = 0; i < dataPointCount; i++) {
+    DataPointDefinition &dp = dataPointDefs[i];
+    snprintf(dp.topic, sizeof(dp.topic), "%s/%s/%s/%s/%s",
+             dataPointBaseTopic.c_str(), location.c_str(), dp.subCategory, dp.measurementType, dp.topicName);
+    dp.published = false; // New topic, publish the current value right away
+  }
+  documentTopic = baseTopic + "/hoval/" + sensorName + "/data";
+}
+
+void startCapture(CaptureSink sink)
+{
+  if (captureFile)
+  {
+    captureFile.close();
+  }
+  captureBuffer.clear();
+  captureDumpActive = false;
+
+  if (sink == CaptureSink::Flash)
+  {
+    if (!LittleFS.begin(true))
+    {
+      Serial.println("Failed to mount LittleFS, capture not started");
+      captureSink = CaptureSink::Off;
+      return;
+    }
+    captureFile = LittleFS.open(CAPTURE_FILE, FILE_WRITE);
+    if (!captureFile)
+    {
+      Serial.println("Failed to create capture file, capture not started");
+      captureSink = CaptureSink::Off;
+      return;
+    }
+    CanCaptureHeader header;
+    CanCaptureBuffer::fillHeader(header);
+    captureFile.write((const uint8_t *)&header, sizeof(header));
+  }
+  captureSink = sink;
+}
+
+void startCaptureDump()
+{
+  if (captureSink == CaptureSink::Flash)
+  {
+    startCapture(CaptureSink::Off);
+  }
+  if (!LittleFS.begin(true) || !LittleFS.exists(CAPTURE_FILE))
+  {
+    Serial.println("No capture file on flash");
+    return;
+  }
+  captureDumpOffset = sizeof(CanCaptureHeader);
+  captureDumpActive = true;
+}
+
+void flushCapture()
+{
+  static CanCaptureRecord chunk[CAPTURE_CHUNK_RECORDS];
+
+  if (captureDumpActive)
+  {
+    // Publish the flash capture one chunk per loop, so CAN reception continues meanwhile
+    File file = LittleFS.open(CAPTURE_FILE, FILE_READ);
+    file.seek(captureDumpOffset);
+    size_t bytes = file.read((uint8_t *)chunk, sizeof(chunk));
+    file.close();
+    bytes -= bytes % sizeof(CanCaptureRecord);
+    if (bytes == 0)
+    {
+      Serial.println("Capture dump finished");
+      captureDumpActive = false;
+      return;
+    }
+    mqttClientLib->publish(mqtt_CaptureDataTopic, base64::encode((const uint8_t *)chunk, bytes), false, 1);
+    captureDumpOffset += bytes;
+    return;
+  }
+
+  if (captureSink == CaptureSink::Off || captureBuffer.size() == 0)
+  {
+    return;
+  }
+  if (captureBuffer.size() < CAPTURE_CHUNK_RECORDS && millis() - lastCaptureFlush < CAPTURE_FLUSH_INTERVAL)
+  {
+    return;
+  }
+  lastCaptureFlush = millis();
+
+  size_t count = captureBuffer.drain(chunk, CAPTURE_CHUNK_RECORDS);
+  size_t bytes = count * sizeof(CanCaptureRecord);
+  if (captureSink == CaptureSink::Mqtt)
+  {
+    mqttClientLib->publish(mqtt_CaptureDataTopic, base64::encode((const uint8_t *)chunk, bytes), false, 1);
+  }
+  else if (captureFile.size() + bytes <= CAPTURE_FILE_MAX_SIZE)
+  {
+    captureFile.write((const uint8_t *)chunk, bytes);
+    captureFile.flush();
+  }
+  else
+  {
+    Serial.println("Capture file full, stopping capture");
+    startCapture(CaptureSink::Off);
+  }
+}
 
 String extractVersionFromUrl(String url)
 {
@@ -92,62 +239,127 @@ String extractVersionFromUrl(String url)
   return ""; // Return empty string if the pattern is not found
 }
 
-void mqttCallback(String &topic, String &payload)
+void handleWriteCommand(const String &topic, const String &payload);
+
+void onDeviceName(const char *topic, const MQTTPayload &payload)
 {
-  Serial.println("Message arrived on topic: " + topic + ". Message: " + payload);
+  sensorName = String(payload.data, payload.length);
+  Serial.println("Device name set to: " + sensorName);
+  buildDataPointTopics();
+}
 
-  if (topic == mqtt_ConfigTopic)
+void onLocation(const char *topic, const MQTTPayload &payload)
+{
+  location = String(payload.data, payload.length);
+  Serial.println("Location set to: " + location);
+  buildDataPointTopics();
+}
+
+void onPublishMode(const char *topic, const MQTTPayload &payload)
+{
+  String mode(payload.data, payload.length);
+  if (mode == "document")
   {
-    sensorName = payload;
-    Serial.println("Device name set to: " + sensorName);
+    publishMode = PublishMode::Document;
+  }
+  else if (mode == "datapoint")
+  {
+    publishMode = PublishMode::PerDataPoint;
+  }
+  else
+  {
+    Serial.println("Invalid publish mode '" + mode + "'. Use datapoint|document.");
     return;
   }
+  Serial.println("Publish mode set to: " + mode);
+}
 
-  if (topic == mqtt_OTAtopic)
+void onCapture(const char *topic, const MQTTPayload &payload)
+{
+  String command(payload.data, payload.length);
+  if (command == "off")
   {
-    if (otaInProgress || !otaEnable)
-    {
-      if (otaInProgress)
-        Serial.println("OTA in progress, ignoring message");
-      if (!otaEnable)
-        Serial.println("OTA disabled, ignoring message");
-      return;
-    }
+    startCapture(CaptureSink::Off);
+  }
+  else if (command == "mqtt")
+  {
+    startCapture(CaptureSink::Mqtt);
+  }
+  else if (command == "flash")
+  {
+    startCapture(CaptureSink::Flash);
+  }
+  else if (command == "dump")
+  {
+    startCaptureDump();
+  }
+  else
+  {
+    Serial.println("Invalid capture command '" + command + "'. Use off|mqtt|flash|dump.");
+    return;
+  }
+  Serial.println("Capture command: " + command);
+}
 
-    String updateVersion = extractVersionFromUrl(payload);
-    Serial.println("Current firmware version is " + String(version));
-    Serial.println("New firmware version is " + updateVersion);
-    if (strcmp(version, updateVersion.c_str()))
-    {
-      // Trigger OTA Update
-      const char *firmwareUrl = payload.c_str();
-      Serial.println("New firmware available, starting OTA Update from " + String(firmwareUrl));
-      otaInProgress = true;
-      bool result = AzureOTAUpdater::UpdateFirmwareFromUrl(firmwareUrl);
-      if (result)
-      {
-        Serial.println("OTA Update successfully initiated, waiting to be finished");
-      }
-    }
-    else
+void onWriteCommand(const char *topic, const MQTTPayload &payload)
+{
+  handleWriteCommand(topic, String(payload.data, payload.length));
+}
+
+void onOTAUpdate(const char *topic, const MQTTPayload &payload)
+{
+  if (otaInProgress || !otaEnable)
+  {
+    if (otaInProgress)
+      Serial.println("OTA in progress, ignoring message");
+    if (!otaEnable)
+      Serial.println("OTA disabled, ignoring message");
+    return;
+  }
+
+  String firmwareUrl(payload.data, payload.length);
+  String updateVersion = extractVersionFromUrl(firmwareUrl);
+  Serial.println("Current firmware version is " + String(version));
+  Serial.println("New firmware version is " + updateVersion);
+  if (strcmp(version, updateVersion.c_str()))
+  {
+    // Trigger OTA Update
+    Serial.println("New firmware available, starting OTA Update from " + firmwareUrl);
+    otaInProgress = true;
+    bool result = AzureOTAUpdater::UpdateFirmwareFromUrl(firmwareUrl.c_str());
+    if (result)
     {
-      Serial.println("Firmware is up to date");
+      Serial.println("OTA Update successfully initiated, waiting to be finished");
     }
   }
   else
   {
-    Serial.println("Unknown topic, ignoring message");
+    Serial.println("Firmware is up to date");
   }
 }
 
 void connectToMQTT()
 {
-  if (WiFi.status() != WL_CONNECTED)
+  // Each handler subscribes its topic; the client replays them after every reconnect by itself
+  mqttClientLib->on(mqtt_ConfigTopic, onDeviceName);
+  mqttClientLib->on(mqtt_LocationTopic, onLocation);
+  mqttClientLib->on(mqtt_PublishModeTopic, onPublishMode);
+  mqttClientLib->on(mqtt_CaptureTopic, onCapture);
+  mqttClientLib->on(mqtt_CommandsTopic, onWriteCommand);
+  mqttClientLib->on(mqtt_OTAtopic, onOTAUpdate);
+  Serial.println(mqttClientLib->connect(false) ? "MQTT Client is connected" : "MQTT Client not connected yet");
+}
+
+bool startCanBus(bool useSenderFilter)
+{
+  twai_filter_config_t filterConfig = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+  if (useSenderFilter)
   {
-    wifiLib.connect();
+    filterConfig.acceptance_code = senderFilter.acceptanceCode();
+    filterConfig.acceptance_mask = senderFilter.acceptanceMask();
+    filterConfig.single_filter = true;
   }
-  mqttClientLib->connect({mqtt_ConfigTopic, mqtt_OTAtopic});
-  Serial.println("MQTT Client is connected");
+  return ESP32Can.begin(TWAI_SPEED_50KBPS, -1, -1, 0xFFFF, 0xFFFF, &filterConfig);
 }
 
 void setupCanBus()
@@ -159,8 +371,8 @@ void setupCanBus()
   ESP32Can.setPins(CAN_TX_PIN, CAN_RX_PIN);
   ESP32Can.setRxQueueSize(100);
   
-  // begin with custom timing instead of a TwaiSpeed enum
-  if (ESP32Can.begin(TWAI_SPEED_50KBPS))
+  // Accept everything until the senders of the datapoints are known
+  if (startCanBus(false))
   {
     Serial.println("CAN Bus initialized at 50 kbps");
   }
@@ -174,126 +386,169 @@ void setupCanBus()
   // Common speeds for HVAC systems: 125kbps, 250kbps, 500kbps
 }
 
+bool sendHovalFrame(const uint8_t *payload, uint8_t length)
+{
+  CanFrame frame;
+  frame.identifier = HOVAL_POLL_IDENTIFIER;
+  frame.extd = true;
+  frame.rtr = false;
+  frame.data_length_code = length;
+  memcpy(frame.data, payload, length);
+  return ESP32Can.writeFrame(frame);
+}
+
+bool sendRequestFrame(const DataPointDefinition &dp)
+{
+  uint8_t payload[8];
+  uint8_t length = HovalProtocol::buildRequest(dp.unitId, dp.functionGroup, dp.functionNumber, dp.dataPointId, payload);
+  if (length == 0) {
+    return false; // Reserved unit id, its answers could not be told from segments
+  }
+  return sendHovalFrame(payload, length);
+}
+
 void sendHovalPollFrame()
 {
   Serial.println("Sending Hoval poll frame...");
 
-  for (DataPointDefinition &dp : dataPointDefs) {
+  for (size_t i = 0; i < dataPointCount; i++) {
+    DataPointDefinition &dp = dataPointDefs[i];
     time_t now = time(nullptr);
     if (now - dp.lastUpdated > dp.publishIntervalInSeconds) {
       Serial.print("Polling for datapoint: ");
       Serial.println(dp.dataPointName);
 
-      uint8_t payload[6];
-      payload[0] = dp.unitId; 
-      payload[1] = REQUEST;
-      payload[2] = dp.functionGroup;
-      payload[3] = dp.functionNumber;
-      payload[4] = (uint8_t)(dp.dataPointId >> 8);
-      payload[5] = (uint8_t)(dp.dataPointId & 0xFF);
-
-      CanFrame pollFrame;
-      pollFrame.identifier = (0x1FE << 16) | 0x0801;
-      pollFrame.extd = true;
-      pollFrame.rtr = false;
-      pollFrame.data_length_code = 6;
-      memcpy(pollFrame.data, payload, 6);
-
-      if (ESP32Can.writeFrame(pollFrame)) {
-        Serial.println("Poll-Frame sent for " + dp.dataPointName);
+      if (sendRequestFrame(dp)) {
+        Serial.println("Poll-Frame sent for " + String(dp.dataPointName));
       } else {
-        Serial.println("Error sending Poll-Frame for " + dp.dataPointName);
+        Serial.println("Error sending Poll-Frame for " + String(dp.dataPointName));
       }
     }
   }
 }
 
-// Function to decode a Hoval value from CAN data
-float decodeHovalValue(const uint8_t *data, int startByte, float factor = 1.0)
+// Result of a write command on meta/CANBusGateway/{location}/commands/{topicName}
+void publishWriteResult(const DataPointDefinition &dp, HovalWriteStatus status, float requestedValue, long latencyMs)
 {
-  // Hoval values are typically stored as 16-bit integers (MSB first)
-  int16_t rawValue = (data[startByte] << 8) | data[startByte + 1];
-  return (float)rawValue * factor;
+  const char *statusName = HovalWritePath::statusName(status);
+  JsonDocument doc;
+  doc["status"] = statusName;
+  doc["requested"] = requestedValue;
+  if (dp.lastUpdated != 0) {
+    doc["value"] = scaledValue(dp);
+  }
+  if (latencyMs >= 0) {
+    doc["latencyMs"] = latencyMs;
+  }
+  String jsonOutput;
+  serializeJson(doc, jsonOutput);
+  String topic = "meta/CANBusGateway/" + location + "/commands/" + dp.topicName;
+  mqttClientLib->publish(topic, jsonOutput, false, 1);
+  Serial.println("Write " + String(dp.topicName) + ": " + statusName + (latencyMs >= 0 ? " after " + String(latencyMs) + " ms" : ""));
+}
+
+// commands/CANBusGateway/{location}/{topicName} with the new value in the datapoint's unit
+void handleWriteCommand(const String &topic, const String &payload)
+{
+  String path = topic.substring(strlen(commandsTopicPrefix));
+  int separator = path.indexOf('/');
+  if (separator < 0 || path.substring(0, separator) != location) {
+    return; // Meant for a gateway at another location
+  }
+  String topicName = path.substring(separator + 1);
+
+  DataPointDefinition *dp = findDataPointByTopicName(topicName.c_str());
+  if (!dp) {
+    Serial.println("Write command for unknown datapoint '" + topicName + "'");
+    return;
+  }
+
+  writePath.request(*dp, payload.c_str(), millis());
 }
 
 // Function to decode Hoval heat pump data from CAN frames
 void decodeHovalData(const CanFrame &frame)
 {
-  if (frame.data[1] == ANSWER)
-  {
-    
-    // First 2 bytes, messages prio & offsets
-    // Last 2 bytes device type and device ID??
-    uint8_t deviceId = frame.data[0];
-    // Extract the function group and number
-    uint8_t functionGroup = frame.data[2];
-    uint8_t functionNumber = frame.data[3];
-    uint16_t dataPointId = (frame.data[4] << 8) | frame.data[5];
-    int16_t rawValue = (frame.data[6] << 8) | frame.data[7];
-   
-    if (debugMode)
+  canFramesReceived++;
+  if (captureSink != CaptureSink::Off)
+  {
+    captureBuffer.record(millis(), frame.identifier, frame.extd, frame.rtr, frame.data_length_code, frame.data);
+  }
+
+  // While learning or auditing the controller accepts everything, otherwise
+  // drop what the hardware filter could not tell apart from our senders
+  bool unfiltered = canFilterState == CanFilterState::Learning || canFilterState == CanFilterState::Audit;
+  if (canFilterState == CanFilterState::Audit && !senderFilter.hardwareAccepts(frame.identifier))
+  {
+    canAuditRejected++;
+  }
+  if (!unfiltered && !senderFilter.accepts(frame.identifier))
+  {
+    canSoftwareRejected++;
+    return;
+  }
+
+  DataPointDefinition *dp = decodeHovalFrame(reassembler, frame.identifier, frame.data, frame.data_length_code, millis(), time(nullptr));
+  if (dp) {
+    if (unfiltered && senderFilter.addSender(HOVAL_SENDER(frame.identifier)))
     {
-      // Log raw CAN frame for debugging
-      Serial.print("CAN frame: 0x");
-      Serial.print(rxFrame.identifier, HEX);
-      Serial.print(" Ext: ");
-      Serial.print(rxFrame.extd, HEX);
-      Serial.print(" Flags: ");
-      Serial.print(rxFrame.flags, HEX);
-      Serial.print(" Data: ");
-
-      for (int i = 0; i < rxFrame.data_length_code; i++)
-      {
-        if (rxFrame.data[i] < 16)
-          Serial.print("0");
-        Serial.print(rxFrame.data[i], HEX);
-        Serial.print(" ");
-      }
-      Serial.println();
-
-      Serial.print("DeviceId: ");
-      Serial.println(deviceId, HEX);
-      Serial.print("Function Group: ");
-      Serial.print(functionGroup, HEX);
-      Serial.print(", Function Number: ");
-      Serial.print(functionNumber, HEX);
-      Serial.print(", Data Point ID: ");
-      Serial.print(dataPointId, HEX);
-      Serial.print(", Raw Value: ");
-      Serial.println(rawValue);
+      senderFilterChanged = true;
+      Serial.printf("CAN filter: %s answered by sender 0x%04X\n", dp->dataPointName, HOVAL_SENDER(frame.identifier));
     }
-
-    auto it = std::find_if(std::begin(dataPointDefs),
-                           std::end(dataPointDefs),
-                           [&](DataPointDefinition &dp) {
-                             return 
-                                    dp.functionGroup == functionGroup &&
-                                    dp.functionNumber == functionNumber &&
-                                    dp.dataPointId   == dataPointId;
-                           });
-    if (it != std::end(dataPointDefs)) {
-      it->value       = rawValue;
-      it->lastUpdated = time(nullptr);
-
-      Serial.print(it->dataPointName);
-      Serial.print(": ");
-      Serial.print(it->value / pow(10, it->decimals));
+    writePath.answerReceived(*dp, millis());
+    Serial.print(dp->dataPointName);
+    Serial.print(": ");
+    if (dp->type == HOVAL_TYPE_STR) {
+      Serial.println(dp->text);
+    } else {
+      Serial.print(scaledValue(*dp));
       Serial.print(" ");
-      Serial.println(it->unit);
-    } else if (debugMode) {
-      Serial.println("Received data for unknown data point, skipping print.");
+      Serial.println(dp->unit);
     }
   }
 }
 
-void publishHovalData()
+void publishHovalDataPoints()
+{
+  time_t now = time(nullptr);
+  for (size_t i = 0; i < dataPointCount; i++) {
+    DataPointDefinition &dp = dataPointDefs[i];
+    if (dp.lastUpdated == 0) {
+      continue; // No answer received yet, nothing to publish
+    }
+    bool changed = !dp.published || dp.value != dp.publishedValue;
+    bool heartbeatDue = now - dp.lastPublished >= DATAPOINT_HEARTBEAT_SECONDS;
+    if (!changed && !heartbeatDue) {
+      continue;
+    }
+
+    char payload[HOVAL_MAX_TEXT_LENGTH + 1];
+    if (dp.type == HOVAL_TYPE_STR) {
+      strcpy(payload, dp.text);
+    } else {
+      dtostrf(scaledValue(dp), 1, dp.decimals, payload);
+    }
+    if (mqttClientLib->publish(dp.topic, payload, true, 0)) {
+      dp.publishedValue = dp.value;
+      dp.lastPublished = now;
+      dp.published = true;
+    }
+  }
+}
+
+void publishHovalDocument()
 {
   JsonDocument jsonDoc;
 
   time_t now = time(nullptr);
-  for (DataPointDefinition &dp : dataPointDefs) {
+  for (size_t i = 0; i < dataPointCount; i++) {
+    DataPointDefinition &dp = dataPointDefs[i];
     if (now - dp.lastPublished >= dp.publishIntervalInSeconds) {
-      jsonDoc[dp.dataPointName] = dp.value / pow(10, dp.decimals);
+      if (dp.type == HOVAL_TYPE_STR) {
+        jsonDoc[dp.dataPointName] = dp.text;
+      } else {
+        jsonDoc[dp.dataPointName] = scaledValue(dp);
+      }
       dp.lastPublished = now;
     }
   }
@@ -309,8 +564,7 @@ void publishHovalData()
   String jsonString;
   serializeJson(jsonDoc, jsonString);
 
-  String topic = baseTopic + "/hoval/" + sensorName + "/data";
-  mqttClientLib->publish(topic.c_str(), jsonString, true, 0); 
+  mqttClientLib->publish(documentTopic.c_str(), jsonString.c_str(), jsonString.length(), true, 0);
 
   if (debugMode)
   {
@@ -318,22 +572,165 @@ void publishHovalData()
   }
 }
 
+void publishHovalData()
+{
+  if (publishMode == PublishMode::PerDataPoint)
+  {
+    publishHovalDataPoints();
+  }
+  else
+  {
+    publishHovalDocument();
+  }
+}
+
 void processCanMessages()
 {
-  // Check if CAN messages are available
-  if (ESP32Can.readFrame(rxFrame, 1000))
+  // Drain everything the driver has queued since the last loop
+  while (ESP32Can.readFrame(rxFrame, 0))
   {
     // Decode the Hoval heat pump data
     decodeHovalData(rxFrame);
   }
+}
 
-  else
+// The TWAI controller has no counter for frames its acceptance filter drops
+// (twai_status_info_t only counts missed, overrun and error frames), so the
+// hardware rejects can't be counted. They are extrapolated from the frames
+// counted during the audits, which are published next to the estimate.
+unsigned long estimatedHardwareRejects()
+{
+  unsigned long filteredMs = canFilteredMs;
+  if (canFilterState == CanFilterState::Active)
   {
-    if (debugMode)
+    filteredMs += millis() - canFilterStateSince;
+  }
+  return canAuditMs == 0 ? 0 : (unsigned long)((uint64_t)canAuditRejected * filteredMs / canAuditMs);
+}
+
+void publishCanFilterStats()
+{
+  static const char *stateNames[] = {"learning", "audit", "hardware", "software"};
+
+  JsonDocument doc;
+  doc["state"] = stateNames[(int)canFilterState];
+  JsonArray senders = doc["senders"].to<JsonArray>();
+  for (size_t i = 0; i < senderFilter.senderCount(); i++)
+  {
+    char sender[7];
+    snprintf(sender, sizeof(sender), "0x%04X", senderFilter.senders()[i]);
+    senders.add(sender);
+  }
+  char hex[11];
+  snprintf(hex, sizeof(hex), "0x%08lX", (unsigned long)senderFilter.code);
+  doc["code"] = hex;
+  snprintf(hex, sizeof(hex), "0x%08lX", (unsigned long)senderFilter.mask);
+  doc["mask"] = hex;
+  doc["exact"] = senderFilter.exact;
+  doc["received"] = canFramesReceived;
+  doc["softwareRejected"] = canSoftwareRejected;
+  doc["auditRejected"] = canAuditRejected;
+  doc["auditMs"] = canAuditMs;
+  doc["hardwareRejectedEstimate"] = estimatedHardwareRejects();
+
+  String jsonOutput;
+  serializeJson(doc, jsonOutput);
+  mqttClientLib->publish("meta/CANBusGateway/" + location + "/canfilter", jsonOutput, true, 0);
+  lastCanFilterStats = millis();
+}
+
+// Reinstalls the TWAI driver with or without the sender filter
+void switchCanFilter(CanFilterState state)
+{
+  processCanMessages(); // The driver queue is lost on reinstall
+  unsigned long now = millis();
+  if (canFilterState == CanFilterState::Active)
+  {
+    canFilteredMs += now - canFilterStateSince;
+  }
+  else if (canFilterState == CanFilterState::Audit)
+  {
+    canAuditMs += now - canFilterStateSince;
+  }
+
+  bool useSenderFilter = state == CanFilterState::Active;
+  bool wasInstalled = canFilterState == CanFilterState::Active;
+  if (useSenderFilter || wasInstalled)
+  {
+    ESP32Can.end();
+    if (!startCanBus(useSenderFilter))
     {
-      Serial.println("No CAN messages received");
+      Serial.println("CAN filter: failed to restart CAN Bus");
     }
   }
+  canFilterState = state;
+  canFilterStateSince = now;
+  publishCanFilterStats();
+}
+
+bool allDataPointsAnswered()
+{
+  for (size_t i = 0; i < dataPointCount; i++)
+  {
+    if (dataPointDefs[i].lastUpdated == 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Learning -> audit -> hardware filter, with an audit window every hour to
+// estimate the hardware rejects and pick up new senders
+void updateCanFilter()
+{
+  unsigned long elapsed = millis() - canFilterStateSince;
+  switch (canFilterState)
+  {
+  case CanFilterState::Learning:
+    if (allDataPointsAnswered() || elapsed > CAN_FILTER_LEARN_TIMEOUT)
+    {
+      // Audit right away, so there is a reject estimate from the start
+      senderFilter.compute();
+      senderFilterChanged = false;
+      switchCanFilter(CanFilterState::Audit);
+    }
+    break;
+  case CanFilterState::Audit:
+    if (elapsed > CAN_FILTER_AUDIT_DURATION)
+    {
+      if (senderFilterChanged)
+      {
+        senderFilter.compute();
+        senderFilterChanged = false;
+      }
+      if (senderFilter.acceptAll)
+      {
+        Serial.println("CAN filter: senders can't be expressed as mask, filtering in software");
+        switchCanFilter(CanFilterState::Software);
+      }
+      else
+      {
+        Serial.printf("CAN filter: code 0x%08lX mask 0x%08lX%s\n", (unsigned long)senderFilter.code,
+                      (unsigned long)senderFilter.mask, senderFilter.exact ? "" : ", software check for the rest");
+        switchCanFilter(CanFilterState::Active);
+      }
+    }
+    break;
+  case CanFilterState::Active:
+    if (elapsed > CAN_FILTER_AUDIT_INTERVAL)
+    {
+      switchCanFilter(CanFilterState::Audit);
+    }
+    break;
+  case CanFilterState::Software:
+    break;
+  }
+
+  if (millis() - lastCanFilterStats > CAN_FILTER_STATS_INTERVAL)
+  {
+    publishCanFilterStats();
+  }
 }
 
 void setup()
@@ -348,18 +745,24 @@ void setup()
   Serial.println(chipID);
 
   mqtt_ConfigTopic.replace("{ID}", chipID);
+  mqtt_LocationTopic.replace("{ID}", chipID);
+  mqtt_PublishModeTopic.replace("{ID}", chipID);
+  mqtt_CaptureTopic.replace("{ID}", chipID);
+  mqtt_CaptureDataTopic.replace("{ID}", chipID);
+  buildDataPointTopics();
 
   // Connect to WiFi
   Serial.println("Connecting to WiFi...");
-  wifiLib.scanAndSelectNetwork();
-  wifiLib.connect();
-  String ssid = wifiLib.getSSID();
+  // Access point and address of the last boot first, scan only if that fails
+  wifiFast.connectOrScan(wifiLib);
+  String ssid = WiFi.SSID();
   Serial.println("Connected to WiFi SSID: " + ssid);
 
   // Set up MQTT
   String mqttClientID = "ESP32CanBusGatewayClient_" + chipID;
-  mqttClientLib = new MQTTClientLib(mqtt_broker, mqttClientID, wifiClient, mqttCallback);
+  mqttClientLib = new MQTTClientLib(mqtt_broker, mqtt_port, mqttClientID, wifiClient, nullptr);
   connectToMQTT();
+  telemetry.begin(mqttClientLib, "meta/CANBusGateway/" + chipID + "/telemetry");
 
   // Initialize NTPClient
   timeClient.begin();
@@ -377,6 +780,7 @@ void setup()
 
 void loop()
 {
+  telemetry.loop();
   otaInProgress = AzureOTAUpdater::CheckUpdateStatus();
 
   if (otaInProgress < 0)
@@ -398,14 +802,14 @@ void loop()
 
     // Process CAN messages
     processCanMessages();
+    updateCanFilter();
+    writePath.process(millis());
     publishHovalData();
+    flushCapture();
 
-    // Check MQTT connection
-    if (!mqttClientLib->loop())
-    {
-      Serial.println("MQTT Client not connected, reconnecting in loop...");
-      connectToMQTT();
-    }
+    // Never blocks: CAN frames keep being received while WiFi or the broker
+    // are away, the client reconnects step by step
+    mqttClientLib->loop();
   }
 
   delay(10); // Small delay to prevent CPU overload
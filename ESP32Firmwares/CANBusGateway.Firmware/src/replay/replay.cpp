@@ -0,0 +1,230 @@
+// Host replay tool for CAN captures recorded by the gateway.
+//
+// Runs the same decoder as the firmware over a capture file, prints what was
+// decoded per datapoint, checks the values against expected ranges,
+// measures decode throughput and shows what the acceptance filter learned from
+// the capture would reject. Build and run with:
+//
+//   pio run -e replay
+//   .pio/build/replay/program capture.bin [--repeat N] [--expect Topic=min..max ...]
+//
+// Exit code is 1 if the capture cannot be read or a value is out of its expected range.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../CanCapture.h"
+#include "../CanFilter.h"
+#include "../HovalDataPoints.h"
+
+struct DataPointStats
+{
+  uint32_t count = 0;
+  float min = 0.0f;
+  float max = 0.0f;
+  float last = 0.0f;
+};
+
+struct Expectation
+{
+  std::string topicName;
+  float min;
+  float max;
+  uint32_t violations = 0;
+};
+
+static bool readCapture(const char *path, std::vector<CanCaptureRecord> &records)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+  {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return false;
+  }
+
+  // The header is optional: chunks collected from MQTT contain records only
+  CanCaptureHeader header;
+  if (fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, CAN_CAPTURE_MAGIC, 4) == 0)
+  {
+    if (header.version != CAN_CAPTURE_VERSION || header.recordSize != sizeof(CanCaptureRecord))
+    {
+      fprintf(stderr, "Unsupported capture version %u (record size %u)\n", header.version, header.recordSize);
+      fclose(file);
+      return false;
+    }
+  }
+  else
+  {
+    rewind(file);
+  }
+
+  CanCaptureRecord record;
+  while (fread(&record, sizeof(record), 1, file) == 1)
+  {
+    records.push_back(record);
+  }
+  fclose(file);
+  return true;
+}
+
+static bool parseExpectation(const char *arg, Expectation &expectation)
+{
+  // Topic=min..max
+  const char *equals = strchr(arg, '=');
+  const char *dots = equals ? strstr(equals, "..") : nullptr;
+  if (!equals || !dots)
+  {
+    return false;
+  }
+  expectation.topicName.assign(arg, equals - arg);
+  expectation.min = strtof(equals + 1, nullptr);
+  expectation.max = strtof(dots + 2, nullptr);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: %s <capture.bin> [--repeat N] [--expect Topic=min..max ...]\n", argv[0]);
+    return 1;
+  }
+
+  int repeat = 1;
+  std::vector<Expectation> expectations;
+  for (int i = 2; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+    {
+      repeat = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--expect") == 0 && i + 1 < argc)
+    {
+      Expectation expectation;
+      if (!parseExpectation(argv[++i], expectation))
+      {
+        fprintf(stderr, "Invalid expectation '%s', use Topic=min..max\n", argv[i]);
+        return 1;
+      }
+      expectations.push_back(expectation);
+    }
+    else
+    {
+      fprintf(stderr, "Unknown argument '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+
+  std::vector<CanCaptureRecord> records;
+  if (!readCapture(argv[1], records))
+  {
+    return 1;
+  }
+  if (records.empty())
+  {
+    fprintf(stderr, "Capture contains no frames\n");
+    return 1;
+  }
+
+  std::vector<DataPointStats> stats(dataPointCount);
+  uint32_t decoded = 0;
+  uint32_t ignored = 0;
+  HovalReassembler reassembler;
+  CanSenderFilter senderFilter;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < repeat; pass++)
+  {
+    for (const CanCaptureRecord &record : records)
+    {
+      DataPointDefinition *dp = decodeHovalFrame(reassembler, record.identifier, record.data, record.length,
+                                                 record.timestampMs, record.timestampMs / 1000);
+      if (!dp)
+      {
+        ignored++;
+        continue;
+      }
+      decoded++;
+      senderFilter.addSender(HOVAL_SENDER(record.identifier));
+      if (dp->type == HOVAL_TYPE_STR)
+      {
+        stats[dp - dataPointDefs].count++;
+        continue;
+      }
+
+      float value = scaledValue(*dp);
+      DataPointStats &s = stats[dp - dataPointDefs];
+      if (s.count == 0 || value < s.min) s.min = value;
+      if (s.count == 0 || value > s.max) s.max = value;
+      s.last = value;
+      s.count++;
+
+      for (Expectation &expectation : expectations)
+      {
+        if (expectation.topicName == dp->topicName && (value < expectation.min || value > expectation.max))
+        {
+          if (expectation.violations == 0)
+          {
+            fprintf(stderr, "%s: %.2f at %.3fs outside %.2f..%.2f\n", dp->topicName, value,
+                    record.timestampMs / 1000.0, expectation.min, expectation.max);
+          }
+          expectation.violations++;
+        }
+      }
+    }
+  }
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  double capturedSeconds = (records.back().timestampMs - records.front().timestampMs) / 1000.0;
+  printf("Capture: %zu frames over %.1f h\n", records.size(), capturedSeconds / 3600.0);
+  printf("Decoded: %u answers, %u other frames (%d pass%s)\n", decoded, ignored, repeat, repeat == 1 ? "" : "es");
+  printf("Segmented: %u reassembled, %u timed out, %u evicted, %u invalid\n",
+         reassembler.completed, reassembler.timedOut, reassembler.evicted, reassembler.invalid);
+  printf("Throughput: %.0f frames/s (%.1f ns/frame)\n",
+         records.size() * repeat / elapsed, elapsed * 1e9 / (records.size() * repeat));
+
+  senderFilter.compute();
+  uint32_t hardwareRejected = 0;
+  uint32_t softwareRejected = 0;
+  for (const CanCaptureRecord &record : records)
+  {
+    if (!senderFilter.hardwareAccepts(record.identifier))
+    {
+      hardwareRejected++;
+    }
+    else if (!senderFilter.accepts(record.identifier))
+    {
+      softwareRejected++;
+    }
+  }
+  printf("Filter: %zu sender%s, code 0x%08X mask 0x%08X%s\n", senderFilter.senderCount(), senderFilter.senderCount() == 1 ? "" : "s",
+         senderFilter.code, senderFilter.mask, senderFilter.acceptAll ? " (software only)" : senderFilter.exact ? " (exact)" : "");
+  printf("        %u frames (%.1f%%) rejected in hardware, %u in software\n",
+         hardwareRejected, 100.0 * hardwareRejected / records.size(), softwareRejected);
+  printf("\n%-26s %8s %10s %10s %10s\n", "Datapoint", "Count", "Min", "Max", "Last");
+  for (size_t i = 0; i < dataPointCount; i++)
+  {
+    const DataPointStats &s = stats[i];
+    if (dataPointDefs[i].type == HOVAL_TYPE_STR)
+    {
+      printf("%-26s %8u %32s\n", dataPointDefs[i].topicName, s.count, dataPointDefs[i].text);
+      continue;
+    }
+    printf("%-26s %8u %10.2f %10.2f %10.2f %s\n", dataPointDefs[i].topicName, s.count, s.min, s.max, s.last, dataPointDefs[i].unit);
+  }
+
+  int result = 0;
+  for (const Expectation &expectation : expectations)
+  {
+    if (expectation.violations > 0)
+    {
+      printf("FAILED %s: %u values outside %.2f..%.2f\n", expectation.topicName.c_str(), expectation.violations, expectation.min, expectation.max);
+      result = 1;
+    }
+  }
+  return result;
+}
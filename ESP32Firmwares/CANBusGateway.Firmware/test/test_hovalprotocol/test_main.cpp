@@ -0,0 +1,103 @@
+// Host tests of the Hoval frame classification and reassembly: pio test -e native
+
+#include <unity.h>
+
+#include "HovalDataPoints.h"
+#include "HovalProtocol.h"
+
+static const uint32_t Identifier = (0x02u << 24) | (0x1Fu << 16) | 0x0801;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_single_frame_answer_is_decoded()
+{
+    HovalReassembler reassembler;
+    // Wasserdruck of unit 0x01: 1.5 bar
+    const uint8_t frame[] = {0x01, ANSWER, 0x0A, 0x01, 0x4E, 0x52, 0x00, 0x0F};
+
+    DataPointDefinition *dp = decodeHovalFrame(reassembler, Identifier, frame, sizeof(frame), 0, 1000);
+    TEST_ASSERT_NOT_NULL(dp);
+    TEST_ASSERT_EQUAL_STRING("Wasserdruck", dp->topicName);
+    TEST_ASSERT_EQUAL_INT64(15, dp->value);
+    TEST_ASSERT_EQUAL_UINT32(0, reassembler.invalid);
+}
+
+void test_segmented_message_is_reassembled()
+{
+    HovalReassembler reassembler;
+    const uint8_t start[] = {HOVAL_SEGMENT_START, 10, 0x01, ANSWER, 0x0A, 0x01, 0x4E, 0x52};
+    const uint8_t continuation[] = {HOVAL_SEGMENT_CONTINUATION + 1, 0x12, 0x34, 0x56, 0x78};
+    const uint8_t *message = nullptr;
+    uint8_t messageLength = 0;
+
+    TEST_ASSERT_FALSE(reassembler.addFrame(Identifier, start, sizeof(start), 0, message, messageLength));
+    TEST_ASSERT_TRUE(reassembler.addFrame(Identifier, continuation, sizeof(continuation), 10, message, messageLength));
+    TEST_ASSERT_EQUAL_UINT8(10, messageLength);
+    TEST_ASSERT_EQUAL_HEX8(0x01, message[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x78, message[9]);
+    TEST_ASSERT_EQUAL_UINT32(1, reassembler.completed);
+}
+
+void test_reserved_unit_ids()
+{
+    TEST_ASSERT_TRUE(HovalProtocol::isReservedUnitId(0x1F));
+    TEST_ASSERT_TRUE(HovalProtocol::isReservedUnitId(0xC0));
+    TEST_ASSERT_TRUE(HovalProtocol::isReservedUnitId(0xD5));
+    TEST_ASSERT_TRUE(HovalProtocol::isReservedUnitId(0xDF));
+    TEST_ASSERT_FALSE(HovalProtocol::isReservedUnitId(0x00));
+    TEST_ASSERT_FALSE(HovalProtocol::isReservedUnitId(0x01));
+    TEST_ASSERT_FALSE(HovalProtocol::isReservedUnitId(0x1E));
+    TEST_ASSERT_FALSE(HovalProtocol::isReservedUnitId(0x20));
+    TEST_ASSERT_FALSE(HovalProtocol::isReservedUnitId(0x81));
+    TEST_ASSERT_FALSE(HovalProtocol::isReservedUnitId(0xBF));
+    TEST_ASSERT_FALSE(HovalProtocol::isReservedUnitId(0xE0));
+}
+
+void test_requests_to_reserved_unit_ids_are_refused()
+{
+    uint8_t payload[8];
+    TEST_ASSERT_EQUAL_UINT8(0, HovalProtocol::buildRequest(0xC0, 0x0A, 0x01, 0x4E52, payload));
+    TEST_ASSERT_EQUAL_UINT8(0, HovalProtocol::buildRequest(0x1F, 0x0A, 0x01, 0x4E52, payload));
+    TEST_ASSERT_EQUAL_UINT8(0, HovalProtocol::buildSetRequest(0xDF, 0x01, 0x00, 0x0000, HOVAL_TYPE_S16, 215, payload));
+    TEST_ASSERT_EQUAL_UINT8(6, HovalProtocol::buildRequest(0xE0, 0x0A, 0x01, 0x4E52, payload));
+    TEST_ASSERT_EQUAL_UINT8(8, HovalProtocol::buildSetRequest(0x01, 0x01, 0x00, 0x0000, HOVAL_TYPE_S16, 215, payload));
+}
+
+void test_frames_of_reserved_unit_ids_are_not_messages()
+{
+    HovalReassembler reassembler;
+    // Answers of units 0xC3 and 0x1F look like a stray continuation and a start with a bad length
+    const uint8_t continuationLike[] = {0xC3, ANSWER, 0x0A, 0x01, 0x4E, 0x52, 0x00, 0x0F};
+    const uint8_t startLike[] = {0x1F, ANSWER, 0x0A, 0x01, 0x4E, 0x52, 0x00, 0x0F};
+
+    TEST_ASSERT_NULL(decodeHovalFrame(reassembler, Identifier, continuationLike, sizeof(continuationLike), 0, 1000));
+    TEST_ASSERT_NULL(decodeHovalFrame(reassembler, Identifier, startLike, sizeof(startLike), 0, 1000));
+    TEST_ASSERT_EQUAL_UINT32(2, reassembler.invalid);
+    TEST_ASSERT_EQUAL_UINT32(0, reassembler.completed);
+}
+
+void test_datapoints_avoid_reserved_unit_ids()
+{
+    for (size_t i = 0; i < dataPointCount; i++)
+    {
+        TEST_ASSERT_FALSE_MESSAGE(HovalProtocol::isReservedUnitId(dataPointDefs[i].unitId), dataPointDefs[i].topicName);
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_frame_answer_is_decoded);
+    RUN_TEST(test_segmented_message_is_reassembled);
+    RUN_TEST(test_reserved_unit_ids);
+    RUN_TEST(test_requests_to_reserved_unit_ids_are_refused);
+    RUN_TEST(test_frames_of_reserved_unit_ids_are_not_messages);
+    RUN_TEST(test_datapoints_avoid_reserved_unit_ids);
+    return UNITY_END();
+}
@@ -0,0 +1,237 @@
+// Host tests of the write path, from the write command to its confirmation: pio test -e native
+
+#include <unity.h>
+#include <string.h>
+#include <vector>
+
+#include "HovalDataPoints.h"
+#include "HovalWritePath.h"
+
+// Identifier of the controller's answers
+static const uint32_t AnswerIdentifier = (0x02u << 24) | (0x1Fu << 16) | 0x0801;
+
+struct SentFrame
+{
+    uint8_t payload[8];
+    uint8_t length;
+};
+
+struct Result
+{
+    const DataPointDefinition *dp;
+    HovalWriteStatus status;
+    float requested;
+    long latencyMs;
+};
+
+static std::vector<SentFrame> sentFrames;
+static std::vector<Result> results;
+static bool sendSucceeds;
+static HovalReassembler reassembler;
+
+static HovalWritePath writePath(
+    [](const uint8_t *payload, uint8_t length)
+    {
+        if (!sendSucceeds)
+        {
+            return false;
+        }
+        SentFrame frame;
+        memcpy(frame.payload, payload, length);
+        frame.length = length;
+        sentFrames.push_back(frame);
+        return true;
+    },
+    [](const DataPointDefinition &dp, HovalWriteStatus status, float requested, long latencyMs)
+    {
+        results.push_back({&dp, status, requested, latencyMs});
+    });
+
+// The controller answers a REQUEST with the raw S16 value
+static void answer(const SentFrame &request, int16_t rawValue, uint32_t nowMs)
+{
+    uint8_t frame[8];
+    memcpy(frame, request.payload, 6);
+    frame[1] = ANSWER;
+    frame[6] = (uint8_t)((uint16_t)rawValue >> 8);
+    frame[7] = (uint8_t)((uint16_t)rawValue & 0xFF);
+    DataPointDefinition *dp = decodeHovalFrame(reassembler, AnswerIdentifier, frame, sizeof(frame), nowMs, nowMs / 1000);
+    TEST_ASSERT_NOT_NULL(dp);
+    writePath.answerReceived(*dp, nowMs);
+}
+
+static DataPointDefinition &setpoint()
+{
+    return *findDataPointByTopicName("Raum_Soll_Normal");
+}
+
+void setUp()
+{
+    sentFrames.clear();
+    results.clear();
+    sendSucceeds = true;
+    for (size_t i = 0; i < dataPointCount; i++)
+    {
+        DataPointDefinition &dp = dataPointDefs[i];
+        dp.value = 0;
+        dp.lastUpdated = 0;
+        dp.writePending = false;
+        dp.written = false;
+        dp.readbackSentMs = 0;
+    }
+}
+
+void tearDown()
+{
+}
+
+void test_setpoint_is_writable()
+{
+    DataPointDefinition &dp = setpoint();
+    TEST_ASSERT_GREATER_THAN(0, dp.writeIntervalSeconds);
+    TEST_ASSERT_TRUE(dp.writeMin < dp.writeMax);
+}
+
+void test_set_request_is_confirmed_by_read_back()
+{
+    DataPointDefinition &dp = setpoint();
+    writePath.request(dp, "21.5", 1000);
+
+    TEST_ASSERT_EQUAL(1, sentFrames.size());
+    const uint8_t setRequest[] = {0x01, SET_REQUEST, 0x01, 0x00, 0x0B, 0xEA, 0x00, 0xD7};
+    TEST_ASSERT_EQUAL_UINT8(sizeof(setRequest), sentFrames[0].length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(setRequest, sentFrames[0].payload, sizeof(setRequest));
+    TEST_ASSERT_TRUE(dp.writePending);
+
+    // The read-back waits for the controller to apply the value
+    writePath.process(1000 + HovalWritePath::ReadbackDelayMs - 1);
+    TEST_ASSERT_EQUAL(1, sentFrames.size());
+    writePath.process(1000 + HovalWritePath::ReadbackDelayMs);
+    TEST_ASSERT_EQUAL(2, sentFrames.size());
+    TEST_ASSERT_EQUAL_HEX8(REQUEST, sentFrames[1].payload[1]);
+    TEST_ASSERT_EQUAL_UINT8(6, sentFrames[1].length);
+
+    answer(sentFrames[1], 215, 1620);
+
+    TEST_ASSERT_EQUAL(1, results.size());
+    TEST_ASSERT_EQUAL_PTR(&dp, results[0].dp);
+    TEST_ASSERT_EQUAL(HovalWriteStatus::Confirmed, results[0].status);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 21.5f, results[0].requested);
+    TEST_ASSERT_EQUAL_INT32(620, results[0].latencyMs);
+    TEST_ASSERT_FALSE(dp.writePending);
+}
+
+void test_read_back_repeats_until_the_value_is_applied()
+{
+    DataPointDefinition &dp = setpoint();
+    writePath.request(dp, "21.5", 1000);
+    writePath.process(1500);
+    answer(sentFrames[1], 200, 1550);
+    TEST_ASSERT_EQUAL(0, results.size());
+
+    writePath.process(1500 + HovalWritePath::ReadbackIntervalMs - 1);
+    TEST_ASSERT_EQUAL(2, sentFrames.size());
+    writePath.process(1500 + HovalWritePath::ReadbackIntervalMs);
+    TEST_ASSERT_EQUAL(3, sentFrames.size());
+    answer(sentFrames[2], 215, 2560);
+
+    TEST_ASSERT_EQUAL(1, results.size());
+    TEST_ASSERT_EQUAL(HovalWriteStatus::Confirmed, results[0].status);
+    TEST_ASSERT_EQUAL_INT32(1560, results[0].latencyMs);
+}
+
+void test_answers_before_the_read_back_do_not_confirm()
+{
+    DataPointDefinition &dp = setpoint();
+    writePath.request(dp, "21.5", 1000);
+    // A poll answer that crossed the SET_REQUEST
+    answer(sentFrames[0], 215, 1100);
+    TEST_ASSERT_EQUAL(0, results.size());
+    TEST_ASSERT_TRUE(dp.writePending);
+}
+
+void test_unconfirmed_write_times_out()
+{
+    DataPointDefinition &dp = setpoint();
+    writePath.request(dp, "18", 1000);
+    writePath.process(1000 + HovalWritePath::ConfirmTimeoutMs - 1);
+    TEST_ASSERT_EQUAL(0, results.size());
+    writePath.process(1000 + HovalWritePath::ConfirmTimeoutMs);
+
+    TEST_ASSERT_EQUAL(1, results.size());
+    TEST_ASSERT_EQUAL(HovalWriteStatus::Timeout, results[0].status);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 18.0f, results[0].requested);
+    TEST_ASSERT_EQUAL_INT32(-1, results[0].latencyMs);
+    TEST_ASSERT_FALSE(dp.writePending);
+}
+
+void test_read_only_datapoint_is_rejected()
+{
+    writePath.request(*findDataPointByTopicName("Vorlauf_Ist"), "40", 1000);
+
+    TEST_ASSERT_EQUAL(0, sentFrames.size());
+    TEST_ASSERT_EQUAL(1, results.size());
+    TEST_ASSERT_EQUAL(HovalWriteStatus::Rejected, results[0].status);
+}
+
+void test_invalid_and_out_of_range_values_are_not_sent()
+{
+    DataPointDefinition &dp = setpoint();
+    writePath.request(dp, "warm", 1000);
+    writePath.request(dp, "30", 1000);
+    writePath.request(dp, "-5", 1000);
+
+    TEST_ASSERT_EQUAL(0, sentFrames.size());
+    TEST_ASSERT_EQUAL(3, results.size());
+    TEST_ASSERT_EQUAL(HovalWriteStatus::Invalid, results[0].status);
+    TEST_ASSERT_EQUAL(HovalWriteStatus::OutOfRange, results[1].status);
+    TEST_ASSERT_EQUAL(HovalWriteStatus::OutOfRange, results[2].status);
+}
+
+void test_writes_are_rate_limited()
+{
+    DataPointDefinition &dp = setpoint();
+    writePath.request(dp, "21.5", 1000);
+    writePath.request(dp, "22", 1200);
+    TEST_ASSERT_EQUAL(HovalWriteStatus::RateLimited, results[0].status);
+
+    writePath.process(1500);
+    answer(sentFrames[1], 215, 1600);
+    writePath.request(dp, "22", 1000 + dp.writeIntervalSeconds * 1000u - 1);
+    TEST_ASSERT_EQUAL(HovalWriteStatus::RateLimited, results[2].status);
+
+    writePath.request(dp, "22", 1000 + dp.writeIntervalSeconds * 1000u);
+    TEST_ASSERT_EQUAL(3, results.size());
+    TEST_ASSERT_EQUAL(3, sentFrames.size());
+    TEST_ASSERT_TRUE(dp.writePending);
+}
+
+void test_send_failure_leaves_no_pending_write()
+{
+    DataPointDefinition &dp = setpoint();
+    sendSucceeds = false;
+    writePath.request(dp, "21.5", 1000);
+
+    TEST_ASSERT_EQUAL(1, results.size());
+    TEST_ASSERT_EQUAL(HovalWriteStatus::SendFailed, results[0].status);
+    TEST_ASSERT_FALSE(dp.writePending);
+
+    sendSucceeds = true;
+    writePath.request(dp, "21.5", 1100);
+    TEST_ASSERT_EQUAL(1, sentFrames.size());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_setpoint_is_writable);
+    RUN_TEST(test_set_request_is_confirmed_by_read_back);
+    RUN_TEST(test_read_back_repeats_until_the_value_is_applied);
+    RUN_TEST(test_answers_before_the_read_back_do_not_confirm);
+    RUN_TEST(test_unconfirmed_write_times_out);
+    RUN_TEST(test_read_only_datapoint_is_rejected);
+    RUN_TEST(test_invalid_and_out_of_range_values_are_not_sent);
+    RUN_TEST(test_writes_are_rate_limited);
+    RUN_TEST(test_send_failure_leaves_no_pending_write);
+    return UNITY_END();
+}
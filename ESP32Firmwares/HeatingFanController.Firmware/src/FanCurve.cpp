@@ -0,0 +1,107 @@
+#include "FanCurve.h"
+#include <algorithm>
+#include <math.h>
+
+// Default until the configuration arrives: off at room temperature, full
+// speed once the radiator is really hot
+static const FanCurvePoint DefaultPoints[] = {
+    {30.0f, 0.0f},
+    {35.0f, 30.0f},
+    {50.0f, 100.0f},
+};
+
+FanCurve::FanCurve()
+{
+  setPoints(DefaultPoints, sizeof(DefaultPoints) / sizeof(DefaultPoints[0]));
+}
+
+bool FanCurve::setPoints(const FanCurvePoint *newPoints, int newCount)
+{
+  FanCurvePoint sorted[MaxPoints];
+  int valid = 0;
+  for (int i = 0; i < newCount && valid < MaxPoints; i++)
+  {
+    if (isnan(newPoints[i].temperature) || isnan(newPoints[i].percent))
+    {
+      continue;
+    }
+    sorted[valid] = newPoints[i];
+    sorted[valid].percent = std::min(100.0f, std::max(0.0f, sorted[valid].percent));
+    valid++;
+  }
+  if (valid == 0)
+  {
+    return false;
+  }
+
+  std::sort(sorted, sorted + valid, [](const FanCurvePoint &a, const FanCurvePoint &b)
+            { return a.temperature < b.temperature; });
+  std::copy(sorted, sorted + valid, points);
+  count = valid;
+  return true;
+}
+
+float FanCurve::evaluate(float temperature) const
+{
+  if (temperature <= points[0].temperature)
+  {
+    return points[0].percent;
+  }
+  for (int i = 1; i < count; i++)
+  {
+    if (temperature <= points[i].temperature)
+    {
+      const FanCurvePoint &a = points[i - 1];
+      const FanCurvePoint &b = points[i];
+      float span = b.temperature - a.temperature;
+      if (span <= 0.0f)
+      {
+        return b.percent;
+      }
+      return a.percent + (temperature - a.temperature) / span * (b.percent - a.percent);
+    }
+  }
+  return points[count - 1].percent;
+}
+
+int FanCurve::update(float temperature, float maxPercent, float dtSeconds)
+{
+  if (!hasTemperature || temperature > heldTemperature)
+  {
+    heldTemperature = temperature;
+    hasTemperature = true;
+  }
+  else if (temperature < heldTemperature - hysteresisKelvin)
+  {
+    heldTemperature = temperature + hysteresisKelvin;
+  }
+
+  float target = std::min(evaluate(heldTemperature), maxPercent);
+  if (target > 0.0f && target < minRunPercent)
+  {
+    target = std::min(minRunPercent, maxPercent);
+  }
+
+  float step = rampPercentPerSecond > 0.0f ? rampPercentPerSecond * dtSeconds : 100.0f;
+  if (target > current)
+  {
+    // A standing fan starts at the minimum speed it actually runs at
+    float start = current < minRunPercent ? std::min(minRunPercent, target) : current;
+    current = std::min(target, std::max(start, current + step));
+  }
+  else if (target < current)
+  {
+    current = std::max(target, current - step);
+    if (current < minRunPercent && target < minRunPercent)
+    {
+      current = target;
+    }
+  }
+
+  return (int)lroundf(current);
+}
+
+void FanCurve::reset(float percent)
+{
+  current = percent;
+}
@@ -0,0 +1,61 @@
+#ifndef FANCURVE_H
+#define FANCURVE_H
+
+// Local fan curve: maps the radiator temperature to a fan speed in percent,
+// so the fans follow the radiator within one sensor cycle and keep working
+// while MQTT is down.
+//
+// - Piecewise linear between up to MaxPoints (temperature, percent) points,
+//   clamped to the first/last point outside of them.
+// - Hysteresis: a rising temperature is followed immediately, a falling one
+//   only after it dropped by hysteresisKelvin (no hunting around a point).
+// - Ramp limit: the output moves by at most rampPercentPerSecond.
+// - Fans that do not start below minRunPercent jump to it instead of
+//   crawling up from zero, and stop once ramped below it.
+
+#include <stdint.h>
+
+struct FanCurvePoint
+{
+  float temperature;
+  float percent;
+};
+
+class FanCurve
+{
+public:
+  static const int MaxPoints = 8;
+
+  FanCurve();
+
+  // Replaces the points; they are sorted by temperature. False if none is valid.
+  bool setPoints(const FanCurvePoint *newPoints, int newCount);
+  int pointCount() const { return count; }
+  const FanCurvePoint &point(int index) const { return points[index]; }
+
+  float hysteresisKelvin = 1.5f;
+  float rampPercentPerSecond = 5.0f;
+  float minRunPercent = 20.0f;
+
+  // Curve value for a temperature (no hysteresis, no ramp)
+  float evaluate(float temperature) const;
+
+  // One step: new output for the measured temperature, capped at maxPercent,
+  // dtSeconds after the previous step
+  int update(float temperature, float maxPercent, float dtSeconds);
+
+  // Continue from a speed set elsewhere (manual override), so leaving the
+  // override ramps from there instead of jumping
+  void reset(float percent);
+
+  float output() const { return current; }
+
+private:
+  FanCurvePoint points[MaxPoints];
+  int count = 0;
+  float current = 0.0f;
+  float heldTemperature = 0.0f;
+  bool hasTemperature = false;
+};
+
+#endif // FANCURVE_H
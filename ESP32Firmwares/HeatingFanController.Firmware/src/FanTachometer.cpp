@@ -0,0 +1,126 @@
+#include "FanTachometer.h"
+#include <esp_timer.h>
+
+const FanTachometerConfig FanTachometer::DefaultConfig = {
+    2,     // pulsesPerRevolution
+    1000,  // glitchFilterNs
+    20,    // minPulses
+    1000,  // minGateMs
+    10000, // maxGateMs
+    0.3f,  // smoothing
+    200,   // stallRpm
+    10000, // spinUpMs
+    10000, // stallAfterMs
+};
+
+bool FanTachometer::begin()
+{
+  if (pin < 0)
+  {
+    return false;
+  }
+
+  pinMode(pin, INPUT_PULLUP);
+
+  pcnt_unit_config_t unitConfig = {};
+  unitConfig.low_limit = -1;
+  unitConfig.high_limit = 32767; // A window never gets near it (10 s at 100 Hz = 1000 edges)
+  if (pcnt_new_unit(&unitConfig, &unit) != ESP_OK)
+  {
+    Serial.println("Tachometer: no free PCNT unit");
+    unit = nullptr;
+    return false;
+  }
+
+  pcnt_glitch_filter_config_t filterConfig = {};
+  filterConfig.max_glitch_ns = config.glitchFilterNs;
+  pcnt_chan_config_t channelConfig = {};
+  channelConfig.edge_gpio_num = pin;
+  channelConfig.level_gpio_num = -1;
+  if (pcnt_unit_set_glitch_filter(unit, &filterConfig) != ESP_OK ||
+      pcnt_new_channel(unit, &channelConfig, &channel) != ESP_OK ||
+      // Falling edges only: one count per tach pulse
+      pcnt_channel_set_edge_action(channel, PCNT_CHANNEL_EDGE_ACTION_HOLD, PCNT_CHANNEL_EDGE_ACTION_INCREASE) != ESP_OK ||
+      pcnt_unit_enable(unit) != ESP_OK ||
+      pcnt_unit_clear_count(unit) != ESP_OK ||
+      pcnt_unit_start(unit) != ESP_OK)
+  {
+    Serial.println("Tachometer: PCNT setup failed");
+    if (channel)
+    {
+      pcnt_del_channel(channel);
+      channel = nullptr;
+    }
+    pcnt_del_unit(unit);
+    unit = nullptr;
+    return false;
+  }
+
+  windowStartUs = esp_timer_get_time();
+  windowPulses = 0;
+  return true;
+}
+
+bool FanTachometer::update()
+{
+  if (!unit)
+  {
+    return false;
+  }
+
+  const int64_t nowUs = esp_timer_get_time();
+  const int64_t elapsedUs = nowUs - windowStartUs;
+  if (elapsedUs < (int64_t)config.minGateMs * 1000)
+  {
+    return false;
+  }
+
+  // Collect the edges counted so far and restart the counter; the window
+  // itself keeps running until it is long enough for the current speed
+  int count = 0;
+  pcnt_unit_get_count(unit, &count);
+  pcnt_unit_clear_count(unit);
+  windowPulses += (uint32_t)count;
+
+  if (windowPulses < config.minPulses && elapsedUs < (int64_t)config.maxGateMs * 1000)
+  {
+    return false;
+  }
+
+  lastWindowRpm = (uint32_t)(((uint64_t)windowPulses * 60000000ULL) /
+                             ((uint64_t)config.pulsesPerRevolution * (uint64_t)elapsedUs));
+  smoothedRpm = hasValue ? smoothedRpm + config.smoothing * ((float)lastWindowRpm - smoothedRpm)
+                         : (float)lastWindowRpm;
+  hasValue = true;
+  windowStartUs = nowUs;
+  windowPulses = 0;
+
+  updateStall(millis());
+  return true;
+}
+
+void FanTachometer::setCommanded(bool on)
+{
+  commandedOn = on;
+  commandMs = millis();
+  hasValue = false;
+  slow = false;
+  isStalled = false;
+}
+
+void FanTachometer::updateStall(unsigned long nowMs)
+{
+  if (!commandedOn || nowMs - commandMs < config.spinUpMs || lastWindowRpm >= config.stallRpm)
+  {
+    slow = false;
+    isStalled = false;
+    return;
+  }
+
+  if (!slow)
+  {
+    slow = true;
+    slowSinceMs = nowMs;
+  }
+  isStalled = nowMs - slowSinceMs >= config.stallAfterMs;
+}
@@ -0,0 +1,75 @@
+#ifndef FANTACHOMETER_H
+#define FANTACHOMETER_H
+
+// Fan speed from the tachometer output, counted by the ESP32 pulse counter
+// (PCNT) peripheral: no interrupt per edge, and the hardware glitch filter
+// drops ringing on the open-collector tach line before it is counted.
+//
+// - Adaptive gate: a measurement window closes after minGateMs once it holds
+//   minPulses edges, at the latest after maxGateMs. A slow fan thus gets a
+//   longer window instead of being quantised to a few hundred RPM per pulse.
+// - Smoothing: exponential moving average of the per-window RPM, restarted
+//   on every speed command so a new speed shows up within one window.
+// - Stall: commanded on, but below stallRpm for longer than stallAfterMs
+//   (not checked during spinUpMs after a speed command).
+
+#include <Arduino.h>
+#include <driver/pulse_cnt.h>
+
+struct FanTachometerConfig
+{
+  uint8_t pulsesPerRevolution; // 2 for standard PC fans
+  uint32_t glitchFilterNs;     // Shorter pulses are ignored (hardware limit ~12700 ns)
+  uint16_t minPulses;          // Edges a window should hold for a precise RPM
+  uint32_t minGateMs;          // Shortest measurement window
+  uint32_t maxGateMs;          // Longest measurement window (slow or stopped fan)
+  float smoothing;             // Weight of a new window in the average (0..1]
+  uint32_t stallRpm;           // Below this the fan counts as standing
+  uint32_t spinUpMs;           // Grace period after a speed command
+  uint32_t stallAfterMs;       // Standing this long while commanded on = stalled
+};
+
+class FanTachometer
+{
+public:
+  static const FanTachometerConfig DefaultConfig;
+
+  explicit FanTachometer(int pin, const FanTachometerConfig &config = DefaultConfig)
+      : pin(pin), config(config) {}
+
+  // Sets up the PCNT unit; false if the pin is not connected (-1) or the driver failed
+  bool begin();
+
+  // Call regularly from loop(). Returns true when a window closed (new RPM).
+  bool update();
+
+  // A new speed was commanded: restarts smoothing and the spin-up grace period
+  void setCommanded(bool on);
+
+  bool available() const { return unit != nullptr; }
+  uint32_t rpm() const { return (uint32_t)(smoothedRpm + 0.5f); }
+  uint32_t windowRpm() const { return lastWindowRpm; }
+  bool stalled() const { return isStalled; }
+
+private:
+  int pin;
+  FanTachometerConfig config;
+  pcnt_unit_handle_t unit = nullptr;
+  pcnt_channel_handle_t channel = nullptr;
+
+  int64_t windowStartUs = 0;
+  uint32_t windowPulses = 0;
+  uint32_t lastWindowRpm = 0;
+  float smoothedRpm = 0.0f;
+  bool hasValue = false;
+
+  bool commandedOn = false;
+  unsigned long commandMs = 0;
+  unsigned long slowSinceMs = 0;
+  bool slow = false;
+  bool isStalled = false;
+
+  void updateStall(unsigned long nowMs);
+};
+
+#endif // FANTACHOMETER_H
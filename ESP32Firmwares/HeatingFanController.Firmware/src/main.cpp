@@ -10,9 +10,14 @@
 #include "AzureOTAUpdater.h"
 #include "MQTTClientLib.h"
 #include "WifiLib.h"
+#include "WiFiFastConnect.h"
+#include "DeviceTelemetry.h"
 #include "SensorData.h"
 #include "ISensor.h"
 #include "DS18B20Sensor.h"
+#include "FanTachometer.h"
+#include "FanCurve.h"
+#include "OneWireScheduler.h"
 
 
 const int fanPWM = 4; // GPIO pin connected to the base of the transistor
@@ -20,13 +25,9 @@ const int tachPin = 21; // GPIO pin connected to the tachometer pin of the fan (
 const int ds18b20Pin = 5; // GPIO pin connected to the DS18B20 sensor data pin
 const int freq = 25000; // 25kHz PWM frequency (standard for 4-wire PC fans)
 const int resolution = 8; // 8-bit resolution (0-255)
-volatile int pulseCount = 0;
 
-static uint32_t lastRpmSampleMs = 0; // Tracks time of last RPM calculation
-
-void IRAM_ATTR pulseCounter() {
-  pulseCount = pulseCount + 1;
-}
+// Tach pulses are counted by the PCNT peripheral, not by an interrupt per edge
+static FanTachometer tachometer(tachPin);
 
 #define DS18B20_PIN 5  // on pin 5 (a 4.7K resistor is necessary)
 
@@ -38,6 +39,8 @@ String chipID = "";
 // WiFi credentials are read from environment variables and used during compile-time (see platformio.ini)
 // Set WIFI_PASSWORDS as environment variables on your dev-system following the pattern: WIFI_PASSWORDS="ssid1;password1|ssid2;password2"
 WifiLib wifiLib(WIFI_PASSWORDS);
+WiFiFastConnect wifiFast(WIFI_PASSWORDS);
+DeviceTelemetry telemetry;
 WiFiClient wifiClient;
 WiFiUDP ntpUDP;
 NTPClient timeClient(ntpUDP);
@@ -47,9 +50,18 @@ static int otaInProgress = 0;
 static bool otaEnable = OTA_ENABLED != "false";
 static bool sendMQTTMessages = true;
 static bool mqttSuccess = false;
+static bool mqttWasConnected = false;
 static int lastMQTTSentMinute = 0;
 static int lastFanPercent = 0; 
 
+// Local fan curve. The backend command either overrides it ("Manual") or
+// only caps it ("Auto", "AutoLow", "AutoHigh": Fanspeed = maximum).
+static FanCurve fanCurve;
+static bool fanCurveEnabled = true;
+static int fanCurveMaxPercent = 100;
+static String fanCurveSensor = "";   // Display name of the input sensor, "" = hottest sensor
+static unsigned long lastFanCurveMs = 0;
+
 // Configuration for data collection
 static const int MAX_READINGS = 24;                 // 2.5 seconds * 24 = 60 seconds (1 minute)
 static const unsigned long READING_INTERVAL = 2500; // 2.5 seconds between readings
@@ -58,7 +70,12 @@ static std::vector<std::vector<SensorData>> readings;
 
 static String baseTopic = "daten";
 static String deviceName = "Heizkörperlüfter";
-static std::unordered_map<std::string, String> sensorNames;
+// Configured ROM id (parsed from "28-FF-...", family code in the top byte) -> display name
+static std::unordered_map<uint64_t, String> sensorNames;
+// Display name per sensor id; rebuilt when the configuration changes, built once for a
+// sensor first seen afterwards
+static std::unordered_map<uint64_t, String> sensorDisplayNames;
+static String jsonTopic = "daten/Heizkörperlüfter/" + deviceName;
 static String location = "unknown";
 const String mqtt_broker = "mosquitto.intern";
 const int mqtt_port = 1883;
@@ -98,6 +115,98 @@ bool initializeSensor()
   return true;
 }
 
+String buildSensorDisplayName(uint64_t sensorId)
+{
+  String idKey = sensor->formatSensorId(sensorId);
+  idKey.toUpperCase();
+  uint64_t romId;
+  auto it = OneWireScheduler::parseId(idKey.c_str(), romId) ? sensorNames.find(romId) : sensorNames.end();
+  return it != sensorNames.end() ? it->second : idKey;
+}
+
+const String &getSensorDisplayName(uint64_t sensorId)
+{
+  auto cached = sensorDisplayNames.find(sensorId);
+  if (cached != sensorDisplayNames.end()) {
+    return cached->second;
+  }
+  return sensorDisplayNames[sensorId] = buildSensorDisplayName(sensorId);
+}
+
+// After a configuration change: new names for all sensors seen so far
+void rebuildSensorDisplayNames()
+{
+  if (!sensor)
+  {
+    return;
+  }
+  for (auto &entry : sensorDisplayNames)
+  {
+    entry.second = buildSensorDisplayName(entry.first);
+  }
+}
+
+void applyFanSpeed(int fanSpeedPercent)
+{
+  if (fanSpeedPercent < 0)
+  {
+    fanSpeedPercent = 0;
+  }
+  if (fanSpeedPercent > 100)
+  {
+    fanSpeedPercent = 100;
+  }
+  if (fanSpeedPercent == lastFanPercent)
+  {
+    return;
+  }
+
+  // Small ramp steps do not restart the tachometer's spin-up grace period
+  if ((fanSpeedPercent > 0) != (lastFanPercent > 0) || abs(fanSpeedPercent - lastFanPercent) >= 10)
+  {
+    tachometer.setCommanded(fanSpeedPercent > 0);
+  }
+
+  // Hardware expects PWM where 0=full speed, 255=off
+  const int pwmValue = 255 - (fanSpeedPercent * 255) / 100;
+  lastFanPercent = fanSpeedPercent;
+  Serial.println("Fan speed set to (percent): " + String(fanSpeedPercent) + ", PWM: " + String(pwmValue));
+  ledcWrite(fanPWM, pwmValue);
+}
+
+// Runs the local fan curve on the readings of one sensor cycle
+void updateFanCurve(const std::vector<SensorData> &successfulReadings)
+{
+  if (!fanCurveEnabled || successfulReadings.empty())
+  {
+    return;
+  }
+
+  bool found = false;
+  float temperature = 0.0f;
+  for (const auto &reading : successfulReadings)
+  {
+    if (fanCurveSensor.length() > 0 && getSensorDisplayName(reading.sensorId) != fanCurveSensor)
+    {
+      continue;
+    }
+    if (!found || reading.temperature > temperature)
+    {
+      temperature = reading.temperature;
+      found = true;
+    }
+  }
+  if (!found)
+  {
+    return;
+  }
+
+  const unsigned long nowMs = millis();
+  const float dtSeconds = lastFanCurveMs == 0 ? 0.0f : (nowMs - lastFanCurveMs) / 1000.0f;
+  lastFanCurveMs = nowMs;
+  applyFanSpeed(fanCurve.update(temperature, static_cast<float>(fanCurveMaxPercent), dtSeconds));
+}
+
 void readSensorData()
 {
   if (deviceName == "" && sensorNames.empty())
@@ -133,7 +242,7 @@ void readSensorData()
     {
       Serial.printf("Sensor reading[%u] (id: %s): %.2f°C\n",
                     static_cast<unsigned>(i),
-                    sensor->formatSensorId(reading.sensorId).c_str(),
+                    getSensorDisplayName(reading.sensorId).c_str(),
                     reading.temperature);
       successfulReadings.push_back(reading);
     }
@@ -146,6 +255,8 @@ void readSensorData()
     }
   }
 
+  updateFanCurve(successfulReadings);
+
   if (!successfulReadings.empty())
   {
     readings.push_back(successfulReadings);
@@ -176,6 +287,7 @@ void parseConfigJSON(String jsonPayload)
   if (!doc["DeviceName"].isNull())
   {
     deviceName = doc["DeviceName"].as<String>();
+    jsonTopic = "daten/Heizkörperlüfter/" + deviceName;
     Serial.println("Device name set to: " + deviceName);
   }
 
@@ -190,17 +302,20 @@ void parseConfigJSON(String jsonPayload)
       {
         for (JsonPair kv : nameEntry)
         {
-          String idKey = String(kv.key().c_str());
           String displayName = kv.value().as<String>();
-          idKey.trim();
           displayName.trim();
-          idKey.toUpperCase();
-          if (idKey.length() == 0 || displayName.length() == 0)
+          uint64_t id;
+          if (!OneWireScheduler::parseId(kv.key().c_str(), id))
+          {
+            Serial.println("Invalid sensor id '" + String(kv.key().c_str()) + "'");
+            continue;
+          }
+          if (displayName.length() == 0)
           {
             continue;
           }
-          sensorNames[std::string(idKey.c_str())] = displayName;
-          Serial.println("Sensor name override added: " + idKey + " -> " + displayName);
+          sensorNames[id] = displayName;
+          Serial.println("Sensor name override added: " + OneWireScheduler::formatId(id) + " -> " + displayName);
         }
       }
       Serial.println("Sensor names loaded: " + String(static_cast<unsigned long>(sensorNames.size())));
@@ -209,6 +324,39 @@ void parseConfigJSON(String jsonPayload)
     {
       Serial.println("SensorNames in JSON is not an array; ignoring configuration.");
     }
+    rebuildSensorDisplayNames();
+  }
+
+  if (!doc["FanCurve"].isNull())
+  {
+    JsonObject curve = doc["FanCurve"];
+    JsonArray pointsArray = curve["Points"];
+    if (!pointsArray.isNull())
+    {
+      FanCurvePoint points[FanCurve::MaxPoints];
+      int count = 0;
+      for (JsonObject point : pointsArray)
+      {
+        if (count >= FanCurve::MaxPoints)
+        {
+          break;
+        }
+        points[count].temperature = point["Temperature"] | NAN;
+        points[count].percent = point["Percent"] | NAN;
+        count++;
+      }
+      if (!fanCurve.setPoints(points, count))
+      {
+        Serial.println("FanCurve.Points contains no valid point; keeping the previous curve.");
+      }
+    }
+    fanCurve.hysteresisKelvin = curve["HysteresisKelvin"] | fanCurve.hysteresisKelvin;
+    fanCurve.rampPercentPerSecond = curve["RampPercentPerSecond"] | fanCurve.rampPercentPerSecond;
+    fanCurve.minRunPercent = curve["MinRunPercent"] | fanCurve.minRunPercent;
+    fanCurveSensor = curve["Sensor"] | "";
+    Serial.println("Fan curve: " + String(fanCurve.pointCount()) + " points, hysteresis " +
+                   String(fanCurve.hysteresisKelvin, 1) + " K, ramp " + String(fanCurve.rampPercentPerSecond, 1) +
+                   " %/s, sensor '" + (fanCurveSensor.length() > 0 ? fanCurveSensor : String("hottest")) + "'");
   }
 
   mqttConfigReceived = true;
@@ -268,20 +416,21 @@ void parseCommandJSON(String jsonPayload)
   {
     // Config now sends fan speed as percent: 0% = off, 100% = full speed
     int fanSpeedPercent = doc["Fanspeed"].as<int>();
-    if (fanSpeedPercent < 0)
+    String mode = doc["Mode"] | "Manual";
+
+    if (mode.startsWith("Auto"))
     {
-      fanSpeedPercent = 0;
+      // The local curve keeps control, the backend only limits it
+      fanCurveEnabled = true;
+      fanCurveMaxPercent = fanSpeedPercent < 0 ? 0 : (fanSpeedPercent > 100 ? 100 : fanSpeedPercent);
+      fanCurve.reset(static_cast<float>(lastFanPercent));
+      Serial.println("Fan curve active (" + mode + "), maximum " + String(fanCurveMaxPercent) + "%");
     }
-    if (fanSpeedPercent > 100)
+    else
     {
-      fanSpeedPercent = 100;
+      fanCurveEnabled = false;
+      applyFanSpeed(fanSpeedPercent);
     }
-
-    // Hardware expects PWM where 0=full speed, 255=off
-    const int pwmValue = 255 - (fanSpeedPercent * 255) / 100;
-    lastFanPercent = fanSpeedPercent;
-    Serial.println("Fan speed set to (percent): " + String(fanSpeedPercent) + ", PWM: " + String(pwmValue));
-    ledcWrite(fanPWM, pwmValue);
   }
 }
 
@@ -345,16 +494,11 @@ void connectToMQTT(bool cleanSession)
   Serial.print("WiFi Status: ");
   Serial.println(WiFi.status() == WL_CONNECTED ? "Connected" : "Disconnected");
 
-  if (WiFi.status() != WL_CONNECTED)
-  {
-    Serial.println("WiFi not connected, attempting to reconnect...");
-    wifiLib.connect();
-  }
-
-  mqttClientLib->connect(cleanSession);
+  // The client replays its subscriptions after every reconnect by itself
   mqttClientLib->subscribe({mqtt_ConfigTopic, mqtt_OTAtopic});
+  mqttClientLib->connect(cleanSession);
 
-  if (!mqttConfigReceived)
+  if (!mqttConfigReceived && mqttClientLib->connected())
   {
     Serial.println("Waiting briefly for retained MQTT config...");
     const uint32_t startMs = millis();
@@ -372,41 +516,21 @@ void connectToMQTT(bool cleanSession)
   Serial.println("Command Topic: " + mqtt_CommandTopic);
 }
 
-void readFanSpeed() 
+void readFanSpeed()
 {
-  const uint32_t nowMs = millis();
-  uint32_t elapsedMs = 0;
-  if (lastRpmSampleMs != 0) {
-    elapsedMs = nowMs - lastRpmSampleMs;
-  }
-
-  int rpm = 0;
-  if (elapsedMs > 0) {
-    const int pulses = pulseCount;
-    rpm = static_cast<int>((static_cast<int64_t>(pulses) * 30000) / elapsedMs);
+  if (!tachometer.update())
+  {
+    return;
   }
 
-  pulseCount = 0;
-  lastRpmSampleMs = nowMs;
-  Serial.print("Fan RPM: ");
-  Serial.println(rpm);
-}
-
-String getSensorDisplayName(uint64_t sensorId)
-{
-  String idKey = sensor->formatSensorId(sensorId);
-  idKey.toUpperCase();
-  std::string lookupKey(idKey.c_str());
-  auto it = sensorNames.find(lookupKey);
-  if (it != sensorNames.end()) {
-    return it->second;
-  }
-  return idKey;
+  Serial.printf("Fan RPM: %u (window %u)%s\n",
+                static_cast<unsigned>(tachometer.rpm()),
+                static_cast<unsigned>(tachometer.windowRpm()),
+                tachometer.stalled() ? " - STALLED" : "");
 }
 
 void publishSensorData()
 {
-  String sensorDisplayName = "";
   if (readings.empty())
   {
     Serial.println("No sensor data to publish");
@@ -467,21 +591,26 @@ void publishSensorData()
     float avgTemperature = agg.temperatureSum / static_cast<float>(agg.temperatureCount);
 
     JsonObject tempObject = temperaturesArray.createNestedObject();
-    sensorDisplayName = getSensorDisplayName(id);
-    tempObject[sensorDisplayName] = avgTemperature;
+    tempObject[getSensorDisplayName(id)] = avgTemperature;
   }
 
   JsonArray percentagesArray = doc.createNestedArray("percentages");
   JsonObject fanObject = percentagesArray.createNestedObject();
   fanObject["Fanspeed"] = lastFanPercent;
+  doc["fanMode"] = fanCurveEnabled ? "curve" : "manual";
+
+  if (tachometer.available())
+  {
+    doc["rpm"] = tachometer.rpm();
+    doc["stalled"] = tachometer.stalled();
+  }
 
   String payload;
   serializeJson(doc, payload);
 
   if (sendMQTTMessages)
   {
-    String jsonTopic = "daten/Heizkörperlüfter/" + deviceName;
-    mqttSuccess = mqttClientLib->publish(jsonTopic.c_str(), payload, true, 2);
+    mqttSuccess = mqttClientLib->publish(jsonTopic.c_str(), payload.c_str(), payload.length(), true, 2);
   }
   else
   {
@@ -507,9 +636,9 @@ void setup()
 
   // Connect to WiFi
   Serial.print("Connecting to WiFi ");
-  wifiLib.scanAndSelectNetwork();
-  wifiLib.connect();
-  String ssid = wifiLib.getSSID();
+  // Access point and address of the last boot first, scan only if that fails
+  wifiFast.connectOrScan(wifiLib);
+  String ssid = WiFi.SSID();
 
   timeClient.begin();
   timeClient.setTimeOffset(0); // Set your time offset from UTC in seconds
@@ -520,20 +649,28 @@ void setup()
 
   initializeSensor();
 
+  // PWM before MQTT: the retained command arrives while connecting. Start
+  // with the fan off, the curve or the command takes over from there.
+  ledcAttach(fanPWM, freq, resolution);
+  ledcWrite(fanPWM, 255);
+
   // Set up MQTT
   String mqttClientID = "ESP32HeatingFanControllerClient_" + chipID;
   mqttClientLib = new MQTTClientLib(mqtt_broker, mqtt_port, mqttClientID, wifiClient, mqttCallback);
+  // Readings during a broker outage are sent afterwards
+  mqttClientLib->beginQueue(16384, "/mqttqueue.bin");
   connectToMQTT(true);
+  telemetry.begin(mqttClientLib, "meta/HeatingFanController/" + chipID + "/telemetry");
   mqttClientLib->publish(("meta/HeatingFanController/" + location + "/" + deviceName + "/version").c_str(), String(version), true, 2);
 
-  if (tachPin != -1) {
-    pinMode(tachPin, INPUT_PULLUP);
-    attachInterrupt(digitalPinToInterrupt(tachPin), pulseCounter, FALLING);
+  if (tachPin != -1 && !tachometer.begin())
+  {
+    Serial.println("Fan tachometer not available, RPM will not be published");
   }
-  ledcAttach(fanPWM, freq, resolution);
 }
 
 void loop(void) {
+  telemetry.loop();
   otaInProgress = AzureOTAUpdater::CheckUpdateStatus();
 
   if (otaInProgress != 1)
@@ -548,13 +685,10 @@ void loop(void) {
 
     readFanSpeed();
 
-    if (WiFi.status() != WL_CONNECTED)
-    {
-      Serial.println("WiFi disconnected, attempting to reconnect...");
-      wifiLib.connect();
-    }
+    // Never blocks: the fan curve keeps running while WiFi or the broker
+    // are away, the client reconnects step by step
     bool mqttConnected = mqttClientLib->loop();
-    if (!mqttConnected)
+    if (!mqttConnected && mqttWasConnected)
     {
       // Log detailed information about the disconnection
       int lastErr = mqttClientLib->lastError();
@@ -568,10 +702,8 @@ void loop(void) {
       Serial.println(ESP.getFreeHeap());
       Serial.print("Uptime: ");
       Serial.println(millis() / 1000);
-
-      Serial.println("MQTT Client not connected, reconnecting in loop...");
-      connectToMQTT(false);
     }
+    mqttWasConnected = mqttConnected;
   }
   delay(1000);
 }
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include "MixerPiController.h"
+#include <math.h>
+
+const MixerPiConfig MixerPiController::DefaultConfig = {
+    4.0f,    // kpPercentPerKelvin
+    600.0f,  // tiSeconds
+    0.3f,    // deadbandKelvin
+    60.0f,   // sampleSeconds
+    2.0f,    // minPulseSeconds
+    20.0f,   // maxPulseSeconds
+    true,    // openIsColder
+};
+
+void MixerPiController::reset() {
+  hasPrevious = false;
+  previousError = 0.0f;
+  residualSeconds = 0.0f;
+  lastPulse = 0;
+  saturated = false;
+}
+
+int32_t MixerPiController::update(float flow, float openFraction, float travelSeconds, float dtSeconds) {
+  lastPulse = 0;
+  saturated = false;
+  if (travelSeconds <= 0.0f) return 0;
+
+  float e = config.openIsColder ? flow - setpoint : setpoint - flow;
+  if (fabsf(e) <= config.deadbandKelvin) e = 0.0f;
+  error = e;
+
+  proportional = hasPrevious ? config.kpPercentPerKelvin * (e - previousError) : 0.0f;
+  integral = config.tiSeconds > 0.0f ? config.kpPercentPerKelvin * dtSeconds / config.tiSeconds * e : 0.0f;
+  previousError = e;
+  hasPrevious = true;
+
+  float seconds = (proportional + integral) / 100.0f * travelSeconds + residualSeconds;
+
+  // Limits of the opening: never plan a move beyond them, and don't remember the excess
+  float wanted = openFraction + seconds / travelSeconds;
+  if (wanted > maxOpen || wanted < minOpen) {
+    float limited = wanted > maxOpen ? maxOpen : minOpen;
+    seconds = (limited - openFraction) * travelSeconds;
+    // Already at (or beyond) the limit: nothing to do in that direction
+    if ((wanted > maxOpen && seconds < 0.0f) || (wanted < minOpen && seconds > 0.0f)) seconds = 0.0f;
+    saturated = true;
+    residualSeconds = 0.0f;
+  }
+
+  if (fabsf(seconds) < config.minPulseSeconds) {
+    // Too short to drive: carry over, unless the limits cut it anyway
+    residualSeconds = saturated ? 0.0f : seconds;
+    return 0;
+  }
+
+  if (fabsf(seconds) > config.maxPulseSeconds) {
+    seconds = seconds > 0.0f ? config.maxPulseSeconds : -config.maxPulseSeconds;
+    saturated = true;
+  }
+  lastPulse = (int32_t)lroundf(seconds);
+  residualSeconds = saturated ? 0.0f : seconds - (float)lastPulse;
+  return lastPulse;
+}
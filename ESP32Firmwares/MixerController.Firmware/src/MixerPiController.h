@@ -0,0 +1,66 @@
+#ifndef MIXERPICONTROLLER_H
+#define MIXERPICONTROLLER_H
+
+// PI flow temperature controller for a mixer with a three-point (open/close)
+// actuator.
+//
+// Velocity form: each step computes the change of the opening
+//     du = Kp * (e[k] - e[k-1]) + Kp * T / Ti * e[k]      (in % of the travel)
+// which maps directly onto a pulse of du * travelTime / 100 seconds, so the
+// actuator itself acts as the integrator.
+// - Pulse quantisation: changes below the minimum pulse are carried over
+//   (residual) instead of being dropped, so small errors still add up.
+// - Anti-windup: changes that would take the estimated opening outside the
+//   limits, and the part of a pulse above the maximum, are discarded rather
+//   than remembered; after a saturation the controller answers immediately.
+//
+// Free of Arduino dependencies so it can be tested on the host against a
+// simulated plant.
+
+#include <stdint.h>
+
+struct MixerPiConfig {
+  float kpPercentPerKelvin;   // Opening change per Kelvin of error change
+  float tiSeconds;            // Integral time
+  float deadbandKelvin;       // Errors up to this are treated as zero
+  float sampleSeconds;        // Control step interval
+  float minPulseSeconds;      // Shorter moves are carried over to the next step
+  float maxPulseSeconds;      // Longer moves are cut (the rest is discarded)
+  bool openIsColder;          // Cooling: opening lowers the flow temperature
+};
+
+class MixerPiController {
+ public:
+  static const MixerPiConfig DefaultConfig;
+
+  explicit MixerPiController(const MixerPiConfig& config = DefaultConfig) : config(config) {}
+
+  MixerPiConfig config;
+  // Supervisor input (RulesEngine via MQTT)
+  bool enabled = false;
+  float setpoint = 0.0f;
+  float minOpen = 0.0f;        // Limits of the opening, 0..1
+  float maxOpen = 1.0f;
+
+  // Forgets the previous error and the carried-over residual (bumpless restart)
+  void reset();
+
+  // One control step. flow is the measured flow temperature, openFraction the
+  // estimated opening (0..1), dtSeconds the time since the last step.
+  // Returns the pulse in seconds: > 0 towards open, < 0 towards close, 0 = none.
+  int32_t update(float flow, float openFraction, float travelSeconds, float dtSeconds);
+
+  // State of the last step (published for monitoring and tuning)
+  float error = 0.0f;          // Kelvin, positive = open to correct
+  float proportional = 0.0f;   // % of travel
+  float integral = 0.0f;       // % of travel
+  float residualSeconds = 0.0f;
+  int32_t lastPulse = 0;
+  bool saturated = false;      // Last change was cut by the opening limits or the maximum pulse
+
+ private:
+  float previousError = 0.0f;
+  bool hasPrevious = false;
+};
+
+#endif // MIXERPICONTROLLER_H
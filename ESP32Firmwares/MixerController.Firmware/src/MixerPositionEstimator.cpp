@@ -0,0 +1,86 @@
+#include "MixerPositionEstimator.h"
+#include <math.h>
+
+const MixerEstimatorConfig MixerPositionEstimator::DefaultConfig = {
+    0.02f,  // referenceStdDev
+    1.0f,   // pulseStartStdDev
+    0.03f,  // pulseRelativeStdDev
+    0.2f,   // sensorStdDev
+    0.08f,  // modelStdDev
+    4.0f,   // minSpreadKelvin
+    0.15f,  // referenceAboveStdDev
+    3,      // driftAfter
+};
+
+void MixerPositionEstimator::reference(bool closed) {
+  x = closed ? 0.0f : 1.0f;
+  variance = config.referenceStdDev * config.referenceStdDev;
+  isValid = true;
+  consecutiveOutliers = 0;
+}
+
+void MixerPositionEstimator::invalidate() {
+  isValid = false;
+  consecutiveOutliers = 0;
+}
+
+void MixerPositionEstimator::predict(bool towardsClose, float seconds, float travelSeconds) {
+  if (!isValid || travelSeconds <= 0.0f) return;
+  float fraction = seconds / travelSeconds;
+  x += towardsClose ? -fraction : fraction;
+  if (x < 0.0f) x = 0.0f;
+  if (x > 1.0f) x = 1.0f;
+  float start = config.pulseStartStdDev / travelSeconds;
+  float relative = config.pulseRelativeStdDev * fraction;
+  variance += start * start + relative * relative;
+}
+
+bool MixerPositionEstimator::correct(float supply, float returnTemperature, float flow) {
+  if (!isValid) return false;
+  float spread = supply - returnTemperature;
+  if (fabsf(spread) < config.minSpreadKelvin) return false;
+
+  float z = (flow - returnTemperature) / spread;
+  if (z < 0.0f) z = 0.0f;
+  if (z > 1.0f) z = 1.0f;
+  lastMeasurement = z;
+
+  // Error of z from the three sensors (flow and return enter the numerator, all three the denominator)
+  float sensor = config.sensorStdDev * sqrtf(2.0f + z * z) / fabsf(spread);
+  float r = sensor * sensor + config.modelStdDev * config.modelStdDev;
+
+  float innovation = z - x;
+  if (innovation * innovation > 9.0f * (variance + r)) {
+    outliers++;
+    if (++consecutiveOutliers >= config.driftAfter) {
+      // The temperatures keep disagreeing: the travel-time estimate has drifted.
+      // Blow up the uncertainty so the mixer re-references.
+      drifts++;
+      consecutiveOutliers = 0;
+      float stdDev = config.referenceAboveStdDev * 2.0f;
+      variance = stdDev * stdDev;
+    }
+    return false;
+  }
+  consecutiveOutliers = 0;
+
+  float gain = variance / (variance + r);
+  x += gain * innovation;
+  variance *= 1.0f - gain;
+  corrections++;
+  return true;
+}
+
+float MixerPositionEstimator::stdDev() const {
+  return sqrtf(variance);
+}
+
+bool MixerPositionEstimator::needsReference() const {
+  return !isValid || stdDev() > config.referenceAboveStdDev;
+}
+
+float MixerPositionEstimator::secondsToEndStop(bool towardsClose, float travelSeconds) const {
+  float distance = towardsClose ? x : 1.0f - x;
+  float seconds = (distance + 3.0f * stdDev()) * travelSeconds;
+  return seconds > travelSeconds ? travelSeconds : seconds;
+}
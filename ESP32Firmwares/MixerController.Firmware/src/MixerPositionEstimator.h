@@ -0,0 +1,70 @@
+#ifndef MIXERPOSITIONESTIMATOR_H
+#define MIXERPOSITIONESTIMATOR_H
+
+// Position estimate of a mixer without position feedback.
+//
+// Combines two sources in a one-dimensional Kalman filter:
+// - Travel time: a reference run against an end stop sets the position with
+//   small uncertainty; every pulse moves the estimate by its share of the
+//   travel time and adds uncertainty (relay and motor start/stop times).
+// - Temperatures: for a mixing valve the flow temperature lies between the
+//   supply (hot/cold side) and the return, so
+//       openFraction ~ (flow - return) / (supply - return)
+//   when the valve has settled and supply and return differ enough. The
+//   valve characteristic is not linear, which the measurement noise covers.
+// A measurement far outside the expected spread several times in a row
+// means the travel-time estimate has drifted; the uncertainty is then
+// raised so the mixer re-references (needsReference()).
+//
+// Free of Arduino dependencies so it can be tested on the host.
+
+#include <stdint.h>
+
+struct MixerEstimatorConfig {
+  float referenceStdDev;      // Uncertainty right after a reference run (fraction of full travel)
+  float pulseStartStdDev;     // Seconds of uncertainty per pulse (relay and motor start/stop)
+  float pulseRelativeStdDev;  // Uncertainty proportional to the pulse length
+  float sensorStdDev;         // Kelvin, per temperature
+  float modelStdDev;          // Non-linear valve characteristic (fraction of full travel)
+  float minSpreadKelvin;      // Minimum |supply - return| for a usable measurement
+  float referenceAboveStdDev; // Re-reference once the uncertainty exceeds this
+  uint8_t driftAfter;         // Consecutive outliers until the estimate counts as drifted
+};
+
+class MixerPositionEstimator {
+ public:
+  static const MixerEstimatorConfig DefaultConfig;
+
+  explicit MixerPositionEstimator(const MixerEstimatorConfig& config = DefaultConfig) : config(config) {}
+
+  // A full travel reached the end stop
+  void reference(bool closed);
+  // Position lost (move interrupted without known duration, reboot)
+  void invalidate();
+  // A move of `seconds` of a mixer with the given full travel time
+  void predict(bool towardsClose, float seconds, float travelSeconds);
+  // Measurement update from settled temperatures. Returns false if the
+  // measurement was not usable (no estimate, too small spread, outlier).
+  bool correct(float supply, float returnTemperature, float flow);
+
+  bool valid() const { return isValid; }
+  float openFraction() const { return x; }       // 1 = open, 0 = closed
+  float stdDev() const;                          // Uncertainty of openFraction
+  bool needsReference() const;
+  // Seconds until the end stop in that direction is certainly reached (estimate plus 3 sigma)
+  float secondsToEndStop(bool towardsClose, float travelSeconds) const;
+
+  float lastMeasurement = -1.0f;  // Last openFraction derived from temperatures, -1 = none
+  uint32_t corrections = 0;
+  uint32_t outliers = 0;
+  uint32_t drifts = 0;
+
+ private:
+  MixerEstimatorConfig config;
+  float x = 0.0f;
+  float variance = 0.0f;
+  bool isValid = false;
+  uint8_t consecutiveOutliers = 0;
+};
+
+#endif // MIXERPOSITIONESTIMATOR_H
@@ -7,18 +7,25 @@
 #include <ESP32Ping.h>
 #include <esp_mac.h>
 #include <OneWire.h>
-#include <DallasTemperature.h>
+#include "OneWireScheduler.h"
+#include "SensorFilter.h"
+#include "MixerPositionEstimator.h"
+#include "MixerPiController.h"
 #include "AzureOTAUpdater.h"
 #include "MQTTClientLib.h"
 #include "WifiLib.h"
+#include "WiFiFastConnect.h"
+#include "DeviceTelemetry.h"
 
 // ---------------------------------------------------------------------------
 // Hardware configuration
 //
-// This firmware is a deliberately "dumb" actuator/sensor node: it receives
-// the mixer target position (open/close) via MQTT from the RulesEngine
-// service and drives the actuators. The control logic (when to open/close)
-// lives in the RulesEngine, not here.
+// This firmware controls the flow temperature of each mixer itself: a PI
+// loop (MixerPiController) runs against the mixer's flow sensor and drives
+// the actuator, and keeps running with the last setpoint while the network
+// is down. Via MQTT the RulesEngine only supplies the setpoint and the
+// limits (.../setpoint), plus the manual override "open:N"/"close:N" for
+// mixers without local control.
 //
 // Relay board: 16-channel board with JQC-3FF-S-Z relays (12V coils).
 // The GPIOs drive the board's opto inputs in open-drain mode: LOW sinks the
@@ -48,6 +55,8 @@ String chipID = "";
 // WiFi credentials are read from environment variables and used during compile-time (see platformio.ini)
 // Set WIFI_PASSWORDS as environment variables on your dev-system following the pattern: WIFI_PASSWORDS="ssid1;password1|ssid2;password2"
 WifiLib wifiLib(WIFI_PASSWORDS);
+WiFiFastConnect wifiFast(WIFI_PASSWORDS);
+DeviceTelemetry telemetry;
 
 WiFiClient wifiClient;
 WiFiUDP ntpUDP;
@@ -61,7 +70,8 @@ const String mqtt_broker = "mosquitto.intern";
 const int mqtt_port = 1883;
 static String mqtt_OTAtopic = "OTAUpdate/MixerController";
 static String mqtt_ConfigTopic = "config/MixerController/";       // + chipID
-static String mqtt_CommandsTopic = "commands/MixerController/#";
+static String mqtt_MixerCommandTopic = "commands/MixerController/+/+";
+static String mqtt_SetpointTopic = "commands/MixerController/+/+/setpoint";
 
 // ---------------------------------------------------------------------------
 // Runtime configuration (updated via retained MQTT config message)
@@ -69,18 +79,26 @@ static String mqtt_CommandsTopic = "commands/MixerController/#";
 static String location = "M1";
 static uint32_t travelTimeSeconds = 140;        // actuator full travel time
 static uint32_t temperatureIntervalSeconds = 60;
-static std::map<String, String> sensorNames;    // ROM address -> display name
+static std::map<uint64_t, String> sensorNames;  // ROM id -> display name
+// Outlier filter for all flow/return temperatures, in hundredths of °C:
+// -20..110 °C, 10 K/min, stuck after 6 h without any change, failed after 3 bad cycles
+static SensorFilterConfig temperatureFilterConfig = {-2000, 11000, 1000, 6UL * 3600UL * 1000UL, 3};
 
 // ---------------------------------------------------------------------------
 // Mixer state machine
 //
 // Two kinds of moves, both without position feedback:
-// - Full travels ("open"/"close"): run 115% of the configured travel time,
-//   so each move is also a reference run against the actuator's end stop.
+// - Full travels ("open"/"close"): run into the actuator's end stop, so each
+//   move is also a reference run. Without a confident position estimate they
+//   run 115% of the configured travel time, otherwise only the remaining way
+//   plus a margin.
 // - Pulses ("open:N"/"close:N"): run exactly N seconds towards one end,
 //   used by the RulesEngine step controller to hold intermediate positions.
-//   The position is then only an estimate (seconds since the last reference
-//   run); a full travel restores certainty.
+//   The position is then an estimate (MixerPositionEstimator: travel time
+//   since the last reference run, corrected by the supply, flow and return
+//   temperatures). A pulse that reaches the end stop anyway becomes a
+//   reference run; when the estimate gets too uncertain the mixer references
+//   against the nearer end stop on its own and returns to its position.
 // ---------------------------------------------------------------------------
 enum class MixerPosition { Unknown, Open, Closed, Partial };
 
@@ -132,14 +150,41 @@ class MixerActuator {
   MixerPosition getTarget() const { return target; }
   MixerPosition getPosition() const { return current; }
   bool isMoving() const { return state == State::Running; }
-  bool hasPositionEstimate() const { return estimateValid; }
+  bool hasPositionEstimate() const { return estimator.valid(); }
   int getOpenPercent() const {
-    if (!estimateValid || travelTimeSeconds == 0) return -1;
-    float fraction = 1.0f - estimatedSeconds / (float)travelTimeSeconds;
-    return (int)(fraction * 100.0f + 0.5f);
+    if (!estimator.valid()) return -1;
+    return (int)(estimator.openFraction() * 100.0f + 0.5f);
+  }
+  const MixerPositionEstimator& positionEstimator() const { return estimator; }
+
+  // The local controller may move the mixer: idle, position known and the
+  // supervisor's base command is open (close, e.g. during warm water, has priority)
+  bool readyForControl() const {
+    return state == State::Idle && !pulsePending && estimator.valid() &&
+           target == MixerPosition::Open && (holding || current == target);
+  }
+
+  // Temperature feedback: settled supply, return and mixed flow temperature.
+  // Returns true if the estimate moved by at least one percent (worth publishing).
+  bool correctPosition(float supply, float returnTemperature, float flow) {
+    if (state != State::Idle || pulsePending || (!holding && current != target) ||
+        millis() - lastMoveEndMs < SETTLE_MS) {
+      return false;
+    }
+    int before = getOpenPercent();
+    estimator.correct(supply, returnTemperature, flow);
+    return getOpenPercent() != before;
   }
 
   const char* name;
+  // Sensor names for the temperature feedback ("" = none) and their index in temperatureSensors (-1 = not found)
+  String supplySensor, flowSensor, returnSensor;
+  int supplyIndex = -1, flowIndex = -1, returnIndex = -1;
+  // Local flow temperature control, setpoint and limits from the RulesEngine
+  MixerPiController controller;
+  unsigned long lastControlMs = 0;
+  // Built with the location by buildTopics()
+  MQTTTopic stateTopic, controlTopic;
 
   // Returns true whenever the externally visible state changed (for publishing)
   bool update() {
@@ -148,27 +193,37 @@ class MixerActuator {
       case State::Idle:
         if (!holding && current != target) {
           pulsePending = false;  // full travel supersedes a queued pulse
-          setDirection(target == MixerPosition::Closed);
+          startMove(MoveKind::Full, target == MixerPosition::Closed, travelToEndStopMs(target == MixerPosition::Closed), now);
           movingTo = target;
-          targetAtMoveStart = target;
-          moveMs = 0;  // 0 = full travel
-          state = State::PrepareDirection;
-          stateMs = now;
         } else if (pulsePending) {
           pulsePending = false;
-          uint32_t effective = clampPulseToRemainingTravel(pulseTowardsClose, pulseSeconds);
-          if (effective == 0) {
+          MixerPosition endStop = pulseTowardsClose ? MixerPosition::Closed : MixerPosition::Open;
+          if (current == endStop) {
             Serial.println(String(name) + ": pulse ignored, already at end stop");
             return false;
           }
-          setDirection(pulseTowardsClose);
-          movingTo = MixerPosition::Partial;
-          targetAtMoveStart = target;
-          holding = false;  // moving, not holding — restored when the pulse completes
-          moveTowardsClose = pulseTowardsClose;
-          moveMs = effective * 1000UL;
-          state = State::PrepareDirection;
-          stateMs = now;
+          holding = false;  // moving, not holding — restored when the move completes
+          float remaining = (pulseTowardsClose ? estimator.openFraction() : 1.0f - estimator.openFraction()) * travelTimeSeconds;
+          if (estimator.valid() && (float)pulseSeconds >= remaining) {
+            // The pulse reaches the end stop anyway: run into it and get a reference for free
+            startMove(MoveKind::EndStop, pulseTowardsClose, travelToEndStopMs(pulseTowardsClose), now);
+            movingTo = endStop;
+            returnSeconds = 0;
+          } else {
+            startMove(MoveKind::Pulse, pulseTowardsClose, pulseSeconds * 1000UL, now);
+            movingTo = MixerPosition::Partial;
+          }
+        } else if (holding && estimator.valid() && estimator.needsReference()) {
+          // The estimate is too uncertain to hold a position: reference against the
+          // nearer end stop and return to the estimated position afterwards
+          bool towardsClose = estimator.openFraction() < 0.5f;
+          float distance = towardsClose ? estimator.openFraction() : 1.0f - estimator.openFraction();
+          returnSeconds = (uint32_t)(distance * travelTimeSeconds + 0.5f);
+          Serial.println(String(name) + ": position uncertain (+-" + String((int)(estimator.stdDev() * 100.0f)) +
+                         "%), re-referencing");
+          holding = false;
+          startMove(MoveKind::EndStop, towardsClose, fullTravelMs(), now);
+          movingTo = towardsClose ? MixerPosition::Closed : MixerPosition::Open;
         }
         return false;
 
@@ -178,9 +233,9 @@ class MixerActuator {
           relayOn(runPin);
           state = State::Running;
           stateMs = now;
-          Serial.println(String(name) + (moveMs == 0
-              ? ": driving to " + String(positionToString(movingTo))
-              : ": pulse " + String(moveMs / 1000UL) + "s towards " + (moveTowardsClose ? "close" : "open")));
+          Serial.println(String(name) + (moveKind == MoveKind::Pulse
+              ? ": pulse " + String(moveMs / 1000UL) + "s towards " + (moveTowardsClose ? "close" : "open")
+              : ": driving to " + String(positionToString(movingTo)) + " (" + String(moveMs / 1000UL) + "s)"));
           return true;
         }
         return false;
@@ -189,32 +244,32 @@ class MixerActuator {
         if (target != targetAtMoveStart) {
           // A new command arrived mid-move: stop and let Idle restart cleanly
           relayOff(runPin);
-          current = MixerPosition::Unknown;
-          estimateValid = false;
-          state = State::Cooldown;
-          stateMs = now;
+          estimator.predict(moveTowardsClose, (now - stateMs) / 1000.0f, (float)travelTimeSeconds);
+          current = estimator.valid() ? MixerPosition::Partial : MixerPosition::Unknown;
+          returnSeconds = 0;
+          finishMove(now);
           return true;
         }
-        if (now - stateMs >= (moveMs != 0 ? moveMs : fullTravelMs())) {
+        if (now - stateMs >= moveMs) {
           relayOff(runPin);
-          if (moveMs == 0) {
-            current = movingTo;
-            estimatedSeconds = (movingTo == MixerPosition::Closed) ? (float)travelTimeSeconds : 0.0f;
-            estimateValid = true;
-          } else {
-            float deltaSeconds = (float)(moveMs / 1000UL);
-            estimatedSeconds += moveTowardsClose ? deltaSeconds : -deltaSeconds;
-            if (estimatedSeconds < 0.0f) estimatedSeconds = 0.0f;
-            if (estimatedSeconds > (float)travelTimeSeconds) estimatedSeconds = (float)travelTimeSeconds;
+          if (moveKind == MoveKind::Pulse) {
+            estimator.predict(moveTowardsClose, moveMs / 1000.0f, (float)travelTimeSeconds);
             current = MixerPosition::Partial;
             // Hold here until the next command — without this the Idle state
             // would immediately drive back to the retained full-travel target
             holding = true;
+          } else {
+            current = movingTo;
+            estimator.reference(movingTo == MixerPosition::Closed);
+            if (moveKind == MoveKind::EndStop) {
+              holding = true;
+              if (returnSeconds > 0) requestPulse(!moveTowardsClose, returnSeconds);
+              returnSeconds = 0;
+            }
           }
-          state = State::Cooldown;
-          stateMs = now;
+          finishMove(now);
           Serial.println(String(name) + ": reached " + positionToString(current) +
-                         (estimateValid ? " (~" + String(getOpenPercent()) + "% open)" : ""));
+                         (estimator.valid() ? " (~" + String(getOpenPercent()) + "% open)" : ""));
           return true;
         }
         return false;
@@ -233,6 +288,12 @@ class MixerActuator {
 
  private:
   enum class State { Idle, PrepareDirection, Running, Cooldown };
+  // Full: commanded travel to target; Pulse: relative move;
+  // EndStop: into an end stop for a reference without changing target
+  enum class MoveKind { Full, Pulse, EndStop };
+
+  // Temperatures need this long after a move before they show the new position
+  static const unsigned long SETTLE_MS = 180000;
 
   int directionPin;
   int runPin;
@@ -243,24 +304,41 @@ class MixerActuator {
   bool holding = false;          // completed pulse: stay put despite current != target
   State state = State::Idle;
   unsigned long stateMs = 0;
-  unsigned long moveMs = 0;      // duration of the current move, 0 = full travel
-  bool moveTowardsClose = false; // direction of the current pulse
+  unsigned long lastMoveEndMs = 0;
+  MoveKind moveKind = MoveKind::Full;
+  unsigned long moveMs = 0;      // duration of the current move
+  bool moveTowardsClose = false; // direction of the current move
   bool pulsePending = false;
   bool pulseTowardsClose = false;
   uint32_t pulseSeconds = 0;
-  // Position estimate in seconds from the open end stop (0 = open,
-  // travelTimeSeconds = closed); valid only after a completed full travel
-  float estimatedSeconds = 0.0f;
-  bool estimateValid = false;
+  uint32_t returnSeconds = 0;    // pulse back to the old position after a re-reference, 0 = none
+  MixerPositionEstimator estimator;
 
   static unsigned long fullTravelMs() { return (unsigned long)travelTimeSeconds * 1000UL * 115UL / 100UL; }
 
-  uint32_t clampPulseToRemainingTravel(bool towardsClose, uint32_t seconds) const {
-    if (!estimateValid) return seconds;
-    float remaining = towardsClose ? ((float)travelTimeSeconds - estimatedSeconds) : estimatedSeconds;
-    if (remaining <= 0.0f) return 0;
-    if ((float)seconds > remaining) return (uint32_t)(remaining + 0.5f);
-    return seconds;
+  // With a confident estimate only the remaining way (plus 3 sigma and 5% of the travel time)
+  // has to be driven to reach the end stop; otherwise 115% of the full travel time
+  unsigned long travelToEndStopMs(bool towardsClose) const {
+    if (!estimator.valid() || estimator.needsReference()) return fullTravelMs();
+    float seconds = estimator.secondsToEndStop(towardsClose, (float)travelTimeSeconds) + 0.05f * travelTimeSeconds;
+    unsigned long ms = (unsigned long)(seconds * 1000.0f);
+    return ms < fullTravelMs() ? ms : fullTravelMs();
+  }
+
+  void startMove(MoveKind kind, bool towardsClose, unsigned long durationMs, unsigned long now) {
+    setDirection(towardsClose);
+    moveKind = kind;
+    moveTowardsClose = towardsClose;
+    moveMs = durationMs;
+    targetAtMoveStart = target;
+    state = State::PrepareDirection;
+    stateMs = now;
+  }
+
+  void finishMove(unsigned long now) {
+    state = State::Cooldown;
+    stateMs = now;
+    lastMoveEndMs = now;
   }
 
   void setDirection(bool towardsClose) {
@@ -289,26 +367,13 @@ const int mixerCount = sizeof(mixers) / sizeof(mixers[0]);
 OneWire oneWireBus1(ONEWIRE_BUS1_PIN);
 OneWire oneWireBus2(ONEWIRE_BUS2_PIN);
 OneWire oneWireBus3(ONEWIRE_BUS3_PIN);
-DallasTemperature temperatureBuses[ONEWIRE_BUS_COUNT] = {
-    DallasTemperature(&oneWireBus1),
-    DallasTemperature(&oneWireBus2),
-    DallasTemperature(&oneWireBus3),
-};
-static bool temperatureConversionRequested = false;
-static unsigned long temperatureRequestMs = 0;
+// Device list from a one-time search, conversions on all buses in parallel
+OneWireScheduler temperatureSensors;
+// Topic per sensor (same index as in temperatureSensors), rebuilt after discovery and config changes
+static MQTTTopic temperatureTopics[OneWireScheduler::MaxSensors];
+static SensorFilter temperatureFilters[OneWireScheduler::MaxSensors];
 static unsigned long lastTemperatureCycleMs = 0;
 
-String formatSensorAddress(const DeviceAddress& address) {
-  String result = "";
-  for (uint8_t i = 0; i < 8; i++) {
-    if (address[i] < 0x10) result += "0";
-    result += String(address[i], HEX);
-    if (i < 7) result += "-";
-  }
-  result.toUpperCase();
-  return result;
-}
-
 String getCurrentTimestamp() {
   timeClient.update();
   unsigned long epochTime = timeClient.getEpochTime();
@@ -330,13 +395,17 @@ void publishMixerState(MixerActuator& mixer) {
   doc["target"] = positionToString(mixer.getTarget());
   doc["moving"] = mixer.isMoving();
   if (mixer.hasPositionEstimate()) {
+    const MixerPositionEstimator& estimator = mixer.positionEstimator();
     doc["openPercent"] = mixer.getOpenPercent();
+    doc["openPercentStdDev"] = (int)(estimator.stdDev() * 100.0f + 0.5f);
+    if (estimator.lastMeasurement >= 0.0f) {
+      doc["measuredOpenPercent"] = (int)(estimator.lastMeasurement * 100.0f + 0.5f);
+    }
   }
   doc["timestamp"] = getCurrentTimestamp();
-  String jsonOutput;
-  serializeJson(doc, jsonOutput);
-  String topic = "daten/Heizung/" + location + "/Mischersteuerung/" + mixer.name;
-  mqttClient->publish(topic.c_str(), jsonOutput.c_str(), true, 1);
+  char jsonOutput[256];
+  size_t length = serializeJson(doc, jsonOutput, sizeof(jsonOutput));
+  mqttClient->publish(mixer.stateTopic, jsonOutput, length, true, 1);
 }
 
 void publishDiscoveredSensors() {
@@ -347,16 +416,18 @@ void publishDiscoveredSensors() {
     JsonObject bus = buses.add<JsonObject>();
     bus["bus"] = b + 1;
     JsonArray sensors = bus["sensors"].to<JsonArray>();
-    int count = temperatureBuses[b].getDeviceCount();
-    for (int i = 0; i < count; i++) {
-      DeviceAddress address;
-      if (temperatureBuses[b].getAddress(address, i)) {
-        String addressString = formatSensorAddress(address);
-        JsonObject sensor = sensors.add<JsonObject>();
-        sensor["address"] = addressString;
-        auto it = sensorNames.find(addressString);
-        sensor["name"] = (it != sensorNames.end()) ? it->second : "";
-      }
+    for (uint8_t i = 0; i < temperatureSensors.sensorCount(); i++) {
+      const OneWireScheduler::Sensor& found = temperatureSensors.sensor(i);
+      if (found.bus != b) continue;
+      JsonObject sensor = sensors.add<JsonObject>();
+      sensor["address"] = OneWireScheduler::formatId(found.rom);
+      auto it = sensorNames.find(found.rom);
+      sensor["name"] = (it != sensorNames.end()) ? it->second : "";
+      sensor["resolution"] = found.resolution;
+      sensor["readErrors"] = found.readErrors;
+      const SensorFilter& filter = temperatureFilters[i];
+      sensor["health"] = SensorFilter::healthName(filter.health());
+      sensor["rejected"] = filter.rejected;
     }
   }
   String jsonOutput;
@@ -364,24 +435,172 @@ void publishDiscoveredSensors() {
   mqttClient->publish(("meta/MixerController/" + location + "/sensors").c_str(), jsonOutput.c_str(), true, 1);
 }
 
+int sensorIndexByName(const String& name) {
+  if (name == "") return -1;
+  for (uint8_t i = 0; i < temperatureSensors.sensorCount(); i++) {
+    auto it = sensorNames.find(temperatureSensors.sensor(i).rom);
+    if (it != sensorNames.end() && it->second == name) return i;
+  }
+  Serial.println("Sensor '" + name + "' for the mixer position feedback not found");
+  return -1;
+}
+
+void resolveMixerSensors() {
+  for (int i = 0; i < mixerCount; i++) {
+    mixers[i].supplyIndex = sensorIndexByName(mixers[i].supplySensor);
+    mixers[i].flowIndex = sensorIndexByName(mixers[i].flowSensor);
+    mixers[i].returnIndex = sensorIndexByName(mixers[i].returnSensor);
+  }
+}
+
+// Topics change only with the configuration, so they are formatted once here
+// instead of on every publish
+void buildTopics() {
+  for (uint8_t i = 0; i < temperatureSensors.sensorCount(); i++) {
+    uint64_t rom = temperatureSensors.sensor(i).rom;
+    auto it = sensorNames.find(rom);
+    String sensorDisplayName = (it != sensorNames.end()) ? it->second : OneWireScheduler::formatId(rom);
+    temperatureTopics[i].set("daten/temperatur/%s/%s", location.c_str(), sensorDisplayName.c_str());
+  }
+  for (int i = 0; i < mixerCount; i++) {
+    mixers[i].stateTopic.set("daten/Heizung/%s/Mischersteuerung/%s", location.c_str(), mixers[i].name);
+    mixers[i].controlTopic.set("meta/MixerController/%s/%s/control", location.c_str(), mixers[i].name);
+  }
+  resolveMixerSensors();
+}
+
+// Filtered temperature of a sensor, false if there is none (not found, no accepted value, not healthy).
+// A stuck sensor still counts: its value is plausible, only unchanged for a long time.
+bool filteredTemperature(int index, float& celsius) {
+  if (index < 0) return false;
+  SensorHealth health = temperatureFilters[index].health();
+  if (health != SensorHealth::Ok && health != SensorHealth::Stuck) return false;
+  celsius = SensorFilter::fromFixed(temperatureFilters[index].value());
+  return true;
+}
+
+// Feeds the settled temperatures of each mixer into its position estimate
+void correctMixerPositions() {
+  for (int i = 0; i < mixerCount; i++) {
+    float supply, flow, returnTemperature;
+    if (!filteredTemperature(mixers[i].supplyIndex, supply) ||
+        !filteredTemperature(mixers[i].flowIndex, flow) ||
+        !filteredTemperature(mixers[i].returnIndex, returnTemperature)) {
+      continue;
+    }
+    if (mixers[i].correctPosition(supply, returnTemperature, flow)) {
+      publishMixerState(mixers[i]);
+    }
+  }
+}
+
+void publishControlState(MixerActuator& mixer, const char* status, float flow) {
+  if (!mqttClient) return;
+  const MixerPiController& controller = mixer.controller;
+  JsonDocument doc;
+  doc["status"] = status;
+  doc["setpoint"] = controller.setpoint;
+  if (!isnan(flow)) doc["flow"] = serialized(String(flow, 2));
+  doc["error"] = serialized(String(controller.error, 2));
+  doc["proportional"] = serialized(String(controller.proportional, 2));
+  doc["integral"] = serialized(String(controller.integral, 2));
+  doc["residualSeconds"] = serialized(String(controller.residualSeconds, 2));
+  doc["pulse"] = controller.lastPulse;
+  doc["saturated"] = controller.saturated;
+  doc["openPercent"] = mixer.getOpenPercent();
+  char jsonOutput[384];
+  size_t length = serializeJson(doc, jsonOutput, sizeof(jsonOutput));
+  mqttClient->publish(mixer.controlTopic, jsonOutput, length, false, 0);
+}
+
+// One step of the local PI controllers, at their configured sample rate.
+// Keeps running with the last setpoint while the network is down.
+void runMixerControllers() {
+  unsigned long now = millis();
+  for (int i = 0; i < mixerCount; i++) {
+    MixerActuator& mixer = mixers[i];
+    MixerPiController& controller = mixer.controller;
+    if (!controller.enabled) continue;
+    unsigned long sampleMs = (unsigned long)(controller.config.sampleSeconds * 1000.0f);
+    if (now - mixer.lastControlMs < sampleMs) continue;
+    mixer.lastControlMs = now;
+
+    float flow;
+    if (!filteredTemperature(mixer.flowIndex, flow)) {
+      controller.reset();
+      publishControlState(mixer, "no_sensor", NAN);
+      continue;
+    }
+    if (!mixer.readyForControl()) {
+      // Restart bumpless once the mixer is back
+      controller.reset();
+      publishControlState(mixer, "paused", flow);
+      continue;
+    }
+    int32_t pulse = controller.update(flow, mixer.positionEstimator().openFraction(),
+                                      (float)travelTimeSeconds, controller.config.sampleSeconds);
+    if (pulse != 0) {
+      mixer.requestPulse(pulse < 0, (uint32_t)abs(pulse));
+    }
+    publishControlState(mixer, "active", flow);
+  }
+}
+
+// commands/MixerController/{location}/{mixerName}/setpoint (retained JSON from the RulesEngine):
+// {"Enabled": true, "Setpoint": 15.0, "MinOpenPercent": 0, "MaxOpenPercent": 100}
+void applySetpoint(MixerActuator& mixer, const String& payload) {
+  JsonDocument doc;
+  if (deserializeJson(doc, payload)) {
+    Serial.println(String(mixer.name) + ": invalid setpoint message '" + payload + "'");
+    return;
+  }
+  MixerPiController& controller = mixer.controller;
+  bool enabled = doc["Enabled"] | false;
+  if (enabled && !doc["Setpoint"].is<float>()) {
+    Serial.println(String(mixer.name) + ": setpoint missing, local control stays off");
+    enabled = false;
+  }
+  if (enabled && !controller.enabled) {
+    controller.reset();
+    mixer.lastControlMs = millis() - (unsigned long)(controller.config.sampleSeconds * 1000.0f);
+  }
+  controller.enabled = enabled;
+  controller.setpoint = doc["Setpoint"] | controller.setpoint;
+  controller.minOpen = (doc["MinOpenPercent"] | 0.0f) / 100.0f;
+  controller.maxOpen = (doc["MaxOpenPercent"] | 100.0f) / 100.0f;
+  Serial.println(String(mixer.name) + ": local control " + (enabled ? "on, setpoint " + String(controller.setpoint, 1) : "off"));
+}
+
 void publishTemperatures() {
-  for (int b = 0; b < ONEWIRE_BUS_COUNT; b++) {
-    int count = temperatureBuses[b].getDeviceCount();
-    for (int i = 0; i < count; i++) {
-      DeviceAddress address;
-      if (!temperatureBuses[b].getAddress(address, i)) continue;
-      float celsius = temperatureBuses[b].getTempC(address);
-      // Skip disconnected sensors and the 85.0 power-on default value
-      if (celsius == DEVICE_DISCONNECTED_C || celsius == 85.0f) continue;
-      String addressString = formatSensorAddress(address);
-      auto it = sensorNames.find(addressString);
-      String sensorDisplayName = (it != sensorNames.end()) ? it->second : addressString;
-      char tempString[8];
-      dtostrf(celsius, 1, 2, tempString);
-      String topic = "daten/temperatur/" + location + "/" + sensorDisplayName;
-      mqttClient->publish(topic.c_str(), String(tempString), true, 2);
+  bool healthChanged = false;
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < temperatureSensors.sensorCount(); i++) {
+    const OneWireScheduler::Sensor& sensor = temperatureSensors.sensor(i);
+    SensorFilter& filter = temperatureFilters[i];
+    SensorHealth previousHealth = filter.health();
+    // Failed reads (CRC error, disconnected, 85.0 power-on value) and rejected
+    // outliers are not published, so the RulesEngine never sees a spike
+    bool accepted = false;
+    if (sensor.valid) {
+      accepted = filter.add(SensorFilter::toFixed(sensor.celsius), now, temperatureFilterConfig);
+    } else {
+      filter.addError(temperatureFilterConfig);
     }
+    if (filter.health() != previousHealth) {
+      Serial.println("Sensor " + String(temperatureTopics[i].c_str()) + ": " + SensorFilter::healthName(previousHealth) +
+                     " -> " + SensorFilter::healthName(filter.health()));
+      // Warmup -> Ok is the normal start, not worth a meta update
+      healthChanged = healthChanged || previousHealth != SensorHealth::Warmup;
+    }
+    if (!accepted) continue;
+    char tempString[8];
+    dtostrf(SensorFilter::fromFixed(filter.value()), 1, 2, tempString);
+    mqttClient->publish(temperatureTopics[i], tempString, true, 2);
+  }
+  if (healthChanged) {
+    publishDiscoveredSensors();
   }
+  correctMixerPositions();
 }
 
 // ---------------------------------------------------------------------------
@@ -399,17 +618,54 @@ bool updateConfiguration(const String& jsonConfig) {
   if (doc["TravelTimeSeconds"].is<uint32_t>()) travelTimeSeconds = doc["TravelTimeSeconds"].as<uint32_t>();
   if (doc["TemperatureIntervalSeconds"].is<uint32_t>()) temperatureIntervalSeconds = doc["TemperatureIntervalSeconds"].as<uint32_t>();
 
+  if (doc["FilterMaxRatePerMinute"].is<float>()) {
+    temperatureFilterConfig.maxRatePerMinute = SensorFilter::toFixed(doc["FilterMaxRatePerMinute"].as<float>());
+  }
+  if (doc["FilterStuckAfterMinutes"].is<uint32_t>()) {
+    temperatureFilterConfig.stuckAfterMs = doc["FilterStuckAfterMinutes"].as<uint32_t>() * 60000UL;
+  }
+
   if (doc["Sensors"].is<JsonArray>()) {
     sensorNames.clear();
     for (JsonObject sensor : doc["Sensors"].as<JsonArray>()) {
-      if (sensor["Address"].is<String>() && sensor["Name"].is<String>()) {
-        String address = sensor["Address"].as<String>();
-        address.toUpperCase();
-        sensorNames[address] = sensor["Name"].as<String>();
+      uint64_t rom;
+      if (!sensor["Address"].is<const char*>() || !sensor["Name"].is<String>()) continue;
+      if (!OneWireScheduler::parseId(sensor["Address"].as<const char*>(), rom)) {
+        Serial.println("Invalid sensor address '" + sensor["Address"].as<String>() + "'");
+        continue;
+      }
+      sensorNames[rom] = sensor["Name"].as<String>();
+      if (sensor["Resolution"].is<uint8_t>() &&
+          !temperatureSensors.setResolution(rom, sensor["Resolution"].as<uint8_t>())) {
+        Serial.println("Invalid resolution for sensor " + sensor["Address"].as<String>() + ", use 9-12 bit");
+      }
+    }
+  }
+
+  if (doc["Mixers"].is<JsonArray>()) {
+    for (JsonObject mixerConfig : doc["Mixers"].as<JsonArray>()) {
+      for (int i = 0; i < mixerCount; i++) {
+        if (mixerConfig["Name"].as<String>() != mixers[i].name) continue;
+        mixers[i].supplySensor = mixerConfig["Supply"] | "";
+        mixers[i].flowSensor = mixerConfig["Flow"] | "";
+        mixers[i].returnSensor = mixerConfig["Return"] | "";
+        JsonObject control = mixerConfig["Control"];
+        if (!control.isNull()) {
+          MixerPiConfig& pi = mixers[i].controller.config;
+          pi.kpPercentPerKelvin = control["Kp"] | pi.kpPercentPerKelvin;
+          pi.tiSeconds = control["TiSeconds"] | pi.tiSeconds;
+          pi.deadbandKelvin = control["DeadbandKelvin"] | pi.deadbandKelvin;
+          pi.sampleSeconds = control["SampleSeconds"] | pi.sampleSeconds;
+          pi.minPulseSeconds = control["MinPulseSeconds"] | pi.minPulseSeconds;
+          pi.maxPulseSeconds = control["MaxPulseSeconds"] | pi.maxPulseSeconds;
+          pi.openIsColder = control["OpenIsColder"] | pi.openIsColder;
+          if (pi.sampleSeconds < 10.0f) pi.sampleSeconds = 10.0f;
+        }
       }
     }
   }
 
+  buildTopics();
   Serial.println("Configuration updated: location=" + location +
                  ", travelTime=" + String(travelTimeSeconds) + "s" +
                  ", sensors=" + String(sensorNames.size()));
@@ -417,87 +673,97 @@ bool updateConfiguration(const String& jsonConfig) {
 }
 
 // ---------------------------------------------------------------------------
-// MQTT callback
+// MQTT topic handlers
 // ---------------------------------------------------------------------------
-void mqttCallback(String& topic, String& payload) {
-  if (topic.startsWith("commands/MixerController/")) {
-    // commands/MixerController/{location}/{mixerName} from the RulesEngine:
-    // - "open" | "close" (retained): full travel to the end stop
-    // - "open:N" | "close:N" (not retained): pulse N seconds towards that end,
-    //   used by the step controller to hold intermediate positions
-    String mixerName = topic.substring(topic.lastIndexOf('/') + 1);
-    mixerName.trim();  // tolerate stray whitespace in manually published topics
-    String command = payload;
-    command.trim();
-    command.toLowerCase();
-    int separator = command.indexOf(':');
-    String action = separator >= 0 ? command.substring(0, separator) : command;
-    long seconds = separator >= 0 ? command.substring(separator + 1).toInt() : 0;
-    for (int i = 0; i < mixerCount; i++) {
-      if (mixerName == mixers[i].name) {
-        if (separator < 0 && action == "open") mixers[i].setTarget(MixerPosition::Open);
-        else if (separator < 0 && action == "close") mixers[i].setTarget(MixerPosition::Closed);
-        else if (separator >= 0 && (action == "open" || action == "close") &&
-                 seconds > 0 && seconds <= (long)travelTimeSeconds) {
-          mixers[i].requestPulse(action == "close", (uint32_t)seconds);
-        } else {
-          Serial.println("Invalid mixer command '" + command + "'. Use open|close|open:N|close:N.");
-        }
-        return;
-      }
-    }
-    Serial.println("Unknown mixer '" + mixerName + "'");
-    return;
+// Level of a topic counted from the end (0 = last level)
+String topicLevelFromEnd(const char* topic, int index) {
+  String path(topic);
+  for (int i = 0; i < index; i++) {
+    path = path.substring(0, path.lastIndexOf('/'));
   }
+  String level = path.substring(path.lastIndexOf('/') + 1);
+  level.trim();  // tolerate stray whitespace in manually published topics
+  return level;
+}
 
-  Serial.println("Message arrived on topic: " + topic + ". Message: " + payload);
+MixerActuator* findMixer(const String& mixerName) {
+  for (int i = 0; i < mixerCount; i++) {
+    if (mixerName == mixers[i].name) return &mixers[i];
+  }
+  Serial.println("Unknown mixer '" + mixerName + "'");
+  return nullptr;
+}
 
-  if (topic == mqtt_ConfigTopic) {
-    if (updateConfiguration(payload)) {
-      publishDiscoveredSensors();
-    }
-    return;
+// commands/MixerController/{location}/{mixerName}/setpoint
+void onSetpoint(const char* topic, const MQTTPayload& payload) {
+  MixerActuator* mixer = findMixer(topicLevelFromEnd(topic, 1));
+  if (mixer) applySetpoint(*mixer, String(payload.data, payload.length));
+}
+
+// commands/MixerController/{location}/{mixerName} from the RulesEngine:
+// - "open" | "close" (retained): full travel to the end stop
+// - "open:N" | "close:N" (not retained): pulse N seconds towards that end,
+//   used by the step controller to hold intermediate positions
+void onMixerCommand(const char* topic, const MQTTPayload& payload) {
+  MixerActuator* mixer = findMixer(topicLevelFromEnd(topic, 0));
+  if (!mixer) return;
+  String command(payload.data, payload.length);
+  command.trim();
+  command.toLowerCase();
+  int separator = command.indexOf(':');
+  String action = separator >= 0 ? command.substring(0, separator) : command;
+  long seconds = separator >= 0 ? command.substring(separator + 1).toInt() : 0;
+  if (separator < 0 && action == "open") mixer->setTarget(MixerPosition::Open);
+  else if (separator < 0 && action == "close") mixer->setTarget(MixerPosition::Closed);
+  else if (separator >= 0 && mixer->controller.enabled)
+    Serial.println(String(mixer->name) + ": pulse '" + command + "' ignored, local control is active");
+  else if (separator >= 0 && (action == "open" || action == "close") &&
+           seconds > 0 && seconds <= (long)travelTimeSeconds) {
+    mixer->requestPulse(action == "close", (uint32_t)seconds);
+  } else {
+    Serial.println("Invalid mixer command '" + command + "'. Use open|close|open:N|close:N.");
   }
+}
 
-  if (topic == mqtt_OTAtopic) {
-    if (otaInProgress || !otaEnable) {
-      if (otaInProgress) Serial.println("OTA in progress, ignoring message");
-      if (!otaEnable) Serial.println("OTA disabled, ignoring message");
-      return;
-    }
-    String updateVersion = AzureOTAUpdater::ExtractVersionFromUrl(payload);
-    Serial.println("Current firmware version is " + String(version));
-    Serial.println("New firmware version is " + updateVersion);
-    if (strcmp(version, updateVersion.c_str())) {
-      const char* firmwareUrl = payload.c_str();
-      Serial.println("New firmware available, starting OTA Update from " + String(firmwareUrl));
-      otaInProgress = true;
-      if (AzureOTAUpdater::UpdateFirmwareFromUrl(firmwareUrl)) {
-        Serial.println("OTA Update successfully initiated, waiting to be finished");
-      }
-    } else {
-      Serial.println("Firmware is up to date");
-    }
-    return;
+void onConfig(const char* topic, const MQTTPayload& payload) {
+  String config(payload.data, payload.length);
+  Serial.println("Configuration received: " + config);
+  if (updateConfiguration(config)) {
+    publishDiscoveredSensors();
   }
+}
 
-  Serial.println("Unknown topic, ignoring message");
+void onOTAUpdate(const char* topic, const MQTTPayload& payload) {
+  if (otaInProgress || !otaEnable) {
+    if (otaInProgress) Serial.println("OTA in progress, ignoring message");
+    if (!otaEnable) Serial.println("OTA disabled, ignoring message");
+    return;
+  }
+  String firmwareUrl(payload.data, payload.length);
+  String updateVersion = AzureOTAUpdater::ExtractVersionFromUrl(firmwareUrl);
+  Serial.println("Current firmware version is " + String(version));
+  Serial.println("New firmware version is " + updateVersion);
+  if (strcmp(version, updateVersion.c_str())) {
+    Serial.println("New firmware available, starting OTA Update from " + firmwareUrl);
+    otaInProgress = true;
+    if (AzureOTAUpdater::UpdateFirmwareFromUrl(firmwareUrl.c_str())) {
+      Serial.println("OTA Update successfully initiated, waiting to be finished");
+    }
+  } else {
+    Serial.println("Firmware is up to date");
+  }
 }
 
 void connectToMQTT(bool cleanSession) {
-  Serial.print("WiFi Status: ");
-  Serial.println(WiFi.status() == WL_CONNECTED ? "Connected" : "Disconnected");
-
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi not connected, attempting to reconnect...");
-    wifiLib.connect();
-  }
-  mqttClient->connect(cleanSession);
-  mqttClient->subscribe({mqtt_ConfigTopic, mqtt_OTAtopic, mqtt_CommandsTopic});
-  Serial.println("MQTT Client is connected");
+  // Each handler subscribes its topic; the client replays them after every reconnect by itself
+  mqttClient->on(mqtt_ConfigTopic, onConfig);
+  mqttClient->on(mqtt_OTAtopic, onOTAUpdate);
+  mqttClient->on(mqtt_SetpointTopic, onSetpoint);
+  mqttClient->on(mqtt_MixerCommandTopic, onMixerCommand);
+  Serial.println(mqttClient->connect(cleanSession) ? "MQTT Client is connected" : "MQTT Client not connected yet");
   Serial.println("Config Topic: " + mqtt_ConfigTopic);
   Serial.println("OTA Topic: " + mqtt_OTAtopic);
-  Serial.println("Commands Topic: " + mqtt_CommandsTopic);
+  Serial.println("Commands Topics: " + mqtt_MixerCommandTopic + ", " + mqtt_SetpointTopic);
 }
 
 void setup() {
@@ -522,15 +788,21 @@ void setup() {
   Serial.println(chipID);
   mqtt_ConfigTopic += chipID;
 
-  for (int b = 0; b < ONEWIRE_BUS_COUNT; b++) {
-    temperatureBuses[b].begin();
-    temperatureBuses[b].setWaitForConversion(false);
-    Serial.println("OneWire bus " + String(b + 1) + ": " + String(temperatureBuses[b].getDeviceCount()) + " sensors found");
+  temperatureSensors.addBus(oneWireBus1);
+  temperatureSensors.addBus(oneWireBus2);
+  temperatureSensors.addBus(oneWireBus3);
+  unsigned long searchStartMs = millis();
+  uint8_t sensorCount = temperatureSensors.discover();
+  buildTopics();
+  for (SensorFilter& filter : temperatureFilters) {
+    filter.reset();
   }
+  Serial.println("OneWire: " + String(sensorCount) + " sensors found on " + String(ONEWIRE_BUS_COUNT) +
+                 " buses in " + String(millis() - searchStartMs) + " ms");
 
   Serial.print("Connecting to WiFi ");
-  wifiLib.scanAndSelectNetwork();
-  wifiLib.connect();
+  // Access point and address of the last boot first, scan only if that fails
+  wifiFast.connectOrScan(wifiLib);
 
   Serial.println("Starting NTP client...");
   timeClient.begin();
@@ -538,8 +810,12 @@ void setup() {
   Serial.println("NTP time synchronized: " + getCurrentTimestamp());
 
   String mqttClientID = "ESP32MixerControllerClient_" + chipID;
-  mqttClient = std::unique_ptr<MQTTClientLib>(new MQTTClientLib(mqtt_broker, mqtt_port, mqttClientID, wifiClient, mqttCallback));
+  mqttClient = std::unique_ptr<MQTTClientLib>(new MQTTClientLib(mqtt_broker, mqtt_port, mqttClientID, wifiClient, nullptr));
+  // Temperatures during a broker outage are sent afterwards; the mixer states only with their latest value
+  mqttClient->setCoalescedTopics({"meta/#", "daten/Heizung/+/Mischersteuerung/#"});
+  mqttClient->beginQueue(32768, "/mqttqueue.bin");
   connectToMQTT(true);
+  telemetry.begin(mqttClient.get(), "meta/MixerController/" + chipID + "/telemetry");
 
   Serial.print("IP Address: ");
   Serial.println(WiFi.localIP());
@@ -554,6 +830,7 @@ void setup() {
 }
 
 void loop() {
+  telemetry.loop();
   otaInProgress = AzureOTAUpdater::CheckUpdateStatus();
   if (otaInProgress) {
     delay(500);
@@ -562,10 +839,9 @@ void loop() {
 
   timeClient.update();
 
-  if (!mqttClient->loop()) {
-    Serial.println("MQTT Client not connected, reconnecting in loop...");
-    connectToMQTT(false);
-  }
+  // Never blocks: while WiFi or the broker are away, the mixers and the
+  // temperature cycle keep running and the client reconnects step by step
+  mqttClient->loop();
 
   for (int i = 0; i < mixerCount; i++) {
     if (mixers[i].update()) {
@@ -573,21 +849,18 @@ void loop() {
     }
   }
 
-  // Non-blocking temperature cycle: request conversion, read after >750ms
+  // Non-blocking temperature cycle: start all conversions, then read one sensor per loop once it is ready
   unsigned long now = millis();
-  if (!temperatureConversionRequested &&
+  if (!temperatureSensors.busy() &&
       now - lastTemperatureCycleMs >= (unsigned long)temperatureIntervalSeconds * 1000UL) {
-    for (int b = 0; b < ONEWIRE_BUS_COUNT; b++) {
-      temperatureBuses[b].requestTemperatures();
-    }
-    temperatureConversionRequested = true;
-    temperatureRequestMs = now;
+    temperatureSensors.startConversion();
+    lastTemperatureCycleMs = now;
   }
-  if (temperatureConversionRequested && now - temperatureRequestMs >= 1000) {
+  if (temperatureSensors.update()) {
     publishTemperatures();
-    temperatureConversionRequested = false;
-    lastTemperatureCycleMs = now;
   }
 
+  runMixerControllers();
+
   delay(50);
 }
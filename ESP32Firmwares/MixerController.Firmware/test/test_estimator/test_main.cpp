@@ -0,0 +1,125 @@
+// Host tests of the mixer position estimator: pio test -e native
+
+#include <unity.h>
+
+#include "MixerPositionEstimator.h"
+
+static const float TRAVEL = 140.0f;
+static MixerPositionEstimator estimator;
+
+void setUp()
+{
+    estimator = MixerPositionEstimator();
+}
+
+void tearDown()
+{
+}
+
+// Flow temperature of a linear mixing valve at the given opening
+static float mixedFlow(float openFraction, float supply, float returnTemperature)
+{
+    return openFraction * supply + (1.0f - openFraction) * returnTemperature;
+}
+
+void test_invalid_until_referenced()
+{
+    TEST_ASSERT_FALSE(estimator.valid());
+    TEST_ASSERT_TRUE(estimator.needsReference());
+    estimator.predict(true, 10.0f, TRAVEL);
+    TEST_ASSERT_FALSE(estimator.correct(40.0f, 30.0f, 35.0f));
+
+    estimator.reference(false);
+    TEST_ASSERT_TRUE(estimator.valid());
+    TEST_ASSERT_FALSE(estimator.needsReference());
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, estimator.openFraction());
+}
+
+void test_pulses_move_estimate_and_add_uncertainty()
+{
+    estimator.reference(false);
+    float before = estimator.stdDev();
+    estimator.predict(true, 35.0f, TRAVEL);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 0.75f, estimator.openFraction());
+    TEST_ASSERT_TRUE(estimator.stdDev() > before);
+
+    estimator.predict(true, 500.0f, TRAVEL);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, estimator.openFraction());
+}
+
+void test_temperatures_pull_estimate_and_reduce_uncertainty()
+{
+    estimator.reference(false);
+    // Travel-time estimate says 50 %, the valve is really at 60 %
+    estimator.predict(true, 70.0f, TRAVEL);
+    for (int i = 0; i < 20; i++)
+    {
+        estimator.predict(true, 0.0f, TRAVEL);
+    }
+    float before = estimator.stdDev();
+    for (int i = 0; i < 10; i++)
+    {
+        TEST_ASSERT_TRUE(estimator.correct(45.0f, 25.0f, mixedFlow(0.6f, 45.0f, 25.0f)));
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.03f, 0.6f, estimator.openFraction());
+    TEST_ASSERT_TRUE(estimator.stdDev() < before);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.6f, estimator.lastMeasurement);
+}
+
+void test_small_spread_is_not_used()
+{
+    estimator.reference(false);
+    estimator.predict(true, 70.0f, TRAVEL);
+    TEST_ASSERT_FALSE(estimator.correct(26.0f, 24.0f, 25.0f));
+    TEST_ASSERT_EQUAL_UINT32(0, estimator.corrections);
+}
+
+void test_persistent_disagreement_triggers_reference()
+{
+    estimator.reference(false);
+    estimator.predict(true, 14.0f, TRAVEL);  // Estimate 90 % open
+    // Temperatures say 10 % open, far outside the expected spread
+    estimator.correct(45.0f, 25.0f, mixedFlow(0.1f, 45.0f, 25.0f));
+    estimator.correct(45.0f, 25.0f, mixedFlow(0.1f, 45.0f, 25.0f));
+    TEST_ASSERT_FALSE(estimator.needsReference());
+    estimator.correct(45.0f, 25.0f, mixedFlow(0.1f, 45.0f, 25.0f));
+    TEST_ASSERT_TRUE(estimator.needsReference());
+    TEST_ASSERT_EQUAL_UINT32(1, estimator.drifts);
+    TEST_ASSERT_EQUAL_UINT32(3, estimator.outliers);
+}
+
+void test_many_pulses_without_feedback_need_reference()
+{
+    estimator.reference(false);
+    int pulses = 0;
+    while (!estimator.needsReference() && pulses < 10000)
+    {
+        estimator.predict(pulses % 2 == 0, 5.0f, TRAVEL);
+        pulses++;
+    }
+    TEST_ASSERT_TRUE(pulses > 100);
+    TEST_ASSERT_TRUE(pulses < 10000);
+}
+
+void test_seconds_to_end_stop_include_margin()
+{
+    estimator.reference(false);
+    estimator.predict(true, 70.0f, TRAVEL);
+    float toClose = estimator.secondsToEndStop(true, TRAVEL);
+    TEST_ASSERT_TRUE(toClose > 70.0f);
+    TEST_ASSERT_TRUE(toClose < TRAVEL);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 70.0f + 3.0f * estimator.stdDev() * TRAVEL, toClose);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_invalid_until_referenced);
+    RUN_TEST(test_pulses_move_estimate_and_add_uncertainty);
+    RUN_TEST(test_temperatures_pull_estimate_and_reduce_uncertainty);
+    RUN_TEST(test_small_spread_is_not_used);
+    RUN_TEST(test_persistent_disagreement_triggers_reference);
+    RUN_TEST(test_many_pulses_without_feedback_need_reference);
+    RUN_TEST(test_seconds_to_end_stop_include_margin);
+    return UNITY_END();
+}
@@ -0,0 +1,182 @@
+// Host tests of the PI mixer controller against a simulated plant: pio test -e native
+
+#include <unity.h>
+#include <math.h>
+
+#include "MixerPiController.h"
+
+static const float TRAVEL = 140.0f;
+
+// Cooling circuit: mixing cold buffer water (supply) into the circuit return.
+// The flow temperature follows the mix with a first-order lag and a dead time.
+struct Plant
+{
+    float supply = 8.0f;
+    float returnTemperature = 22.0f;
+    float tauSeconds = 180.0f;
+    static const int DeadTimeSeconds = 30;
+
+    float opening = 0.0f;  // Real valve position, 0..1
+    float flow = 22.0f;
+    float history[DeadTimeSeconds] = {};
+    int historyIndex = 0;
+    bool primed = false;
+
+    void pulse(int32_t seconds)
+    {
+        opening += seconds / TRAVEL;
+        if (opening < 0.0f) opening = 0.0f;
+        if (opening > 1.0f) opening = 1.0f;
+    }
+
+    void step()
+    {
+        float mixed = opening * supply + (1.0f - opening) * returnTemperature;
+        if (!primed)
+        {
+            for (float &h : history) h = mixed;
+            primed = true;
+        }
+        float delayed = history[historyIndex];
+        history[historyIndex] = mixed;
+        historyIndex = (historyIndex + 1) % DeadTimeSeconds;
+        flow += (delayed - flow) / tauSeconds;
+    }
+};
+
+static Plant plant;
+static MixerPiController controller;
+static int pulses;
+
+void setUp()
+{
+    plant = Plant();
+    controller = MixerPiController();
+    controller.enabled = true;
+    controller.setpoint = 15.0f;
+    pulses = 0;
+}
+
+void tearDown()
+{
+}
+
+// Runs the closed loop for the given time; the controller sees the real opening
+// as its estimate (the estimator is tested separately)
+static void run(int seconds)
+{
+    const int sample = (int)controller.config.sampleSeconds;
+    for (int t = 0; t < seconds; t++)
+    {
+        plant.step();
+        if (t % sample == 0)
+        {
+            int32_t pulse = controller.update(plant.flow, plant.opening, TRAVEL, (float)sample);
+            if (pulse != 0)
+            {
+                plant.pulse(pulse);
+                pulses++;
+            }
+        }
+    }
+}
+
+void test_settles_at_setpoint()
+{
+    run(90 * 60);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 15.0f, plant.flow);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 0.5f, plant.opening);
+
+    // And stays there without hunting
+    int before = pulses;
+    run(60 * 60);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 15.0f, plant.flow);
+    TEST_ASSERT_TRUE(pulses - before <= 3);
+}
+
+void test_overshoot_is_limited()
+{
+    float lowest = 100.0f;
+    for (int minute = 0; minute < 120; minute++)
+    {
+        run(60);
+        if (plant.flow < lowest) lowest = plant.flow;
+    }
+    TEST_ASSERT_TRUE(lowest > 15.0f - 1.5f);
+}
+
+void test_no_windup_after_unreachable_setpoint()
+{
+    // Colder than the supply: the valve ends up fully open
+    controller.setpoint = 5.0f;
+    run(120 * 60);
+    // Fully open up to the last step shorter than the minimum pulse
+    TEST_ASSERT_TRUE(plant.opening >= 1.0f - controller.config.minPulseSeconds / TRAVEL);
+    TEST_ASSERT_TRUE(controller.saturated);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, controller.residualSeconds);
+
+    // A reachable setpoint is approached right away, nothing to unwind
+    controller.setpoint = 15.0f;
+    run(60);
+    TEST_ASSERT_TRUE(plant.opening < 0.95f);
+    run(90 * 60);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 15.0f, plant.flow);
+}
+
+void test_opening_limits_are_respected()
+{
+    controller.maxOpen = 0.3f;
+    run(90 * 60);
+    TEST_ASSERT_TRUE(plant.opening <= 0.3f + 1e-4f);
+    TEST_ASSERT_FLOAT_WITHIN(0.02f, 0.3f, plant.opening);
+}
+
+void test_small_errors_are_carried_over()
+{
+    controller.config.deadbandKelvin = 0.0f;
+    plant.flow = 15.5f;
+    // 0.5 K error: 0.2 % integral per step = 0.28 s, below the minimum pulse
+    int32_t pulse = controller.update(15.5f, 0.5f, TRAVEL, 60.0f);
+    TEST_ASSERT_EQUAL_INT32(0, pulse);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.28f, controller.residualSeconds);
+
+    int steps = 1;
+    while (pulse == 0 && steps < 20)
+    {
+        pulse = controller.update(15.5f, 0.5f, TRAVEL, 60.0f);
+        steps++;
+    }
+    TEST_ASSERT_EQUAL_INT32(2, pulse);
+    TEST_ASSERT_EQUAL_INT(8, steps);
+}
+
+void test_deadband_holds_still()
+{
+    plant.opening = 0.5f;
+    plant.flow = 15.0f;
+    for (int i = 0; i < 60; i++)
+    {
+        TEST_ASSERT_EQUAL_INT32(0, controller.update(15.0f + (i % 2 ? 0.25f : -0.25f), 0.5f, TRAVEL, 60.0f));
+    }
+}
+
+void test_heating_direction()
+{
+    controller.config.openIsColder = false;
+    controller.setpoint = 45.0f;
+    // Too cold in heating mode: open
+    TEST_ASSERT_TRUE(controller.update(40.0f, 0.5f, TRAVEL, 60.0f) > 0);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_settles_at_setpoint);
+    RUN_TEST(test_overshoot_is_limited);
+    RUN_TEST(test_no_windup_after_unreachable_setpoint);
+    RUN_TEST(test_opening_limits_are_respected);
+    RUN_TEST(test_small_errors_are_carried_over);
+    RUN_TEST(test_deadband_holds_still);
+    RUN_TEST(test_heating_direction);
+    return UNITY_END();
+}
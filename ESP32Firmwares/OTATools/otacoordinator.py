@@ -0,0 +1,452 @@
+#!/usr/bin/env python3
+"""Fleet OTA coordinator: staged rollouts from a local firmware cache.
+
+CI publishes a new firmware URL (retained) on OTARelease/<firmware> instead
+of the fleet topic. The coordinator then rolls the release out in stages,
+canary devices first, then growing percentages of the fleet, and only moves
+to the next stage when every device of the current one runs the new version
+and stayed healthy for the soak time. A device that reports a failed update
+or restarts repeatedly halts the rollout; the rest of the fleet keeps its
+version.
+
+Devices are triggered one by one on OTAUpdate/<firmware>/<chipId> with the
+URL rewritten to the coordinator's HTTP cache, which fetches every artifact
+(.bin, .bin.hs, .delta, .bin.sig) from Azure Blob Storage once and serves it
+on the LAN afterwards. The cache is not authenticated; the devices check the
+release signature (.bin.sig) before they boot an image.
+
+MQTT topics:
+    OTARelease/<firmware>                in, retained: firmware URL from CI
+    OTAStatus/<firmware>/<chipId>        in, retained: device status JSON
+                                         {"version", "board", "state", "uptime"}
+                                         state: idle, updating or failed
+    OTACoordinator/<firmware>/command    in: "resume" (retry a halted stage)
+                                         or "abort"
+    OTAUpdate/<firmware>/<chipId>        out, retained: update trigger with the
+                                         cache URL, cleared once the device
+                                         runs the release
+    OTACoordinator/<firmware>/status     out, retained: rollout state JSON
+
+Usage:
+    otacoordinator.py otacoordinator.json
+
+Configuration: see otacoordinator.example.json. Needs paho-mqtt
+(requirements.txt).
+"""
+
+import hashlib
+import http.server
+import json
+import logging
+import os
+import shutil
+import sys
+import threading
+import time
+import urllib.error
+import urllib.parse
+import urllib.request
+
+import paho.mqtt.client as mqtt
+
+logger = logging.getLogger("otacoordinator")
+
+# A device triggered once is triggered again after this long if it still
+# reports the old version (missed message, failed download)
+RETRIGGER_SECONDS = 600
+# Upstream 404s are remembered this long (devices probe for deltas that
+# often do not exist)
+NEGATIVE_CACHE_SECONDS = 300
+TICK_SECONDS = 10
+
+
+def version_from_url(url):
+    """Same rule as the firmwares: between the last '_' and the last '.'."""
+    underscore = url.rfind("_")
+    dot = url.rfind(".")
+    return url[underscore + 1:dot] if 0 <= underscore < dot else ""
+
+
+def bucket(chip_id):
+    """Stable position 0..99 of a device in the percentage stages."""
+    return int(hashlib.sha256(chip_id.encode()).hexdigest()[:8], 16) % 100
+
+
+class FirmwareCache:
+    """Read-through cache of the blob storage, served over HTTP."""
+
+    def __init__(self, directory, upstream, allowed_prefix):
+        self.directory = os.path.abspath(directory)
+        self.upstream = upstream.rstrip("/")
+        self.allowed_prefix = allowed_prefix
+        self.locks = {}
+        self.locks_lock = threading.Lock()
+        self.missing = {}
+
+    def local_path(self, path):
+        path = urllib.parse.unquote(urllib.parse.urlsplit(path).path)
+        if not path.startswith(self.allowed_prefix) or ".." in path.split("/"):
+            return None
+        return os.path.join(self.directory, path.lstrip("/"))
+
+    def fetch(self, path):
+        """Local file for path, downloaded first if needed; None if missing."""
+        local = self.local_path(path)
+        if local is None:
+            return None
+        with self.locks_lock:
+            lock = self.locks.setdefault(local, threading.Lock())
+        # One download per file, concurrent requests wait for it
+        with lock:
+            if os.path.exists(local):
+                return local
+            if time.time() < self.missing.get(local, 0):
+                return None
+            url = self.upstream + urllib.parse.urlsplit(path).path
+            try:
+                with urllib.request.urlopen(url, timeout=60) as response:
+                    os.makedirs(os.path.dirname(local), exist_ok=True)
+                    partial = local + ".partial"
+                    with open(partial, "wb") as file:
+                        shutil.copyfileobj(response, file)
+                    os.replace(partial, local)
+            except urllib.error.HTTPError as error:
+                if error.code == 404:
+                    self.missing[local] = time.time() + NEGATIVE_CACHE_SECONDS
+                    return None
+                logger.warning("Fetching %s failed: %s", url, error)
+                return None
+            except OSError as error:
+                logger.warning("Fetching %s failed: %s", url, error)
+                return None
+            logger.info("Cached %s (%d bytes)", url, os.path.getsize(local))
+            return local
+
+    def serve(self, port):
+        cache = self
+
+        class Handler(http.server.BaseHTTPRequestHandler):
+            def do_GET(self):
+                local = cache.fetch(self.path)
+                if local is None:
+                    self.send_error(404)
+                    return
+                self.send_response(200)
+                self.send_header("Content-Type", "application/octet-stream")
+                self.send_header("Content-Length", str(os.path.getsize(local)))
+                self.end_headers()
+                with open(local, "rb") as file:
+                    shutil.copyfileobj(file, self.wfile)
+
+            def log_message(self, format, *args):
+                logger.info("HTTP %s %s", self.address_string(), format % args)
+
+        server = http.server.ThreadingHTTPServer(("", port), Handler)
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        return server
+
+
+class Device:
+    def __init__(self, chip_id):
+        self.chip_id = chip_id
+        self.version = ""
+        self.board = ""
+        self.state = "idle"
+        self.uptime = None
+        self.last_seen = 0.0
+        self.triggered_at = 0.0
+        # A retained trigger may be left from before a restart
+        self.trigger_retained = True
+        # Since when the device runs the release version, and how often it
+        # restarted since then
+        self.on_release_since = None
+        self.restarts = 0
+
+    def update(self, status, release_version, now):
+        uptime = status.get("uptime")
+        version = status.get("version", "")
+        if version == release_version and release_version:
+            if self.version != version or self.on_release_since is None:
+                self.on_release_since = now
+                self.restarts = 0
+            elif uptime is not None and self.uptime is not None and uptime < self.uptime:
+                self.restarts += 1
+        else:
+            self.on_release_since = None
+            self.restarts = 0
+        self.version = version
+        self.board = status.get("board", self.board)
+        self.state = status.get("state", "idle")
+        self.uptime = uptime
+        self.last_seen = now
+
+
+class Rollout:
+    """Staged rollout of one firmware."""
+
+    def __init__(self, name, config, coordinator):
+        self.name = name
+        self.coordinator = coordinator
+        self.canaries = config.get("canaries", [])
+        self.stages = config.get("stages", [10, 50, 100])
+        self.soak_seconds = config.get("soakMinutes", 15) * 60
+        self.stage_timeout = config.get("stageTimeoutMinutes", 120) * 60
+        self.offline_after = config.get("offlineAfterMinutes", 30) * 60
+        self.max_restarts = config.get("maxRestarts", 1)
+        self.devices = {}
+        # Persisted
+        self.url = ""
+        self.version = ""
+        self.stage = 0
+        self.stage_started = 0.0
+        self.status = "idle"
+        self.reason = ""
+
+    # Stage 0 is the canary stage, stage n the n-th percentage
+    def stage_name(self, stage):
+        return "canary" if stage == 0 else f"{self.stages[stage - 1]}%"
+
+    def online(self, now):
+        return [d for d in self.devices.values() if now - d.last_seen <= self.offline_after]
+
+    def members(self, stage, now):
+        devices = self.online(now)
+        if self.canaries:
+            canaries = [d for d in devices if d.chip_id in self.canaries]
+        else:
+            canaries = sorted(devices, key=lambda d: bucket(d.chip_id))[:1]
+        if stage == 0:
+            return canaries
+        percent = self.stages[stage - 1]
+        return list({d.chip_id: d for d in canaries + [d for d in devices if bucket(d.chip_id) < percent]}.values())
+
+    def release(self, url, now):
+        version = version_from_url(url)
+        if not version or (url == self.url and self.status != "idle"):
+            return
+        logger.info("%s: release %s", self.name, version)
+        self.url = url
+        self.version = version
+        self.stage = 0
+        self.stage_started = now
+        self.status = "rolling out"
+        self.reason = ""
+        for device in self.devices.values():
+            device.on_release_since = now if device.version == version else None
+            device.restarts = 0
+            device.triggered_at = 0.0
+        self.coordinator.prefetch(self.url, {d.board for d in self.devices.values() if d.board})
+        self.coordinator.save()
+
+    def command(self, command, now):
+        if command == "resume" and self.status == "halted":
+            logger.info("%s: resuming stage %s", self.name, self.stage_name(self.stage))
+            self.status = "rolling out"
+            self.reason = ""
+            self.stage_started = now
+            for device in self.devices.values():
+                if device.version == self.version:
+                    device.on_release_since = now
+                    device.restarts = 0
+        elif command == "abort" and self.status in ("rolling out", "halted"):
+            logger.info("%s: rollout of %s aborted", self.name, self.version)
+            self.status = "aborted"
+            for device in self.devices.values():
+                if device.trigger_retained:
+                    self.clear_trigger(device)
+        self.coordinator.save()
+
+    def device_status(self, chip_id, status, now):
+        device = self.devices.setdefault(chip_id, Device(chip_id))
+        device.update(status, self.version, now)
+
+    def halt(self, reason):
+        logger.warning("%s: rollout of %s halted: %s", self.name, self.version, reason)
+        self.status = "halted"
+        self.reason = reason
+        self.coordinator.save()
+
+    def tick(self, now):
+        if self.status != "rolling out":
+            return
+
+        # Every device of the finished stages is included: devices that were
+        # offline when their stage ran get the update when they come back
+        members = self.members(self.stage, now)
+        for device in members:
+            # Only a status sent after the trigger tells about this update
+            if device.state == "failed" and device.version != self.version and \
+                    0 < device.triggered_at < device.last_seen:
+                self.halt(f"update failed on {device.chip_id}")
+                return
+            if device.version == self.version and device.restarts > self.max_restarts:
+                self.halt(f"{device.chip_id} restarted {device.restarts} times on {self.version}")
+                return
+            if device.version != self.version and device.state != "updating" and \
+                    now - device.triggered_at >= RETRIGGER_SECONDS:
+                self.trigger(device, now)
+            elif device.version == self.version and device.trigger_retained:
+                self.clear_trigger(device)
+
+        healthy = [d for d in members if d.version == self.version and d.on_release_since is not None
+                   and now - d.on_release_since >= self.soak_seconds and d.state != "failed"]
+        if members and len(healthy) == len(members):
+            if self.stage == len(self.stages):
+                logger.info("%s: %s rolled out to all %d devices", self.name, self.version, len(members))
+                self.status = "completed"
+            else:
+                self.stage += 1
+                self.stage_started = now
+                logger.info("%s: %s healthy on %d devices, next stage %s", self.name, self.version,
+                            len(members), self.stage_name(self.stage))
+            self.coordinator.save()
+        elif now - self.stage_started > self.stage_timeout:
+            pending = [d.chip_id for d in members if d not in healthy]
+            self.halt(f"stage {self.stage_name(self.stage)} timed out waiting for {', '.join(pending) or 'devices'}")
+
+    def trigger(self, device, now):
+        url = self.coordinator.cache_url(self.url)
+        logger.info("%s: triggering %s (%s -> %s, stage %s)", self.name, device.chip_id, device.version or "?",
+                    self.version, self.stage_name(self.stage))
+        # Retained, so battery nodes that are online only for a few seconds
+        # get it on their next wake
+        self.coordinator.client.publish(f"OTAUpdate/{self.name}/{device.chip_id}", url, qos=1, retain=True)
+        device.triggered_at = now
+        device.trigger_retained = True
+
+    def clear_trigger(self, device):
+        # A retained trigger left behind would update the device back to
+        # this version once it runs a newer one
+        self.coordinator.client.publish(f"OTAUpdate/{self.name}/{device.chip_id}", b"", qos=1, retain=True)
+        device.triggered_at = 0.0
+        device.trigger_retained = False
+
+    def summary(self, now):
+        return {
+            "version": self.version,
+            "status": self.status,
+            "reason": self.reason,
+            "stage": self.stage_name(self.stage),
+            "devices": len(self.online(now)),
+            "updated": sum(1 for d in self.online(now) if d.version == self.version),
+            "stageMembers": len(self.members(self.stage, now)) if self.version else 0,
+        }
+
+    def to_json(self):
+        return {"url": self.url, "version": self.version, "stage": self.stage, "stageStarted": self.stage_started,
+                "status": self.status, "reason": self.reason}
+
+    def from_json(self, data):
+        self.url = data.get("url", "")
+        self.version = data.get("version", "")
+        self.stage = data.get("stage", 0)
+        self.stage_started = data.get("stageStarted", 0.0)
+        self.status = data.get("status", "idle")
+        self.reason = data.get("reason", "")
+
+
+class Coordinator:
+    def __init__(self, config):
+        self.config = config
+        self.public_url = config["publicUrl"].rstrip("/")
+        self.state_file = config.get("stateFile", "otacoordinator.state.json")
+        self.cache = FirmwareCache(config.get("cacheDir", "otacache"), config["upstream"],
+                                   config.get("allowedPrefix", "/firmwareupdates/"))
+        self.rollouts = {name: Rollout(name, firmware, self) for name, firmware in config["firmwares"].items()}
+        self.lock = threading.Lock()
+        self.load()
+
+        self.client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2, client_id=config.get("clientId", "otacoordinator"),
+                                  protocol=mqtt.MQTTv5)
+        self.client.on_connect = self.on_connect
+        self.client.on_message = self.on_message
+
+    def load(self):
+        if not os.path.exists(self.state_file):
+            return
+        with open(self.state_file) as file:
+            state = json.load(file)
+        for name, data in state.items():
+            if name in self.rollouts:
+                self.rollouts[name].from_json(data)
+                # Soak times restart: device status is not persisted
+                self.rollouts[name].stage_started = time.time()
+
+    def save(self):
+        partial = self.state_file + ".partial"
+        with open(partial, "w") as file:
+            json.dump({name: rollout.to_json() for name, rollout in self.rollouts.items()}, file, indent=2)
+        os.replace(partial, self.state_file)
+
+    def cache_url(self, url):
+        parts = urllib.parse.urlsplit(url)
+        return self.public_url + parts.path
+
+    def prefetch(self, url, boards):
+        """Loads the full images of a release before the first device asks."""
+        path = urllib.parse.urlsplit(url).path
+
+        def run():
+            for board in boards:
+                board_path = path.replace("---board---", board)
+                for candidate in (board_path + ".sig", board_path + ".hs", board_path):
+                    self.cache.fetch(candidate)
+
+        threading.Thread(target=run, daemon=True).start()
+
+    def on_connect(self, client, userdata, flags, reason_code, properties):
+        logger.info("Connected to %s: %s", self.config["broker"], reason_code)
+        for name in self.rollouts:
+            client.subscribe(f"OTARelease/{name}", qos=1)
+            client.subscribe(f"OTAStatus/{name}/+", qos=1)
+            client.subscribe(f"OTACoordinator/{name}/command", qos=1)
+
+    def on_message(self, client, userdata, message):
+        levels = message.topic.split("/")
+        rollout = self.rollouts.get(levels[1]) if len(levels) > 1 else None
+        if rollout is None:
+            return
+        payload = message.payload.decode(errors="replace").strip()
+        now = time.time()
+        with self.lock:
+            if levels[0] == "OTARelease" and len(levels) == 2:
+                rollout.release(payload, now)
+            elif levels[0] == "OTAStatus" and len(levels) == 3:
+                try:
+                    status = json.loads(payload)
+                except ValueError:
+                    logger.warning("Ignoring status of %s: %s", levels[2], payload)
+                    return
+                rollout.device_status(levels[2], status, now)
+            elif levels[0] == "OTACoordinator" and levels[2:] == ["command"]:
+                rollout.command(payload, now)
+
+    def run(self):
+        self.cache.serve(self.config.get("httpPort", 8070))
+        self.client.connect_async(self.config["broker"], self.config.get("port", 1883))
+        self.client.loop_start()
+        summaries = {}
+        while True:
+            now = time.time()
+            with self.lock:
+                for name, rollout in self.rollouts.items():
+                    rollout.tick(now)
+                    summary = rollout.summary(now)
+                    if summary != summaries.get(name):
+                        summaries[name] = summary
+                        self.client.publish(f"OTACoordinator/{name}/status", json.dumps(summary), qos=1,
+                                            retain=True)
+            time.sleep(TICK_SECONDS)
+
+
+def main():
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(levelname)s %(message)s")
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    with open(sys.argv[1]) as file:
+        config = json.load(file)
+    Coordinator(config).run()
+
+
+if __name__ == "__main__":
+    main()
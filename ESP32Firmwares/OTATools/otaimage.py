@@ -0,0 +1,360 @@
+#!/usr/bin/env python3
+"""Builds the compressed and delta OTA artifacts read by SharedLibs/OTAImage.
+
+Commands:
+    compress  NEW.bin OUT.hs                 heatshrink compressed full image
+    delta     OLD.bin NEW.bin OUT.delta      patch against OLD.bin, compressed
+    apply     ARTIFACT OUT.bin [--source OLD.bin]
+                                             decodes an artifact the way the
+                                             device does (used by CI to check
+                                             every artifact before upload)
+
+The container format is described in SharedLibs/OTAImage/OTAImageDecoder.h.
+Standard library only, so it runs on a bare CI runner.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"OTAI"
+FORMAT_VERSION = 1
+KIND_COMPRESSED = 1
+KIND_DELTA = 2
+COMPRESSION_NONE = 0
+COMPRESSION_HEATSHRINK = 1
+HEADER = struct.Struct("<4sBBBBB3xII32s")
+ESP_IMAGE_MAGIC = 0xE9
+
+# 4 KB window: the decoder allocates it on the device
+WINDOW_BITS = 12
+LOOKAHEAD_BITS = 5
+
+# Delta search: seed length for the index, shortest exact match worth a seek
+SEED_LENGTH = 8
+MIN_MATCH = 12
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.bits = 0
+        self.count = 0
+
+    def write(self, value, width):
+        self.bits = (self.bits << width) | value
+        self.count += width
+        while self.count >= 8:
+            self.count -= 8
+            self.out.append((self.bits >> self.count) & 0xFF)
+        self.bits &= (1 << self.count) - 1
+
+    def finish(self):
+        # Zero padding never completes a back-reference in the decoder
+        if self.count:
+            self.out.append((self.bits << (8 - self.count)) & 0xFF)
+            self.count = 0
+        return bytes(self.out)
+
+
+def heatshrink_compress(data, window_bits=WINDOW_BITS, lookahead_bits=LOOKAHEAD_BITS):
+    """LZSS in heatshrink's bit format, greedy with hash chains on 3 bytes."""
+    window = 1 << window_bits
+    max_length = 1 << lookahead_bits
+    # Shorter matches cost more bits than literals
+    min_length = (1 + window_bits + lookahead_bits) // 9 + 1
+    max_chain = 64
+    writer = BitWriter()
+    chains = {}
+    position = 0
+    size = len(data)
+
+    def remember(index):
+        if index + 3 <= size:
+            chains.setdefault(data[index:index + 3], []).append(index)
+
+    while position < size:
+        best_length = 0
+        best_distance = 0
+        limit = min(max_length, size - position)
+        if limit >= min_length:
+            candidates = chains.get(data[position:position + 3], ())
+            for candidate in reversed(candidates[-max_chain:]):
+                distance = position - candidate
+                if distance > window:
+                    break
+                if best_length and data[candidate + best_length] != data[position + best_length]:
+                    continue
+                length = 0
+                while length < limit and data[candidate + length] == data[position + length]:
+                    length += 1
+                if length > best_length:
+                    best_length = length
+                    best_distance = distance
+                    if length == limit:
+                        break
+
+        if best_length >= min_length:
+            writer.write(0, 1)
+            writer.write(best_distance - 1, window_bits)
+            writer.write(best_length - 1, lookahead_bits)
+            for index in range(position, position + best_length):
+                remember(index)
+            position += best_length
+        else:
+            writer.write(1, 1)
+            writer.write(data[position], 8)
+            remember(position)
+            position += 1
+    return writer.finish()
+
+
+def heatshrink_decompress(data, window_bits, lookahead_bits, size):
+    out = bytearray()
+    bits = 0
+    count = 0
+    position = 0
+
+    def read(width):
+        nonlocal bits, count, position
+        while count < width:
+            if position >= len(data):
+                return None
+            bits = (bits << 8) | data[position]
+            position += 1
+            count += 8
+        count -= width
+        value = (bits >> count) & ((1 << width) - 1)
+        bits &= (1 << count) - 1
+        return value
+
+    while len(out) < size:
+        tag = read(1)
+        if tag is None:
+            break
+        if tag:
+            value = read(8)
+            if value is None:
+                break
+            out.append(value)
+        else:
+            index = read(window_bits)
+            length = read(lookahead_bits)
+            if index is None or length is None:
+                break
+            for _ in range(length + 1):
+                source = len(out) - index - 1
+                out.append(out[source] if source >= 0 else 0)
+    return bytes(out)
+
+
+def write_varint(out, value):
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return
+
+
+def read_varint(data, position):
+    value = 0
+    shift = 0
+    while True:
+        if position >= len(data) or shift > 28:
+            raise ValueError("malformed patch")
+        byte = data[position]
+        position += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, position
+
+
+def zigzag(value):
+    return (value << 1) if value >= 0 else ((-value << 1) - 1)
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def match_length(old, old_position, new, new_position):
+    limit = min(len(old) - old_position, len(new) - new_position)
+    length = 0
+    for step in (256, 16, 1):
+        while length + step <= limit and \
+                old[old_position + length:old_position + length + step] == new[new_position + length:new_position + length + step]:
+            length += step
+    return length
+
+
+def make_patch(old, new):
+    """bsdiff-style patch: exact seed matches anchor the alignment, the diff
+    of each region runs on past the match as long as most bytes still agree
+    (relocated code differs only in a few address bytes), the rest is extra."""
+    index = {}
+    for position in range(len(old) - SEED_LENGTH + 1):
+        index.setdefault(old[position:position + SEED_LENGTH], position)
+
+    patch = bytearray()
+    last_scan = 0
+    last_old = 0
+    scan = 0
+
+    def emit(region_end, next_old):
+        # Forward extension of the diff, scored like bsdiff: +1 per equal
+        # byte, -1 per different one; stop once clearly past the best point
+        limit = min(region_end - last_scan, len(old) - last_old)
+        score = best_score = 0
+        diff_length = 0
+        for offset in range(limit):
+            score += 1 if old[last_old + offset] == new[last_scan + offset] else -1
+            if score > best_score:
+                best_score = score
+                diff_length = offset + 1
+            elif score < best_score - 64:
+                break
+        extra_start = last_scan + diff_length
+        write_varint(patch, diff_length)
+        write_varint(patch, region_end - extra_start)
+        write_varint(patch, zigzag(next_old - (last_old + diff_length)))
+        patch.extend((new[last_scan + i] - old[last_old + i]) & 0xFF for i in range(diff_length))
+        patch.extend(new[extra_start:region_end])
+
+    while scan + SEED_LENGTH <= len(new):
+        aligned = last_old + (scan - last_scan)
+        seed = new[scan:scan + SEED_LENGTH]
+        if 0 <= aligned and aligned + SEED_LENGTH <= len(old) and old[aligned:aligned + SEED_LENGTH] == seed:
+            # Still in step with the current region: no new triple
+            scan += match_length(old, aligned, new, scan)
+            continue
+
+        candidate = index.get(seed)
+        if candidate is None:
+            scan += 1
+            continue
+        length = match_length(old, candidate, new, scan)
+        # Only re-align when the match beats the current alignment clearly
+        aligned_score = 0
+        if 0 <= aligned < len(old):
+            window = min(length, len(old) - aligned, 256)
+            aligned_score = sum(1 for i in range(window) if old[aligned + i] == new[scan + i])
+        if length < MIN_MATCH or length <= aligned_score + 8:
+            scan += 1
+            continue
+
+        emit(scan, candidate)
+        last_scan = scan
+        last_old = candidate
+        scan += length
+
+    emit(len(new), last_old)
+    return bytes(patch)
+
+
+def apply_patch(old, patch, size):
+    out = bytearray()
+    position = 0
+    old_position = 0
+    while len(out) < size:
+        diff_length, position = read_varint(patch, position)
+        extra_length, position = read_varint(patch, position)
+        seek, position = read_varint(patch, position)
+        if old_position + diff_length > len(old):
+            raise ValueError("patch reads past the source image")
+        out.extend((patch[position + i] + old[old_position + i]) & 0xFF for i in range(diff_length))
+        position += diff_length
+        out.extend(patch[position:position + extra_length])
+        position += extra_length
+        old_position += diff_length + unzigzag(seek)
+    if len(out) != size:
+        raise ValueError("patch size mismatch")
+    return bytes(out)
+
+
+def build(kind, payload, target_size, source=b""):
+    compressed = heatshrink_compress(payload)
+    header = HEADER.pack(MAGIC, FORMAT_VERSION, kind, COMPRESSION_HEATSHRINK, WINDOW_BITS, LOOKAHEAD_BITS,
+                         target_size, len(source), hashlib.sha256(source).digest() if source else bytes(32))
+    return header + compressed
+
+
+def decode(artifact, source=None):
+    if artifact and artifact[0] == ESP_IMAGE_MAGIC:
+        return artifact
+    if len(artifact) < HEADER.size:
+        raise ValueError("artifact too short")
+    magic, version, kind, compression, window_bits, lookahead_bits, target_size, source_size, source_hash = \
+        HEADER.unpack_from(artifact)
+    if magic != MAGIC or version != FORMAT_VERSION:
+        raise ValueError("unknown artifact format")
+    body = artifact[HEADER.size:]
+    if kind == KIND_DELTA:
+        if source is None:
+            raise ValueError("delta needs --source")
+        if hashlib.sha256(source[:source_size]).digest() != source_hash:
+            raise ValueError("delta does not match the source image")
+    if compression == COMPRESSION_HEATSHRINK:
+        # The patch of a delta is longer than the image; decode all of it
+        body = heatshrink_decompress(body, window_bits, lookahead_bits,
+                                     target_size if kind == KIND_COMPRESSED else sys.maxsize)
+    elif compression != COMPRESSION_NONE:
+        raise ValueError("unknown compression")
+    if kind == KIND_DELTA:
+        return apply_patch(source[:source_size], body, target_size)
+    if len(body) != target_size:
+        raise ValueError("image size mismatch")
+    return body
+
+
+def read_file(path):
+    with open(path, "rb") as file:
+        return file.read()
+
+
+def write_file(path, data):
+    with open(path, "wb") as file:
+        file.write(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+    compress = commands.add_parser("compress")
+    compress.add_argument("new")
+    compress.add_argument("out")
+    delta = commands.add_parser("delta")
+    delta.add_argument("old")
+    delta.add_argument("new")
+    delta.add_argument("out")
+    apply = commands.add_parser("apply")
+    apply.add_argument("artifact")
+    apply.add_argument("out")
+    apply.add_argument("--source")
+    args = parser.parse_args()
+
+    if args.command == "compress":
+        new = read_file(args.new)
+        artifact = build(KIND_COMPRESSED, new, len(new))
+    elif args.command == "delta":
+        old = read_file(args.old)
+        new = read_file(args.new)
+        artifact = build(KIND_DELTA, make_patch(old, new), len(new), old)
+    else:
+        source = read_file(args.source) if args.source else None
+        write_file(args.out, decode(read_file(args.artifact), source))
+        return
+
+    # Never publish an artifact the device would decode differently
+    if decode(artifact, old if args.command == "delta" else None) != new:
+        sys.exit(f"{args.out}: round trip failed")
+    write_file(args.out, artifact)
+    print(f"{args.out}: {len(artifact)} bytes, {100 * len(artifact) / max(len(new), 1):.1f} % of {len(new)}")
+
+
+if __name__ == "__main__":
+    main()
@@ -12,6 +12,8 @@
 #include "AzureOTAUpdater.h"
 #include "MQTTClientLib.h"
 #include "WifiLib.h"
+#include "WiFiFastConnect.h"
+#include "DeviceTelemetry.h"
 
 const int irLedPin = 19; // Define the pin for the IR LED
 const int irPhototransistorPin = 23;   // Define the pin for the IR sensor
@@ -27,6 +29,8 @@ String chipID = "";
 // WiFi credentials are read from environment variables and used during compile-time (see platformio.ini)
 // Set WIFI_PASSWORDS as environment variables on your dev-system following the pattern: WIFI_PASSWORDS="ssid1;password1|ssid2;password2"
 WifiLib wifiLib(WIFI_PASSWORDS);
+WiFiFastConnect wifiFast(WIFI_PASSWORDS);
+DeviceTelemetry telemetry;
 
 WiFiClient wifiClient;
 WiFiUDP ntpUDP;
@@ -42,6 +46,7 @@ static bool pinSent = false;
 static String baseTopic = "data/electricity";
 static String sensorName = "";
 static String location = "";
+static MQTTTopic smartmeterTopic;   // baseTopic/location/Smartmeter/sensorName, set with the config
 const String mqtt_broker = "mosquitto.intern";
 const int mqtt_port = 1883;
 static String mqtt_OTAtopic = "OTAUpdate/SMLSensor";
@@ -156,6 +161,7 @@ void mqttCallback(String &topic, String &payload) {
       location = payload;
       location.replace("Smartmeter_", "");
       Serial.println("Sensor name set to: " + sensorName);
+      smartmeterTopic.set("%s/%s/Smartmeter/%s", baseTopic.c_str(), location.c_str(), sensorName.c_str());
       mqttClientLib->publish(("meta/SMLSensor/" + sensorName + "/version/").c_str(), String(version), true, 2);
       return;
     } 
@@ -192,12 +198,9 @@ void mqttCallback(String &topic, String &payload) {
 }
 
 void connectToMQTT(bool cleanSession = false) {
-  if (WiFi.status() != WL_CONNECTED) {
-    wifiLib.connect();
-  }
-  mqttClientLib->connect(cleanSession);
+  // The client replays its subscriptions after every reconnect by itself
   mqttClientLib->subscribe({mqtt_OTAtopic, mqtt_ConfigTopic});
-  Serial.println("MQTT Client is connected");
+  Serial.println(mqttClientLib->connect(cleanSession) ? "MQTT Client is connected" : "MQTT Client not connected yet");
 }
 
 void setup() {
@@ -229,14 +232,17 @@ void setup() {
   delay(1000);
   // Connect to WiFi (falls back to NVS/AP mode if WIFI_PASSWORDS is not defined)
   Serial.print("Connecting to WiFi ");
-  wifiLib.scanAndSelectNetwork();
-  wifiLib.connect();
-  String ssid = wifiLib.getSSID();
+  // Access point and address of the last boot first, scan only if that fails
+  wifiFast.connectOrScan(wifiLib);
+  String ssid = WiFi.SSID();
   
   // Set up MQTT
   String mqttClientID = "ESP32SMLSensorClient_" + chipID;
   mqttClientLib = std::make_unique<MQTTClientLib>(mqtt_broker, mqtt_port, mqttClientID, wifiClient, mqttCallback);
+  // Meter readings during a broker outage are sent afterwards, also across a reboot
+  mqttClientLib->beginQueue(32768, "/mqttqueue.bin");
   connectToMQTT(true);
+  telemetry.begin(mqttClientLib.get(), "meta/SMLSensor/" + chipID + "/telemetry");
   
   // Print the IP address
   Serial.print("IP Address: ");
@@ -254,6 +260,7 @@ void setup() {
 }
 
 void loop() {
+  telemetry.loop();
   otaInProgress = AzureOTAUpdater::CheckUpdateStatus();
 
   if (!otaInProgress) {
@@ -376,10 +383,10 @@ void loop() {
                       jsonDoc["NetzanschlussMomentanleistung"] = smlData->Power.value();
                     }
                     
-                    String jsonString;
-                    serializeJson(jsonDoc, jsonString);
+                    char jsonString[200];
+                    size_t jsonLength = serializeJson(jsonDoc, jsonString, sizeof(jsonString));
                     
-                    mqttSuccess = mqttClientLib->publish((baseTopic + "/" + location + "/Smartmeter/" + sensorName).c_str(), jsonString, true, 0);
+                    mqttSuccess = mqttClientLib->publish(smartmeterTopic, jsonString, jsonLength, true, 0);
                     if (mqttSuccess) {
                       digitalWrite(ledPin, HIGH); 
                       delay(5);
@@ -413,9 +420,6 @@ void loop() {
       }
     }
 
-    if(!mqttClientLib->loop())
-    {
-      Serial.println("MQTT Client not connected, reconnecting in loop...");
-      connectToMQTT();
-    }
+    // Never blocks: SML reception goes on while WiFi or the broker are away
+    mqttClientLib->loop();
 }
\ No newline at end of file
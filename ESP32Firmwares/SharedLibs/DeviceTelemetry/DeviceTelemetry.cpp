@@ -0,0 +1,167 @@
+#include "DeviceTelemetry.h"
+#include <WiFi.h>
+#include <atomic>
+#include <memory>
+#include <new>
+
+#ifndef configRUN_TIME_COUNTER_TYPE
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+#endif
+
+namespace {
+    // Counted in the WiFi event task
+    std::atomic<uint32_t> wifiDisconnects{0};
+    std::atomic<uint32_t> wifiConnects{0};
+    bool wifiEventsRegistered = false;
+
+    float toMs(uint32_t us) {
+        return us / 1000.0f;
+    }
+}
+
+void DeviceTelemetry::begin(MQTTClientLib* client, const String& topic, uint32_t intervalMs) {
+    this->client = client;
+    this->topic = topic;
+    this->intervalMs = intervalMs;
+    lastReportMs = millis();
+    lastLoopUs = 0;
+    if (!wifiEventsRegistered) {
+        wifiEventsRegistered = true;
+        WiFi.onEvent([](WiFiEvent_t, WiFiEventInfo_t) { wifiDisconnects++; }, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+        WiFi.onEvent([](WiFiEvent_t, WiFiEventInfo_t) { wifiConnects++; }, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+        // The connect before begin() is not a reconnect
+        wifiConnects = WiFi.status() == WL_CONNECTED ? 1 : 0;
+    }
+}
+
+void DeviceTelemetry::addSection(const char* name, std::function<void(JsonObject)> fill) {
+    sections.push_back({name, fill});
+}
+
+void DeviceTelemetry::loop() {
+    unsigned long nowUs = micros();
+    if (lastLoopUs != 0) {
+        loopPeriods.add(nowUs - lastLoopUs);
+    }
+    lastLoopUs = nowUs;
+
+    if (client && millis() - lastReportMs >= intervalMs) {
+        publish();
+    }
+}
+
+void DeviceTelemetry::addHistogram(JsonObject target, const LatencyHistogram& histogram) {
+    target["n"] = histogram.count();
+    target["meanMs"] = toMs(histogram.meanUs());
+    target["p50Ms"] = toMs(histogram.percentileUs(50));
+    target["p95Ms"] = toMs(histogram.percentileUs(95));
+    target["p99Ms"] = toMs(histogram.percentileUs(99));
+    target["maxMs"] = toMs(histogram.maxUs());
+    JsonArray buckets = target["buckets"].to<JsonArray>();
+    for (size_t i = 0; i < LatencyHistogram::BucketCount; i++) {
+        buckets.add(histogram.bucket(i));
+    }
+}
+
+void DeviceTelemetry::addTasks(JsonObject tasks) {
+#if configUSE_TRACE_FACILITY
+    UBaseType_t capacity = uxTaskGetNumberOfTasks() + 4;
+    std::unique_ptr<TaskStatus_t[]> status(new (std::nothrow) TaskStatus_t[capacity]);
+    if (!status) {
+        return;
+    }
+    uint32_t totalRunTime = 0;
+#if configGENERATE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE runTime = 0;
+    UBaseType_t count = uxTaskGetSystemState(status.get(), capacity, &runTime);
+    totalRunTime = (uint32_t)runTime;
+#else
+    UBaseType_t count = uxTaskGetSystemState(status.get(), capacity, nullptr);
+#endif
+    // Counters wrap after 71 minutes; the 32 bit differences stay right for shorter intervals
+    uint32_t totalDelta = (totalRunTime - lastTotalRunTime) * portNUM_PROCESSORS;
+    std::vector<TaskRunTime> runTimes;
+    runTimes.reserve(count);
+    for (UBaseType_t i = 0; i < count; i++) {
+        JsonObject task = tasks[String(status[i].pcTaskName)].to<JsonObject>();
+#if configGENERATE_RUN_TIME_STATS
+        uint32_t taskRunTime = (uint32_t)status[i].ulRunTimeCounter;
+        runTimes.push_back({status[i].xTaskNumber, taskRunTime});
+        // Tasks started during the interval count from zero
+        uint32_t previous = 0;
+        for (const TaskRunTime& last : lastRunTimes) {
+            if (last.taskNumber == status[i].xTaskNumber) {
+                previous = last.runTime;
+                break;
+            }
+        }
+        if (lastTotalRunTime != 0 && totalDelta > 0) {
+            task["cpu"] = serialized(String(100.0f * (taskRunTime - previous) / totalDelta, 1));
+        }
+#endif
+        task["stackFree"] = status[i].usStackHighWaterMark;
+    }
+    lastRunTimes.swap(runTimes);
+    lastTotalRunTime = totalRunTime;
+#else
+    tasks[String(pcTaskGetName(nullptr))]["stackFree"] = uxTaskGetStackHighWaterMark(nullptr);
+#endif
+}
+
+bool DeviceTelemetry::publish() {
+    lastReportMs = millis();
+    if (!client) {
+        return false;
+    }
+
+    JsonDocument doc;
+    doc["uptime"] = millis() / 1000;
+
+    JsonObject heap = doc["heap"].to<JsonObject>();
+    heap["free"] = ESP.getFreeHeap();
+    heap["min"] = ESP.getMinFreeHeap();
+    heap["largestBlock"] = ESP.getMaxAllocHeap();
+    if (psramFound()) {
+        heap["psramFree"] = ESP.getFreePsram();
+    }
+
+    addHistogram(doc["loop"].to<JsonObject>(), loopPeriods);
+
+    const MQTTPublishStats& publishStats = client->publishStats();
+    const MQTTConnectionStats& connectionStats = client->stats();
+    const MQTTQueueStats& queueStats = client->queueStats();
+    JsonObject mqtt = doc["mqtt"].to<JsonObject>();
+    mqtt["sent"] = publishStats.sent;
+    mqtt["failed"] = publishStats.failed;
+    addHistogram(mqtt["latency"].to<JsonObject>(), publishStats.latency);
+    mqtt["connects"] = connectionStats.connects;
+    mqtt["disconnects"] = connectionStats.disconnects;
+    mqtt["failedAttempts"] = connectionStats.failedAttempts;
+    mqtt["longestOutageMs"] = connectionStats.longestOutageMs;
+    mqtt["queueDepth"] = queueStats.depth;
+    mqtt["queueDropped"] = queueStats.dropped;
+
+    JsonObject wifi = doc["wifi"].to<JsonObject>();
+    if (WiFi.status() == WL_CONNECTED) {
+        wifi["rssi"] = WiFi.RSSI();
+    }
+    uint32_t connects = wifiConnects;
+    wifi["disconnects"] = (uint32_t)wifiDisconnects;
+    wifi["reconnects"] = connects > 0 ? connects - 1 : 0;
+
+    addTasks(doc["tasks"].to<JsonObject>());
+
+    for (const Section& section : sections) {
+        section.fill(doc[section.name].to<JsonObject>());
+    }
+
+    String json;
+    serializeJson(doc, json);
+    bool sent = client->publish(topic.c_str(), json.c_str(), json.length(), false, 0);
+
+    // New interval for the histograms
+    loopPeriods.clear();
+    lastLoopUs = 0;
+    client->clearPublishLatency();
+    return sent;
+}
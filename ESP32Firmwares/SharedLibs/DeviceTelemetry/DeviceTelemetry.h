@@ -0,0 +1,74 @@
+#ifndef DEVICETELEMETRY_H
+#define DEVICETELEMETRY_H
+
+// Health counters of a node, published as one JSON document at a low rate
+// (default every 5 minutes) on the topic given to begin(), e.g.
+// meta/<firmware>/<chipId>/telemetry:
+//
+//   {"uptime": 86400,
+//    "heap": {"free": 143212, "min": 98304, "largestBlock": 65524},
+//    "loop": {"n": 1200, "meanMs": 250.1, "p50Ms": 500, "p95Ms": 500, "p99Ms": 1000, "maxMs": 712.4, "buckets": [...]},
+//    "mqtt": {"sent": 5210, "failed": 3, "latency": {...}, "connects": 2, "disconnects": 1, "failedAttempts": 4,
+//             "longestOutageMs": 8200, "queueDepth": 0, "queueDropped": 0},
+//    "wifi": {"rssi": -67, "disconnects": 1, "reconnects": 1},
+//    "tasks": {"loopTask": {"cpu": 2.5, "stackFree": 5120}, "IDLE0": {...}, ...}}
+//
+// - loop: periods between two loop() calls, latency: duration of the MQTT
+//   publishes (see MQTTPublishStats); both histograms cover the last report
+//   interval, in the buckets of LatencyHistogram. The other counters run
+//   since boot.
+// - heap.min is the lowest free heap since boot, largestBlock the biggest
+//   allocation possible now: far below free means fragmentation.
+// - tasks: share of all cores per FreeRTOS task over the last interval,
+//   and the stack bytes never used. CPU shares need run time stats in the
+//   FreeRTOS configuration, the whole section the trace facility; without
+//   them only the stack of the loop task is reported.
+// - addSection() adds firmware specific objects, e.g. the statistics of an
+//   EventLoop.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+#include <vector>
+#include "LatencyHistogram.h"
+#include "MQTTClientLib.h"
+
+class DeviceTelemetry {
+public:
+    static const uint32_t DefaultIntervalMs = 300000;
+
+    void begin(MQTTClientLib* client, const String& topic, uint32_t intervalMs = DefaultIntervalMs);
+
+    // Once per pass of loop(): records the loop period, publishes when the interval passed
+    void loop();
+    // Publishes now and starts a new interval
+    bool publish();
+
+    void addSection(const char* name, std::function<void(JsonObject)> fill);
+
+private:
+    struct Section {
+        const char* name;
+        std::function<void(JsonObject)> fill;
+    };
+    // Run time counter per task at the last report, for the shares of the interval
+    struct TaskRunTime {
+        UBaseType_t taskNumber;
+        uint32_t runTime;
+    };
+
+    MQTTClientLib* client = nullptr;
+    String topic;
+    uint32_t intervalMs = DefaultIntervalMs;
+    unsigned long lastReportMs = 0;
+    unsigned long lastLoopUs = 0;
+    LatencyHistogram loopPeriods;
+    std::vector<Section> sections;
+    std::vector<TaskRunTime> lastRunTimes;
+    uint32_t lastTotalRunTime = 0;
+
+    void addTasks(JsonObject tasks);
+    static void addHistogram(JsonObject target, const LatencyHistogram& histogram);
+};
+
+#endif // DEVICETELEMETRY_H
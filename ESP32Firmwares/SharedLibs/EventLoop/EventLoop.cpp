@@ -0,0 +1,245 @@
+#include "EventLoop.h"
+
+EventLoop::EventLoop(EventLoopPlatform& platform) : platform(platform) {
+    for (size_t i = 0; i < WheelSlots; i++) {
+        slots[i] = InvalidTask;
+    }
+}
+
+EventLoop::TaskId EventLoop::add(const char* name, EventLoopCallback callback) {
+    if (count >= MaxTasks) {
+        return InvalidTask;
+    }
+    TaskId id = (TaskId)count++;
+    Task& task = tasks[id];
+    task.callback = callback;
+    task.stats = {};
+    task.stats.name = name;
+    task.dueMs = 0;
+    task.periodMs = 0;
+    task.armed = false;
+    task.next = InvalidTask;
+    task.previous = InvalidTask;
+    return id;
+}
+
+EventLoop::TaskId EventLoop::every(const char* name, uint32_t periodMs, EventLoopCallback callback, bool runNow) {
+    TaskId id = add(name, callback);
+    if (id != InvalidTask) {
+        tasks[id].periodMs = periodMs;
+        arm(id, nowMs() + (runNow ? 0 : periodMs));
+    }
+    return id;
+}
+
+EventLoop::TaskId EventLoop::after(const char* name, uint32_t delayMs, EventLoopCallback callback) {
+    TaskId id = add(name, callback);
+    if (id != InvalidTask) {
+        arm(id, nowMs() + delayMs);
+    }
+    return id;
+}
+
+EventLoop::TaskId EventLoop::onEvent(const char* name, EventLoopCallback callback) {
+    return add(name, callback);
+}
+
+void EventLoop::arm(TaskId task, uint64_t dueMs) {
+    Task& entry = tasks[task];
+    entry.dueMs = dueMs;
+    entry.armed = true;
+    size_t slot = (dueMs / WheelTickMs) % WheelSlots;
+    entry.previous = InvalidTask;
+    entry.next = slots[slot];
+    if (entry.next != InvalidTask) {
+        tasks[entry.next].previous = task;
+    }
+    slots[slot] = task;
+}
+
+void EventLoop::unlink(TaskId task) {
+    Task& entry = tasks[task];
+    if (!entry.armed) {
+        return;
+    }
+    if (entry.previous != InvalidTask) {
+        tasks[entry.previous].next = entry.next;
+    } else {
+        slots[(entry.dueMs / WheelTickMs) % WheelSlots] = entry.next;
+    }
+    if (entry.next != InvalidTask) {
+        tasks[entry.next].previous = entry.previous;
+    }
+    entry.next = InvalidTask;
+    entry.previous = InvalidTask;
+    entry.armed = false;
+}
+
+void EventLoop::schedule(TaskId task, uint32_t delayMs) {
+    if (task >= count) {
+        return;
+    }
+    unlink(task);
+    arm(task, nowMs() + delayMs);
+}
+
+void EventLoop::setPeriod(TaskId task, uint32_t periodMs) {
+    if (task < count) {
+        tasks[task].periodMs = periodMs;
+    }
+}
+
+void EventLoop::cancel(TaskId task) {
+    if (task < count) {
+        unlink(task);
+    }
+}
+
+bool EventLoop::scheduled(TaskId task) const {
+    return task < count && tasks[task].armed;
+}
+
+void EVENTLOOP_IRAM_ATTR EventLoop::signal(TaskId task) {
+    if (task >= MaxTasks) {
+        return;
+    }
+    pendingEvents.fetch_or(1u << task);
+    EventLoopPlatform::WakeFunction wake = platform.isrSafeWake;
+    if (wake) {
+        wake(platform);
+    } else {
+        platform.wake();
+    }
+}
+
+void EventLoop::runTask(TaskId task, bool byEvent, uint64_t dueMs) {
+    EventLoopTaskStats& stats = tasks[task].stats;
+    uint64_t startUs = platform.nowUs();
+    if (!byEvent && startUs / 1000 > dueMs) {
+        uint64_t lateMs = startUs / 1000 - dueMs;
+        if (lateMs > stats.maxLateMs) {
+            stats.maxLateMs = lateMs > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)lateMs;
+        }
+    }
+
+    tasks[task].callback();
+
+    uint64_t runUs = platform.nowUs() - startUs;
+    stats.runs++;
+    if (byEvent) {
+        stats.eventRuns++;
+    }
+    stats.busyUs += runUs;
+    if (runUs > stats.maxRunUs) {
+        stats.maxRunUs = runUs > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)runUs;
+    }
+}
+
+uint32_t EventLoop::runOnce() {
+    uint32_t events = pendingEvents.exchange(0);
+    for (TaskId task = 0; events != 0 && task < count; task++, events >>= 1) {
+        if (events & 1) {
+            runTask(task, true, 0);
+        }
+    }
+
+    // Collect the due timers from the slots of the ticks since the last pass;
+    // after a full revolution or more every slot is visited once
+    uint64_t now = nowMs();
+    uint64_t nowTick = now / WheelTickMs;
+    uint64_t ticks = nowTick - cursorTick + 1;
+    if (ticks > WheelSlots) {
+        ticks = WheelSlots;
+    }
+    TaskId due[MaxTasks];
+    size_t dueCount = 0;
+    for (uint64_t tick = nowTick + 1 - ticks; tick <= nowTick; tick++) {
+        TaskId task = slots[tick % WheelSlots];
+        while (task != InvalidTask) {
+            TaskId next = tasks[task].next;
+            if (tasks[task].dueMs <= now) {
+                unlink(task);
+                due[dueCount++] = task;
+            }
+            task = next;
+        }
+    }
+    cursorTick = nowTick;
+
+    // Earliest deadline first
+    for (size_t i = 1; i < dueCount; i++) {
+        TaskId task = due[i];
+        size_t j = i;
+        while (j > 0 && tasks[due[j - 1]].dueMs > tasks[task].dueMs) {
+            due[j] = due[j - 1];
+            j--;
+        }
+        due[j] = task;
+    }
+
+    for (size_t i = 0; i < dueCount; i++) {
+        TaskId task = due[i];
+        uint64_t dueMs = tasks[task].dueMs;
+        uint32_t periodMs = tasks[task].periodMs;
+        if (periodMs > 0) {
+            // Armed before running, so the callback may cancel or reschedule
+            // itself; an overrun is not caught up
+            uint64_t nextMs = dueMs + periodMs;
+            arm(task, nextMs > now ? nextMs : now + periodMs);
+        }
+        runTask(task, false, dueMs);
+    }
+
+    if (pendingEvents.load() != 0) {
+        return 0;
+    }
+    return untilNextDeadline(nowMs());
+}
+
+uint32_t EventLoop::untilNextDeadline(uint64_t now) const {
+    // The first slot ahead holding a deadline of its own revolution has the earliest one
+    uint64_t nowTick = now / WheelTickMs;
+    for (uint64_t tick = nowTick; tick < nowTick + WheelSlots; tick++) {
+        uint64_t earliest = UINT64_MAX;
+        for (TaskId task = slots[tick % WheelSlots]; task != InvalidTask; task = tasks[task].next) {
+            if (tasks[task].dueMs / WheelTickMs <= tick && tasks[task].dueMs < earliest) {
+                earliest = tasks[task].dueMs;
+            }
+        }
+        if (earliest != UINT64_MAX) {
+            return earliest <= now ? 0 : (uint32_t)(earliest - now);
+        }
+    }
+
+    // Nothing within one revolution
+    uint64_t earliest = UINT64_MAX;
+    for (size_t task = 0; task < count; task++) {
+        if (tasks[task].armed && tasks[task].dueMs < earliest) {
+            earliest = tasks[task].dueMs;
+        }
+    }
+    if (earliest == UINT64_MAX) {
+        return NoDeadline;
+    }
+    return earliest - now >= NoDeadline ? NoDeadline - 1 : (uint32_t)(earliest - now);
+}
+
+void EventLoop::run(uint32_t maxSleepMs) {
+    uint32_t untilNext = runOnce();
+    if (untilNext == 0) {
+        return;
+    }
+    uint64_t startUs = platform.nowUs();
+    platform.wait(untilNext < maxSleepMs ? untilNext : maxSleepMs);
+    idleTimeUs += platform.nowUs() - startUs;
+}
+
+void EventLoop::resetStats() {
+    for (size_t task = 0; task < count; task++) {
+        const char* name = tasks[task].stats.name;
+        tasks[task].stats = {};
+        tasks[task].stats.name = name;
+    }
+    idleTimeUs = 0;
+    statsSinceUs = platform.nowUs();
+}
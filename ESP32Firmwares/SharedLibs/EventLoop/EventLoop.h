@@ -0,0 +1,140 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+// Cooperative scheduler for the firmwares' loop(): tasks run at their
+// deadlines or when an event is signalled, and in between the loop task
+// blocks until the next deadline instead of polling with delay().
+//
+//   EventLoop::TaskId readingTask = eventLoop.every("reading", 5000, readSensorData, true);
+//   EventLoop::TaskId canTask = eventLoop.onEvent("can", processCanMessages);
+//   void IRAM_ATTR onCanInterrupt() { eventLoop.signal(canTask); }
+//   void loop() { eventLoop.run(); }
+//
+// - Timers sit in a hashed timer wheel (WheelSlots slots of WheelTickMs):
+//   scheduling is constant time and a pass only visits the slots of the
+//   ticks that went by. Deadlines beyond one revolution stay in their slot
+//   until their round comes.
+// - signal() is safe from ISRs and other FreeRTOS tasks (MQTT, UART, CAN
+//   or GPIO): it sets the task's bit in an atomic mask and wakes the loop.
+//   Several signals before the task runs are coalesced into one run. On the
+//   ESP32 it is in IRAM and reads nothing from flash (with a platform that
+//   sets isrSafeWake), so IRAM_ATTR handlers may call it while the flash
+//   cache is off, e.g. while an OTA download writes the flash.
+// - A periodic task that overran its period is not run repeatedly to catch
+//   up; its next run is one period after the late one.
+// - Per task: runs, runs by event, busy time, longest run and worst
+//   lateness against the deadline; idle time of the loop itself.
+//
+// Free of Arduino dependencies; the clock and the blocking wait come from
+// an EventLoopPlatform (FreeRTOSEventLoopPlatform.h on the device).
+
+#include <atomic>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(ESP_PLATFORM)
+#include <esp_attr.h>
+#define EVENTLOOP_IRAM_ATTR IRAM_ATTR
+#else
+#define EVENTLOOP_IRAM_ATTR
+#endif
+
+class EventLoopPlatform {
+public:
+    virtual ~EventLoopPlatform() {}
+    virtual uint64_t nowUs() = 0;
+    // Blocks up to timeoutMs; returns early once wake() was called, also
+    // when that happened after the last wait()
+    virtual void wait(uint32_t timeoutMs) = 0;
+    // Ends the current or the next wait(); may be called from an ISR
+    virtual void wake() = 0;
+
+    // wake() as a plain function in IRAM, used by signal() instead of the
+    // virtual call whose vtable is in flash; nullptr: signal() calls wake()
+    typedef void (*WakeFunction)(EventLoopPlatform& platform);
+    WakeFunction isrSafeWake = nullptr;
+};
+
+typedef std::function<void()> EventLoopCallback;
+
+struct EventLoopTaskStats {
+    const char* name;
+    uint32_t runs;
+    uint32_t eventRuns;     // Runs caused by signal()
+    uint64_t busyUs;
+    uint32_t maxRunUs;
+    uint32_t maxLateMs;     // Worst start after the deadline
+};
+
+class EventLoop {
+public:
+    typedef uint8_t TaskId;
+    static const size_t MaxTasks = 32;          // One bit each in the event mask
+    static const TaskId InvalidTask = 0xFF;
+    static const size_t WheelSlots = 64;
+    static const uint32_t WheelTickMs = 10;
+    static const uint32_t NoDeadline = 0xFFFFFFFF;
+
+    explicit EventLoop(EventLoopPlatform& platform);
+
+    // Runs callback every periodMs, the first time right away or after one period
+    TaskId every(const char* name, uint32_t periodMs, EventLoopCallback callback, bool runNow = false);
+    // Runs callback once after delayMs; schedule() arms it again
+    TaskId after(const char* name, uint32_t delayMs, EventLoopCallback callback);
+    // Runs callback only when signalled
+    TaskId onEvent(const char* name, EventLoopCallback callback);
+
+    // (Re)arms the timer of a task, periodic tasks keep their period afterwards
+    void schedule(TaskId task, uint32_t delayMs);
+    void setPeriod(TaskId task, uint32_t periodMs);
+    // Stops the timer; signal() still runs the task
+    void cancel(TaskId task);
+    bool scheduled(TaskId task) const;
+
+    // Runs the task on the next pass; safe from ISRs and other tasks
+    void signal(TaskId task);
+
+    // Runs the signalled and due tasks once; returns the milliseconds until
+    // the next deadline (0 if one is due already, NoDeadline if none)
+    uint32_t runOnce();
+    // runOnce(), then sleeps until the next deadline or a signal, but at
+    // most maxSleepMs; call from loop()
+    void run(uint32_t maxSleepMs = 1000);
+
+    size_t taskCount() const { return count; }
+    const EventLoopTaskStats& stats(TaskId task) const { return tasks[task].stats; }
+    uint64_t idleUs() const { return idleTimeUs; }
+    // Time since the last resetStats(), so busy and idle time become shares
+    uint64_t statsPeriodUs() { return platform.nowUs() - statsSinceUs; }
+    void resetStats();
+
+private:
+    struct Task {
+        EventLoopCallback callback;
+        EventLoopTaskStats stats;
+        uint64_t dueMs;
+        uint32_t periodMs;      // 0 for one-shot and event tasks
+        bool armed;
+        TaskId next;            // Wheel slot list
+        TaskId previous;
+    };
+
+    EventLoopPlatform& platform;
+    Task tasks[MaxTasks];
+    size_t count = 0;
+    TaskId slots[WheelSlots];
+    uint64_t cursorTick = 0;    // Slots up to this tick have been visited
+    std::atomic<uint32_t> pendingEvents{0};
+    uint64_t idleTimeUs = 0;
+    uint64_t statsSinceUs = 0;
+
+    TaskId add(const char* name, EventLoopCallback callback);
+    uint64_t nowMs() { return platform.nowUs() / 1000; }
+    void arm(TaskId task, uint64_t dueMs);
+    void unlink(TaskId task);
+    void runTask(TaskId task, bool byEvent, uint64_t dueMs);
+    uint32_t untilNextDeadline(uint64_t now) const;
+};
+
+#endif // EVENTLOOP_H
@@ -0,0 +1,23 @@
+// Only on the device; the host tests build EventLoop with their own platforms
+#if defined(ESP_PLATFORM)
+
+#include "FreeRTOSEventLoopPlatform.h"
+
+void IRAM_ATTR FreeRTOSEventLoopPlatform::wakeOwner(EventLoopPlatform& platform) {
+    // Before the first wait() the event is only in the mask, the next pass runs it
+    TaskHandle_t task = static_cast<FreeRTOSEventLoopPlatform&>(platform).owner;
+    if (task == nullptr) {
+        return;
+    }
+    if (xPortInIsrContext()) {
+        BaseType_t higherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(task, &higherPriorityTaskWoken);
+        if (higherPriorityTaskWoken) {
+            portYIELD_FROM_ISR();
+        }
+    } else {
+        xTaskNotifyGive(task);
+    }
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef FREERTOSEVENTLOOPPLATFORM_H
+#define FREERTOSEVENTLOOPPLATFORM_H
+
+// EventLoopPlatform of the ESP32 firmwares: esp_timer as the clock, and the
+// wait blocks the loop task on its task notification. The idle task runs in
+// the meantime, so the CPU sleeps (light sleep too, when power management
+// is enabled) until the next deadline or the next signal().
+//
+// wake() is in IRAM (FreeRTOSEventLoopPlatform.cpp) and set as isrSafeWake,
+// so signal() may be called from any interrupt handler, also from ones
+// registered with ESP_INTR_FLAG_IRAM that keep running while the flash is
+// written (OTA download, LittleFS, NVS).
+
+#include "EventLoop.h"
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+class FreeRTOSEventLoopPlatform : public EventLoopPlatform {
+public:
+    FreeRTOSEventLoopPlatform() {
+        isrSafeWake = wakeOwner;
+    }
+
+    uint64_t nowUs() override {
+        return esp_timer_get_time();
+    }
+
+    void wait(uint32_t timeoutMs) override {
+        owner = xTaskGetCurrentTaskHandle();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+    }
+
+    void wake() override {
+        wakeOwner(*this);
+    }
+
+private:
+    volatile TaskHandle_t owner = nullptr;
+
+    static void wakeOwner(EventLoopPlatform& platform);
+};
+
+#endif // FREERTOSEVENTLOOPPLATFORM_H
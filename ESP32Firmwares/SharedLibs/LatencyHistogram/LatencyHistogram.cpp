@@ -0,0 +1,53 @@
+#include "LatencyHistogram.h"
+
+const uint32_t LatencyHistogram::UpperBoundsUs[BucketCount - 1] = {
+    100, 200, 500,
+    1000, 2000, 5000,
+    10000, 20000, 50000,
+    100000, 200000, 500000,
+    1000000, 2000000, 5000000
+};
+
+void LatencyHistogram::add(uint32_t us) {
+    size_t index = 0;
+    while (index < BucketCount - 1 && us > UpperBoundsUs[index]) {
+        index++;
+    }
+    counts[index]++;
+    total++;
+    sumUs += us;
+    if (us > largest) {
+        largest = us;
+    }
+}
+
+void LatencyHistogram::clear() {
+    for (size_t i = 0; i < BucketCount; i++) {
+        counts[i] = 0;
+    }
+    total = 0;
+    sumUs = 0;
+    largest = 0;
+}
+
+uint32_t LatencyHistogram::percentileUs(uint8_t percent) const {
+    if (total == 0) {
+        return 0;
+    }
+    if (percent > 100) {
+        percent = 100;
+    }
+    // Rank of the value below which percent of all values lie, at least the first
+    uint64_t rank = ((uint64_t)total * percent + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BucketCount - 1; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return UpperBoundsUs[i] < largest ? UpperBoundsUs[i] : largest;
+        }
+    }
+    return largest;
+}
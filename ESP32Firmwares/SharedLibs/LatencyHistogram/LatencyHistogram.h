@@ -0,0 +1,36 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+// Fixed-bucket histogram of durations in microseconds (loop periods, MQTT
+// publish round trips). The buckets grow in 1-2-5 steps from 100 µs to 5 s,
+// the last one is open; percentiles are the upper bound of the bucket they
+// fall into, capped at the largest value seen. Constant size, no heap.
+// Kept free of Arduino dependencies so it can be tested on the host.
+
+#include <stddef.h>
+#include <stdint.h>
+
+class LatencyHistogram {
+public:
+    static const size_t BucketCount = 16;
+    // Upper bounds (inclusive) of all but the last bucket
+    static const uint32_t UpperBoundsUs[BucketCount - 1];
+
+    void add(uint32_t us);
+    void clear();
+
+    uint32_t count() const { return total; }
+    uint32_t bucket(size_t index) const { return counts[index]; }
+    uint32_t maxUs() const { return largest; }
+    uint32_t meanUs() const { return total > 0 ? (uint32_t)(sumUs / total) : 0; }
+    // 0 without values
+    uint32_t percentileUs(uint8_t percent) const;
+
+private:
+    uint32_t counts[BucketCount] = {};
+    uint32_t total = 0;
+    uint64_t sumUs = 0;
+    uint32_t largest = 0;
+};
+
+#endif // LATENCYHISTOGRAM_H
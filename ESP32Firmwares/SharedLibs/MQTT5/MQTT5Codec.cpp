@@ -0,0 +1,482 @@
+#include "MQTT5Codec.h"
+#include <string.h>
+
+// Property identifiers used here (MQTT 5.0, section 2.2.2.2)
+static const uint8_t PropertyMessageExpiry = 0x02;
+static const uint8_t PropertySessionExpiry = 0x11;
+static const uint8_t PropertyServerKeepAlive = 0x13;
+static const uint8_t PropertyReceiveMaximum = 0x21;
+static const uint8_t PropertyTopicAliasMaximum = 0x22;
+static const uint8_t PropertyTopicAlias = 0x23;
+static const uint8_t PropertyMaximumQos = 0x24;
+static const uint8_t PropertyRetainAvailable = 0x25;
+static const uint8_t PropertyUserProperty = 0x26;
+static const uint8_t PropertyMaximumPacketSize = 0x27;
+
+namespace {
+
+// Builds the variable header and payload behind a reserved fixed header,
+// then moves the body so the fixed header fits exactly
+class PacketWriter {
+public:
+    PacketWriter(uint8_t* buffer, size_t size) : buffer(buffer), size(size), position(MaxHeader) {
+        overflow = size < MaxHeader;
+    }
+
+    void byte(uint8_t value) {
+        if (!reserve(1)) return;
+        buffer[position++] = value;
+    }
+
+    void u16(uint16_t value) {
+        byte(value >> 8);
+        byte(value & 0xFF);
+    }
+
+    void u32(uint32_t value) {
+        u16(value >> 16);
+        u16(value & 0xFFFF);
+    }
+
+    void varInt(uint32_t value) {
+        uint8_t encoded[4];
+        uint8_t length = MQTT5Codec::encodeVarInt(value, encoded);
+        bytes(encoded, length);
+    }
+
+    void bytes(const void* data, size_t length) {
+        if (length == 0 || !reserve(length)) return;
+        memcpy(buffer + position, data, length);
+        position += length;
+    }
+
+    void string(const char* text) {
+        size_t length = text ? strlen(text) : 0;
+        if (length > 0xFFFF) {
+            overflow = true;
+            return;
+        }
+        u16((uint16_t)length);
+        bytes(text, length);
+    }
+
+    size_t finish(uint8_t firstByte) {
+        if (overflow) {
+            return 0;
+        }
+        uint32_t remaining = position - MaxHeader;
+        uint8_t encoded[4];
+        uint8_t length = MQTT5Codec::encodeVarInt(remaining, encoded);
+        size_t start = MaxHeader - 1 - length;
+        buffer[start] = firstByte;
+        memcpy(buffer + start + 1, encoded, length);
+        if (start > 0) {
+            memmove(buffer, buffer + start, position - start);
+        }
+        return position - start;
+    }
+
+    static const size_t MaxHeader = 5;
+
+private:
+    uint8_t* buffer;
+    size_t size;
+    size_t position;
+    bool overflow;
+
+    bool reserve(size_t length) {
+        if (overflow || position + length > size) {
+            overflow = true;
+            return false;
+        }
+        return true;
+    }
+};
+
+// Big-endian reader over a packet body
+class PacketReader {
+public:
+    PacketReader(const uint8_t* data, size_t length) : position(data), end(data + length) {}
+
+    bool u8(uint8_t& value) {
+        if (end - position < 1) return false;
+        value = *position++;
+        return true;
+    }
+
+    bool u16(uint16_t& value) {
+        if (end - position < 2) return false;
+        value = (uint16_t)(position[0] << 8 | position[1]);
+        position += 2;
+        return true;
+    }
+
+    bool varInt(uint32_t& value) {
+        int used = MQTT5Codec::decodeVarInt(position, end - position, value);
+        if (used <= 0) return false;
+        position += used;
+        return true;
+    }
+
+    bool string(const char*& text, uint16_t& length) {
+        if (!u16(length) || end - position < length) return false;
+        text = (const char*)position;
+        position += length;
+        return true;
+    }
+
+    bool skip(size_t length) {
+        if ((size_t)(end - position) < length) return false;
+        position += length;
+        return true;
+    }
+
+    const uint8_t* position;
+    const uint8_t* end;
+};
+
+// Size of the property values by identifier; 0 = unknown
+enum class PropertyKind : uint8_t { Unknown, Byte, TwoByte, FourByte, VarInt, String, Binary, StringPair };
+
+PropertyKind propertyKind(uint8_t id) {
+    switch (id) {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            return PropertyKind::Byte;
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            return PropertyKind::TwoByte;
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            return PropertyKind::FourByte;
+        case 0x0B:
+            return PropertyKind::VarInt;
+        case 0x03: case 0x08: case 0x12: case 0x15: case 0x1A: case 0x1C: case 0x1F:
+            return PropertyKind::String;
+        case 0x09: case 0x16:
+            return PropertyKind::Binary;
+        case 0x26:
+            return PropertyKind::StringPair;
+        default:
+            return PropertyKind::Unknown;
+    }
+}
+
+} // namespace
+
+uint8_t MQTT5Codec::encodeVarInt(uint32_t value, uint8_t* out) {
+    uint8_t length = 0;
+    do {
+        uint8_t digit = value % 128;
+        value /= 128;
+        if (value > 0) {
+            digit |= 0x80;
+        }
+        out[length++] = digit;
+    } while (value > 0 && length < 4);
+    return length;
+}
+
+int MQTT5Codec::decodeVarInt(const uint8_t* data, size_t length, uint32_t& value) {
+    value = 0;
+    uint32_t multiplier = 1;
+    for (size_t i = 0; i < 4; i++) {
+        if (i >= length) {
+            return 0;
+        }
+        value += (data[i] & 0x7F) * multiplier;
+        if (!(data[i] & 0x80)) {
+            return (int)i + 1;
+        }
+        multiplier *= 128;
+    }
+    return -1;
+}
+
+bool MQTT5Codec::parseFixedHeader(const uint8_t* data, size_t length, MQTT5PacketType& type, uint8_t& flags,
+                                  uint32_t& remainingLength, uint8_t& headerLength, bool& malformed) {
+    malformed = false;
+    if (length < 2) {
+        return false;
+    }
+    int used = decodeVarInt(data + 1, length - 1, remainingLength);
+    if (used < 0) {
+        malformed = true;
+        return false;
+    }
+    if (used == 0) {
+        return false;
+    }
+    type = (MQTT5PacketType)(data[0] >> 4);
+    flags = data[0] & 0x0F;
+    headerLength = 1 + used;
+    return true;
+}
+
+size_t MQTT5Codec::encodeConnect(uint8_t* buffer, size_t size, const char* clientId, uint16_t keepAliveSeconds,
+                                 bool cleanStart, uint32_t sessionExpirySeconds, uint32_t maximumPacketSize) {
+    PacketWriter writer(buffer, size);
+    writer.string("MQTT");
+    writer.byte(5);
+    writer.byte(cleanStart ? 0x02 : 0x00);
+    writer.u16(keepAliveSeconds);
+
+    uint8_t properties = (sessionExpirySeconds ? 5 : 0) + (maximumPacketSize ? 5 : 0);
+    writer.varInt(properties);
+    if (sessionExpirySeconds) {
+        writer.byte(PropertySessionExpiry);
+        writer.u32(sessionExpirySeconds);
+    }
+    if (maximumPacketSize) {
+        writer.byte(PropertyMaximumPacketSize);
+        writer.u32(maximumPacketSize);
+    }
+    // No Topic Alias Maximum: the broker sends full topics to this client
+
+    writer.string(clientId);
+    return writer.finish((uint8_t)MQTT5PacketType::Connect << 4);
+}
+
+size_t MQTT5Codec::encodePublish(uint8_t* buffer, size_t size, const char* topic, const uint8_t* payload,
+                                 size_t payloadLength, uint8_t qos, bool retain, uint16_t packetId,
+                                 const MQTT5PublishProperties& properties) {
+    PacketWriter writer(buffer, size);
+    writer.string(topic);
+    if (qos > 0) {
+        writer.u16(packetId);
+    }
+
+    uint32_t propertiesLength = 0;
+    if (properties.messageExpirySeconds) {
+        propertiesLength += 5;
+    }
+    if (properties.topicAlias) {
+        propertiesLength += 3;
+    }
+    for (uint8_t i = 0; i < properties.userPropertyCount; i++) {
+        propertiesLength += 5 + strlen(properties.userProperties[i].key) + strlen(properties.userProperties[i].value);
+    }
+    writer.varInt(propertiesLength);
+    if (properties.messageExpirySeconds) {
+        writer.byte(PropertyMessageExpiry);
+        writer.u32(properties.messageExpirySeconds);
+    }
+    if (properties.topicAlias) {
+        writer.byte(PropertyTopicAlias);
+        writer.u16(properties.topicAlias);
+    }
+    for (uint8_t i = 0; i < properties.userPropertyCount; i++) {
+        writer.byte(PropertyUserProperty);
+        writer.string(properties.userProperties[i].key);
+        writer.string(properties.userProperties[i].value);
+    }
+
+    writer.bytes(payload, payloadLength);
+    uint8_t firstByte = (uint8_t)MQTT5PacketType::Publish << 4 | (qos & 0x03) << 1 | (retain ? 1 : 0);
+    return writer.finish(firstByte);
+}
+
+size_t MQTT5Codec::encodeSubscribe(uint8_t* buffer, size_t size, uint16_t packetId, const char* filter, uint8_t qos) {
+    PacketWriter writer(buffer, size);
+    writer.u16(packetId);
+    writer.varInt(0);
+    writer.string(filter);
+    writer.byte(qos & 0x03);
+    return writer.finish((uint8_t)MQTT5PacketType::Subscribe << 4 | 0x02);
+}
+
+size_t MQTT5Codec::encodeUnsubscribe(uint8_t* buffer, size_t size, uint16_t packetId, const char* filter) {
+    PacketWriter writer(buffer, size);
+    writer.u16(packetId);
+    writer.varInt(0);
+    writer.string(filter);
+    return writer.finish((uint8_t)MQTT5PacketType::Unsubscribe << 4 | 0x02);
+}
+
+size_t MQTT5Codec::encodeAck(uint8_t* buffer, size_t size, MQTT5PacketType type, uint16_t packetId) {
+    // Remaining length 2: reason code success and no properties (section 3.4.2.1)
+    PacketWriter writer(buffer, size);
+    writer.u16(packetId);
+    uint8_t flags = type == MQTT5PacketType::Pubrel ? 0x02 : 0x00;
+    return writer.finish((uint8_t)type << 4 | flags);
+}
+
+size_t MQTT5Codec::encodePingreq(uint8_t* buffer, size_t size) {
+    PacketWriter writer(buffer, size);
+    return writer.finish((uint8_t)MQTT5PacketType::Pingreq << 4);
+}
+
+size_t MQTT5Codec::encodeDisconnect(uint8_t* buffer, size_t size) {
+    PacketWriter writer(buffer, size);
+    return writer.finish((uint8_t)MQTT5PacketType::Disconnect << 4);
+}
+
+bool MQTT5Codec::nextProperty(const uint8_t*& position, const uint8_t* end, Property& property, bool& malformed) {
+    malformed = false;
+    if (position >= end) {
+        return false;
+    }
+    PacketReader reader(position, end - position);
+    uint8_t id;
+    reader.u8(id);
+    property = {};
+    property.id = id;
+
+    bool ok = false;
+    switch (propertyKind(id)) {
+        case PropertyKind::Byte: {
+            uint8_t value;
+            ok = reader.u8(value);
+            property.value = value;
+            break;
+        }
+        case PropertyKind::TwoByte: {
+            uint16_t value;
+            ok = reader.u16(value);
+            property.value = value;
+            break;
+        }
+        case PropertyKind::FourByte: {
+            uint16_t high, low;
+            ok = reader.u16(high) && reader.u16(low);
+            property.value = (uint32_t)high << 16 | low;
+            break;
+        }
+        case PropertyKind::VarInt:
+            ok = reader.varInt(property.value);
+            break;
+        case PropertyKind::String:
+        case PropertyKind::Binary: {
+            const char* data;
+            ok = reader.string(data, property.length);
+            property.data = (const uint8_t*)data;
+            break;
+        }
+        case PropertyKind::StringPair: {
+            const char* key;
+            const char* value;
+            ok = reader.string(key, property.length) && reader.string(value, property.length2);
+            property.data = (const uint8_t*)key;
+            property.data2 = (const uint8_t*)value;
+            break;
+        }
+        case PropertyKind::Unknown:
+            break;
+    }
+    if (!ok) {
+        malformed = true;
+        return false;
+    }
+    position = reader.position;
+    return true;
+}
+
+bool MQTT5Codec::parseConnack(const uint8_t* body, size_t length, Connack& connack) {
+    connack = {};
+    connack.receiveMaximum = 65535;
+    connack.maximumQos = 2;
+    connack.retainAvailable = true;
+
+    PacketReader reader(body, length);
+    uint8_t flags;
+    uint32_t propertiesLength;
+    if (!reader.u8(flags) || !reader.u8(connack.reasonCode)) {
+        return false;
+    }
+    connack.sessionPresent = flags & 0x01;
+    if (!reader.varInt(propertiesLength) || (size_t)(reader.end - reader.position) < propertiesLength) {
+        return false;
+    }
+
+    const uint8_t* position = reader.position;
+    const uint8_t* end = position + propertiesLength;
+    Property property;
+    bool malformed;
+    while (nextProperty(position, end, property, malformed)) {
+        switch (property.id) {
+            case PropertyTopicAliasMaximum: connack.topicAliasMaximum = property.value; break;
+            case PropertyReceiveMaximum: connack.receiveMaximum = property.value; break;
+            case PropertyMaximumQos: connack.maximumQos = property.value; break;
+            case PropertyRetainAvailable: connack.retainAvailable = property.value != 0; break;
+            case PropertyMaximumPacketSize: connack.maximumPacketSize = property.value; break;
+            case PropertyServerKeepAlive: connack.serverKeepAlive = property.value; break;
+        }
+    }
+    return !malformed;
+}
+
+bool MQTT5Codec::parsePublish(uint8_t flags, const uint8_t* body, size_t length, Publish& publish) {
+    publish = {};
+    publish.qos = (flags >> 1) & 0x03;
+    publish.retain = flags & 0x01;
+    publish.dup = flags & 0x08;
+    if (publish.qos > 2) {
+        return false;
+    }
+
+    PacketReader reader(body, length);
+    if (!reader.string(publish.topic, publish.topicLength)) {
+        return false;
+    }
+    if (publish.qos > 0 && !reader.u16(publish.packetId)) {
+        return false;
+    }
+    if (!reader.varInt(publish.propertiesLength) ||
+        (size_t)(reader.end - reader.position) < publish.propertiesLength) {
+        return false;
+    }
+    publish.properties = reader.position;
+    reader.skip(publish.propertiesLength);
+    publish.payload = reader.position;
+    publish.payloadLength = reader.end - reader.position;
+
+    const uint8_t* position = publish.properties;
+    const uint8_t* end = position + publish.propertiesLength;
+    Property property;
+    bool malformed;
+    while (nextProperty(position, end, property, malformed)) {
+        if (property.id == PropertyTopicAlias) {
+            publish.topicAlias = property.value;
+        } else if (property.id == PropertyMessageExpiry) {
+            publish.messageExpirySeconds = property.value;
+        }
+    }
+    return !malformed;
+}
+
+bool MQTT5Codec::parseAck(MQTT5PacketType type, const uint8_t* body, size_t length, Ack& ack) {
+    ack = {};
+    PacketReader reader(body, length);
+    if (!reader.u16(ack.packetId)) {
+        return false;
+    }
+    if (type == MQTT5PacketType::Suback || type == MQTT5PacketType::Unsuback) {
+        // Properties, then one reason code per filter
+        uint32_t propertiesLength;
+        return reader.varInt(propertiesLength) && reader.skip(propertiesLength) && reader.u8(ack.reasonCode);
+    }
+    // Reason code and properties may be left out when the reason is success
+    if (!reader.u8(ack.reasonCode)) {
+        ack.reasonCode = 0;
+    }
+    return true;
+}
+
+uint8_t MQTT5Codec::parseDisconnect(const uint8_t* body, size_t length) {
+    return length > 0 ? body[0] : 0;
+}
+
+bool MQTT5Codec::findUserProperty(const uint8_t* properties, uint32_t length, const char* key,
+                                  const char*& value, uint16_t& valueLength) {
+    size_t keyLength = strlen(key);
+    const uint8_t* position = properties;
+    const uint8_t* end = properties + length;
+    Property property;
+    bool malformed;
+    while (nextProperty(position, end, property, malformed)) {
+        if (property.id == PropertyUserProperty && property.length == keyLength &&
+            memcmp(property.data, key, keyLength) == 0) {
+            value = (const char*)property.data2;
+            valueLength = property.length2;
+            return true;
+        }
+    }
+    return false;
+}
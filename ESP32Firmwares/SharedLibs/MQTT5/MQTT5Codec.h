@@ -0,0 +1,129 @@
+#ifndef MQTT5CODEC_H
+#define MQTT5CODEC_H
+
+// Encoding and parsing of the MQTT 5 packets a sensor client needs:
+// CONNECT/CONNACK, PUBLISH with topic alias, message expiry and user
+// properties, the QoS 1/2 acknowledgements, SUBSCRIBE/UNSUBSCRIBE, PING and
+// DISCONNECT. No will, no authentication.
+//
+// Encoders write a complete packet into the caller's buffer and return its
+// length, 0 if it does not fit. Parsers take the packet body (everything
+// after the fixed header) and point into it, nothing is copied.
+//
+// Free of Arduino dependencies (host tests in
+// TemperatureSensor2.Firmware/test/test_mqtt5).
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum class MQTT5PacketType : uint8_t {
+    Connect = 1,
+    Connack = 2,
+    Publish = 3,
+    Puback = 4,
+    Pubrec = 5,
+    Pubrel = 6,
+    Pubcomp = 7,
+    Subscribe = 8,
+    Suback = 9,
+    Unsubscribe = 10,
+    Unsuback = 11,
+    Pingreq = 12,
+    Pingresp = 13,
+    Disconnect = 14
+};
+
+struct MQTT5UserProperty {
+    const char* key;
+    const char* value;
+};
+
+struct MQTT5PublishProperties {
+    uint16_t topicAlias = 0;                // 0 = none
+    uint32_t messageExpirySeconds = 0;      // 0 = never expires
+    const MQTT5UserProperty* userProperties = nullptr;
+    uint8_t userPropertyCount = 0;
+};
+
+class MQTT5Codec {
+public:
+    // One property of a CONNACK, PUBLISH, ... property list
+    struct Property {
+        uint8_t id;
+        uint32_t value;           // Byte, two byte, four byte and variable byte integers
+        const uint8_t* data;      // Strings and binary data, not terminated
+        uint16_t length;
+        const uint8_t* data2;     // Value of a user property (string pair)
+        uint16_t length2;
+    };
+
+    struct Connack {
+        bool sessionPresent;
+        uint8_t reasonCode;                 // 0 = success
+        uint16_t topicAliasMaximum;         // 0 = the broker accepts no aliases
+        uint16_t receiveMaximum;
+        uint8_t maximumQos;
+        bool retainAvailable;
+        uint32_t maximumPacketSize;         // 0 = no limit
+        uint16_t serverKeepAlive;           // 0 = the client's value applies
+    };
+
+    struct Publish {
+        const char* topic;                  // Not terminated; empty if only an alias was sent
+        uint16_t topicLength;
+        uint16_t packetId;
+        uint8_t qos;
+        bool retain;
+        bool dup;
+        uint16_t topicAlias;
+        uint32_t messageExpirySeconds;      // 0 = none
+        const uint8_t* properties;
+        uint32_t propertiesLength;
+        const uint8_t* payload;
+        uint32_t payloadLength;
+    };
+
+    struct Ack {
+        uint16_t packetId;
+        uint8_t reasonCode;                 // First reason code for SUBACK/UNSUBACK
+    };
+
+    // Variable byte integer: returns the bytes written (1-4)
+    static uint8_t encodeVarInt(uint32_t value, uint8_t* out);
+    // Returns the bytes used, 0 if more data is needed, -1 if malformed
+    static int decodeVarInt(const uint8_t* data, size_t length, uint32_t& value);
+
+    // Fixed header of a received packet: true once it is complete
+    static bool parseFixedHeader(const uint8_t* data, size_t length, MQTT5PacketType& type, uint8_t& flags,
+                                 uint32_t& remainingLength, uint8_t& headerLength, bool& malformed);
+
+    // sessionExpirySeconds 0 ends the session with the connection, 0xFFFFFFFF keeps it forever.
+    // maximumPacketSize tells the broker the size of the receive buffer.
+    static size_t encodeConnect(uint8_t* buffer, size_t size, const char* clientId, uint16_t keepAliveSeconds,
+                                bool cleanStart, uint32_t sessionExpirySeconds, uint32_t maximumPacketSize);
+    // topic may be nullptr or empty when properties.topicAlias is an alias the broker already knows
+    static size_t encodePublish(uint8_t* buffer, size_t size, const char* topic, const uint8_t* payload,
+                                size_t payloadLength, uint8_t qos, bool retain, uint16_t packetId,
+                                const MQTT5PublishProperties& properties);
+    static size_t encodeSubscribe(uint8_t* buffer, size_t size, uint16_t packetId, const char* filter, uint8_t qos);
+    static size_t encodeUnsubscribe(uint8_t* buffer, size_t size, uint16_t packetId, const char* filter);
+    // PUBACK, PUBREC, PUBREL, PUBCOMP with reason code success
+    static size_t encodeAck(uint8_t* buffer, size_t size, MQTT5PacketType type, uint16_t packetId);
+    static size_t encodePingreq(uint8_t* buffer, size_t size);
+    static size_t encodeDisconnect(uint8_t* buffer, size_t size);
+
+    static bool parseConnack(const uint8_t* body, size_t length, Connack& connack);
+    static bool parsePublish(uint8_t flags, const uint8_t* body, size_t length, Publish& publish);
+    // PUBACK, PUBREC, PUBREL, PUBCOMP, SUBACK, UNSUBACK
+    static bool parseAck(MQTT5PacketType type, const uint8_t* body, size_t length, Ack& ack);
+    // Reason code of a DISCONNECT from the broker
+    static uint8_t parseDisconnect(const uint8_t* body, size_t length);
+
+    // Walks a property list: call with position = properties until it returns false
+    static bool nextProperty(const uint8_t*& position, const uint8_t* end, Property& property, bool& malformed);
+    // Value of the first user property with this key
+    static bool findUserProperty(const uint8_t* properties, uint32_t length, const char* key,
+                                 const char*& value, uint16_t& valueLength);
+};
+
+#endif // MQTT5CODEC_H
@@ -0,0 +1,443 @@
+#include "MQTT5Session.h"
+#include <string.h>
+
+// Upper bound for the alias table, whatever the broker allows: aliases pay
+// off for the few topics a device publishes over and over
+static const uint16_t MaxTopicAliases = 32;
+
+// Acknowledgements, PINGREQ and DISCONNECT are encoded behind the same
+// reserved five byte fixed header as every other packet
+static const size_t ControlPacketSize = 8;
+
+MQTT5Session::MQTT5Session(size_t bufferSize)
+    : txBuffer(new uint8_t[bufferSize]), rxBuffer(new uint8_t[bufferSize]), bufferSize(bufferSize) {
+}
+
+void MQTT5Session::begin(MQTT5Transport* transport, MQTT5MessageHandler handler) {
+    this->transport = transport;
+    this->handler = handler;
+}
+
+bool MQTT5Session::connect(const char* clientId, bool cleanStart, uint32_t sessionExpirySeconds) {
+    isConnected = false;
+    rxLength = 0;
+    pingOutstanding = false;
+    // A new connection acknowledges nothing of the old one
+    inFlight.clear();
+    // Aliases are bound to the network connection
+    aliases.clear();
+    error = Error::None;
+    reasonCode = 0;
+
+    size_t length = MQTT5Codec::encodeConnect(txBuffer.get(), bufferSize, clientId, keepAliveSeconds, cleanStart,
+                                              sessionExpirySeconds, bufferSize);
+    if (length == 0) {
+        error = Error::BufferTooSmall;
+        return false;
+    }
+    if (!send(txBuffer.get(), length) || !waitFor(MQTT5PacketType::Connack, 0)) {
+        return false;
+    }
+    if (awaitedReason >= 0x80) {
+        error = Error::Refused;
+        reasonCode = awaitedReason;
+        return false;
+    }
+    if (connackInfo.serverKeepAlive) {
+        keepAliveSeconds = connackInfo.serverKeepAlive;
+    }
+    isConnected = true;
+    return true;
+}
+
+bool MQTT5Session::loop() {
+    if (!isConnected) {
+        return false;
+    }
+    if (!transport->connected()) {
+        fail(Error::ConnectionClosed);
+        return false;
+    }
+    if (!receive()) {
+        return false;
+    }
+
+    uint32_t now = transport->nowMs();
+    if (pingOutstanding) {
+        if (now - pingSentMs >= (uint32_t)keepAliveSeconds * 500) {
+            fail(Error::PingTimeout);
+            return false;
+        }
+    } else if (keepAliveSeconds && now - lastSendMs >= (uint32_t)keepAliveSeconds * 1000) {
+        uint8_t ping[ControlPacketSize];
+        if (!send(ping, MQTT5Codec::encodePingreq(ping, sizeof(ping)))) {
+            return false;
+        }
+        pingOutstanding = true;
+        pingSentMs = now;
+    }
+    return isConnected;
+}
+
+void MQTT5Session::disconnect() {
+    if (isConnected) {
+        uint8_t packet[ControlPacketSize];
+        transport->write(packet, MQTT5Codec::encodeDisconnect(packet, sizeof(packet)));
+    }
+    isConnected = false;
+}
+
+bool MQTT5Session::publish(const char* topic, const uint8_t* payload, size_t length, bool retained, uint8_t qos,
+                           uint32_t messageExpirySeconds, const MQTT5UserProperty* userProperties,
+                           uint8_t userPropertyCount) {
+    if (!isConnected) {
+        error = Error::NotConnected;
+        return false;
+    }
+    // The broker's limits from CONNACK
+    if (qos > connackInfo.maximumQos) {
+        qos = connackInfo.maximumQos;
+    }
+    if (!connackInfo.retainAvailable) {
+        retained = false;
+    }
+
+    bool known = false;
+    MQTT5PublishProperties properties;
+    properties.topicAlias = aliasFor(topic, known);
+    properties.messageExpirySeconds = messageExpirySeconds;
+    properties.userProperties = userProperties;
+    properties.userPropertyCount = userPropertyCount;
+
+    uint16_t id = qos > 0 ? packetId() : 0;
+    size_t packetLength = MQTT5Codec::encodePublish(txBuffer.get(), bufferSize, known ? nullptr : topic,
+                                                    payload, length, qos, retained, id, properties);
+    if (packetLength == 0 || (connackInfo.maximumPacketSize && packetLength > connackInfo.maximumPacketSize)) {
+        if (properties.topicAlias && !known) {
+            // Never reached the broker: the alias is free again
+            aliases.pop_back();
+        }
+        error = Error::BufferTooSmall;
+        return false;
+    }
+    if (!send(txBuffer.get(), packetLength)) {
+        return false;
+    }
+    sessionStats.publishes++;
+    if (known) {
+        sessionStats.aliasedPublishes++;
+        sessionStats.bytesSaved += strlen(topic);
+    }
+
+    // Inside a message handler the packet being handled is still in the
+    // receive buffer: the acknowledgement is not awaited there
+    if (qos == 0 || dispatching) {
+        return true;
+    }
+    if (qos == 1 && pipelining) {
+        inFlight.push_back(id);
+        size_t window = connackInfo.receiveMaximum < MaxInFlight ? connackInfo.receiveMaximum : MaxInFlight;
+        // The next publish may only go out once the window has room again
+        return waitForInFlight(window > 0 ? window - 1 : 0);
+    }
+    MQTT5PacketType ackType = qos == 1 ? MQTT5PacketType::Puback : MQTT5PacketType::Pubrec;
+    if (!waitFor(ackType, id)) {
+        return false;
+    }
+    if (awaitedReason >= 0x80) {
+        error = Error::Refused;
+        reasonCode = awaitedReason;
+        return false;
+    }
+    if (qos == 2) {
+        uint8_t release[ControlPacketSize];
+        if (!send(release, MQTT5Codec::encodeAck(release, sizeof(release), MQTT5PacketType::Pubrel, id)) ||
+            !waitFor(MQTT5PacketType::Pubcomp, id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MQTT5Session::subscribe(const char* filter, uint8_t qos) {
+    if (!isConnected) {
+        error = Error::NotConnected;
+        return false;
+    }
+    uint16_t id = packetId();
+    size_t length = MQTT5Codec::encodeSubscribe(txBuffer.get(), bufferSize, id, filter, qos);
+    if (length == 0) {
+        error = Error::BufferTooSmall;
+        return false;
+    }
+    if (!send(txBuffer.get(), length)) {
+        return false;
+    }
+    if (dispatching) {
+        return true;
+    }
+    if (!waitFor(MQTT5PacketType::Suback, id)) {
+        return false;
+    }
+    if (awaitedReason >= 0x80) {
+        error = Error::Refused;
+        reasonCode = awaitedReason;
+        return false;
+    }
+    return true;
+}
+
+void MQTT5Session::beginPipeline() {
+    pipelining = true;
+    pipelineRefused = false;
+}
+
+bool MQTT5Session::endPipeline() {
+    pipelining = false;
+    bool acknowledged = isConnected && waitForInFlight(0);
+    inFlight.clear();
+    return acknowledged && !pipelineRefused;
+}
+
+bool MQTT5Session::unsubscribe(const char* filter) {
+    if (!isConnected) {
+        error = Error::NotConnected;
+        return false;
+    }
+    uint16_t id = packetId();
+    size_t length = MQTT5Codec::encodeUnsubscribe(txBuffer.get(), bufferSize, id, filter);
+    if (length == 0) {
+        error = Error::BufferTooSmall;
+        return false;
+    }
+    if (!send(txBuffer.get(), length)) {
+        return false;
+    }
+    return dispatching || waitFor(MQTT5PacketType::Unsuback, id);
+}
+
+uint16_t MQTT5Session::packetId() {
+    uint16_t id = nextPacketId++;
+    if (nextPacketId == 0) {
+        nextPacketId = 1;
+    }
+    return id;
+}
+
+bool MQTT5Session::send(const uint8_t* data, size_t length) {
+    if (!transport->write(data, length)) {
+        fail(Error::WriteFailed);
+        return false;
+    }
+    lastSendMs = transport->nowMs();
+    return true;
+}
+
+bool MQTT5Session::waitFor(MQTT5PacketType type, uint16_t id) {
+    awaitedType = type;
+    awaitedPacketId = id;
+    awaitedReceived = false;
+    uint32_t startMs = transport->nowMs();
+    while (true) {
+        if (!receive()) {
+            return false;
+        }
+        if (awaitedReceived) {
+            return true;
+        }
+        if (transport->nowMs() - startMs >= timeoutMs) {
+            fail(Error::Timeout);
+            return false;
+        }
+        transport->idle();
+    }
+}
+
+bool MQTT5Session::waitForInFlight(size_t limit) {
+    uint32_t startMs = transport->nowMs();
+    size_t outstanding = inFlight.size();
+    while (inFlight.size() > limit) {
+        if (!receive()) {
+            return false;
+        }
+        if (inFlight.size() < outstanding) {
+            // The timeout applies to each acknowledgement, not to the whole window
+            outstanding = inFlight.size();
+            startMs = transport->nowMs();
+            continue;
+        }
+        if (transport->nowMs() - startMs >= timeoutMs) {
+            fail(Error::Timeout);
+            return false;
+        }
+        transport->idle();
+    }
+    return true;
+}
+
+bool MQTT5Session::receive() {
+    if (rxLength < bufferSize) {
+        int count = transport->read(rxBuffer.get() + rxLength, bufferSize - rxLength);
+        if (count < 0) {
+            fail(Error::ConnectionClosed);
+            return false;
+        }
+        rxLength += count;
+    }
+
+    size_t offset = 0;
+    bool ok = true;
+    while (ok) {
+        MQTT5PacketType type;
+        uint8_t flags;
+        uint32_t remainingLength;
+        uint8_t headerLength;
+        bool malformed;
+        if (!MQTT5Codec::parseFixedHeader(rxBuffer.get() + offset, rxLength - offset, type, flags,
+                                          remainingLength, headerLength, malformed)) {
+            if (malformed) {
+                fail(Error::MalformedPacket);
+                ok = false;
+            }
+            break;
+        }
+        size_t packetLength = headerLength + remainingLength;
+        if (packetLength > bufferSize) {
+            // CONNECT announced the buffer size as Maximum Packet Size
+            fail(Error::BufferTooSmall);
+            ok = false;
+            break;
+        }
+        if (rxLength - offset < packetLength) {
+            break;
+        }
+        ok = handlePacket(type, flags, rxBuffer.get() + offset + headerLength, remainingLength);
+        offset += packetLength;
+    }
+
+    if (!ok) {
+        rxLength = 0;
+        return false;
+    }
+    if (offset > 0) {
+        memmove(rxBuffer.get(), rxBuffer.get() + offset, rxLength - offset);
+        rxLength -= offset;
+    }
+    return true;
+}
+
+bool MQTT5Session::handlePacket(MQTT5PacketType type, uint8_t flags, const uint8_t* body, size_t length) {
+    switch (type) {
+        case MQTT5PacketType::Connack:
+            if (!MQTT5Codec::parseConnack(body, length, connackInfo)) {
+                fail(Error::MalformedPacket);
+                return false;
+            }
+            if (awaitedType == MQTT5PacketType::Connack) {
+                awaitedReceived = true;
+                awaitedReason = connackInfo.reasonCode;
+            }
+            return true;
+
+        case MQTT5PacketType::Publish: {
+            MQTT5Codec::Publish publish;
+            if (!MQTT5Codec::parsePublish(flags, body, length, publish)) {
+                fail(Error::MalformedPacket);
+                return false;
+            }
+            handlePublish(publish);
+            if (publish.qos > 0) {
+                uint8_t ack[ControlPacketSize];
+                MQTT5PacketType ackType = publish.qos == 1 ? MQTT5PacketType::Puback : MQTT5PacketType::Pubrec;
+                return send(ack, MQTT5Codec::encodeAck(ack, sizeof(ack), ackType, publish.packetId));
+            }
+            return true;
+        }
+
+        case MQTT5PacketType::Pubrel: {
+            // QoS 2 from the broker: the message was delivered on PUBLISH already
+            MQTT5Codec::Ack ack;
+            if (!MQTT5Codec::parseAck(type, body, length, ack)) {
+                fail(Error::MalformedPacket);
+                return false;
+            }
+            uint8_t complete[ControlPacketSize];
+            return send(complete, MQTT5Codec::encodeAck(complete, sizeof(complete), MQTT5PacketType::Pubcomp, ack.packetId));
+        }
+
+        case MQTT5PacketType::Puback:
+        case MQTT5PacketType::Pubrec:
+        case MQTT5PacketType::Pubcomp:
+        case MQTT5PacketType::Suback:
+        case MQTT5PacketType::Unsuback: {
+            MQTT5Codec::Ack ack;
+            if (!MQTT5Codec::parseAck(type, body, length, ack)) {
+                fail(Error::MalformedPacket);
+                return false;
+            }
+            if (type == awaitedType && ack.packetId == awaitedPacketId) {
+                awaitedReceived = true;
+                awaitedReason = ack.reasonCode;
+            }
+            if (type == MQTT5PacketType::Puback) {
+                for (size_t i = 0; i < inFlight.size(); i++) {
+                    if (inFlight[i] == ack.packetId) {
+                        inFlight.erase(inFlight.begin() + i);
+                        if (ack.reasonCode >= 0x80) {
+                            pipelineRefused = true;
+                            reasonCode = ack.reasonCode;
+                        }
+                        break;
+                    }
+                }
+            }
+            return true;
+        }
+
+        case MQTT5PacketType::Pingresp:
+            pingOutstanding = false;
+            return true;
+
+        case MQTT5PacketType::Disconnect:
+            reasonCode = MQTT5Codec::parseDisconnect(body, length);
+            fail(Error::ConnectionClosed);
+            return false;
+
+        default:
+            return true;
+    }
+}
+
+void MQTT5Session::handlePublish(const MQTT5Codec::Publish& publish) {
+    // CONNECT allows no aliases towards this client, so every message names its topic
+    if (publish.topicLength == 0 || publish.topicLength >= sizeof(topicBuffer) || !handler) {
+        return;
+    }
+    memcpy(topicBuffer, publish.topic, publish.topicLength);
+    topicBuffer[publish.topicLength] = '\0';
+
+    dispatching = true;
+    handler(topicBuffer, publish.payload, publish.payloadLength, publish);
+    dispatching = false;
+}
+
+uint16_t MQTT5Session::aliasFor(const char* topic, bool& known) {
+    for (size_t i = 0; i < aliases.size(); i++) {
+        if (aliases[i] == topic) {
+            known = true;
+            return i + 1;
+        }
+    }
+    known = false;
+    uint16_t maximum = connackInfo.topicAliasMaximum < MaxTopicAliases ? connackInfo.topicAliasMaximum : MaxTopicAliases;
+    if (aliases.size() >= maximum) {
+        return 0;
+    }
+    aliases.push_back(topic);
+    return aliases.size();
+}
+
+void MQTT5Session::fail(Error reason) {
+    error = reason;
+    isConnected = false;
+}
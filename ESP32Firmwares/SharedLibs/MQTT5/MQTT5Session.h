@@ -0,0 +1,152 @@
+#ifndef MQTT5SESSION_H
+#define MQTT5SESSION_H
+
+// MQTT 5 client session over any byte stream (WiFiClient on the device, a
+// POSIX socket in the host tests).
+//
+// - Topic aliases: the first publish to a topic sends the topic together
+//   with a new alias, every later one only the two byte alias. The table is
+//   sized by the broker's Topic Alias Maximum and starts empty on every
+//   connect (aliases live only as long as the network connection). When it
+//   is full, further topics are sent in full.
+// - Message expiry and user properties per publish (MQTT5PublishProperties).
+// - QoS 0, 1 and 2 in both directions; acknowledgements are awaited with a
+//   timeout like the 3.1.1 client does, except for publishes and
+//   subscriptions made inside the message handler.
+// - Pipelined QoS 1 publishes between beginPipeline() and endPipeline():
+//   publish() returns once the packet is written, up to the broker's Receive
+//   Maximum (at most MaxInFlight) PUBACKs are outstanding at a time, and
+//   endPipeline() waits for the rest.
+// - Keep alive: PINGREQ after keepAlive seconds without sending, connection
+//   considered lost when the PINGRESP does not arrive within another half.
+//
+// Free of Arduino dependencies.
+
+#include "MQTT5Codec.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Byte stream and clock the session runs on
+class MQTT5Transport {
+public:
+    virtual ~MQTT5Transport() {}
+    // Whatever is available without waiting: bytes read, 0 if none, -1 if closed
+    virtual int read(uint8_t* data, size_t length) = 0;
+    virtual bool write(const uint8_t* data, size_t length) = 0;
+    virtual bool connected() = 0;
+    virtual uint32_t nowMs() = 0;
+    // Called while waiting for an acknowledgement
+    virtual void idle() {}
+};
+
+// topic is terminated; payload points into the receive buffer and is only valid during the call
+typedef std::function<void(const char* topic, const uint8_t* payload, size_t length,
+                           const MQTT5Codec::Publish& publish)> MQTT5MessageHandler;
+
+struct MQTT5SessionStats {
+    uint32_t publishes;
+    uint32_t aliasedPublishes;    // Sent with the alias only
+    uint32_t bytesSaved;          // Topic bytes left out thanks to aliases
+};
+
+class MQTT5Session {
+public:
+    enum class Error : uint8_t {
+        None,
+        NotConnected,
+        BufferTooSmall,
+        WriteFailed,
+        Timeout,
+        Refused,            // Negative reason code in CONNACK, PUBACK, SUBACK, ...
+        MalformedPacket,
+        ConnectionClosed,
+        PingTimeout
+    };
+
+    explicit MQTT5Session(size_t bufferSize);
+
+    void begin(MQTT5Transport* transport, MQTT5MessageHandler handler);
+    void setKeepAlive(uint16_t seconds) { keepAliveSeconds = seconds; }
+    void setTimeout(uint32_t ms) { timeoutMs = ms; }
+
+    // Sends CONNECT on the open transport and waits for CONNACK
+    bool connect(const char* clientId, bool cleanStart, uint32_t sessionExpirySeconds);
+    // Reads and handles everything available, keeps the connection alive;
+    // false once the connection is lost
+    bool loop();
+    bool connected() const { return isConnected; }
+    // Sends DISCONNECT; the caller closes the transport
+    void disconnect();
+
+    bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained, uint8_t qos,
+                 uint32_t messageExpirySeconds = 0, const MQTT5UserProperty* userProperties = nullptr,
+                 uint8_t userPropertyCount = 0);
+    bool subscribe(const char* filter, uint8_t qos = 0);
+
+    static const size_t MaxInFlight = 16;
+    void beginPipeline();
+    // Waits for the outstanding PUBACKs; false if one timed out or was refused,
+    // or the connection was lost
+    bool endPipeline();
+    size_t inFlightCount() const { return inFlight.size(); }
+    bool unsubscribe(const char* filter);
+
+    Error lastError() const { return error; }
+    // Reason code of the last refused CONNECT, PUBLISH, SUBSCRIBE or of a DISCONNECT from the broker
+    uint8_t lastReasonCode() const { return reasonCode; }
+    const MQTT5Codec::Connack& connack() const { return connackInfo; }
+    const MQTT5SessionStats& stats() const { return sessionStats; }
+    // Aliases in use on this connection
+    size_t aliasCount() const { return aliases.size(); }
+
+private:
+    MQTT5Transport* transport = nullptr;
+    MQTT5MessageHandler handler;
+    std::unique_ptr<uint8_t[]> txBuffer;
+    std::unique_ptr<uint8_t[]> rxBuffer;
+    size_t bufferSize;
+    size_t rxLength = 0;
+    char topicBuffer[256];
+
+    uint16_t keepAliveSeconds = 60;
+    uint32_t timeoutMs = 1000;
+    bool isConnected = false;
+    bool dispatching = false;      // Inside the message handler
+    Error error = Error::None;
+    uint8_t reasonCode = 0;
+    uint16_t nextPacketId = 1;
+    uint32_t lastSendMs = 0;
+    uint32_t pingSentMs = 0;
+    bool pingOutstanding = false;
+    MQTT5Codec::Connack connackInfo = {};
+    MQTT5SessionStats sessionStats = {};
+
+    // Alias n is aliases[n - 1]
+    std::vector<std::string> aliases;
+
+    // Packet ids of pipelined publishes without PUBACK yet
+    std::vector<uint16_t> inFlight;
+    bool pipelining = false;
+    bool pipelineRefused = false;
+
+    // Acknowledgement the session waits for
+    MQTT5PacketType awaitedType = MQTT5PacketType::Connack;
+    uint16_t awaitedPacketId = 0;
+    bool awaitedReceived = false;
+    uint8_t awaitedReason = 0;
+
+    uint16_t packetId();
+    bool send(const uint8_t* data, size_t length);
+    bool waitFor(MQTT5PacketType type, uint16_t id);
+    // Receives until at most limit pipelined publishes are unacknowledged
+    bool waitForInFlight(size_t limit);
+    bool receive();
+    bool handlePacket(MQTT5PacketType type, uint8_t flags, const uint8_t* body, size_t length);
+    void handlePublish(const MQTT5Codec::Publish& publish);
+    uint16_t aliasFor(const char* topic, bool& known);
+    void fail(Error reason);
+};
+
+#endif // MQTT5SESSION_H
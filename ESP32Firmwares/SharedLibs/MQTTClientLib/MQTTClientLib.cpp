@@ -0,0 +1,606 @@
+#include "MQTTClientLib.h"
+#include "MQTTQueueStorage.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <lwip/sockets.h>
+
+// MQTT5Session on the WiFiClient that the state machine connected
+class WiFiClientTransport : public MQTT5Transport {
+public:
+    explicit WiFiClientTransport(WiFiClient& client) : client(client) {}
+
+    int read(uint8_t* data, size_t length) override {
+        int available = client.available();
+        if (available <= 0) {
+            return client.connected() ? 0 : -1;
+        }
+        return client.read(data, (size_t)available < length ? available : length);
+    }
+
+    bool write(const uint8_t* data, size_t length) override {
+        return client.write(data, length) == length;
+    }
+
+    bool connected() override { return client.connected(); }
+    uint32_t nowMs() override { return millis(); }
+    void idle() override { delay(1); }
+
+private:
+    WiFiClient& client;
+};
+
+MQTTClientLib::MQTTClientLib(const String& mqtt_broker, int mqtt_port, const String& clientId, WiFiClient& wifiClient, MQTTClientCallbackSimple callback)
+    : mqttClient(MQTT_MAX_PACKET_SIZE), wifiClient(wifiClient), clientId(clientId), mqtt_broker(mqtt_broker), mqtt_port(mqtt_port), callback(callback) {
+    mqttClient.begin(this->mqtt_broker.c_str(), mqtt_port, wifiClient);
+    mqttClient.onMessageAdvanced([this](MQTTClient* client, char topic[], char bytes[], int length) {
+        handleMessage(topic, bytes, length);
+    });
+    mqttClient.setOptions(60, cleanSession, commandTimeoutMs);
+    stateSinceMs = millis();
+}
+
+const char* MQTTClientLib::stateName(State state) {
+    switch (state) {
+        case State::WaitingForNetwork: return "waiting_for_network";
+        case State::Backoff: return "backoff";
+        case State::Resolving: return "resolving";
+        case State::TcpConnecting: return "tcp_connecting";
+        case State::MqttConnecting: return "mqtt_connecting";
+        case State::Subscribing: return "subscribing";
+        case State::Connected: return "connected";
+    }
+    return "unknown";
+}
+
+bool MQTTClientLib::connect(bool cleanSession, uint32_t timeoutMs) {
+    this->cleanSession = cleanSession;
+    mqttClient.setCleanSession(cleanSession);
+    if (currentState == State::Backoff) {
+        // An explicit connect does not wait for a pending backoff
+        nextAttemptMs = millis();
+    }
+
+    unsigned long startMs = millis();
+    while (millis() - startMs < timeoutMs) {
+        if (loop()) {
+            return true;
+        }
+        delay(10);
+    }
+    Serial.print("MQTT not connected after ");
+    Serial.print(timeoutMs);
+    Serial.print(" ms (");
+    Serial.print(stateName(currentState));
+    Serial.println("), retrying in the background");
+    return false;
+}
+
+bool MQTTClientLib::loop() {
+    if (currentState == State::Connected) {
+        if (WiFi.status() == WL_CONNECTED && clientLoop()) {
+            drainQueue();
+            return true;
+        }
+        connectionLost();
+        return false;
+    }
+    step();
+    return currentState == State::Connected;
+}
+
+void MQTTClientLib::step() {
+    unsigned long now = millis();
+    if (WiFi.status() != WL_CONNECTED) {
+        if (currentState != State::WaitingForNetwork) {
+            closeSocket();
+            wifiClient.stop();
+            setState(State::WaitingForNetwork);
+            wifiNudgeMs = now;
+        } else if (now - wifiNudgeMs >= 30000) {
+            WiFi.reconnect();
+            wifiNudgeMs = now;
+        }
+        return;
+    }
+
+    switch (currentState) {
+        case State::WaitingForNetwork:
+            // First attempt right after WiFi is back
+            nextAttemptMs = now;
+            setState(State::Backoff);
+            break;
+
+        case State::Backoff:
+            if ((long)(now - nextAttemptMs) >= 0) {
+                attemptStartMs = now;
+                setState(State::Resolving);
+            }
+            break;
+
+        case State::Resolving:
+            if (!brokerResolved) {
+                // An IP literal needs no lookup; a host name is resolved once and reused
+                if (!brokerAddress.fromString(mqtt_broker) &&
+                    !WiFi.hostByName(mqtt_broker.c_str(), brokerAddress)) {
+                    failAttempt("DNS lookup failed");
+                    break;
+                }
+                brokerResolved = true;
+            }
+            startTcpConnect();
+            break;
+
+        case State::TcpConnecting:
+            pollTcpConnect();
+            break;
+
+        case State::MqttConnecting:
+            // Network connection is already up: only CONNECT/CONNACK
+            if (!clientConnect()) {
+                failAttempt("no CONNACK");
+                break;
+            }
+            connectionStats.connects++;
+            connectionStats.lastConnectMs = now - attemptStartMs;
+            if (connectionStats.lastConnectMs > connectionStats.maxConnectMs) {
+                connectionStats.maxConnectMs = connectionStats.lastConnectMs;
+            }
+            replayIndex = 0;
+            setState(State::Subscribing);
+            break;
+
+        case State::Subscribing:
+            if (!clientLoop()) {
+                failAttempt("connection lost while subscribing");
+                break;
+            }
+            if (replayIndex < subscriptions.size()) {
+                // A copy: the message callback may change the list meanwhile
+                String topic = subscriptions[replayIndex++];
+                if (!clientSubscribe(topic.c_str())) {
+                    Serial.println("Failed to subscribe to topic: " + topic + ", Last Error: " + String(lastError()));
+                }
+                break;
+            }
+            if (everConnected) {
+                uint32_t outageMs = now - outageStartMs;
+                connectionStats.lastOutageMs = outageMs;
+                connectionStats.totalOutageMs += outageMs;
+                if (outageMs > connectionStats.longestOutageMs) {
+                    connectionStats.longestOutageMs = outageMs;
+                }
+            }
+            everConnected = true;
+            consecutiveFailures = 0;
+            setState(State::Connected);
+            Serial.println("Connected to MQTT Broker " + mqtt_broker + " as " + clientId + " in " +
+                           String(connectionStats.lastConnectMs) + " ms, " + String(subscriptions.size()) + " subscriptions");
+            break;
+
+        case State::Connected:
+            break;
+    }
+}
+
+void MQTTClientLib::setState(State state) {
+    currentState = state;
+    stateSinceMs = millis();
+}
+
+void MQTTClientLib::startTcpConnect() {
+    socketFd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (socketFd < 0) {
+        failAttempt("no socket");
+        return;
+    }
+    fcntl(socketFd, F_SETFL, fcntl(socketFd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(mqtt_port);
+    address.sin_addr.s_addr = (uint32_t)brokerAddress;
+    if (::connect(socketFd, (struct sockaddr*)&address, sizeof(address)) < 0 && errno != EINPROGRESS) {
+        failAttempt("TCP connect failed");
+        return;
+    }
+    setState(State::TcpConnecting);
+}
+
+void MQTTClientLib::pollTcpConnect() {
+    fd_set writeSet;
+    FD_ZERO(&writeSet);
+    FD_SET(socketFd, &writeSet);
+    struct timeval noWait = {0, 0};
+    int ready = select(socketFd + 1, nullptr, &writeSet, nullptr, &noWait);
+    if (ready < 0) {
+        failAttempt("TCP select failed");
+        return;
+    }
+    if (ready == 0) {
+        if (millis() - stateSinceMs >= tcpConnectTimeoutMs) {
+            failAttempt("TCP connect timeout");
+        }
+        return;
+    }
+
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(socketFd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+        failAttempt("TCP connect refused");
+        return;
+    }
+
+    // Hand the connected socket to the WiFiClient, blocking again as
+    // WiFiClient::connect() leaves it; the MQTT client then skips its own connect
+    fcntl(socketFd, F_SETFL, fcntl(socketFd, F_GETFL, 0) & ~O_NONBLOCK);
+    int noDelay = 1;
+    setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    wifiClient = WiFiClient(socketFd);
+    socketFd = -1;
+    setState(State::MqttConnecting);
+}
+
+void MQTTClientLib::closeSocket() {
+    if (socketFd >= 0) {
+        close(socketFd);
+        socketFd = -1;
+    }
+}
+
+void MQTTClientLib::failAttempt(const char* reason) {
+    closeSocket();
+    wifiClient.stop();
+    connectionStats.failedAttempts++;
+    if (consecutiveFailures < 16) {
+        consecutiveFailures++;
+    }
+    // The broker may have moved: look the name up again now and then
+    if (consecutiveFailures % 4 == 0) {
+        brokerResolved = false;
+    }
+
+    // Exponential backoff, half fixed and half random ("equal jitter")
+    uint32_t delayMs = backoffMinMs;
+    for (uint8_t i = 1; i < consecutiveFailures && delayMs < backoffMaxMs; i++) {
+        delayMs *= 2;
+    }
+    if (delayMs > backoffMaxMs) {
+        delayMs = backoffMaxMs;
+    }
+    delayMs = delayMs / 2 + (uint32_t)random(delayMs / 2 + 1);
+    nextAttemptMs = millis() + delayMs;
+    setState(State::Backoff);
+
+    Serial.print("MQTT connect to ");
+    Serial.print(mqtt_broker);
+    Serial.print(" failed (");
+    Serial.print(reason);
+    Serial.print(", Last Error: ");
+    Serial.print(lastError());
+    Serial.print("), retry in ");
+    Serial.print(delayMs);
+    Serial.println(" ms");
+}
+
+void MQTTClientLib::connectionLost() {
+    connectionStats.disconnects++;
+    outageStartMs = millis();
+    Serial.print("MQTT connection lost, Last Error: ");
+    Serial.println(lastError());
+    clientDisconnect();
+    wifiClient.stop();
+    // Reconnect at once; only repeated failures back off
+    consecutiveFailures = 0;
+    nextAttemptMs = outageStartMs;
+    setState(WiFi.status() == WL_CONNECTED ? State::Backoff : State::WaitingForNetwork);
+}
+
+bool MQTTTopic::set(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(topic, sizeof(topic), format, args);
+    va_end(args);
+    if (written < 0 || (size_t)written > MaxLength) {
+        topic[0] = '\0';
+        topicLength = 0;
+        return false;
+    }
+    topicLength = written;
+    return true;
+}
+
+bool MQTTClientLib::publish(const char* topic, const char* payload, size_t length, bool retained, int qos) {
+    bool online = currentState == State::Connected || currentState == State::Subscribing;
+    if (queue.active() && (!online || !queue.empty())) {
+        return enqueue(topic, payload, length, retained, qos);
+    }
+    if (!online) {
+        publishingStats.failed++;
+        return false;
+    }
+    if (sendPublish(topic, payload, length, retained, qos, true)) {
+        return true;
+    }
+    return queue.active() && enqueue(topic, payload, length, retained, qos);
+}
+
+void MQTTClientLib::beginPipeline() {
+    pipelined = session && connected();
+    if (pipelined) {
+        session->beginPipeline();
+    }
+}
+
+bool MQTTClientLib::endPipeline() {
+    if (!pipelined) {
+        return true;
+    }
+    pipelined = false;
+    if (session->endPipeline()) {
+        return true;
+    }
+    publishingStats.failed++;
+    return false;
+}
+
+bool MQTTClientLib::beginQueue(uint32_t capacityBytes, const char* flashPath, MQTTQueueDropPolicy policy) {
+    std::unique_ptr<MQTTQueueStorage> storage;
+    const char* kind = "RAM";
+    if (psramFound() || !flashPath) {
+        MemoryQueueStorage* memory = new MemoryQueueStorage(capacityBytes);
+        storage.reset(memory);
+        if (!memory->valid()) {
+            Serial.println("No memory for the offline queue");
+            return false;
+        }
+        kind = memory->inPsram() ? "PSRAM" : "RAM";
+    } else {
+        FileQueueStorage* file = new FileQueueStorage(flashPath, capacityBytes);
+        storage.reset(file);
+        if (!file->begin()) {
+            return false;
+        }
+        kind = flashPath;
+    }
+    if (!drainBuffer) {
+        drainBuffer.reset(new char[MQTT_MAX_PACKET_SIZE]);
+    }
+
+    queueStorage = std::move(storage);
+    queue.begin(queueStorage.get(), policy);
+    Serial.println("Offline queue: " + String(capacityBytes) + " bytes in " + kind + ", " +
+                   String(queue.stats().depth) + " messages waiting");
+    return true;
+}
+
+void MQTTClientLib::setCoalescedTopics(const std::vector<String>& filters) {
+    coalescedTopics = filters;
+}
+
+void MQTTClientLib::setQueueDrainRate(uint16_t messagesPerSecond) {
+    drainIntervalMs = messagesPerSecond > 0 ? 1000 / messagesPerSecond : 0;
+}
+
+bool MQTTClientLib::enqueue(const char* topic, const char* payload, size_t length, bool retained, int qos) {
+    bool coalesce = false;
+    if (retained) {
+        for (const String& filter : coalescedTopics) {
+            if (topicMatches(filter.c_str(), topic)) {
+                coalesce = true;
+                break;
+            }
+        }
+    }
+    return queue.push(topic, payload, length, retained, qos, coalesce);
+}
+
+void MQTTClientLib::drainQueue() {
+    if (!queue.active() || queue.empty() || millis() - lastDrainMs < drainIntervalMs) {
+        return;
+    }
+    lastDrainMs = millis();
+
+    MQTTPublishQueue::Message message;
+    if (!queue.peek(message, drainBuffer.get(), MQTT_MAX_PACKET_SIZE)) {
+        return;
+    }
+    // On failure the message stays first in line; loop() notices the lost connection
+    if (sendPublish(message.topic, message.payload, message.payloadLength, message.retained, message.qos, false)) {
+        queue.pop();
+    }
+}
+
+void MQTTClientLib::handleMessage(const char* topic, const char* bytes, int length) {
+    if (logMessages) {
+        Serial.print("MQTT message on ");
+        Serial.print(topic);
+        Serial.print(", ");
+        Serial.print(length);
+        Serial.println(" bytes");
+    }
+    MQTTPayload payload = {bytes, (size_t)length};
+    if (router.dispatch(topic, payload)) {
+        return;
+    }
+    if (callback) {
+        String topicString(topic);
+        String payloadString;
+        payloadString.concat(bytes, length);
+        callback(topicString, payloadString);
+    }
+}
+
+bool MQTTClientLib::on(const String& filter, MQTTHandler handler) {
+    switch (router.add(filter.c_str(), handler)) {
+        case MQTTRouter::AddResult::Duplicate:
+            Serial.println("MQTT handler for " + filter + " already registered, ignored");
+            return false;
+        case MQTTRouter::AddResult::Overlapping:
+            Serial.println("MQTT handler for " + filter + " overlaps " + String(router.conflict()));
+            break;
+        case MQTTRouter::AddResult::Added:
+            break;
+    }
+    return subscribe(filter);
+}
+
+bool MQTTClientLib::subscribe(const String& topic) {
+    bool known = false;
+    for (const String& existing : subscriptions) {
+        if (existing == topic) {
+            known = true;
+            break;
+        }
+    }
+    if (!known) {
+        // Also picked up by a replay that is still running
+        subscriptions.push_back(topic);
+    }
+    if (currentState != State::Connected) {
+        return true;
+    }
+    bool subscribeSuccess = clientSubscribe(topic.c_str());
+    if (subscribeSuccess) {
+        Serial.println("Subscribed to topic: " + topic);
+    } else {
+        Serial.println("Failed to subscribe to topic: " + topic + ", Last Error: " + String(lastError()));
+    }
+    return subscribeSuccess;
+}
+
+bool MQTTClientLib::subscribe(const std::vector<String>& topics) {
+    bool success = true;
+    for (const String& topic : topics) {
+        success = subscribe(topic) && success;
+    }
+    return success;
+}
+
+bool MQTTClientLib::unsubscribe(const String& topic) {
+    for (size_t i = 0; i < subscriptions.size(); i++) {
+        if (subscriptions[i] == topic) {
+            subscriptions.erase(subscriptions.begin() + i);
+            if (i < replayIndex) {
+                replayIndex--;
+            }
+            break;
+        }
+    }
+    if (currentState != State::Connected) {
+        return true;
+    }
+    return clientUnsubscribe(topic.c_str());
+}
+
+int MQTTClientLib::lastError() {
+    return session ? (int)session->lastError() : mqttClient.lastError();
+}
+
+void MQTTClientLib::setBackoff(uint32_t minMs, uint32_t maxMs) {
+    backoffMinMs = minMs > 0 ? minMs : 1;
+    backoffMaxMs = maxMs > backoffMinMs ? maxMs : backoffMinMs;
+}
+
+void MQTTClientLib::setTimeouts(uint32_t tcpConnectMs, uint32_t commandMs) {
+    tcpConnectTimeoutMs = tcpConnectMs;
+    commandTimeoutMs = commandMs;
+    mqttClient.setTimeout(commandMs);
+    if (session) {
+        session->setTimeout(commandMs);
+    }
+}
+
+void MQTTClientLib::setProtocol(MQTTProtocol protocol) {
+    if (protocol == MQTTProtocol::V311) {
+        session.reset();
+        sessionTransport.reset();
+        return;
+    }
+    if (session) {
+        return;
+    }
+    sessionTransport.reset(new WiFiClientTransport(wifiClient));
+    session.reset(new MQTT5Session(MQTT_MAX_PACKET_SIZE));
+    session->begin(sessionTransport.get(), [this](const char* topic, const uint8_t* payload, size_t length,
+                                                  const MQTT5Codec::Publish& publish) {
+        handleMessage(topic, (const char*)payload, (int)length);
+    });
+    session->setKeepAlive(60);
+    session->setTimeout(commandTimeoutMs);
+}
+
+void MQTTClientLib::setMessageExpiry(const String& filter, uint32_t seconds) {
+    for (ExpiryRule& rule : expiryRules) {
+        if (rule.filter == filter) {
+            rule.seconds = seconds;
+            return;
+        }
+    }
+    expiryRules.push_back({filter, seconds});
+}
+
+bool MQTTClientLib::clientConnect() {
+    if (!session) {
+        // Network connection is already up (skip = true): only CONNECT/CONNACK
+        return mqttClient.connect(clientId.c_str(), true);
+    }
+    // A session that never expires is what a 3.1.1 persistent session is
+    return session->connect(clientId.c_str(), cleanSession, cleanSession ? 0 : 0xFFFFFFFF);
+}
+
+bool MQTTClientLib::clientLoop() {
+    return session ? session->loop() : mqttClient.loop();
+}
+
+bool MQTTClientLib::clientPublish(const char* topic, const char* payload, size_t length, bool retained, int qos,
+                                  bool timestamp) {
+    if (!session) {
+        return mqttClient.publish(topic, payload, (int)length, retained, qos);
+    }
+
+    uint32_t expirySeconds = 0;
+    for (const ExpiryRule& rule : expiryRules) {
+        if (topicMatches(rule.filter.c_str(), topic)) {
+            expirySeconds = rule.seconds;
+            break;
+        }
+    }
+    char time[11];
+    MQTT5UserProperty property = {"ts", time};
+    uint8_t propertyCount = 0;
+    uint32_t now = timestamp && timestampSource ? timestampSource() : 0;
+    if (now) {
+        snprintf(time, sizeof(time), "%lu", (unsigned long)now);
+        propertyCount = 1;
+    }
+    return session->publish(topic, (const uint8_t*)payload, length, retained, qos, expirySeconds, &property,
+                            propertyCount);
+}
+
+bool MQTTClientLib::sendPublish(const char* topic, const char* payload, size_t length, bool retained, int qos,
+                                bool timestamp) {
+    unsigned long startUs = micros();
+    if (!clientPublish(topic, payload, length, retained, qos, timestamp)) {
+        publishingStats.failed++;
+        return false;
+    }
+    publishingStats.sent++;
+    publishingStats.latency.add(micros() - startUs);
+    return true;
+}
+
+bool MQTTClientLib::clientSubscribe(const char* topic) {
+    return session ? session->subscribe(topic) : mqttClient.subscribe(topic);
+}
+
+bool MQTTClientLib::clientUnsubscribe(const char* topic) {
+    return session ? session->unsubscribe(topic) : mqttClient.unsubscribe(topic);
+}
+
+void MQTTClientLib::clientDisconnect() {
+    if (session) {
+        session->disconnect();
+    } else {
+        mqttClient.disconnect();
+    }
+}
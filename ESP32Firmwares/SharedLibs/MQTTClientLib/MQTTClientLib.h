@@ -0,0 +1,261 @@
+#ifndef MQTTCLIENTLIB_H
+#define MQTTCLIENTLIB_H
+
+// MQTT client with a non-blocking connection state machine, a drop-in
+// replacement for the ESP32_MQTTClientLib package (same constructor and
+// publish/subscribe calls).
+//
+// - loop() never waits for the broker: while disconnected it advances the
+//   connection by at most one step per call (wait for WiFi, back off,
+//   resolve, TCP connect, MQTT connect, one subscription). The TCP connect
+//   runs on a non-blocking socket that is polled on every call.
+// - Only two steps can still wait, both bounded: a DNS lookup on a cache miss
+//   (the broker address is resolved once and reused) and the CONNACK/SUBACK
+//   of a broker that accepted the TCP connection (command timeout).
+// - Failed attempts back off exponentially with jitter, so a fleet does not
+//   reconnect in lockstep after a broker restart.
+// - Subscriptions are remembered and replayed one per call after CONNACK.
+// - stats() counts connects, failed attempts, connect latency and outages;
+//   publishStats() counts sent and failed publishes and keeps a histogram
+//   of their duration.
+// - WiFi itself reconnects in the background (auto reconnect); after 30 s
+//   without it the client nudges it with a non-blocking WiFi.reconnect().
+// - publish() takes plain char buffers with a length, so a caller needs no
+//   String: the packet is encoded straight from them into the client's send
+//   buffer. MQTTTopic keeps a topic formatted once per stream.
+// - Incoming messages are dispatched by an MQTTRouter: on() registers a
+//   handler per topic filter (+, # allowed) and subscribes it. Messages
+//   without a handler go to the callback passed to the constructor.
+// - Optional offline queue (beginQueue()): publishes made while disconnected
+//   are kept in a bounded MQTTPublishQueue and sent after the reconnect at a
+//   limited rate, in their original order. Retained messages on coalesced
+//   topics (default meta/#) keep only their latest value.
+// - Optional MQTT 5 (setProtocol()): the same API over an MQTT5Session, with
+//   topic aliases (a repeated topic is sent as a two byte alias), a message
+//   expiry per topic filter (the broker drops retained values that are too
+//   old instead of handing them to the next subscriber) and a "ts" user
+//   property with the send time in Unix seconds. QoS 1 publishes between
+//   beginPipeline() and endPipeline() are pipelined there.
+
+#include <WiFi.h>
+#include <MQTT.h>
+#include <vector>
+#include <memory>
+#include "MQTTPublishQueue.h"
+#include "MQTTRouter.h"
+#include "MQTT5Session.h"
+#include "LatencyHistogram.h"
+
+// Define the maximum packet size for the MQTT client
+#define MQTT_MAX_PACKET_SIZE 4096
+
+// Topic of one logical stream, formatted once (e.g. after the config
+// arrived) and reused for every publish without touching the heap
+class MQTTTopic {
+public:
+    static const size_t MaxLength = 127;
+
+    // printf-style; false (and an empty topic) if it does not fit
+    bool set(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    const char* c_str() const { return topic; }
+    size_t length() const { return topicLength; }
+    bool empty() const { return topicLength == 0; }
+
+private:
+    char topic[MaxLength + 1] = {};
+    size_t topicLength = 0;
+};
+
+enum class MQTTProtocol : uint8_t {
+    V311,
+    V5
+};
+
+struct MQTTConnectionStats {
+    uint32_t connects;            // Successful connects (CONNACK received)
+    uint32_t failedAttempts;      // Attempts that ended before CONNACK
+    uint32_t disconnects;         // Lost established connections
+    uint32_t lastConnectMs;       // Latency of the last connect: attempt start to CONNACK
+    uint32_t maxConnectMs;
+    uint32_t lastOutageMs;        // Duration of the last outage: connection lost to subscribed again
+    uint32_t longestOutageMs;
+    uint32_t totalOutageMs;
+};
+
+struct MQTTPublishStats {
+    uint32_t sent;                // Handed to the broker, with QoS 1/2 acknowledged (pipelined: written)
+    uint32_t failed;              // Failed sends, refused while offline without a queue, pipelines without all PUBACKs
+    LatencyHistogram latency;     // Duration of the sent ones; with QoS 1/2 the PUBACK round trip, pipelined the write
+};
+
+class MQTTClientLib {
+public:
+    enum class State : uint8_t {
+        WaitingForNetwork,   // WiFi down
+        Backoff,             // Waiting for the next attempt
+        Resolving,           // Broker address lookup
+        TcpConnecting,       // Non-blocking TCP connect in progress
+        MqttConnecting,      // TCP up, CONNECT/CONNACK next
+        Subscribing,         // Replaying subscriptions, one per call
+        Connected
+    };
+
+    // callback gets the messages no on() handler took; nullptr if all topics have one
+    MQTTClientLib(const String& mqtt_broker, int mqtt_port, const String& clientId, WiFiClient& wifiClient, MQTTClientCallbackSimple callback);
+
+    // For setup(): drives the state machine until connected and subscribed or
+    // timeoutMs passed. Returns false on timeout; loop() keeps trying.
+    bool connect(bool cleanSession, uint32_t timeoutMs = 10000);
+
+    // Call on every loop() iteration. Returns true while connected.
+    bool loop();
+
+    bool connected() const { return currentState == State::Connected; }
+    State state() const { return currentState; }
+    static const char* stateName(State state);
+    const MQTTConnectionStats& stats() const { return connectionStats; }
+    const MQTTPublishStats& publishStats() const { return publishingStats; }
+    // For a latency histogram per reporting interval; the counters keep running
+    void clearPublishLatency() { publishingStats.latency.clear(); }
+
+    // Without a queue: fails immediately while not connected. With a queue:
+    // true when sent or queued; messages are queued while disconnected, after
+    // a failed send and while older messages still wait (keeps the order)
+    bool publish(const char* topic, const char* payload, size_t length, bool retained, int qos);
+    bool publish(const char* topic, const char* payload, bool retained, int qos) {
+        return publish(topic, payload, strlen(payload), retained, qos);
+    }
+    bool publish(const MQTTTopic& topic, const char* payload, size_t length, bool retained, int qos) {
+        return publish(topic.c_str(), payload, length, retained, qos);
+    }
+    bool publish(const MQTTTopic& topic, const char* payload, bool retained, int qos) {
+        return publish(topic.c_str(), payload, strlen(payload), retained, qos);
+    }
+    bool publish(const String& topic, const String& payload, bool retained, int qos) {
+        return publish(topic.c_str(), payload.c_str(), payload.length(), retained, qos);
+    }
+
+    // MQTT 5: QoS 1 publishes up to endPipeline() return once written, without
+    // waiting for their PUBACK; endPipeline() waits for the outstanding ones and
+    // returns false if one timed out or was refused. With MQTT 3.1.1 (or while
+    // disconnected) every publish keeps waiting for its own acknowledgement.
+    void beginPipeline();
+    bool endPipeline();
+
+    // Enables the offline queue: capacityBytes in PSRAM when the board has it,
+    // otherwise in the LittleFS file flashPath (survives reboots), or in
+    // internal RAM when flashPath is nullptr
+    bool beginQueue(uint32_t capacityBytes, const char* flashPath = nullptr,
+                    MQTTQueueDropPolicy policy = MQTTQueueDropPolicy::DropOldest);
+    // MQTT topic filters (+, #) whose retained messages are coalesced while queued
+    void setCoalescedTopics(const std::vector<String>& filters);
+    // Drain rate after a reconnect, so the backlog does not flood broker and loop()
+    void setQueueDrainRate(uint16_t messagesPerSecond);
+    const MQTTQueueStats& queueStats() const { return queue.stats(); }
+    // MQTT topic filter match (+ one level, # rest)
+    static bool topicMatches(const char* filter, const char* topic) { return MQTTRouter::matches(filter, topic); }
+
+    // Remembered and replayed after every reconnect; sent right away when connected
+    bool subscribe(const String& topic);
+    bool subscribe(const std::vector<String>& topics);
+    bool unsubscribe(const String& topic);
+
+    // Handler for a topic filter (+, # allowed), subscribed like subscribe().
+    // Refuses a filter that already has a handler and warns about one that
+    // overlaps another (the exact topic, then the older filter wins).
+    bool on(const String& filter, MQTTHandler handler);
+    // Logs topic and size of every incoming message; off by default
+    void setMessageLogging(bool enabled) { logMessages = enabled; }
+
+    // lwmqtt_err_t with MQTT 3.1.1, MQTT5Session::Error with MQTT 5
+    int lastError();
+
+    // Call before connect(); MQTT 5 needs a broker that speaks it (mosquitto 1.6 or later)
+    void setProtocol(MQTTProtocol protocol);
+    MQTTProtocol protocol() const { return session ? MQTTProtocol::V5 : MQTTProtocol::V311; }
+    // MQTT 5: messages on topics matching filter expire after seconds; the first matching filter wins
+    void setMessageExpiry(const String& filter, uint32_t seconds);
+    // MQTT 5: Unix time for the "ts" user property; a source returning 0 (no time yet) adds none.
+    // Messages sent from the offline queue carry no ts, their send time is not their time.
+    void setTimestampSource(std::function<uint32_t()> source) { timestampSource = source; }
+    // MQTT 5: alias use; nullptr with MQTT 3.1.1
+    const MQTT5SessionStats* protocolStats() const { return session ? &session->stats() : nullptr; }
+
+    // Backoff between failed attempts, doubling from minMs up to maxMs
+    void setBackoff(uint32_t minMs, uint32_t maxMs);
+    // Limit for one TCP connect, and for CONNACK/SUBACK/PUBACK
+    void setTimeouts(uint32_t tcpConnectMs, uint32_t commandMs);
+
+private:
+    MQTTClient mqttClient;
+    WiFiClient& wifiClient;
+    String clientId;
+    String mqtt_broker;
+    int mqtt_port;
+    bool cleanSession = true;
+    MQTTClientCallbackSimple callback;
+    MQTTRouter router;
+
+    struct ExpiryRule {
+        String filter;
+        uint32_t seconds;
+    };
+    std::unique_ptr<MQTT5Transport> sessionTransport;
+    std::unique_ptr<MQTT5Session> session;
+    std::vector<ExpiryRule> expiryRules;
+    std::function<uint32_t()> timestampSource;
+    bool logMessages = false;
+
+    State currentState = State::WaitingForNetwork;
+    std::vector<String> subscriptions;
+    size_t replayIndex = 0;
+
+    IPAddress brokerAddress;
+    bool brokerResolved = false;
+    int socketFd = -1;
+
+    uint32_t backoffMinMs = 1000;
+    uint32_t backoffMaxMs = 60000;
+    uint32_t tcpConnectTimeoutMs = 3000;
+    uint32_t commandTimeoutMs = 1000;
+    uint8_t consecutiveFailures = 0;
+
+    unsigned long stateSinceMs = 0;
+    unsigned long nextAttemptMs = 0;
+    unsigned long attemptStartMs = 0;
+    unsigned long outageStartMs = 0;
+    unsigned long wifiNudgeMs = 0;
+    bool everConnected = false;
+    MQTTConnectionStats connectionStats = {};
+    MQTTPublishStats publishingStats = {};
+    bool pipelined = false;         // beginPipeline() reached the MQTT 5 session
+
+    MQTTPublishQueue queue;
+    std::unique_ptr<MQTTQueueStorage> queueStorage;
+    std::unique_ptr<char[]> drainBuffer;
+    std::vector<String> coalescedTopics = {"meta/#"};
+    uint32_t drainIntervalMs = 50;
+    unsigned long lastDrainMs = 0;
+
+    void step();
+    // The calls both protocols share
+    bool clientConnect();
+    bool clientLoop();
+    bool clientPublish(const char* topic, const char* payload, size_t length, bool retained, int qos, bool timestamp);
+    // clientPublish() with publishStats()
+    bool sendPublish(const char* topic, const char* payload, size_t length, bool retained, int qos, bool timestamp);
+    bool clientSubscribe(const char* topic);
+    bool clientUnsubscribe(const char* topic);
+    void clientDisconnect();
+    void handleMessage(const char* topic, const char* bytes, int length);
+    bool enqueue(const char* topic, const char* payload, size_t length, bool retained, int qos);
+    void drainQueue();
+    void setState(State state);
+    void startTcpConnect();
+    void pollTcpConnect();
+    void closeSocket();
+    void failAttempt(const char* reason);
+    void connectionLost();
+};
+
+#endif // MQTTCLIENTLIB_H
@@ -0,0 +1,114 @@
+#include "MQTTQueueStorage.h"
+#include <LittleFS.h>
+#include <esp_heap_caps.h>
+
+MemoryQueueStorage::MemoryQueueStorage(uint32_t capacity) {
+    if (psramFound()) {
+        buffer = (uint8_t*)heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        psram = buffer != nullptr;
+    }
+    if (!buffer) {
+        buffer = (uint8_t*)malloc(capacity);
+    }
+    size = buffer ? capacity : 0;
+}
+
+MemoryQueueStorage::~MemoryQueueStorage() {
+    free(buffer);
+}
+
+bool MemoryQueueStorage::read(uint32_t offset, void* data, uint32_t length) {
+    if (offset + length > size) {
+        return false;
+    }
+    memcpy(data, buffer + offset, length);
+    return true;
+}
+
+bool MemoryQueueStorage::write(uint32_t offset, const void* data, uint32_t length) {
+    if (offset + length > size) {
+        return false;
+    }
+    memcpy(buffer + offset, data, length);
+    return true;
+}
+
+// The ring state is stored in front of the records
+static const uint32_t FileHeaderSize = sizeof(MQTTQueueState);
+
+FileQueueStorage::FileQueueStorage(const char* path, uint32_t capacity)
+    : path(path), size(capacity) {
+}
+
+FileQueueStorage::~FileQueueStorage() {
+    if (file) {
+        file.close();
+    }
+}
+
+bool FileQueueStorage::begin() {
+    if (!LittleFS.begin(true)) {
+        Serial.println("Failed to mount LittleFS, no offline queue");
+        return false;
+    }
+    if (LittleFS.exists(path)) {
+        file = LittleFS.open(path, "r+");
+        if (file && file.size() == FileHeaderSize + size) {
+            return true;
+        }
+        // Different capacity or damaged: start with an empty ring
+        if (file) {
+            file.close();
+        }
+    }
+
+    // Allocate the whole file once, so later writes never grow it
+    file = LittleFS.open(path, "w+");
+    if (!file) {
+        Serial.println("Failed to create offline queue file " + path);
+        return false;
+    }
+    uint8_t zeros[256] = {};
+    for (uint32_t written = 0; written < FileHeaderSize + size;) {
+        uint32_t chunk = FileHeaderSize + size - written;
+        if (chunk > sizeof(zeros)) {
+            chunk = sizeof(zeros);
+        }
+        if (file.write(zeros, chunk) != chunk) {
+            Serial.println("Offline queue file " + path + " does not fit into LittleFS");
+            file.close();
+            LittleFS.remove(path);
+            return false;
+        }
+        written += chunk;
+    }
+    file.flush();
+    return true;
+}
+
+bool FileQueueStorage::read(uint32_t offset, void* data, uint32_t length) {
+    if (!file || offset + length > size || !file.seek(FileHeaderSize + offset)) {
+        return false;
+    }
+    return file.read((uint8_t*)data, length) == length;
+}
+
+bool FileQueueStorage::write(uint32_t offset, const void* data, uint32_t length) {
+    if (!file || offset + length > size || !file.seek(FileHeaderSize + offset)) {
+        return false;
+    }
+    return file.write((const uint8_t*)data, length) == length;
+}
+
+bool FileQueueStorage::loadState(MQTTQueueState& state) {
+    return file && file.seek(0) && file.read((uint8_t*)&state, sizeof(state)) == sizeof(state);
+}
+
+void FileQueueStorage::saveState(const MQTTQueueState& state) {
+    if (!file || !file.seek(0)) {
+        return;
+    }
+    file.write((const uint8_t*)&state, sizeof(state));
+    // Records and position on flash together: a reset loses at most this change
+    file.flush();
+}
@@ -0,0 +1,54 @@
+#ifndef MQTTQUEUESTORAGE_H
+#define MQTTQUEUESTORAGE_H
+
+// Storages for the MQTTPublishQueue ring.
+//
+// - MemoryQueueStorage: a RAM arena, in PSRAM when the board has it,
+//   otherwise on the internal heap. Lost on reboot.
+// - FileQueueStorage: a fixed-size LittleFS file plus the ring position, for
+//   boards without PSRAM. Survives reboots and deep sleep; it is only written
+//   while messages are queued, so an online device does not wear the flash.
+
+#include <Arduino.h>
+#include <FS.h>
+#include "MQTTPublishQueue.h"
+
+class MemoryQueueStorage : public MQTTQueueStorage {
+public:
+    explicit MemoryQueueStorage(uint32_t capacity);
+    ~MemoryQueueStorage() override;
+
+    bool valid() const { return buffer != nullptr; }
+    bool inPsram() const { return psram; }
+
+    uint32_t capacity() const override { return size; }
+    bool read(uint32_t offset, void* data, uint32_t length) override;
+    bool write(uint32_t offset, const void* data, uint32_t length) override;
+
+private:
+    uint8_t* buffer = nullptr;
+    uint32_t size = 0;
+    bool psram = false;
+};
+
+class FileQueueStorage : public MQTTQueueStorage {
+public:
+    FileQueueStorage(const char* path, uint32_t capacity);
+    ~FileQueueStorage() override;
+
+    // Mounts LittleFS (formats it if needed) and opens or creates the ring file
+    bool begin();
+
+    uint32_t capacity() const override { return size; }
+    bool read(uint32_t offset, void* data, uint32_t length) override;
+    bool write(uint32_t offset, const void* data, uint32_t length) override;
+    bool loadState(MQTTQueueState& state) override;
+    void saveState(const MQTTQueueState& state) override;
+
+private:
+    String path;
+    uint32_t size;
+    File file;
+};
+
+#endif // MQTTQUEUESTORAGE_H
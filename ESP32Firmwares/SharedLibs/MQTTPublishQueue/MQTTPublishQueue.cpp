@@ -0,0 +1,233 @@
+#include "MQTTPublishQueue.h"
+#include <string.h>
+
+static const uint32_t QueueMagic = 0x4D505131;   // "MPQ1"
+static const uint16_t RecordCheck = 0xA55A;
+
+static const uint8_t FlagRetained = 0x01;
+static const uint8_t FlagCoalesce = 0x02;
+static const uint8_t FlagDead = 0x04;
+
+void MQTTPublishQueue::begin(MQTTQueueStorage* storage, MQTTQueueDropPolicy policy) {
+    this->storage = storage;
+    this->policy = policy;
+    queueStats = {};
+    if (!storage) {
+        state = {};
+        return;
+    }
+
+    // A persistent storage continues where it stopped before the reboot
+    uint32_t capacity = storage->capacity();
+    if (storage->loadState(state) && state.magic == QueueMagic && state.head < capacity &&
+        state.tail < capacity && state.used <= capacity && state.live <= state.records) {
+        queueStats.depth = state.live;
+        queueStats.maxDepth = state.live;
+        return;
+    }
+    clear();
+}
+
+void MQTTPublishQueue::clear() {
+    state = {};
+    state.magic = QueueMagic;
+    queueStats.depth = 0;
+    save();
+}
+
+void MQTTPublishQueue::save() {
+    storage->saveState(state);
+}
+
+bool MQTTPublishQueue::readRing(uint32_t offset, void* data, uint32_t length) {
+    uint32_t capacity = storage->capacity();
+    uint32_t first = capacity - offset < length ? capacity - offset : length;
+    if (!storage->read(offset, data, first)) {
+        return false;
+    }
+    return first == length || storage->read(0, (uint8_t*)data + first, length - first);
+}
+
+bool MQTTPublishQueue::writeRing(uint32_t offset, const void* data, uint32_t length) {
+    uint32_t capacity = storage->capacity();
+    uint32_t first = capacity - offset < length ? capacity - offset : length;
+    if (!storage->write(offset, data, first)) {
+        return false;
+    }
+    return first == length || storage->write(0, (const uint8_t*)data + first, length - first);
+}
+
+bool MQTTPublishQueue::readHeader(uint32_t offset, RecordHeader& header) {
+    if (!readRing(offset, &header, sizeof(header)) || header.check != RecordCheck) {
+        // Storage damaged (e.g. power lost while writing flash): start over
+        queueStats.dropped += state.live;
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool MQTTPublishQueue::push(const char* topic, const char* payload, uint32_t payloadLength, bool retained, uint8_t qos, bool coalesce) {
+    if (!storage) {
+        return false;
+    }
+    size_t topicLength = strlen(topic);
+    uint32_t size = sizeof(RecordHeader) + topicLength + payloadLength;
+    if (topicLength > 0xFFFF || payloadLength > 0xFFFF || size > storage->capacity()) {
+        queueStats.dropped++;
+        return false;
+    }
+
+    // Capacity first: a rejected message must not coalesce the queued value away
+    skipDeadRecords();
+    if (policy == MQTTQueueDropPolicy::DropNewest && storage->capacity() - state.used < size) {
+        queueStats.dropped++;
+        return false;
+    }
+    if (coalesce) {
+        this->coalesce(topic, (uint16_t)topicLength);
+    }
+    while (storage->capacity() - state.used < size) {
+        removeHead(false);
+    }
+
+    RecordHeader header = {};
+    header.check = RecordCheck;
+    header.flags = (retained ? FlagRetained : 0) | (coalesce ? FlagCoalesce : 0);
+    header.qos = qos;
+    header.topicLength = (uint16_t)topicLength;
+    header.payloadLength = (uint16_t)payloadLength;
+
+    uint32_t capacity = storage->capacity();
+    uint32_t offset = state.tail;
+    if (!writeRing(offset, &header, sizeof(header)) ||
+        !writeRing((offset + sizeof(header)) % capacity, topic, topicLength) ||
+        !writeRing((offset + sizeof(header) + topicLength) % capacity, payload, payloadLength)) {
+        queueStats.dropped++;
+        return false;
+    }
+
+    state.tail = (offset + size) % capacity;
+    state.used += size;
+    state.records++;
+    state.live++;
+    save();
+
+    queueStats.queued++;
+    queueStats.depth = state.live;
+    if (queueStats.depth > queueStats.maxDepth) {
+        queueStats.maxDepth = queueStats.depth;
+    }
+    return true;
+}
+
+bool MQTTPublishQueue::topicEquals(uint32_t offset, const char* topic, uint16_t length) {
+    char chunk[32];
+    uint32_t capacity = storage->capacity();
+    for (uint16_t done = 0; done < length;) {
+        uint16_t part = length - done < (int)sizeof(chunk) ? length - done : sizeof(chunk);
+        if (!readRing((offset + done) % capacity, chunk, part) || memcmp(chunk, topic + done, part) != 0) {
+            return false;
+        }
+        done += part;
+    }
+    return true;
+}
+
+void MQTTPublishQueue::coalesce(const char* topic, uint16_t length) {
+    uint32_t capacity = storage->capacity();
+    uint32_t offset = state.head;
+    for (uint32_t i = 0; i < state.records; i++) {
+        RecordHeader header;
+        if (!readHeader(offset, header)) {
+            return;
+        }
+        if ((header.flags & FlagCoalesce) && !(header.flags & FlagDead) && header.topicLength == length &&
+            topicEquals((offset + sizeof(header)) % capacity, topic, length)) {
+            // At most one live record per coalesced topic exists
+            header.flags |= FlagDead;
+            writeRing(offset, &header, sizeof(header));
+            state.live--;
+            queueStats.coalesced++;
+            queueStats.depth = state.live;
+            return;
+        }
+        offset = (offset + sizeof(header) + header.topicLength + header.payloadLength) % capacity;
+    }
+}
+
+void MQTTPublishQueue::removeHead(bool sent) {
+    RecordHeader header;
+    if (state.records == 0 || !readHeader(state.head, header)) {
+        return;
+    }
+    uint32_t size = sizeof(header) + header.topicLength + header.payloadLength;
+    state.head = (state.head + size) % storage->capacity();
+    state.used -= size;
+    state.records--;
+    if (!(header.flags & FlagDead)) {
+        state.live--;
+        if (sent) {
+            queueStats.drained++;
+        } else {
+            queueStats.dropped++;
+        }
+    }
+    if (state.records == 0) {
+        // Empty: start at the beginning again, keeps records contiguous
+        state.head = 0;
+        state.tail = 0;
+        state.used = 0;
+    }
+    queueStats.depth = state.live;
+}
+
+void MQTTPublishQueue::skipDeadRecords() {
+    RecordHeader header;
+    while (state.records > 0 && readHeader(state.head, header) && (header.flags & FlagDead)) {
+        removeHead(false);
+    }
+}
+
+bool MQTTPublishQueue::peek(Message& message, char* buffer, uint32_t bufferSize) {
+    if (!storage) {
+        return false;
+    }
+    while (true) {
+        skipDeadRecords();
+        RecordHeader header;
+        if (state.live == 0 || !readHeader(state.head, header)) {
+            save();
+            return false;
+        }
+
+        uint32_t capacity = storage->capacity();
+        uint32_t topicOffset = (state.head + sizeof(header)) % capacity;
+        uint32_t payloadOffset = (topicOffset + header.topicLength) % capacity;
+        if ((uint32_t)header.topicLength + header.payloadLength + 2 > bufferSize ||
+            !readRing(topicOffset, buffer, header.topicLength) ||
+            !readRing(payloadOffset, buffer + header.topicLength + 1, header.payloadLength)) {
+            // Cannot be sent with this buffer, would block the queue forever
+            removeHead(false);
+            save();
+            continue;
+        }
+        buffer[header.topicLength] = '\0';
+        buffer[header.topicLength + 1 + header.payloadLength] = '\0';
+
+        message.topic = buffer;
+        message.payload = buffer + header.topicLength + 1;
+        message.payloadLength = header.payloadLength;
+        message.retained = header.flags & FlagRetained;
+        message.qos = header.qos;
+        return true;
+    }
+}
+
+void MQTTPublishQueue::pop() {
+    if (!storage) {
+        return;
+    }
+    removeHead(true);
+    save();
+}
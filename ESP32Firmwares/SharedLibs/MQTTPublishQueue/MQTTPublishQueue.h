@@ -0,0 +1,108 @@
+#ifndef MQTTPUBLISHQUEUE_H
+#define MQTTPUBLISHQUEUE_H
+
+// Bounded outbound queue for publishes that could not be sent (broker or
+// WiFi away). Records live in a byte ring on a MQTTQueueStorage, so the same
+// code runs on PSRAM, internal RAM or a flash file.
+//
+// - Record: 8 byte header, topic, payload; records may wrap around the end.
+// - Coalescing: a state message (retained, on a coalesced topic) marks an
+//   older queued message on the same topic as dead, so only the latest value
+//   is sent. Samples keep every message.
+// - Full: DropOldest discards the oldest records to make room, DropNewest
+//   rejects the new message (and keeps the queued value it would have
+//   coalesced).
+//
+// Free of Arduino dependencies (host tests in
+// TemperatureSensor2.Firmware/test/test_mqttqueue); the storages are in
+// MQTTClientLib/MQTTQueueStorage.h.
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Ring position, persisted by storages that survive a reboot
+struct MQTTQueueState {
+    uint32_t magic;
+    uint32_t head;        // Offset of the oldest record
+    uint32_t tail;        // Offset of the next record
+    uint32_t used;        // Bytes in use, dead records included
+    uint32_t records;     // Records in the ring, dead records included
+    uint32_t live;        // Records still to be sent
+};
+
+class MQTTQueueStorage {
+public:
+    virtual ~MQTTQueueStorage() {}
+    virtual uint32_t capacity() const = 0;
+    virtual bool read(uint32_t offset, void* data, uint32_t length) = 0;
+    virtual bool write(uint32_t offset, const void* data, uint32_t length) = 0;
+    virtual bool loadState(MQTTQueueState& state) { return false; }
+    virtual void saveState(const MQTTQueueState& state) {}
+};
+
+enum class MQTTQueueDropPolicy : uint8_t {
+    DropOldest,
+    DropNewest
+};
+
+struct MQTTQueueStats {
+    uint32_t queued;      // Messages accepted into the queue
+    uint32_t coalesced;   // Queued state messages replaced by a newer value
+    uint32_t dropped;     // Messages lost: queue full, too large or corrupted
+    uint32_t drained;     // Messages sent from the queue
+    uint32_t depth;       // Messages waiting now
+    uint32_t maxDepth;
+};
+
+class MQTTPublishQueue {
+public:
+    struct Message {
+        const char* topic;     // Null-terminated, points into the peek buffer
+        const char* payload;
+        uint16_t payloadLength;
+        bool retained;
+        uint8_t qos;
+    };
+
+    void begin(MQTTQueueStorage* storage, MQTTQueueDropPolicy policy);
+    bool active() const { return storage != nullptr; }
+    bool empty() const { return state.live == 0; }
+    uint32_t bytesUsed() const { return state.used; }
+
+    // coalesce: replaces a queued message on the same topic that was also pushed with coalesce
+    bool push(const char* topic, const char* payload, uint32_t payloadLength, bool retained, uint8_t qos, bool coalesce);
+
+    // Reads the oldest message into buffer (topic and payload, both
+    // null-terminated); false if the queue is empty
+    bool peek(Message& message, char* buffer, uint32_t bufferSize);
+    // Removes the message returned by peek() after it was sent
+    void pop();
+
+    const MQTTQueueStats& stats() const { return queueStats; }
+
+private:
+    struct RecordHeader {
+        uint16_t check;
+        uint8_t flags;
+        uint8_t qos;
+        uint16_t topicLength;
+        uint16_t payloadLength;
+    };
+
+    MQTTQueueStorage* storage = nullptr;
+    MQTTQueueDropPolicy policy = MQTTQueueDropPolicy::DropOldest;
+    MQTTQueueState state = {};
+    MQTTQueueStats queueStats = {};
+
+    void clear();
+    void save();
+    bool readHeader(uint32_t offset, RecordHeader& header);
+    bool readRing(uint32_t offset, void* data, uint32_t length);
+    bool writeRing(uint32_t offset, const void* data, uint32_t length);
+    bool topicEquals(uint32_t offset, const char* topic, uint16_t length);
+    void coalesce(const char* topic, uint16_t length);
+    void removeHead(bool sent);
+    void skipDeadRecords();
+};
+
+#endif // MQTTPUBLISHQUEUE_H
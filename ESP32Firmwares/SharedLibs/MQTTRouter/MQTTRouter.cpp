@@ -0,0 +1,164 @@
+#include "MQTTRouter.h"
+#include <algorithm>
+#include <stdlib.h>
+
+// The payload is not null-terminated: parse a terminated copy
+static size_t terminatedCopy(const MQTTPayload& payload, char* buffer, size_t size) {
+    size_t length = payload.length < size - 1 ? payload.length : size - 1;
+    memcpy(buffer, payload.data, length);
+    buffer[length] = '\0';
+    return length;
+}
+
+float MQTTPayload::toFloat() const {
+    char buffer[32];
+    terminatedCopy(*this, buffer, sizeof(buffer));
+    return strtof(buffer, nullptr);
+}
+
+long MQTTPayload::toInt() const {
+    char buffer[32];
+    terminatedCopy(*this, buffer, sizeof(buffer));
+    return strtol(buffer, nullptr, 10);
+}
+
+uint32_t MQTTRouter::hash(const char* topic) {
+    uint32_t value = 2166136261u;
+    while (*topic) {
+        value ^= (uint8_t)*topic++;
+        value *= 16777619u;
+    }
+    return value;
+}
+
+bool MQTTRouter::isWildcard(const char* filter) {
+    return strpbrk(filter, "+#") != nullptr;
+}
+
+std::vector<MQTTRouter::Route>::const_iterator MQTTRouter::findExact(const char* topic, uint32_t topicHash) const {
+    auto it = std::lower_bound(exactRoutes.begin(), exactRoutes.end(), topicHash,
+                               [](const Route& route, uint32_t value) { return route.hash < value; });
+    for (; it != exactRoutes.end() && it->hash == topicHash; ++it) {
+        if (it->filter == topic) {
+            return it;
+        }
+    }
+    return exactRoutes.end();
+}
+
+MQTTRouter::AddResult MQTTRouter::add(const char* filter, MQTTHandler handler) {
+    lastConflict.clear();
+    uint32_t filterHash = hash(filter);
+    bool wildcard = isWildcard(filter);
+    if (wildcard) {
+        for (const Route& route : wildcardRoutes) {
+            if (route.filter == filter) {
+                lastConflict = route.filter;
+                return AddResult::Duplicate;
+            }
+        }
+    } else if (findExact(filter, filterHash) != exactRoutes.end()) {
+        lastConflict = filter;
+        return AddResult::Duplicate;
+    }
+
+    // Exact topics only collide with wildcards; wildcards with everything
+    for (const Route& route : wildcardRoutes) {
+        if (overlaps(route.filter.c_str(), filter)) {
+            lastConflict = route.filter;
+            break;
+        }
+    }
+    if (wildcard && lastConflict.empty()) {
+        for (const Route& route : exactRoutes) {
+            if (matches(filter, route.filter.c_str())) {
+                lastConflict = route.filter;
+                break;
+            }
+        }
+    }
+
+    Route route = {filterHash, filter, handler};
+    if (wildcard) {
+        wildcardRoutes.push_back(route);
+    } else {
+        auto position = std::upper_bound(exactRoutes.begin(), exactRoutes.end(), filterHash,
+                                         [](uint32_t value, const Route& existing) { return value < existing.hash; });
+        exactRoutes.insert(position, route);
+    }
+    return lastConflict.empty() ? AddResult::Added : AddResult::Overlapping;
+}
+
+bool MQTTRouter::remove(const char* filter) {
+    std::vector<Route>& routes = isWildcard(filter) ? wildcardRoutes : exactRoutes;
+    for (auto it = routes.begin(); it != routes.end(); ++it) {
+        if (it->filter == filter) {
+            routes.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MQTTRouter::dispatch(const char* topic, const MQTTPayload& payload) const {
+    // Handlers are called on a copy: one may add routes, which moves the vectors
+    auto exact = findExact(topic, hash(topic));
+    if (exact != exactRoutes.end()) {
+        MQTTHandler handler = exact->handler;
+        handler(topic, payload);
+        return true;
+    }
+    for (const Route& route : wildcardRoutes) {
+        if (matches(route.filter.c_str(), topic)) {
+            MQTTHandler handler = route.handler;
+            handler(topic, payload);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MQTTRouter::matches(const char* filter, const char* topic) {
+    while (*filter) {
+        if (*filter == '#') {
+            return true;
+        }
+        if (*filter == '+') {
+            while (*topic && *topic != '/') {
+                topic++;
+            }
+            filter++;
+            continue;
+        }
+        if (*filter != *topic) {
+            // "a/#" also matches "a"
+            return *topic == '\0' && strcmp(filter, "/#") == 0;
+        }
+        filter++;
+        topic++;
+    }
+    return *topic == '\0';
+}
+
+bool MQTTRouter::overlaps(const char* a, const char* b) {
+    while (true) {
+        if (*a == '#' || *b == '#') {
+            return true;
+        }
+        size_t lengthA = strcspn(a, "/");
+        size_t lengthB = strcspn(b, "/");
+        bool anyA = lengthA == 1 && *a == '+';
+        bool anyB = lengthB == 1 && *b == '+';
+        if (!anyA && !anyB && (lengthA != lengthB || memcmp(a, b, lengthA) != 0)) {
+            return false;
+        }
+        a += lengthA;
+        b += lengthB;
+        if (*a == '\0' || *b == '\0') {
+            // Same depth, or one side ends where the other continues with "/#"
+            return (*a == '\0' && *b == '\0') || strcmp(a, "/#") == 0 || strcmp(b, "/#") == 0;
+        }
+        a++;
+        b++;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef MQTTROUTER_H
+#define MQTTROUTER_H
+
+// Dispatch of incoming messages to one handler per topic filter, instead of
+// a chain of String comparisons in the message callback.
+//
+// - Exact topics are looked up by hash (FNV-1a, sorted vector, binary
+//   search) without building a String. Wildcard filters (+, #) are checked
+//   after that, in registration order; a device has a handful of them.
+// - A topic matches at most one handler: the exact one wins over wildcards.
+//   Registering the same filter twice is refused, and add() reports a filter
+//   that overlaps an existing one, so no handler is shadowed silently.
+// - Handlers get the payload as a non-owning view into the client's read
+//   buffer, valid only during the call.
+//
+// Free of Arduino dependencies (host tests in
+// TemperatureSensor2.Firmware/test/test_mqttrouter).
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Payload of an incoming message; points into the receive buffer
+struct MQTTPayload {
+    const char* data;
+    size_t length;
+
+    bool equals(const char* text) const {
+        return strlen(text) == length && memcmp(data, text, length) == 0;
+    }
+    // Numbers up to 31 characters; 0 if there is none
+    float toFloat() const;
+    long toInt() const;
+};
+
+typedef std::function<void(const char* topic, const MQTTPayload& payload)> MQTTHandler;
+
+class MQTTRouter {
+public:
+    enum class AddResult : uint8_t {
+        Added,
+        Overlapping,   // Added, but some topics also match another filter
+        Duplicate      // Not added, the filter already has a handler
+    };
+
+    AddResult add(const char* filter, MQTTHandler handler);
+    bool remove(const char* filter);
+
+    // Calls the handler for topic; false if no filter matches
+    bool dispatch(const char* topic, const MQTTPayload& payload) const;
+
+    size_t size() const { return exactRoutes.size() + wildcardRoutes.size(); }
+    // The filter that add() found overlapping or duplicate
+    const char* conflict() const { return lastConflict.c_str(); }
+
+    // MQTT filter match: + one level, # the rest (including the parent level)
+    static bool matches(const char* filter, const char* topic);
+    // True if some topic matches both filters
+    static bool overlaps(const char* a, const char* b);
+
+private:
+    struct Route {
+        uint32_t hash;
+        std::string filter;
+        MQTTHandler handler;
+    };
+    std::vector<Route> exactRoutes;      // Sorted by hash
+    std::vector<Route> wildcardRoutes;   // In registration order
+    std::string lastConflict;
+
+    static uint32_t hash(const char* topic);
+    static bool isWildcard(const char* filter);
+    std::vector<Route>::const_iterator findExact(const char* topic, uint32_t topicHash) const;
+};
+
+#endif // MQTTROUTER_H
@@ -0,0 +1,76 @@
+#include "HeatshrinkDecoder.h"
+#include <string.h>
+
+bool HeatshrinkDecoder::begin(uint8_t windowBits, uint8_t lookaheadBits) {
+    if (windowBits < 4 || windowBits > 15 || lookaheadBits < 3 || lookaheadBits >= windowBits) {
+        window.reset();
+        return false;
+    }
+    this->windowBits = windowBits;
+    this->lookaheadBits = lookaheadBits;
+    windowMask = (1u << windowBits) - 1;
+    // Back-references before the start read zeros, as in heatshrink itself
+    window.reset(new uint8_t[windowMask + 1]());
+    head = 0;
+    step = Step::Tag;
+    bits = 0;
+    bitCount = 0;
+    return true;
+}
+
+bool HeatshrinkDecoder::feed(const uint8_t* data, size_t length, const Sink& sink) {
+    if (!window) {
+        return false;
+    }
+    uint8_t out[64];
+    size_t outLength = 0;
+    size_t position = 0;
+
+    while (true) {
+        uint8_t needed = step == Step::Tag ? 1 : step == Step::Literal ? 8 : step == Step::Index ? windowBits : lookaheadBits;
+        while (bitCount < needed && position < length) {
+            bits = bits << 8 | data[position++];
+            bitCount += 8;
+        }
+        if (bitCount < needed) {
+            break;
+        }
+        bitCount -= needed;
+        uint16_t value = (bits >> bitCount) & ((1u << needed) - 1);
+
+        switch (step) {
+            case Step::Tag:
+                step = value ? Step::Literal : Step::Index;
+                break;
+
+            case Step::Literal:
+                window[head++ & windowMask] = value;
+                out[outLength++] = value;
+                if (outLength == sizeof(out)) {
+                    if (!sink(out, outLength)) return false;
+                    outLength = 0;
+                }
+                step = Step::Tag;
+                break;
+
+            case Step::Index:
+                distance = value + 1;
+                step = Step::Count;
+                break;
+
+            case Step::Count:
+                for (uint16_t count = value + 1; count > 0; count--) {
+                    uint8_t byte = window[(head - distance) & windowMask];
+                    window[head++ & windowMask] = byte;
+                    out[outLength++] = byte;
+                    if (outLength == sizeof(out)) {
+                        if (!sink(out, outLength)) return false;
+                        outLength = 0;
+                    }
+                }
+                step = Step::Tag;
+                break;
+        }
+    }
+    return outLength == 0 || sink(out, outLength);
+}
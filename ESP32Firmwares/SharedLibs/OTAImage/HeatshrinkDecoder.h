@@ -0,0 +1,44 @@
+#ifndef HEATSHRINKDECODER_H
+#define HEATSHRINKDECODER_H
+
+// Streaming decoder for heatshrink (LZSS) compressed data, bit compatible
+// with the heatshrink tool and OTATools/otaimage.py: a 1 bit marks a literal
+// byte, a 0 bit a back-reference of windowBits (distance - 1) and
+// lookaheadBits (length - 1), most significant bit first.
+//
+// Needs 2^windowBits bytes for the window and no other buffer: output is
+// handed to the sink in slices of at most 64 bytes.
+//
+// Free of Arduino dependencies.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <memory>
+
+class HeatshrinkDecoder {
+public:
+    // Returns false to stop decoding
+    typedef std::function<bool(const uint8_t* data, size_t length)> Sink;
+
+    // windowBits 4..15, lookaheadBits 3..windowBits - 1
+    bool begin(uint8_t windowBits, uint8_t lookaheadBits);
+    // Decodes input; false if the sink stopped or begin() failed
+    bool feed(const uint8_t* data, size_t length, const Sink& sink);
+
+private:
+    enum class Step : uint8_t { Tag, Literal, Index, Count };
+
+    std::unique_ptr<uint8_t[]> window;
+    uint16_t windowMask = 0;
+    uint16_t head = 0;
+    uint8_t windowBits = 0;
+    uint8_t lookaheadBits = 0;
+
+    Step step = Step::Tag;
+    uint32_t bits = 0;          // Input bits not used yet, right aligned
+    uint8_t bitCount = 0;
+    uint16_t distance = 0;
+};
+
+#endif // HEATSHRINKDECODER_H
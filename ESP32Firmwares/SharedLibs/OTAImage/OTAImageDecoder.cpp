@@ -0,0 +1,247 @@
+#include "OTAImageDecoder.h"
+#include <string.h>
+
+namespace {
+    const uint8_t EspImageMagic = 0xE9;
+    const uint8_t FormatVersion = 1;
+    const uint8_t KindCompressed = 1;
+    const uint8_t KindDelta = 2;
+    const uint8_t CompressionNone = 0;
+    const uint8_t CompressionHeatshrink = 1;
+
+    uint32_t readLe32(const uint8_t* data) {
+        return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+    }
+}
+
+void OTAImageDecoder::begin(OTAImageIO* io) {
+    this->io = io;
+    imageKind = OTAImageKind::Unknown;
+    errorText = "";
+    headerLength = 0;
+    compressed = false;
+    totalSize = 0;
+    writtenBytes = 0;
+    sourceSize = 0;
+    patchStep = PatchStep::DiffLength;
+    varint = 0;
+    varintShift = 0;
+    diffLength = 0;
+    extraLength = 0;
+    seek = 0;
+    remaining = 0;
+    sourcePosition = 0;
+}
+
+bool OTAImageDecoder::fail(const char* reason) {
+    if (*errorText == '\0') {
+        errorText = reason;
+    }
+    return false;
+}
+
+bool OTAImageDecoder::write(const uint8_t* data, size_t length) {
+    if (*errorText != '\0') {
+        return false;
+    }
+    if (!io) {
+        return fail("not started");
+    }
+    if (length == 0) {
+        return true;
+    }
+
+    if (imageKind == OTAImageKind::Unknown) {
+        if (headerLength == 0 && data[0] == EspImageMagic) {
+            imageKind = OTAImageKind::Plain;
+        } else {
+            size_t take = HeaderSize - headerLength;
+            if (take > length) take = length;
+            memcpy(header + headerLength, data, take);
+            headerLength += take;
+            data += take;
+            length -= take;
+            if (headerLength < HeaderSize) {
+                return true;
+            }
+            if (!parseHeader()) {
+                return false;
+            }
+            if (length == 0) {
+                return true;
+            }
+        }
+    }
+
+    if (imageKind == OTAImageKind::Plain) {
+        return target(data, length);
+    }
+    if (compressed) {
+        return heatshrink.feed(data, length, [this](const uint8_t* out, size_t outLength) {
+            return decoded(out, outLength);
+        }) || fail("decompression failed");
+    }
+    return decoded(data, length);
+}
+
+bool OTAImageDecoder::parseHeader() {
+    if (memcmp(header, "OTAI", 4) != 0) {
+        return fail("unknown image format");
+    }
+    if (header[4] != FormatVersion) {
+        return fail("unsupported format version");
+    }
+    if (header[5] == KindCompressed) {
+        imageKind = OTAImageKind::Compressed;
+    } else if (header[5] == KindDelta) {
+        imageKind = OTAImageKind::Delta;
+    } else {
+        return fail("unknown image kind");
+    }
+
+    if (header[6] == CompressionHeatshrink) {
+        compressed = true;
+        if (!heatshrink.begin(header[7], header[8])) {
+            return fail("invalid heatshrink parameters");
+        }
+    } else if (header[6] != CompressionNone) {
+        return fail("unknown compression");
+    }
+
+    totalSize = readLe32(header + 12);
+    if (totalSize == 0) {
+        return fail("empty image");
+    }
+    if (imageKind == OTAImageKind::Delta) {
+        sourceSize = readLe32(header + 16);
+        // A delta against another build would write garbage: refuse it before
+        // touching the partition so the caller can fall back to a full image
+        if (!io->verifySource(sourceSize, header + 20)) {
+            return fail("delta does not match the running image");
+        }
+    }
+    return true;
+}
+
+bool OTAImageDecoder::decoded(const uint8_t* data, size_t length) {
+    if (imageKind == OTAImageKind::Delta) {
+        return patch(data, length);
+    }
+    return target(data, length);
+}
+
+bool OTAImageDecoder::target(const uint8_t* data, size_t length) {
+    if (totalSize > 0 && length > totalSize - writtenBytes) {
+        return fail("image larger than announced");
+    }
+    if (!io->writeTarget(data, length)) {
+        return fail("writing the image failed");
+    }
+    writtenBytes += length;
+    return true;
+}
+
+bool OTAImageDecoder::varintByte(uint8_t byte, bool& complete) {
+    if (varintShift > 28) {
+        return fail("malformed patch");
+    }
+    varint |= (uint32_t)(byte & 0x7F) << varintShift;
+    varintShift += 7;
+    complete = (byte & 0x80) == 0;
+    return true;
+}
+
+bool OTAImageDecoder::patch(const uint8_t* data, size_t length) {
+    size_t position = 0;
+    while (position < length) {
+        if (patchStep == PatchStep::Diff || patchStep == PatchStep::Extra) {
+            uint8_t out[64];
+            size_t chunk = length - position;
+            if (chunk > remaining) chunk = remaining;
+            if (chunk > sizeof(out)) chunk = sizeof(out);
+
+            if (patchStep == PatchStep::Diff) {
+                if (!io->readSource((uint32_t)sourcePosition, out, chunk)) {
+                    return fail("reading the running image failed");
+                }
+                for (size_t i = 0; i < chunk; i++) {
+                    out[i] += data[position + i];
+                }
+                sourcePosition += chunk;
+            } else {
+                memcpy(out, data + position, chunk);
+            }
+            if (!target(out, chunk)) {
+                return false;
+            }
+            position += chunk;
+            remaining -= chunk;
+
+            if (remaining == 0 && patchStep == PatchStep::Diff && extraLength > 0) {
+                patchStep = PatchStep::Extra;
+                remaining = extraLength;
+            } else if (remaining == 0) {
+                sourcePosition += seek;
+                patchStep = PatchStep::DiffLength;
+            }
+            continue;
+        }
+
+        bool complete = false;
+        if (!varintByte(data[position++], complete)) {
+            return false;
+        }
+        if (!complete) {
+            continue;
+        }
+        uint32_t value = varint;
+        varint = 0;
+        varintShift = 0;
+
+        if (patchStep == PatchStep::DiffLength) {
+            diffLength = value;
+            patchStep = PatchStep::ExtraLength;
+        } else if (patchStep == PatchStep::ExtraLength) {
+            extraLength = value;
+            patchStep = PatchStep::Seek;
+        } else {
+            seek = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+
+            if ((uint64_t)diffLength + extraLength > totalSize - writtenBytes) {
+                return fail("patch larger than announced");
+            }
+            if (sourcePosition + diffLength > sourceSize) {
+                return fail("patch reads past the running image");
+            }
+            int64_t next = sourcePosition + diffLength + seek;
+            if (next < 0 || next > sourceSize) {
+                return fail("patch seeks outside the running image");
+            }
+
+            if (diffLength > 0) {
+                patchStep = PatchStep::Diff;
+                remaining = diffLength;
+            } else if (extraLength > 0) {
+                patchStep = PatchStep::Extra;
+                remaining = extraLength;
+            } else {
+                sourcePosition = next;
+                patchStep = PatchStep::DiffLength;
+            }
+        }
+    }
+    return true;
+}
+
+bool OTAImageDecoder::finished() const {
+    if (*errorText != '\0') {
+        return false;
+    }
+    if (imageKind == OTAImageKind::Plain) {
+        return writtenBytes > 0;
+    }
+    if (imageKind == OTAImageKind::Unknown) {
+        return false;
+    }
+    return writtenBytes == totalSize && (imageKind != OTAImageKind::Delta || patchStep == PatchStep::DiffLength);
+}
@@ -0,0 +1,105 @@
+#ifndef OTAIMAGEDECODER_H
+#define OTAIMAGEDECODER_H
+
+// Streaming decoder for the OTA artifacts built by OTATools/otaimage.py. It
+// turns the download into the new firmware image while it arrives, with no
+// buffer beyond the heatshrink window:
+//
+// - Plain image: the .bin as built (first byte 0xE9), passed through.
+// - Compressed image (.hs): header, then the image heatshrink compressed.
+// - Delta (.delta): header, then a bsdiff-style patch against the running
+//   image, optionally heatshrink compressed. The patch is a sequence of
+//   (diff, extra, seek) triples, each a LEB128 varint (seek zigzag encoded):
+//   diff bytes are added to the source bytes at the current source
+//   position, extra bytes are copied as they are, then the source position
+//   moves by diff + seek. The header carries size and SHA-256 of the source
+//   image, checked before the first byte is written.
+//
+// Header (little-endian, 52 bytes):
+//   0  "OTAI"         magic
+//   4  uint8          format version (1)
+//   5  uint8          kind: 1 compressed image, 2 delta
+//   6  uint8          compression: 0 none, 1 heatshrink
+//   7  uint8          heatshrink window bits
+//   8  uint8          heatshrink lookahead bits
+//   9  uint8[3]       reserved
+//   12 uint32         target (new image) size
+//   16 uint32         source (running image) size, delta only
+//   20 uint8[32]      source SHA-256, delta only
+//
+// Free of Arduino dependencies (host tests in
+// TemperatureSensor2.Firmware/test/test_otaimage).
+
+#include <stdint.h>
+#include <stddef.h>
+#include "HeatshrinkDecoder.h"
+
+// Running image and new partition, provided by the caller
+class OTAImageIO {
+public:
+    virtual ~OTAImageIO() {}
+    virtual bool readSource(uint32_t offset, uint8_t* data, size_t length) = 0;
+    // True if the first size bytes of the running image have this SHA-256
+    virtual bool verifySource(uint32_t size, const uint8_t sha256[32]) = 0;
+    virtual bool writeTarget(const uint8_t* data, size_t length) = 0;
+};
+
+enum class OTAImageKind : uint8_t {
+    Unknown,     // Nothing received yet
+    Plain,
+    Compressed,
+    Delta
+};
+
+class OTAImageDecoder {
+public:
+    static const size_t HeaderSize = 52;
+
+    void begin(OTAImageIO* io);
+    // Feeds the next downloaded bytes; false on a format, source or write error
+    bool write(const uint8_t* data, size_t length);
+    // True once the whole image was written. Plain images carry no size:
+    // for them the end of the download is the end of the image.
+    bool finished() const;
+
+    OTAImageKind kind() const { return imageKind; }
+    // Size of the new image, 0 while unknown (plain images)
+    uint32_t targetSize() const { return totalSize; }
+    uint32_t written() const { return writtenBytes; }
+    const char* error() const { return errorText; }
+
+private:
+    enum class PatchStep : uint8_t { DiffLength, ExtraLength, Seek, Diff, Extra };
+
+    OTAImageIO* io = nullptr;
+    OTAImageKind imageKind = OTAImageKind::Unknown;
+    const char* errorText = "";
+
+    uint8_t header[HeaderSize];
+    size_t headerLength = 0;
+    bool compressed = false;
+    HeatshrinkDecoder heatshrink;
+
+    uint32_t totalSize = 0;
+    uint32_t writtenBytes = 0;
+    uint32_t sourceSize = 0;
+
+    PatchStep patchStep = PatchStep::DiffLength;
+    uint32_t varint = 0;
+    uint8_t varintShift = 0;
+    uint32_t diffLength = 0;
+    uint32_t extraLength = 0;
+    int32_t seek = 0;
+    uint32_t remaining = 0;
+    int64_t sourcePosition = 0;
+
+    bool fail(const char* reason);
+    bool parseHeader();
+    // Decompressed bytes of a compressed image or a patch
+    bool decoded(const uint8_t* data, size_t length);
+    bool target(const uint8_t* data, size_t length);
+    bool patch(const uint8_t* data, size_t length);
+    bool varintByte(uint8_t byte, bool& complete);
+};
+
+#endif // OTAIMAGEDECODER_H
@@ -0,0 +1,230 @@
+#include "OneWireScheduler.h"
+
+// DS18B20 function commands
+#define CMD_CONVERT_T 0x44
+#define CMD_READ_SCRATCHPAD 0xBE
+#define CMD_WRITE_SCRATCHPAD 0x4E
+
+#define FAMILY_DS18B20 0x28
+#define FAMILY_DS1822 0x22
+
+// Raw value the sensor reports before its first conversion (85 °C)
+#define POWER_ON_RAW 0x0550
+
+bool OneWireScheduler::addBus(OneWire& bus) {
+    if (busCount == MaxBuses) {
+        return false;
+    }
+    buses[busCount++] = &bus;
+    return true;
+}
+
+uint8_t OneWireScheduler::discover() {
+    count = 0;
+    converting = false;
+    for (uint8_t b = 0; b < busCount; b++) {
+        uint8_t rom[8];
+        buses[b]->reset_search();
+        while (count < MaxSensors && buses[b]->search(rom)) {
+            if (OneWire::crc8(rom, 7) != rom[7]) {
+                continue;
+            }
+            if (rom[0] != FAMILY_DS18B20 && rom[0] != FAMILY_DS1822) {
+                continue;
+            }
+            Sensor& sensor = sensors[count++];
+            sensor.rom = romToId(rom);
+            sensor.bus = b;
+            sensor.resolution = resolutionFor(sensor.rom);
+            sensor.celsius = NAN;
+            sensor.valid = false;
+            sensor.readErrors = 0;
+            writeResolution(sensor);
+        }
+    }
+    return count;
+}
+
+bool OneWireScheduler::setResolution(uint64_t rom, uint8_t bits) {
+    if (bits < 9 || bits > 12) {
+        return false;
+    }
+    uint8_t i = 0;
+    while (i < overrideCount && overrides[i].rom != rom) {
+        i++;
+    }
+    if (i == overrideCount) {
+        if (overrideCount == MaxSensors) {
+            return false;
+        }
+        overrideCount++;
+    }
+    overrides[i] = {rom, bits};
+
+    for (uint8_t s = 0; s < count; s++) {
+        if (sensors[s].rom == rom && sensors[s].resolution != bits) {
+            sensors[s].resolution = bits;
+            writeResolution(sensors[s]);
+        }
+    }
+    return true;
+}
+
+void OneWireScheduler::setDefaultResolution(uint8_t bits) {
+    if (bits >= 9 && bits <= 12) {
+        defaultResolution = bits;
+    }
+}
+
+void OneWireScheduler::startConversion() {
+    if (converting || count == 0) {
+        return;
+    }
+    // Skip ROM + Convert T: every sensor on the bus starts at once
+    for (uint8_t b = 0; b < busCount; b++) {
+        if (buses[b]->reset()) {
+            buses[b]->skip();
+            // Keep the bus driven high during the conversion for parasite powered sensors
+            buses[b]->write(CMD_CONVERT_T, 1);
+        }
+    }
+    conversionStartMs = millis();
+    pendingMask = (count == 32) ? 0xFFFFFFFFu : ((1u << count) - 1);
+    converting = true;
+}
+
+bool OneWireScheduler::update() {
+    if (!converting) {
+        return false;
+    }
+
+    // First sensor whose conversion is done; lower resolutions are ready earlier
+    unsigned long elapsed = millis() - conversionStartMs;
+    uint8_t index = 0;
+    while (index < count && (!(pendingMask & (1u << index)) || elapsed < conversionTimeMs(sensors[index].resolution))) {
+        index++;
+    }
+    if (index == count) {
+        return false;
+    }
+    Sensor& sensor = sensors[index];
+    pendingMask &= ~(1u << index);
+
+    uint8_t data[9];
+    if (readScratchpad(sensor, data)) {
+        int16_t raw = (int16_t)((data[1] << 8) | data[0]);
+        // Undefined low bits at lower resolutions
+        raw &= ~((1 << (12 - sensor.resolution)) - 1);
+        if (raw == POWER_ON_RAW) {
+            sensor.valid = false;
+            sensor.readErrors++;
+        } else {
+            sensor.celsius = raw / 16.0f;
+            sensor.valid = true;
+        }
+    } else {
+        sensor.valid = false;
+        sensor.readErrors++;
+    }
+
+    if (pendingMask != 0) {
+        return false;
+    }
+    converting = false;
+    cycleMs = millis() - conversionStartMs;
+    return true;
+}
+
+uint64_t OneWireScheduler::romToId(const uint8_t* rom) {
+    uint64_t id = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+        id = (id << 8) | rom[i];
+    }
+    return id;
+}
+
+void OneWireScheduler::idToRom(uint64_t id, uint8_t* rom) {
+    for (int i = 7; i >= 0; i--) {
+        rom[i] = (uint8_t)(id & 0xFF);
+        id >>= 8;
+    }
+}
+
+String OneWireScheduler::formatId(uint64_t id) {
+    uint8_t rom[8];
+    idToRom(id, rom);
+    char text[24];
+    snprintf(text, sizeof(text), "%02X-%02X-%02X-%02X-%02X-%02X-%02X-%02X",
+             rom[0], rom[1], rom[2], rom[3], rom[4], rom[5], rom[6], rom[7]);
+    return String(text);
+}
+
+bool OneWireScheduler::parseId(const char* text, uint64_t& id) {
+    uint64_t value = 0;
+    uint8_t digits = 0;
+    for (const char* c = text; *c; c++) {
+        uint8_t nibble;
+        if (*c >= '0' && *c <= '9') nibble = *c - '0';
+        else if (*c >= 'a' && *c <= 'f') nibble = *c - 'a' + 10;
+        else if (*c >= 'A' && *c <= 'F') nibble = *c - 'A' + 10;
+        else if (*c == '-' || *c == ':' || *c == ' ') continue;
+        else return false;
+        if (++digits > 16) return false;
+        value = (value << 4) | nibble;
+    }
+    if (digits != 16) {
+        return false;
+    }
+    id = value;
+    return true;
+}
+
+uint16_t OneWireScheduler::conversionTimeMs(uint8_t resolution) {
+    // 93.75 ms at 9 bit, doubling per bit; rounded up
+    return 94 << (resolution - 9);
+}
+
+uint8_t OneWireScheduler::resolutionFor(uint64_t rom) const {
+    for (uint8_t i = 0; i < overrideCount; i++) {
+        if (overrides[i].rom == rom) {
+            return overrides[i].bits;
+        }
+    }
+    return defaultResolution;
+}
+
+bool OneWireScheduler::writeResolution(const Sensor& sensor) {
+    // Keep the alarm registers, only the configuration byte changes.
+    // Not copied to EEPROM; discover() writes it again after a power cycle.
+    uint8_t data[9];
+    if (!readScratchpad(sensor, data)) {
+        return false;
+    }
+    uint8_t rom[8];
+    idToRom(sensor.rom, rom);
+    OneWire* bus = buses[sensor.bus];
+    if (!bus->reset()) {
+        return false;
+    }
+    bus->select(rom);
+    bus->write(CMD_WRITE_SCRATCHPAD);
+    bus->write(data[2]);
+    bus->write(data[3]);
+    bus->write(((sensor.resolution - 9) << 5) | 0x1F);
+    return true;
+}
+
+bool OneWireScheduler::readScratchpad(const Sensor& sensor, uint8_t* data) {
+    uint8_t rom[8];
+    idToRom(sensor.rom, rom);
+    OneWire* bus = buses[sensor.bus];
+    if (!bus->reset()) {
+        return false;
+    }
+    bus->select(rom);
+    bus->write(CMD_READ_SCRATCHPAD);
+    bus->read_bytes(data, 9);
+    // A missing sensor reads as all ones, which fails the CRC check; a shorted bus
+    // reads as all zeros, which passes it but not the fixed bits of the configuration byte
+    return OneWire::crc8(data, 8) == data[8] && (data[4] & 0x9F) == 0x1F;
+}
@@ -0,0 +1,92 @@
+#ifndef ONEWIRESCHEDULER_H
+#define ONEWIRESCHEDULER_H
+
+// Non-blocking DS18B20 reader for one or more OneWire buses.
+//
+// - The ROM search runs once (discover()); the device list is cached, so a
+//   cycle never searches the bus again.
+// - startConversion() starts the conversion of all sensors on all buses at
+//   once with a single Skip ROM command per bus.
+// - update() reads the scratchpad of one sensor per call as soon as its
+//   conversion time (depending on its resolution) has passed, checks the CRC
+//   and rejects the 85 °C power-on value. The loop is blocked for one
+//   scratchpad read (about 10 ms) at a time.
+// - The resolution can be set per sensor (9-12 bit); lower resolutions
+//   convert faster (94 ms at 9 bit vs. 750 ms at 12 bit).
+//
+// Sensor ROM ids are uint64_t with the family code in the most significant
+// byte, so printing them as hex gives the usual "28-FF-..." order.
+
+#include <Arduino.h>
+#include <OneWire.h>
+
+class OneWireScheduler {
+public:
+    static const uint8_t MaxBuses = 4;
+    static const uint8_t MaxSensors = 32;
+
+    struct Sensor {
+        uint64_t rom;
+        uint8_t bus;
+        uint8_t resolution;       // 9-12 bit
+        float celsius;            // Last valid reading
+        bool valid;               // celsius belongs to the last completed cycle
+        uint32_t readErrors;      // CRC errors, missing sensors and power-on values
+    };
+
+    // Returns false if MaxBuses are already registered
+    bool addBus(OneWire& bus);
+
+    // Searches all buses and applies the configured resolutions; returns the number of sensors found
+    uint8_t discover();
+
+    // Resolution used for a sensor from now on (also for sensors found by a later discover())
+    bool setResolution(uint64_t rom, uint8_t bits);
+    void setDefaultResolution(uint8_t bits);
+
+    // Starts a conversion cycle on all buses; ignored while a cycle is running
+    void startConversion();
+
+    // Reads at most one sensor per call. Returns true once when a cycle has completed.
+    bool update();
+
+    bool busy() const { return converting; }
+    uint8_t sensorCount() const { return count; }
+    const Sensor& sensor(uint8_t index) const { return sensors[index]; }
+    // Duration of the last complete cycle, conversion plus reads
+    uint32_t lastCycleMs() const { return cycleMs; }
+
+    static uint64_t romToId(const uint8_t* rom);
+    static void idToRom(uint64_t id, uint8_t* rom);
+    // "28-FF-64-1E-11-22-33-44"
+    static String formatId(uint64_t id);
+    // Parses the format of formatId (separators optional), returns false for invalid ids
+    static bool parseId(const char* text, uint64_t& id);
+
+    static uint16_t conversionTimeMs(uint8_t resolution);
+
+private:
+    struct ResolutionOverride {
+        uint64_t rom;
+        uint8_t bits;
+    };
+
+    OneWire* buses[MaxBuses];
+    uint8_t busCount = 0;
+    Sensor sensors[MaxSensors];
+    uint8_t count = 0;
+    ResolutionOverride overrides[MaxSensors];
+    uint8_t overrideCount = 0;
+    uint8_t defaultResolution = 12;
+
+    bool converting = false;
+    unsigned long conversionStartMs = 0;
+    uint32_t pendingMask = 0;     // Bit n set while sensor n has not been read in this cycle
+    uint32_t cycleMs = 0;
+
+    uint8_t resolutionFor(uint64_t rom) const;
+    bool writeResolution(const Sensor& sensor);
+    bool readScratchpad(const Sensor& sensor, uint8_t* data);
+};
+
+#endif // ONEWIRESCHEDULER_H
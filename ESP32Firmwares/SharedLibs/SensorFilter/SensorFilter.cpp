@@ -0,0 +1,112 @@
+#include "SensorFilter.h"
+
+void SensorFilter::reset() {
+    windowCount = 0;
+    windowNext = 0;
+    output = 0;
+    outputMs = 0;
+    hasOutput = false;
+    lastRaw = 0;
+    lastRawChangeMs = 0;
+    consecutiveBad = 0;
+    state = SensorHealth::Warmup;
+    rejected = 0;
+    errors = 0;
+}
+
+bool SensorFilter::add(int32_t value, uint32_t nowMs, const SensorFilterConfig& config) {
+    if (value < config.minValue || value > config.maxValue) {
+        rejected++;
+        if (++consecutiveBad >= config.failAfter) {
+            state = SensorHealth::Failed;
+        } else {
+            state = SensorHealth::Spike;
+        }
+        return false;
+    }
+
+    if (windowCount == 0 || value != lastRaw) {
+        lastRaw = value;
+        lastRawChangeMs = nowMs;
+    }
+
+    window[windowNext] = value;
+    windowNext = (windowNext + 1) % WindowSize;
+    if (windowCount < WindowSize) {
+        windowCount++;
+    }
+
+    // A median of less than half a window would still pass a single spike
+    if (windowCount <= WindowSize / 2) {
+        consecutiveBad = 0;
+        state = SensorHealth::Warmup;
+        return false;
+    }
+
+    int32_t filtered = median(window, windowCount);
+    if (hasOutput && config.maxRatePerMinute > 0) {
+        int64_t allowed = (int64_t)config.maxRatePerMinute * (nowMs - outputMs) / 60000;
+        int64_t change = (int64_t)filtered - output;
+        if (change > allowed || -change > allowed) {
+            rejected++;
+            if (++consecutiveBad >= config.failAfter) {
+                state = SensorHealth::Failed;
+            } else {
+                state = SensorHealth::Spike;
+            }
+            return false;
+        }
+    }
+
+    output = filtered;
+    outputMs = nowMs;
+    hasOutput = true;
+    consecutiveBad = 0;
+    // Only suspicious: a healthy sensor in a stable room or tank can read the
+    // same value for hours, so the value is still passed on
+    bool stuck = config.stuckAfterMs > 0 && nowMs - lastRawChangeMs >= config.stuckAfterMs;
+    state = stuck ? SensorHealth::Stuck : SensorHealth::Ok;
+    return true;
+}
+
+void SensorFilter::addError(const SensorFilterConfig& config) {
+    errors++;
+    if (++consecutiveBad >= config.failAfter) {
+        state = SensorHealth::Failed;
+    }
+}
+
+const char* SensorFilter::healthName(SensorHealth health) {
+    switch (health) {
+        case SensorHealth::Warmup: return "warmup";
+        case SensorHealth::Ok: return "ok";
+        case SensorHealth::Spike: return "spike";
+        case SensorHealth::Stuck: return "stuck";
+        case SensorHealth::Failed: return "failed";
+    }
+    return "";
+}
+
+int32_t SensorFilter::toFixed(float value) {
+    return (int32_t)(value >= 0 ? value * 100.0f + 0.5f : value * 100.0f - 0.5f);
+}
+
+float SensorFilter::fromFixed(int32_t value) {
+    return value / 100.0f;
+}
+
+int32_t SensorFilter::median(const int32_t* values, uint8_t count) {
+    // Insertion sort of a copy, the window is tiny
+    int32_t sorted[WindowSize];
+    for (uint8_t i = 0; i < count; i++) {
+        int32_t v = values[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    // Lower middle for even counts, so the result is always one of the readings
+    return sorted[(count - 1) / 2];
+}
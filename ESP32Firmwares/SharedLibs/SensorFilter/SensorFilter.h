@@ -0,0 +1,76 @@
+#ifndef SENSORFILTER_H
+#define SENSORFILTER_H
+
+// Outlier rejection and fault detection for one measurement of one sensor.
+//
+// Each reading passes three checks before it is used:
+// - plausible range: values outside [minValue, maxValue] are rejected
+// - median of the last WindowSize readings: a single spike never reaches the
+//   output, it only moves the median by one position
+// - rate of change: the median may move at most maxRatePerMinute per minute
+//   since the last accepted value; a real step change is accepted once
+//   enough time has passed, a glitch is gone from the window before that
+// Additionally a raw value that does not change at all for stuckAfterMs marks
+// the sensor as stuck (frozen bus, DHT returning its last value). That is only
+// a hint in the health state: the value itself still passes, a stable room
+// or tank can read the same value for hours.
+//
+// Values are fixed-point integers in the unit the caller chooses (the
+// firmwares use hundredths, see toFixed()), so the filter does no float math.
+// Kept free of Arduino dependencies and constructors so it can be tested on
+// the host and live in RTC memory; call reset() before first use.
+
+#include <stdint.h>
+
+enum class SensorHealth : uint8_t {
+    Warmup,   // Not enough readings for a median yet
+    Ok,
+    Spike,    // Last reading rejected (out of range or too fast a change)
+    Stuck,    // Raw value unchanged for stuckAfterMs, value still passed on
+    Failed,   // failAfter readings in a row failed or were rejected
+};
+
+struct SensorFilterConfig {
+    int32_t minValue;
+    int32_t maxValue;
+    int32_t maxRatePerMinute;   // 0 = no rate limit
+    uint32_t stuckAfterMs;      // 0 = no stuck detection
+    uint8_t failAfter;          // Consecutive bad readings until Failed
+};
+
+struct SensorFilter {
+    static const uint8_t WindowSize = 5;
+
+    int32_t window[WindowSize];
+    uint8_t windowCount;
+    uint8_t windowNext;
+    int32_t output;             // Last accepted (filtered) value
+    uint32_t outputMs;          // Time of the last accepted value
+    bool hasOutput;
+    int32_t lastRaw;
+    uint32_t lastRawChangeMs;
+    uint8_t consecutiveBad;
+    SensorHealth state;
+    uint32_t rejected;          // Readings rejected since reset
+    uint32_t errors;            // Failed reads since reset
+
+    void reset();
+
+    // Adds a reading. Returns true if value() holds a new accepted value.
+    bool add(int32_t value, uint32_t nowMs, const SensorFilterConfig& config);
+    // Records a failed read (CRC error, sensor missing, driver error)
+    void addError(const SensorFilterConfig& config);
+
+    int32_t value() const { return output; }
+    SensorHealth health() const { return state; }
+
+    static const char* healthName(SensorHealth health);
+    // value * 100 rounded to the nearest integer, e.g. 21.37 °C -> 2137
+    static int32_t toFixed(float value);
+    static float fromFixed(int32_t value);
+
+    // Median of values (count <= WindowSize)
+    static int32_t median(const int32_t* values, uint8_t count);
+};
+
+#endif // SENSORFILTER_H
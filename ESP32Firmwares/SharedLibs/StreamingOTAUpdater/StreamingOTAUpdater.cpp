@@ -0,0 +1,366 @@
+#include <Arduino.h>
+#include <esp_http_client.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/sha256.h>
+#include <memory>
+#include <new>
+#include <string.h>
+#include "OTAImageDecoder.h"
+#include "StreamingOTAUpdater.h"
+
+namespace {
+
+// Root Certificate for Azure Blob Storage
+// DigiCert Global Root G2 as defined in the Azure Portal certificate chain
+// Downloaded from https://www.digicert.com/kb/digicert-root-certificates.htm
+const char* server_certificate = "-----BEGIN CERTIFICATE-----\n" \
+"MIIDjjCCAnagAwIBAgIQAzrx5qcRqaC7KGSxHQn65TANBgkqhkiG9w0BAQsFADBh\n" \
+"MQswCQYDVQQGEwJVUzEVMBMGA1UEChMMRGlnaUNlcnQgSW5jMRkwFwYDVQQLExB3\n" \
+"d3cuZGlnaWNlcnQuY29tMSAwHgYDVQQDExdEaWdpQ2VydCBHbG9iYWwgUm9vdCBH\n" \
+"MjAeFw0xMzA4MDExMjAwMDBaFw0zODAxMTUxMjAwMDBaMGExCzAJBgNVBAYTAlVT\n" \
+"MRUwEwYDVQQKEwxEaWdpQ2VydCBJbmMxGTAXBgNVBAsTEHd3dy5kaWdpY2VydC5j\n" \
+"b20xIDAeBgNVBAMTF0RpZ2lDZXJ0IEdsb2JhbCBSb290IEcyMIIBIjANBgkqhkiG\n" \
+"9w0BAQEFAAOCAQ8AMIIBCgKCAQEAuzfNNNx7a8myaJCtSnX/RrohCgiN9RlUyfuI\n" \
+"2/Ou8jqJkTx65qsGGmvPrC3oXgkkRLpimn7Wo6h+4FR1IAWsULecYxpsMNzaHxmx\n" \
+"1x7e/dfgy5SDN67sH0NO3Xss0r0upS/kqbitOtSZpLYl6ZtrAGCSYP9PIUkY92eQ\n" \
+"q2EGnI/yuum06ZIya7XzV+hdG82MHauVBJVJ8zUtluNJbd134/tJS7SsVQepj5Wz\n" \
+"tCO7TG1F8PapspUwtP1MVYwnSlcUfIKdzXOS0xZKBgyMUNGPHgm+F6HmIcr9g+UQ\n" \
+"vIOlCsRnKPZzFBQ9RnbDhxSJITRNrw9FDKZJobq7nMWxM4MphQIDAQABo0IwQDAP\n" \
+"BgNVHRMBAf8EBTADAQH/MA4GA1UdDwEB/wQEAwIBhjAdBgNVHQ4EFgQUTiJUIBiV\n" \
+"5uNu5g/6+rkS7QYXjzkwDQYJKoZIhvcNAQELBQADggEBAGBnKJRvDkhj6zHd6mcY\n" \
+"1Yl9PMWLSn/pvtsrF9+wX3N3KjITOYFnQoQj8kVnNeyIv/iPsGEMNKSuIEyExtv4\n" \
+"NeF22d+mQrvHRAiGfzZ0JFrabA0UWTW98kndth/Jsw1HKj2ZL7tcu7XUIOGZX1NG\n" \
+"Fdtom/DzMNU+MeKNhJ7jitralj41E6Vf8PlwUHBHQRFXGU7Aj64GxJUTFy8bJZ91\n" \
+"8rGOmaFvE7FBcf6IKshPECBV1/MUReXgRPTqh5Uykw7+U0b6LJ3/iyK5S9kJRaTe\n" \
+"pLiaWN0bfVKfjllDiIGknibVb63dDcY3fe0Dkhvld1927jyNxF1WW6LZZm6zNTfl\n" \
+"MrY=\n" \
+"-----END CERTIFICATE-----";
+
+// Release signing key, see StreamingOTAUpdater.h and OTATools/README.md
+#ifndef OTA_SIGNING_KEY
+#define OTA_SIGNING_KEY ""
+#endif
+const char* signingKey = OTA_SIGNING_KEY;
+
+enum Status : int {
+    Idle = 0,
+    Updating = 1,
+    Finished = 2,
+    Failed = -1
+};
+
+const size_t FlashBufferSize = 4096;
+const size_t DownloadChunkSize = 1024;
+const uint32_t TaskStackSize = 8192;
+// DER encoded ECDSA P-256 signatures are at most 72 bytes
+const size_t MaxSignatureSize = 80;
+
+volatile int status = Idle;
+volatile uint32_t bytesWritten = 0;
+String candidates[3];
+size_t candidateCount = 0;
+String signatureUrl;
+
+// Running partition as source, the next OTA partition as target. Flash
+// writes are collected to whole 4 KB sectors; the task yields after each.
+class PartitionIO : public OTAImageIO {
+public:
+    PartitionIO(const esp_partition_t* source, esp_ota_handle_t handle) : source(source), handle(handle) {
+        mbedtls_sha256_init(&imageHash);
+        mbedtls_sha256_starts(&imageHash, 0);
+    }
+
+    ~PartitionIO() {
+        mbedtls_sha256_free(&imageHash);
+    }
+
+    bool readSource(uint32_t offset, uint8_t* data, size_t length) override {
+        if (offset + length > source->size) {
+            return false;
+        }
+        return esp_partition_read(source, offset, data, length) == ESP_OK;
+    }
+
+    bool verifySource(uint32_t size, const uint8_t sha256[32]) override {
+        if (size == 0 || size > source->size) {
+            return false;
+        }
+        mbedtls_sha256_context context;
+        mbedtls_sha256_init(&context);
+        mbedtls_sha256_starts(&context, 0);
+        uint8_t chunk[512];
+        bool ok = true;
+        for (uint32_t offset = 0; offset < size && ok; offset += sizeof(chunk)) {
+            size_t length = size - offset < sizeof(chunk) ? size - offset : sizeof(chunk);
+            ok = esp_partition_read(source, offset, chunk, length) == ESP_OK;
+            if (ok) {
+                mbedtls_sha256_update(&context, chunk, length);
+            }
+        }
+        uint8_t digest[32];
+        mbedtls_sha256_finish(&context, digest);
+        mbedtls_sha256_free(&context);
+        return ok && memcmp(digest, sha256, sizeof(digest)) == 0;
+    }
+
+    bool writeTarget(const uint8_t* data, size_t length) override {
+        mbedtls_sha256_update(&imageHash, data, length);
+        while (length > 0) {
+            size_t take = FlashBufferSize - buffered;
+            if (take > length) take = length;
+            memcpy(buffer.get() + buffered, data, take);
+            buffered += take;
+            data += take;
+            length -= take;
+            if (buffered == FlashBufferSize && !flush()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool flush() {
+        if (buffered == 0) {
+            return true;
+        }
+        if (esp_ota_write(handle, buffer.get(), buffered) != ESP_OK) {
+            return false;
+        }
+        bytesWritten += buffered;
+        buffered = 0;
+        // Lets loop() and the network stack run between two sectors
+        vTaskDelay(1);
+        return true;
+    }
+
+    bool allocated() const { return buffer != nullptr; }
+
+    // SHA-256 of the decoded image, what the release signature covers
+    void imageDigest(uint8_t digest[32]) {
+        mbedtls_sha256_finish(&imageHash, digest);
+    }
+
+private:
+    const esp_partition_t* source;
+    esp_ota_handle_t handle;
+    mbedtls_sha256_context imageHash;
+    std::unique_ptr<uint8_t[]> buffer{new (std::nothrow) uint8_t[FlashBufferSize]};
+    size_t buffered = 0;
+};
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+struct Signature {
+    uint8_t data[MaxSignatureSize];
+    size_t length = 0;
+};
+
+bool verifySignature(const uint8_t digest[32], const Signature& signature) {
+    uint8_t key[128];
+    size_t keyLength = strlen(signingKey) / 2;
+    if (keyLength == 0 || keyLength > sizeof(key)) {
+        return false;
+    }
+    for (size_t i = 0; i < keyLength; i++) {
+        int high = hexDigit(signingKey[2 * i]);
+        int low = hexDigit(signingKey[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        key[i] = (uint8_t)(high << 4 | low);
+    }
+
+    mbedtls_pk_context pk;
+    mbedtls_pk_init(&pk);
+    bool ok = mbedtls_pk_parse_public_key(&pk, key, keyLength) == 0 && mbedtls_pk_can_do(&pk, MBEDTLS_PK_ECDSA) &&
+              mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, digest, 32, signature.data, signature.length) == 0;
+    mbedtls_pk_free(&pk);
+    return ok;
+}
+
+esp_http_client_handle_t openUrl(const String& url) {
+    esp_http_client_config_t config = {};
+    config.url = url.c_str();
+    config.cert_pem = server_certificate;
+    config.timeout_ms = 15000;
+    config.buffer_size = DownloadChunkSize;
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (!client) {
+        return nullptr;
+    }
+    if (esp_http_client_open(client, 0) != ESP_OK) {
+        esp_http_client_cleanup(client);
+        return nullptr;
+    }
+    esp_http_client_fetch_headers(client);
+    int httpStatus = esp_http_client_get_status_code(client);
+    if (httpStatus != 200) {
+        Serial.printf("OTA: HTTP status %d\n", httpStatus);
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+        return nullptr;
+    }
+    return client;
+}
+
+bool downloadSignature(Signature& signature) {
+    Serial.println("OTA: requesting " + signatureUrl);
+    esp_http_client_handle_t client = openUrl(signatureUrl);
+    if (!client) {
+        return false;
+    }
+    signature.length = 0;
+    bool ok = true;
+    while (ok) {
+        int length = esp_http_client_read(client, (char*)signature.data + signature.length,
+                                          sizeof(signature.data) - signature.length);
+        if (length <= 0) {
+            ok = length == 0 && esp_http_client_is_complete_data_received(client);
+            break;
+        }
+        signature.length += length;
+        // Anything this long is no signature
+        ok = signature.length < sizeof(signature.data);
+    }
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return ok && signature.length > 0;
+}
+
+Signature releaseSignature;
+
+bool download(const String& url, const Signature* signature) {
+    Serial.println("OTA: requesting " + url);
+    esp_http_client_handle_t client = openUrl(url);
+    if (!client) {
+        return false;
+    }
+    int64_t contentLength = esp_http_client_get_content_length(client);
+
+    const esp_partition_t* target = esp_ota_get_next_update_partition(nullptr);
+    esp_ota_handle_t handle = 0;
+    if (!target || esp_ota_begin(target, OTA_WITH_SEQUENTIAL_WRITES, &handle) != ESP_OK) {
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+        return false;
+    }
+
+    PartitionIO io(esp_ota_get_running_partition(), handle);
+    OTAImageDecoder decoder;
+    decoder.begin(&io);
+    bytesWritten = 0;
+
+    bool ok = io.allocated();
+    uint8_t chunk[DownloadChunkSize];
+    int64_t received = 0;
+    while (ok) {
+        int length = esp_http_client_read(client, (char*)chunk, sizeof(chunk));
+        if (length < 0) {
+            Serial.println("OTA: download interrupted");
+            ok = false;
+        } else if (length == 0) {
+            ok = esp_http_client_is_complete_data_received(client);
+            break;
+        } else {
+            received += length;
+            ok = decoder.write(chunk, length);
+            if (!ok) {
+                Serial.printf("OTA: %s\n", decoder.error());
+            }
+        }
+    }
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+
+    ok = ok && decoder.finished() && io.flush();
+    if (ok && signature) {
+        uint8_t digest[32];
+        io.imageDigest(digest);
+        ok = verifySignature(digest, *signature);
+        if (!ok) {
+            Serial.println("OTA: image signature invalid");
+        }
+    }
+    if (!ok) {
+        esp_ota_abort(handle);
+        return false;
+    }
+    // esp_ota_end() checks the image and its SHA-256 appended by the build
+    if (esp_ota_end(handle) != ESP_OK || esp_ota_set_boot_partition(target) != ESP_OK) {
+        Serial.println("OTA: written image is invalid");
+        return false;
+    }
+    Serial.printf("OTA: %u byte image from %lld bytes download (content length %lld)\n",
+                  (unsigned)decoder.written(), received, contentLength);
+    return true;
+}
+
+void updateTask(void*) {
+    // Fetched first: without it no artifact can be accepted
+    bool requireSignature = *signingKey != '\0';
+    bool done = false;
+    if (requireSignature && !downloadSignature(releaseSignature)) {
+        Serial.println("OTA: image signature missing");
+        candidateCount = 0;
+    }
+    // A missing artifact (404) or one that does not fit, like a delta built
+    // against another image, falls back to the next candidate
+    for (size_t i = 0; i < candidateCount && !done; i++) {
+        done = download(candidates[i], requireSignature ? &releaseSignature : nullptr);
+    }
+    status = done ? Finished : Failed;
+    vTaskDelete(nullptr);
+}
+
+}
+
+bool StreamingOTAUpdater::UpdateFirmwareFromUrl(const char* firmwareUrl, const char* currentVersion) {
+    if (status == Updating || status == Finished) {
+        return false;
+    }
+
+    String url = firmwareUrl;
+    if (*signingKey == '\0' && !url.startsWith("https://")) {
+        // Nothing would authenticate the image
+        Serial.println("OTA: unsigned build, refusing " + url);
+        status = Failed;
+        return false;
+    }
+    signatureUrl = url + ".sig";
+    candidateCount = 0;
+    if (currentVersion && *currentVersion && url.endsWith(".bin")) {
+        candidates[candidateCount++] = url.substring(0, url.length() - 4) + "_from_" + currentVersion + ".delta";
+    }
+    candidates[candidateCount++] = url + ".hs";
+    candidates[candidateCount++] = url;
+
+    status = Updating;
+    // Same priority as the loop task, which gets its turn at every flash write
+    if (xTaskCreate(updateTask, "ota", TaskStackSize, nullptr, tskIDLE_PRIORITY + 1, nullptr) != pdPASS) {
+        status = Failed;
+        return false;
+    }
+    Serial.println("Starting OTA Update from Azure Blob Storage " + url + " ...");
+    return true;
+}
+
+int StreamingOTAUpdater::CheckUpdateStatus() {
+    int current = status;
+    if (current == Finished) {
+        Serial.println("Firmware written successfully. Rebooting now ...");
+        Serial.flush();
+        ESP.restart();
+    }
+    return current == Finished ? Updating : current;
+}
+
+uint32_t StreamingOTAUpdater::BytesWritten() {
+    return bytesWritten;
+}
@@ -0,0 +1,38 @@
+#ifndef STREAMINGOTAUPDATER_H
+#define STREAMINGOTAUPDATER_H
+
+// Firmware update from Azure Blob Storage that runs beside the firmware, a
+// replacement for AzureOTAUpdater of the ESP32_OTAUpdate package (same
+// UpdateFirmwareFromUrl()/CheckUpdateStatus() calls).
+//
+// - The download runs in its own task and yields after every flash write,
+//   so loop() keeps sampling and publishing while it runs.
+// - Given the running version, it first asks for a delta against it
+//   (<image>_from_<version>.delta), then for the compressed image
+//   (<image>.bin.hs), then for the plain .bin; a missing artifact (404) or a
+//   delta built against another image falls back to the next one.
+// - Artifacts are decoded while they stream in (OTAImage), the only buffers
+//   are the 4 KB heatshrink window and a 4 KB flash write buffer.
+// - CI builds the artifacts with OTATools/otaimage.py.
+// - Built with OTA_SIGNING_KEY (hex DER of the release signing key's P-256
+//   public key), every image must come with a valid signature,
+//   <image>.bin.sig, checked before the boot partition is switched; the
+//   URL may then be plain HTTP (the LAN cache of OTATools/otacoordinator.py).
+//   Built without it, only HTTPS from the pinned Azure Blob Storage is
+//   accepted.
+
+#include <stdint.h>
+
+class StreamingOTAUpdater {
+public:
+    // Starts the update; false if one is already running. Without
+    // currentVersion only the compressed and the plain image are tried.
+    static bool UpdateFirmwareFromUrl(const char* firmwareUrl, const char* currentVersion = nullptr);
+    // 1 while updating, -1 after a failed update, 0 otherwise. Restarts the
+    // device once the new image is written and set as boot partition.
+    static int CheckUpdateStatus();
+    // Bytes of the new image written so far
+    static uint32_t BytesWritten();
+};
+
+#endif // STREAMINGOTAUPDATER_H
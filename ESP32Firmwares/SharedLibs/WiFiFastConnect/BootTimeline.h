@@ -0,0 +1,71 @@
+#ifndef BOOTTIMELINE_H
+#define BOOTTIMELINE_H
+
+// Milliseconds since boot at which each startup stage finished, so the cost
+// of WiFi, NTP, MQTT and the first reading can be compared across the fleet:
+//
+//   bootTimeline.mark("wifi");
+//   ...
+//   for (size_t i = 0; i < bootTimeline.size(); i++)
+//     doc[bootTimeline.stage(i)] = bootTimeline.atMs(i);
+//
+// The clock starts when the application starts; the ROM and second stage
+// bootloader before that are not included.
+
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <string.h>
+
+class BootTimeline {
+public:
+    static const size_t MaxStages = 12;
+
+    // Records the first time a stage is reached, later marks are ignored
+    void mark(const char* stage) {
+        if (count >= MaxStages || has(stage)) {
+            return;
+        }
+        stages[count].name = stage;
+        stages[count].atMs = (uint32_t)(esp_timer_get_time() / 1000);
+        count++;
+    }
+
+    bool has(const char* stage) const {
+        for (size_t i = 0; i < count; i++) {
+            if (strcmp(stages[i].name, stage) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t size() const { return count; }
+    const char* stage(size_t index) const { return stages[index].name; }
+    uint32_t atMs(size_t index) const { return stages[index].atMs; }
+
+    static const char* resetReason() {
+        switch (esp_reset_reason()) {
+            case ESP_RST_POWERON: return "poweron";
+            case ESP_RST_EXT: return "external";
+            case ESP_RST_SW: return "software";
+            case ESP_RST_PANIC: return "panic";
+            case ESP_RST_INT_WDT:
+            case ESP_RST_TASK_WDT:
+            case ESP_RST_WDT: return "watchdog";
+            case ESP_RST_DEEPSLEEP: return "deepsleep";
+            case ESP_RST_BROWNOUT: return "brownout";
+            default: return "unknown";
+        }
+    }
+
+private:
+    struct Stage {
+        const char* name;
+        uint32_t atMs;
+    };
+
+    Stage stages[MaxStages] = {};
+    size_t count = 0;
+};
+
+#endif // BOOTTIMELINE_H
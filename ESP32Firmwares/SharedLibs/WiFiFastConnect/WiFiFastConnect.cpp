@@ -0,0 +1,178 @@
+#include "WiFiFastConnect.h"
+#include <Preferences.h>
+#include <esp_attr.h>
+#include <time.h>
+
+namespace {
+    // Bump when Entry changes, older entries are ignored
+    const uint32_t EntryVersion = 2;
+    const char* EntryKey = "ap";
+
+    // Fast connects with the cached address since the last DHCP, and when
+    // that DHCP was. Counted on every boot and wake, so it lives in RTC memory
+    // instead of NVS; check tells a valid counter from the random content
+    // after a power loss.
+    struct LeaseCounter {
+        uint32_t check;
+        uint32_t ip;
+        uint8_t reuses;
+        time_t acquired;   // System time, which keeps running across resets and deep sleep
+    };
+    const uint32_t LeaseCounterMagic = 0x4C454153;   // "LEAS"
+    RTC_NOINIT_ATTR LeaseCounter leaseCounter;
+}
+
+WiFiFastConnect::WiFiFastConnect(const char* passwords, const char* nvsNamespace)
+    : passwords(passwords), nvsNamespace(nvsNamespace) {
+}
+
+bool WiFiFastConnect::load() {
+    if (loaded) {
+        return entry.version == EntryVersion;
+    }
+    loaded = true;
+    Preferences preferences;
+    if (!preferences.begin(nvsNamespace, true)) {
+        return false;
+    }
+    size_t length = preferences.getBytes(EntryKey, &entry, sizeof(entry));
+    preferences.end();
+    if (length != sizeof(entry) || entry.version != EntryVersion) {
+        entry = {};
+        return false;
+    }
+    return true;
+}
+
+void WiFiFastConnect::store() {
+    Preferences preferences;
+    if (!preferences.begin(nvsNamespace, false)) {
+        return;
+    }
+    preferences.putBytes(EntryKey, &entry, sizeof(entry));
+    preferences.end();
+}
+
+uint8_t WiFiFastConnect::leaseReuses() const {
+    if (leaseCounter.check != (LeaseCounterMagic ^ leaseCounter.ip) || leaseCounter.ip != entry.ip) {
+        // Power lost (or another address): renew the lease
+        return MaxLeaseReuses;
+    }
+    // Few boots can still span weeks on a mains node. A clock that went back
+    // (power lost, so it restarted) or forward (first NTP sync) renews once
+    time_t now = time(nullptr);
+    if (now < leaseCounter.acquired || now - leaseCounter.acquired >= MaxLeaseAgeSeconds) {
+        return MaxLeaseReuses;
+    }
+    return leaseCounter.reuses;
+}
+
+void WiFiFastConnect::setLeaseReuses(uint8_t reuses) {
+    leaseCounter.ip = entry.ip;
+    leaseCounter.reuses = reuses;
+    if (reuses == 0) {
+        leaseCounter.acquired = time(nullptr);
+    }
+    leaseCounter.check = LeaseCounterMagic ^ entry.ip;
+}
+
+String WiFiFastConnect::passwordFor(const char* ssid) const {
+    // WIFI_PASSWORDS="ssid1;password1|ssid2;password2"
+    String credentials = passwords;
+    int start = 0;
+    while (start < (int)credentials.length()) {
+        int end = credentials.indexOf('|', start);
+        if (end < 0) {
+            end = credentials.length();
+        }
+        String candidate = credentials.substring(start, end);
+        int separator = candidate.indexOf(';');
+        if (separator > 0 && candidate.substring(0, separator) == ssid) {
+            return candidate.substring(separator + 1);
+        }
+        start = end + 1;
+    }
+    return "";
+}
+
+bool WiFiFastConnect::connect(uint32_t timeoutMs) {
+    if (!load()) {
+        lastResult = "none";
+        return false;
+    }
+    String password = passwordFor(entry.ssid);
+    if (password == "") {
+        // Credentials changed with a new build
+        lastResult = "none";
+        forget();
+        return false;
+    }
+
+    uint8_t reuses = leaseReuses();
+    bool reuseLease = entry.ip != 0 && reuses < MaxLeaseReuses;
+    WiFi.mode(WIFI_STA);
+    if (reuseLease) {
+        WiFi.config(IPAddress(entry.ip), IPAddress(entry.gateway), IPAddress(entry.subnet), IPAddress(entry.dns));
+    } else {
+        // A static address from an earlier connect of this boot stays set otherwise
+        WiFi.config(IPAddress(), IPAddress(), IPAddress());
+    }
+    WiFi.begin(entry.ssid, password.c_str(), entry.channel, entry.bssid, true);
+    unsigned long start = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - start < timeoutMs) {
+        delay(10);
+    }
+
+    if (WiFi.status() == WL_CONNECTED) {
+        lastResult = reuseLease ? "cached" : "cached-dhcp";
+        setLeaseReuses(reuseLease ? reuses + 1 : 0);
+        return true;
+    }
+
+    // Access point moved or gone, or the address is taken: back to scan and DHCP
+    lastResult = "failed";
+    forget();
+    WiFi.disconnect();
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());
+    return false;
+}
+
+void WiFiFastConnect::remember() {
+    if (WiFi.status() != WL_CONNECTED) {
+        return;
+    }
+    load();
+    Entry current = {};
+    current.version = EntryVersion;
+    strlcpy(current.ssid, WiFi.SSID().c_str(), sizeof(current.ssid));
+    memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+    current.channel = WiFi.channel();
+    current.ip = (uint32_t)WiFi.localIP();
+    current.gateway = (uint32_t)WiFi.gatewayIP();
+    current.subnet = (uint32_t)WiFi.subnetMask();
+    current.dns = (uint32_t)WiFi.dnsIP();
+
+    // NVS is flash: unchanged connections are not written again
+    if (memcmp(&current, &entry, sizeof(current)) != 0) {
+        bool newAddress = current.ip != entry.ip;
+        entry = current;
+        store();
+        if (newAddress) {
+            // Fresh from DHCP (scan or renewal)
+            setLeaseReuses(0);
+        }
+    }
+}
+
+void WiFiFastConnect::forget() {
+    load();
+    if (entry.version == 0) {
+        return;
+    }
+    entry = {};
+    Preferences preferences;
+    if (preferences.begin(nvsNamespace, false)) {
+        preferences.remove(EntryKey);
+        preferences.end();
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef WIFIFASTCONNECT_H
+#define WIFIFASTCONNECT_H
+
+// Fast WiFi connect at boot: the access point (SSID, BSSID, channel) and the
+// address lease of the last good connection are kept in NVS and tried first,
+// which skips the channel scan and DHCP. Only when that fails does the
+// firmware fall back to WifiLib's scan.
+//
+//   wifiFast.connectOrScan(wifiLib);
+//
+// - The cache survives reboots, OTA updates, brownouts and deep sleep. NVS
+//   is only written when the access point or the address changes.
+// - A cached address is reused for at most MaxLeaseReuses fast connects and
+//   at most MaxLeaseAgeSeconds after its DHCP, then one connect runs DHCP
+//   (still without a scan) to renew the lease, so a node does not keep an
+//   address the router gave away. Count and time are kept in RTC memory,
+//   which survives resets and deep sleep but not a power loss: after one the
+//   lease is renewed right away. A node that stays connected keeps the
+//   address until its next connect().
+// - A failed fast connect drops the cache, the next boot scans.
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+class WiFiFastConnect {
+public:
+    static const uint32_t DefaultTimeoutMs = 3000;
+    static const uint8_t MaxLeaseReuses = 16;
+    // Half of the common 24 h lease, where a DHCP client would renew too
+    static const uint32_t MaxLeaseAgeSeconds = 12 * 3600;
+
+    // passwords in the WIFI_PASSWORDS format "ssid1;password1|ssid2;password2"
+    explicit WiFiFastConnect(const char* passwords, const char* nvsNamespace = "wififast");
+
+    // Connects to the cached access point; false if there is none or it did
+    // not answer within timeoutMs
+    bool connect(uint32_t timeoutMs = DefaultTimeoutMs);
+    // connect(), WifiLib's scan and connect if that fails, then remember();
+    // true when connected
+    template <typename Scanner>
+    bool connectOrScan(Scanner& wifiLib, uint32_t timeoutMs = DefaultTimeoutMs) {
+        if (!connect(timeoutMs)) {
+            wifiLib.scanAndSelectNetwork();
+            wifiLib.connect();
+        }
+        remember();
+        return WiFi.status() == WL_CONNECTED;
+    }
+    // Stores the current connection if it differs from the cached one
+    void remember();
+    void forget();
+
+    // How the last connect() went: "cached", "cached-dhcp" (lease renewal),
+    // "failed" or "none" (nothing cached)
+    const char* result() const { return lastResult; }
+
+private:
+    struct Entry {
+        uint32_t version;
+        char ssid[33];
+        uint8_t bssid[6];
+        int32_t channel;
+        uint32_t ip, gateway, subnet, dns;
+    };
+
+    const char* passwords;
+    const char* nvsNamespace;
+    const char* lastResult = "none";
+    Entry entry = {};
+    bool loaded = false;
+
+    bool load();
+    void store();
+    uint8_t leaseReuses() const;
+    void setLeaseReuses(uint8_t reuses);
+    String passwordFor(const char* ssid) const;
+};
+
+#endif // WIFIFASTCONNECT_H
@@ -12,6 +12,8 @@ using ArduinoJson::JsonDocument;
 #include "AzureOTAUpdater.h"
 #include "MQTTClientLib.h"
 #include "WifiLib.h"
+#include "WiFiFastConnect.h"
+#include "DeviceTelemetry.h"
 
 // Project specific libraries
 #include "temperature_display.h"
@@ -20,12 +22,15 @@ using ArduinoJson::JsonDocument;
 // WiFi credentials are read from environment variables and used during compile-time (see platformio.ini)
 // Set WIFI_PASSWORDS as environment variables on your dev-system following the pattern: WIFI_PASSWORDS="ssid1;password1|ssid2;password2"
 WifiLib wifiLib(WIFI_PASSWORDS);
+WiFiFastConnect wifiFast(WIFI_PASSWORDS);
+DeviceTelemetry telemetry;
 WiFiClient wifiClient;
 WiFiUDP ntpUDP;
 static int otaInProgress = 0;
 static bool otaEnable = OTA_ENABLED != "false";
 static bool sendMQTTMessages = true;
 static bool mqttSuccess = false;
+static bool mqttWasConnected = false;
 static String baseTopic = "daten";
 static String deviceName = "";
 const String mqtt_broker = "mosquitto.intern";
@@ -73,135 +78,78 @@ String extractVersionFromUrl(String url) {
     return "";
 }
 
-void mqttCallback(String &topic, String &payload) {
-    Serial.println("Message arrived on topic: " + topic + ". Message: " + payload);
-
-    if (topic == mqtt_DeviceNameTopic) {
-      deviceName = payload;
-      Serial.println("Sensor name set to: " + deviceName);
-      mqttClientLib->publish(("meta/" + deviceName + "/version/TemperatureDisplay").c_str(), String(version), true, 2);
-      return;
-    } 
-
-    if (topic == mqtt_OutsideTempTopic) {
-      float outsideTemp = payload.toFloat();
-      display.updateOutsideTemperature(outsideTemp);
-      return;
-    }
-
-    if (topic == mqtt_OutsideTempGardenTopic) {
-      float outsideTemp = payload.toFloat();
-      display.updateOutsideGardenTemperature(outsideTemp);
-      return;
-    }
-
-    if (topic == mqtt_HeatPumpCurrentPower) {
-      float currentPower = payload.toFloat();
-      display.updateIsHeatPumpActive(currentPower > 0);
-      Serial.printf("Heat pump current power: %.2f kW\n", currentPower);
-      return;
-    }
-    
-    if (topic == mqtt_ThermostatWohnzimmerTopic) {
-      ThermostatData thermostatData;
-      if (thermostatData.parseFromJson(payload)) {
-          // Pass the full thermostat data object
-          display.updateRoomData(thermostatData, Room::Wohnzimmer);
-      } else {
-          Serial.println("Failed to parse thermostat data for Wohnzimmer");
-      }
-      return;
-    }
-
-    if (topic == mqtt_ThermostatEsszimmerTopic) {
-      ThermostatData thermostatData;
-      if (thermostatData.parseFromJson(payload)) {
-          display.updateRoomData(thermostatData, Room::Esszimmer);
-      } else {
-          Serial.println("Failed to parse thermostat data for Esszimmer");
-      }
-      return;
-    }
-
-    if (topic == mqtt_ThermostatKuecheTopic) {
-      ThermostatData thermostatData;
-      if (thermostatData.parseFromJson(payload)) {
-          display.updateRoomData(thermostatData, Room::Kueche);
-      } else {
-          Serial.println("Failed to parse thermostat data for Küche");
-      }
-      return;
+// Thermostat JSON of one room
+MQTTHandler thermostatHandler(Room room) {
+  return [room](const char *topic, const MQTTPayload &payload) {
+    ThermostatData thermostatData;
+    if (thermostatData.parseFromJson(String(payload.data, payload.length))) {
+      display.updateRoomData(thermostatData, room);
+    } else {
+      Serial.printf("Failed to parse thermostat data for %s\n", display.roomToString(room));
     }
+  };
+}
 
-    if (topic == mqtt_ThermostatGaestezimmerTopic) {
-      ThermostatData thermostatData;
-      if (thermostatData.parseFromJson(payload)) {
-          display.updateRoomData(thermostatData, Room::Gaestezimmer);
-      } else {
-          Serial.println("Failed to parse thermostat data for Gaestezimmer");
-      }
-      return;
-    }
+void onDeviceName(const char *topic, const MQTTPayload &payload) {
+  deviceName = String(payload.data, payload.length);
+  Serial.println("Sensor name set to: " + deviceName);
+  mqttClientLib->publish(("meta/" + deviceName + "/version/TemperatureDisplay").c_str(), version, true, 2);
+}
 
-    if (topic == mqtt_ThermostatBueroTopic) {
-      ThermostatData thermostatData;
-      if (thermostatData.parseFromJson(payload)) {
-          display.updateRoomData(thermostatData, Room::Buero);
-      } else {
-          Serial.println("Failed to parse thermostat data for Buero");
-      }
-      return;
-    }
+void onOTAUpdate(const char *topic, const MQTTPayload &payload) {
+  if (otaInProgress || !otaEnable) {
+    if (otaInProgress)
+      Serial.println("OTA in progress, ignoring message");
+    if (!otaEnable)
+      Serial.println("OTA disabled, ignoring message");
+    return;
+  }
 
-    if (topic == mqtt_OTAtopic) {
-      if (otaInProgress || !otaEnable) {
-        if (otaInProgress)
-          Serial.println("OTA in progress, ignoring message");
-        if (!otaEnable)
-          Serial.println("OTA disabled, ignoring message");
-        return;
+  String firmwareUrl(payload.data, payload.length);
+  String updateVersion = extractVersionFromUrl(firmwareUrl);
+  Serial.println("Current firmware version is " + String(version));
+  Serial.println("New firmware version is " + updateVersion);
+  if(strcmp(version, updateVersion.c_str())) {
+      // Trigger OTA Update
+      Serial.println("New firmware available, starting OTA Update from " + firmwareUrl);
+      otaInProgress = true;
+      bool result =  AzureOTAUpdater::UpdateFirmwareFromUrl(firmwareUrl.c_str());
+      if (result) {
+        Serial.println("OTA Update successful initiated, waiting to be finished");
       }
+  }
+  else {
+    Serial.println("Firmware is up to date");
+  }
+}
 
-      String updateVersion = extractVersionFromUrl(payload);
-      Serial.println("Current firmware version is " + String(version));
-      Serial.println("New firmware version is " + updateVersion);
-      if(strcmp(version, updateVersion.c_str())) {
-          // Trigger OTA Update
-          const char *firmwareUrl = payload.c_str();
-          Serial.println("New firmware available, starting OTA Update from " + String(firmwareUrl));
-          otaInProgress = true;
-          bool result =  AzureOTAUpdater::UpdateFirmwareFromUrl(firmwareUrl);
-          if (result) {
-            Serial.println("OTA Update successful initiated, waiting to be finished");
-          }
-      }
-      else {
-        Serial.println("Firmware is up to date");
-      }
-    }
-    else {
-      Serial.println("Unknown topic, ignoring message");
-    }
+// One handler per topic, looked up by the MQTT client instead of comparing
+// the topic against every known one
+void registerTopicHandlers() {
+  mqttClientLib->on(mqtt_DeviceNameTopic, onDeviceName);
+  mqttClientLib->on(mqtt_OTAtopic, onOTAUpdate);
+  mqttClientLib->on(mqtt_OutsideTempTopic, [](const char *topic, const MQTTPayload &payload) {
+    display.updateOutsideTemperature(payload.toFloat());
+  });
+  mqttClientLib->on(mqtt_OutsideTempGardenTopic, [](const char *topic, const MQTTPayload &payload) {
+    display.updateOutsideGardenTemperature(payload.toFloat());
+  });
+  mqttClientLib->on(mqtt_HeatPumpCurrentPower, [](const char *topic, const MQTTPayload &payload) {
+    float currentPower = payload.toFloat();
+    display.updateIsHeatPumpActive(currentPower > 0);
+    Serial.printf("Heat pump current power: %.2f kW\n", currentPower);
+  });
+  mqttClientLib->on(mqtt_ThermostatWohnzimmerTopic, thermostatHandler(Room::Wohnzimmer));
+  mqttClientLib->on(mqtt_ThermostatEsszimmerTopic, thermostatHandler(Room::Esszimmer));
+  mqttClientLib->on(mqtt_ThermostatKuecheTopic, thermostatHandler(Room::Kueche));
+  mqttClientLib->on(mqtt_ThermostatGaestezimmerTopic, thermostatHandler(Room::Gaestezimmer));
+  mqttClientLib->on(mqtt_ThermostatBueroTopic, thermostatHandler(Room::Buero));
 }
 
 void connectToMQTT() {
-  if (WiFi.status() != WL_CONNECTED) {
-    wifiLib.connect();
-  }
-  mqttClientLib->connect(false);
-  mqttClientLib->subscribe({
-    mqtt_DeviceNameTopic, 
-    mqtt_OTAtopic, 
-    mqtt_ThermostatBueroTopic, 
-    mqtt_ThermostatEsszimmerTopic, 
-    mqtt_ThermostatKuecheTopic, 
-    mqtt_ThermostatWohnzimmerTopic, 
-    mqtt_ThermostatGaestezimmerTopic,
-    mqtt_OutsideTempTopic,
-    mqtt_OutsideTempGardenTopic,
-    mqtt_HeatPumpCurrentPower
-  });
-  Serial.println("MQTT Client is connected");
+  // The client replays the subscriptions of the handlers after every reconnect by itself
+  registerTopicHandlers();
+  Serial.println(mqttClientLib->connect(false) ? "MQTT Client is connected" : "MQTT Client not connected yet");
 }
 
 void targetTemperatureSet(float temperature, Room room) {
@@ -210,7 +158,9 @@ void targetTemperatureSet(float temperature, Room room) {
 
   // Publish the new target temperature to MQTT
   String topic = "commands/shelly/M3/" + String(display.roomToString(room));
-  mqttClientLib->publish(topic, String(temperature), true, 2);
+  char payload[16];
+  snprintf(payload, sizeof(payload), "%.2f", temperature);
+  mqttClientLib->publish(topic.c_str(), payload, true, 2);
 }
 
 void setup()
@@ -243,15 +193,16 @@ void setup()
 
   // Connect to WiFi
   Serial.print("Connecting to WiFi ");
-  wifiLib.scanAndSelectNetwork();
-  wifiLib.connect();
-  String ssid = wifiLib.getSSID();
+  // Access point and address of the last boot first, scan only if that fails
+  wifiFast.connectOrScan(wifiLib);
+  String ssid = WiFi.SSID();
 
   // Set up MQTT
   String mqttClientID = "ESP32TemperatureDisplayClient_" + chipID;
   mqtt_DeviceNameTopic.replace("{ID}", chipID);
-  mqttClientLib = new MQTTClientLib(mqtt_broker, mqtt_port, mqttClientID, wifiClient, mqttCallback);
+  mqttClientLib = new MQTTClientLib(mqtt_broker, mqtt_port, mqttClientID, wifiClient, nullptr);
   connectToMQTT();
+  telemetry.begin(mqttClientLib, "meta/TemperatureDisplay/" + chipID + "/telemetry");
 
   timeClient.begin();
   timeClient.setTimeOffset(0); // Set your time offset from UTC in seconds
@@ -268,6 +219,7 @@ void setup()
 
 void loop()
 {
+  telemetry.loop();
   otaInProgress = AzureOTAUpdater::CheckUpdateStatus();
 
   if (otaInProgress == 1) {
@@ -283,11 +235,12 @@ void loop()
     display.updateTime(timeClient.getEpochTime());
     display.unlock();
 
-    if(!mqttClientLib->loop())
-    {
-      Serial.println("MQTT Client not connected, reconnecting in loop...");
-      connectToMQTT();
+    // Never blocks: the client reconnects step by step
+    bool mqttConnected = mqttClientLib->loop();
+    if (!mqttConnected && mqttWasConnected) {
+      Serial.println("MQTT Client not connected, reconnecting in the background...");
     }
+    mqttWasConnected = mqttConnected;
 
     display.updateTransferProgress();
 
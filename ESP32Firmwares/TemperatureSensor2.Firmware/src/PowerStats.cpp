@@ -0,0 +1,27 @@
+#include "PowerStats.h"
+
+void PowerStats::clear()
+{
+    activeUs = 0;
+    radioUs = 0;
+    lightSleepUs = 0;
+    deepSleepUs = 0;
+    wakeups = 0;
+}
+
+float PowerStats::averageCurrentMa() const
+{
+    uint64_t total = totalUs();
+    if (total == 0)
+    {
+        return 0.0f;
+    }
+    double chargeMaUs = activeUs * (double)POWER_ACTIVE_MA + radioUs * (double)POWER_RADIO_MA +
+                        lightSleepUs * (double)POWER_LIGHT_SLEEP_MA + deepSleepUs * (double)POWER_DEEP_SLEEP_MA;
+    return (float)(chargeMaUs / total);
+}
+
+uint64_t deepSleepBreakEvenUs(uint32_t wakeCostUs)
+{
+    return (uint64_t)(wakeCostUs * (double)POWER_ACTIVE_MA / (POWER_LIGHT_SLEEP_MA - POWER_DEEP_SLEEP_MA));
+}
@@ -0,0 +1,46 @@
+#ifndef POWERSTATS_H
+#define POWERSTATS_H
+
+// Time spent per power state between two publishes in low-power mode, and the
+// average current estimated from it. There is no current sensor on the
+// boards, so the estimate uses nominal currents per state; override them
+// with build flags after measuring a board.
+
+#include <stdint.h>
+
+#ifndef POWER_ACTIVE_MA
+#define POWER_ACTIVE_MA 25.0f      // CPU running, radio off
+#endif
+#ifndef POWER_RADIO_MA
+#define POWER_RADIO_MA 85.0f       // WiFi connected
+#endif
+#ifndef POWER_LIGHT_SLEEP_MA
+#define POWER_LIGHT_SLEEP_MA 0.25f
+#endif
+#ifndef POWER_DEEP_SLEEP_MA
+#define POWER_DEEP_SLEEP_MA 0.015f
+#endif
+#ifndef POWER_BOOTLOADER_US
+#define POWER_BOOTLOADER_US 150000 // ROM and bootloader after a deep sleep, before esp_timer runs
+#endif
+
+// Sleep length from which a deep sleep, together with the boot that ends it
+// (wakeCostUs at POWER_ACTIVE_MA), needs less charge than a light sleep
+uint64_t deepSleepBreakEvenUs(uint32_t wakeCostUs);
+
+// No constructor, so it can live in RTC memory across deep sleep
+struct PowerStats
+{
+    uint64_t activeUs;
+    uint64_t radioUs;
+    uint64_t lightSleepUs;
+    uint64_t deepSleepUs;
+    uint32_t wakeups;  // Light and deep sleep wakeups
+
+    void clear();
+    uint64_t totalUs() const { return activeUs + radioUs + lightSleepUs + deepSleepUs; }
+    // Time-weighted average of the nominal currents, 0 before anything was recorded
+    float averageCurrentMa() const;
+};
+
+#endif // POWERSTATS_H
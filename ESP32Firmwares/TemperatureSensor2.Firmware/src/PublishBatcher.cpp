@@ -0,0 +1,128 @@
+#include "PublishBatcher.h"
+#include <ArduinoJson.h>
+
+bool PublishBatcher::add(const String &topic, const char *measurement, const String &sensor, const char *payload)
+{
+    size_t length = strlen(payload);
+    if (length > MaxPayload)
+    {
+        Serial.println("Payload for " + topic + " too long, not published");
+        return false;
+    }
+    if (topic.length() > MaxTopic || sensor.length() > MaxSensor)
+    {
+        Serial.println("Topic or sensor name of " + topic + " too long, not published");
+        return false;
+    }
+    entries.emplace_back();
+    Entry &entry = entries.back();
+    memcpy(entry.topic, topic.c_str(), topic.length() + 1);
+    entry.measurement = measurement;
+    memcpy(entry.sensor, sensor.c_str(), sensor.length() + 1);
+    memcpy(entry.payload, payload, length + 1);
+    entry.payloadLength = length;
+    return true;
+}
+
+bool PublishBatcher::flush(MQTTClientLib &client, PublishMode mode, String location,
+                           String documentTopic, bool legacyTopics)
+{
+    unsigned long start = millis();
+    bool success = true;
+    lastMessages = 0;
+
+    switch (mode)
+    {
+    case PublishMode::PerTopicQos2:
+        success = publishTopics(client, 2);
+        break;
+    case PublishMode::PerTopicQos1:
+        client.beginPipeline();
+        success = publishTopics(client, 1);
+        success = client.endPipeline() && success;
+        break;
+    case PublishMode::Document:
+    {
+        String document = buildDocument(location);
+        success = client.publish(documentTopic.c_str(), document.c_str(), document.length(), true, 1);
+        lastMessages++;
+        if (legacyTopics)
+        {
+            publishTopics(client, 0);
+        }
+        break;
+    }
+    }
+
+    lastStallMs = millis() - start;
+    if (lastStallMs > maxStallMs)
+    {
+        maxStallMs = lastStallMs;
+    }
+    entries.clear();
+    return success;
+}
+
+bool PublishBatcher::publishTopics(MQTTClientLib &client, int qos)
+{
+    bool success = true;
+    for (const Entry &entry : entries)
+    {
+        // QoS 0 is fire and forget, its result says nothing about delivery
+        if (!client.publish(entry.topic, entry.payload, entry.payloadLength, true, qos) && qos > 0)
+        {
+            success = false;
+        }
+        lastMessages++;
+    }
+    return success;
+}
+
+// {"location": "...", "sensors": {"<sensor>": {"<measurement>": <value>, ...}, ...}}
+String PublishBatcher::buildDocument(const String &location) const
+{
+    JsonDocument doc;
+    doc["location"] = location;
+    JsonObject sensors = doc["sensors"].to<JsonObject>();
+    for (const Entry &entry : entries)
+    {
+        const char *name = entry.sensor;
+        JsonObject sensor = sensors[name].as<JsonObject>();
+        if (sensor.isNull())
+        {
+            sensor = sensors[name].to<JsonObject>();
+        }
+        // Payloads are numbers or JSON objects already
+        sensor[entry.measurement] = serialized(entry.payload);
+    }
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
+
+const char *PublishBatcher::modeName(PublishMode mode)
+{
+    switch (mode)
+    {
+    case PublishMode::PerTopicQos2:
+        return "qos2";
+    case PublishMode::PerTopicQos1:
+        return "qos1";
+    case PublishMode::Document:
+        return "document";
+    }
+    return "";
+}
+
+bool PublishBatcher::parseMode(const String &name, PublishMode &mode)
+{
+    for (PublishMode candidate : {PublishMode::PerTopicQos2, PublishMode::PerTopicQos1, PublishMode::Document})
+    {
+        if (name == modeName(candidate))
+        {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,81 @@
+#ifndef PUBLISHBATCHER_H
+#define PUBLISHBATCHER_H
+
+// Collects the values of one publish cycle and sends them in one go.
+//
+// With QoS 2 every message costs two round trips to the broker, and
+// MQTTClientLib waits for the handshake of each message before returning,
+// so a node with many sensors blocks its loop for a long time. The batcher
+// sends the same topics with less waiting:
+// - PerTopicQos2: the per-sensor topics as before (for comparison)
+// - PerTopicQos1: the per-sensor topics with QoS 1, pipelined: all publishes
+//                 go out back to back and the PUBACKs are collected at the
+//                 end (MQTTClientLib::beginPipeline(); needs MQTT 5, with
+//                 3.1.1 each publish waits for its own PUBACK)
+// - Document:     one QoS 1 JSON document per node; the per-sensor topics are
+//                 additionally sent with QoS 0 (no handshake) for consumers
+//                 that don't read the document yet
+//
+// TemperatureSensor2 uses PerTopicQos1 unless the config sets "PublishMode":
+// the same topics as before, but QoS 1 instead of 2. Consumers may see a
+// reading twice after a lost PUBACK; the values are retained states, so a
+// duplicate changes nothing.
+
+#include <Arduino.h>
+#include <vector>
+#include "MQTTClientLib.h"
+
+enum class PublishMode
+{
+    PerTopicQos2,
+    PerTopicQos1,
+    Document,
+};
+
+class PublishBatcher
+{
+public:
+    // topic is the prebuilt per-sensor topic, measurement and sensor are the keys in the document;
+    // payload is a number or a JSON object of at most MaxPayload characters. topic, sensor and
+    // payload are copied into the entry (longer ones are dropped): a configuration message
+    // handled while flush waits for an acknowledgement may rebuild the topics.
+    // measurement must be a string literal.
+    bool add(const String &topic, const char *measurement, const String &sensor, const char *payload);
+    bool empty() const { return entries.empty(); }
+
+    // Publishes everything added since the last flush to the per-sensor topics, or as
+    // document to documentTopic. Returns false if a QoS 1/2 publish failed. location and
+    // documentTopic are copied for the same reason as the entries.
+    bool flush(MQTTClientLib &client, PublishMode mode, String location,
+               String documentTopic, bool legacyTopics);
+
+    // Time the last flush blocked the loop, and the longest since start
+    uint32_t lastStallMs = 0;
+    uint32_t maxStallMs = 0;
+    size_t lastMessages = 0;
+
+    static const char *modeName(PublishMode mode);
+    static bool parseMode(const String &name, PublishMode &mode);
+
+    static const size_t MaxPayload = 127;
+    static const size_t MaxTopic = 127;
+    static const size_t MaxSensor = 63;
+
+private:
+    // Fixed-size entries: once the vector has grown to the usual cycle size,
+    // collecting and publishing a cycle needs no heap allocation
+    struct Entry
+    {
+        char topic[MaxTopic + 1];
+        const char *measurement;
+        char sensor[MaxSensor + 1];
+        char payload[MaxPayload + 1];
+        size_t payloadLength;
+    };
+    std::vector<Entry> entries;
+
+    bool publishTopics(MQTTClientLib &client, int qos);
+    String buildDocument(const String &location) const;
+};
+
+#endif // PUBLISHBATCHER_H
@@ -0,0 +1,71 @@
+#include "SensorAggregator.h"
+#include <math.h>
+
+void RunningStats::reset()
+{
+    count = 0;
+    mean = 0.0f;
+    m2 = 0.0f;
+    min = NAN;
+    max = NAN;
+}
+
+void RunningStats::add(float value)
+{
+    count++;
+    float delta = value - mean;
+    mean += delta / count;
+    m2 += delta * (value - mean);
+    if (count == 1 || value < min) min = value;
+    if (count == 1 || value > max) max = value;
+}
+
+float RunningStats::variance() const
+{
+    return count > 1 ? m2 / (count - 1) : 0.0f;
+}
+
+void SensorAggregator::clear()
+{
+    sensorCount = 0;
+    cycles = 0;
+    overflow = 0;
+}
+
+bool SensorAggregator::add(uint64_t sensorId, float temperature, float humidity, float pressure)
+{
+    SensorAggregate *aggregate = nullptr;
+    for (size_t i = 0; i < sensorCount; i++)
+    {
+        if (sensors[i].sensorId == sensorId)
+        {
+            aggregate = &sensors[i];
+            break;
+        }
+    }
+
+    if (!aggregate)
+    {
+        if (sensorCount == MaxSensors)
+        {
+            overflow++;
+            return false;
+        }
+        aggregate = &sensors[sensorCount++];
+        aggregate->sensorId = sensorId;
+        aggregate->temperature.reset();
+        aggregate->humidity.reset();
+        aggregate->pressure.reset();
+    }
+
+    aggregate->temperature.add(temperature);
+    if (!isnan(humidity))
+    {
+        aggregate->humidity.add(humidity);
+    }
+    if (!isnan(pressure))
+    {
+        aggregate->pressure.add(pressure);
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef SENSORAGGREGATOR_H
+#define SENSORAGGREGATOR_H
+
+// Per-sensor aggregation of the readings between two publishes.
+//
+// Every reading is folded into a fixed-capacity table in place (Welford's
+// algorithm for mean and variance), so memory does not depend on the number
+// of readings per publish interval. Kept free of Arduino dependencies and
+// constructors so it can be tested on the host and live in RTC memory.
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Running count, mean, variance, min and max of one measurement
+struct RunningStats
+{
+    uint32_t count;
+    float mean;
+    float m2;  // Sum of squared differences from the mean
+    float min;
+    float max;
+
+    void reset();
+    void add(float value);
+    // Sample variance, 0 for less than two values
+    float variance() const;
+};
+
+struct SensorAggregate
+{
+    uint64_t sensorId;
+    RunningStats temperature;
+    RunningStats humidity;  // Only for sensors that report humidity (count 0 otherwise)
+    RunningStats pressure;  // Only for sensors that report pressure (count 0 otherwise)
+};
+
+struct SensorAggregator
+{
+    static const size_t MaxSensors = 16;
+
+    SensorAggregate sensors[MaxSensors];
+    size_t sensorCount;
+    uint16_t cycles;    // Read cycles with at least one successful reading
+    uint32_t overflow;  // Readings dropped because the table was full
+
+    void clear();
+    // Adds one reading; NAN humidity or pressure are skipped. Returns false if the table is full.
+    bool add(uint64_t sensorId, float temperature, float humidity, float pressure);
+    bool empty() const { return sensorCount == 0; }
+};
+
+#endif // SENSORAGGREGATOR_H
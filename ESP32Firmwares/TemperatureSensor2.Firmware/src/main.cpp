@@ -13,12 +13,20 @@
 #include <math.h>
 #include <Adafruit_NeoPixel.h>
 #include <Wire.h>
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include <sys/time.h>
 
 // Shared libaries
 #include "ESP32Helpers.h"
-#include "AzureOTAUpdater.h"
+#include "StreamingOTAUpdater.h"
 #include "MQTTClientLib.h"
 #include "WifiLib.h"
+#include "WiFiFastConnect.h"
+#include "BootTimeline.h"
+#include "EventLoop.h"
+#include "FreeRTOSEventLoopPlatform.h"
+#include "DeviceTelemetry.h"
 
 // Project specific libraries
 #include "colors.h"
@@ -29,6 +37,11 @@
 #include "Sht45Sensor.h"
 #include "DS18B20Sensor.h"
 #include "Bmp280Sensor.h"
+#include "SensorAggregator.h"
+#include "PowerStats.h"
+#include "PublishBatcher.h"
+#include "SensorFilter.h"
+#include "OneWireScheduler.h"
 
 // Pin configuration
 #define NEOPIXEL_PIN 17    // WS2812 connected to GP17
@@ -49,6 +62,7 @@ String chipID = "";
 // WiFi credentials are read from environment variables and used during compile-time (see platformio.ini)
 // Set WIFI_PASSWORDS as environment variables on your dev-system following the pattern: WIFI_PASSWORDS="ssid1;password1|ssid2;password2"
 WifiLib wifiLib(WIFI_PASSWORDS);
+WiFiFastConnect wifiFast(WIFI_PASSWORDS);
 WiFiClient wifiClient;
 WiFiUDP ntpUDP;
 
@@ -61,22 +75,100 @@ static int otaInProgress = 0;
 static bool otaEnable = OTA_ENABLED != "false";
 static bool sendMQTTMessages = true;
 static bool mqttSuccess = false;
+static bool mqttWasConnected = false;
 static int lastMQTTSentMinute = 0;
+#ifndef LOW_POWER_MODE
+// Mains nodes run their work as tasks of the event loop and sleep in between
+static FreeRTOSEventLoopPlatform eventLoopPlatform;
+static EventLoop eventLoop(eventLoopPlatform);
+static EventLoop::TaskId otaTask = EventLoop::InvalidTask;
+// Still polled: the MQTT client only sees incoming data when loop() reads the
+// socket, there is no receive hook that could signal() the task
+static const uint32_t MQTT_POLL_INTERVAL = 250;
+static const uint32_t OTA_POLL_INTERVAL = 1000;
+static const uint32_t NTP_UPDATE_INTERVAL = 60000; // NTPClient's own update interval
+static DeviceTelemetry telemetry;
+#endif
+static BootTimeline bootTimeline;
+static bool bootTimelinePublished = false;
 
 // Configuration for data collection
+#ifdef LOW_POWER_MODE
+// Battery nodes (env esp32-c6-battery): WiFi is only switched on to publish
+static const int MAX_READINGS = 10;                  // 30 seconds * 10 = 300 seconds (5 minutes)
+static const unsigned long READING_INTERVAL = 30000; // 30 seconds between readings
+#else
 static const int MAX_READINGS = 24;                 // 5 seconds * 24 = 120 seconds (2 minutes)
 static const unsigned long READING_INTERVAL = 5000; // 5 seconds between readings
-static unsigned long lastReadingTime = 0;
+#endif
 
-static std::vector<std::vector<SensorData>> readings;
+// Outlier filters per sensor, values in hundredths: -40..85 °C at 5 K/min and
+// 0..100 % at 10 %/min; a value unchanged for 12 h marks the sensor stuck
+static const SensorFilterConfig temperatureFilterConfig = {-4000, 8500, 500, 12UL * 3600UL * 1000UL, 5};
+static const SensorFilterConfig humidityFilterConfig = {0, 10000, 1000, 12UL * 3600UL * 1000UL, 5};
+struct SensorFilters
+{
+  uint64_t sensorId;
+  SensorFilter temperature;
+  SensorFilter humidity;
+};
+
+#ifdef LOW_POWER_MODE
+// Everything needed between two publishes survives deep sleep in RTC memory
+RTC_DATA_ATTR static SensorAggregator aggregator;
+RTC_DATA_ATTR static PowerStats powerStats;
+RTC_DATA_ATTR static SensorFilters sensorFilters[SensorAggregator::MaxSensors];
+RTC_DATA_ATTR static size_t sensorFilterCount = 0;
+RTC_DATA_ATTR static bool sensorHealthChanged = false;
+RTC_DATA_ATTR static int cachedSensorType = -1;
+RTC_DATA_ATTR static char cachedSensorName[32];
+RTC_DATA_ATTR static char cachedLocation[32];
+RTC_DATA_ATTR static bool cachedHasSensorNames = false; // The names themselves arrive with the config at publish time
+
+RTC_DATA_ATTR static uint32_t deepSleepWakeUs = 0;  // Measured boot after a deep sleep, 0 until the first one
+static const unsigned long CONFIG_WAIT_TIME = 300; // Time for the retained config to arrive before publishing
+static int64_t cycleStartUs = 0;                   // Wakeup of the current reading cycle
+static int64_t accountedUntilUs = 0;               // Time before this is in powerStats
+#else
+static SensorAggregator aggregator;
+static SensorFilters sensorFilters[SensorAggregator::MaxSensors];
+static size_t sensorFilterCount = 0;
+static bool sensorHealthChanged = false;
+#endif
 static String baseTopic = "daten";
 static String sensorName = "";
-static std::unordered_map<std::string, String> sensorNames;
+// Configured ROM id (parsed from "28-FF-...", family code in the top byte) -> display name
+static std::unordered_map<uint64_t, String> sensorNames;
+// Display name and topics per sensor id, so reading and publishing don't format ids
+// or topics; rebuilt in place when the configuration changes, built once for a
+// sensor first seen afterwards
+struct SensorTopics
+{
+  String displayName;   // Configured name, or the formatted id
+  String publishName;   // SensorName if set, else displayName
+  String temperature;
+  String humidity;
+  String pressure;
+  String statistics;
+};
+static std::unordered_map<uint64_t, SensorTopics> sensorTopicCache;
+static String documentTopic;
+static String publishStatsTopic;
+static String healthTopic;
 static String location = "unknown";
 const String mqtt_broker = "mosquitto.intern";
 const int mqtt_port = 1883;
 static String mqtt_OTAtopic = "OTAUpdate/TemperaturSensor2";
+// Staged rollouts by OTATools/otacoordinator.py: trigger for this node only,
+// and the status the coordinator gates the next stage on
+static String mqtt_OTADeviceTopic = "OTAUpdate/TemperaturSensor2/{ID}";
+static String mqtt_OTAStatusTopic = "OTAStatus/TemperaturSensor2/{ID}";
+static const unsigned long OTA_STATUS_INTERVAL = 300000; // 5 minutes
+static int publishedOTAState = 0;
 static String mqtt_ConfigTopic = "config/TemperaturSensor2/{ID}";
+static PublishBatcher publishBatcher;
+static PublishMode publishMode = PublishMode::PerTopicQos1; // Was QoS 2 before the batcher, "qos2" in the config restores it
+static bool legacyTopics = true; // Per-sensor topics next to the document in document mode
 static int brightness = 255;
 static int blinkCount = 0;
 static const int MAX_BLINK_COUNT = 3;
@@ -120,6 +212,58 @@ String extractVersionFromUrl(String url)
   return "";
 }
 
+void buildSensorTopics(uint64_t sensorId, SensorTopics &topics)
+{
+  String idKey = sensor->formatSensorId(sensorId);
+  idKey.toUpperCase();
+  uint64_t romId;
+  auto it = OneWireScheduler::parseId(idKey.c_str(), romId) ? sensorNames.find(romId) : sensorNames.end();
+  topics.displayName = it != sensorNames.end() ? it->second : idKey;
+  topics.publishName = sensorName != "" ? sensorName : topics.displayName;
+  String suffix = "/" + location + "/" + topics.publishName;
+  topics.temperature = baseTopic + "/temperatur" + suffix;
+  topics.humidity = baseTopic + "/luftfeuchtigkeit" + suffix;
+  topics.pressure = baseTopic + "/luftdruck" + suffix;
+  // Separate topic, the DataHub reads everything below daten/temperatur/ as temperature
+  topics.statistics = baseTopic + "/temperaturstatistik" + suffix;
+}
+
+const SensorTopics &getSensorTopics(uint64_t sensorId)
+{
+  auto cached = sensorTopicCache.find(sensorId);
+  if (cached != sensorTopicCache.end())
+  {
+    return cached->second;
+  }
+  SensorTopics &topics = sensorTopicCache[sensorId];
+  buildSensorTopics(sensorId, topics);
+  return topics;
+}
+
+// After a configuration change: new names and topics for all sensors seen so far,
+// including those of the running cycle. Entries are updated in place, so references
+// into the cache stay valid.
+void rebuildSensorTopics()
+{
+  if (!sensor)
+  {
+    return;
+  }
+  for (auto &entry : sensorTopicCache)
+  {
+    buildSensorTopics(entry.first, entry.second);
+  }
+  for (size_t i = 0; i < aggregator.sensorCount; i++)
+  {
+    getSensorTopics(aggregator.sensors[i].sensorId);
+  }
+}
+
+const String &getSensorDisplayName(uint64_t sensorId)
+{
+  return getSensorTopics(sensorId).displayName;
+}
+
 void parseConfigJSON(String jsonPayload)
 {
   JsonDocument doc;
@@ -133,16 +277,24 @@ void parseConfigJSON(String jsonPayload)
     return;
   }
 
+  documentTopic = "";
+
   if (!doc["SensorName"].isNull())
   {
     sensorName = doc["SensorName"].as<String>();
     Serial.println("Sensor name set to: " + sensorName);
+#ifdef LOW_POWER_MODE
+    strlcpy(cachedSensorName, sensorName.c_str(), sizeof(cachedSensorName));
+#endif
   }
 
   if (!doc["Location"].isNull())
   {
     location = doc["Location"].as<String>();
     Serial.println("Location set to: " + location);
+#ifdef LOW_POWER_MODE
+    strlcpy(cachedLocation, location.c_str(), sizeof(cachedLocation));
+#endif
   }
 
   if (!doc["SensorNames"].isNull())
@@ -156,20 +308,26 @@ void parseConfigJSON(String jsonPayload)
       {
         for (JsonPair kv : nameEntry)
         {
-          String idKey = String(kv.key().c_str());
           String displayName = kv.value().as<String>();
-          idKey.trim();
           displayName.trim();
-          idKey.toUpperCase();
-          if (idKey.length() == 0 || displayName.length() == 0)
+          uint64_t id;
+          if (!OneWireScheduler::parseId(kv.key().c_str(), id))
+          {
+            Serial.println("Invalid sensor id '" + String(kv.key().c_str()) + "'");
+            continue;
+          }
+          if (displayName.length() == 0)
           {
             continue;
           }
-          sensorNames[std::string(idKey.c_str())] = displayName;
-          Serial.println("Sensor name override added: " + idKey + " -> " + displayName);
+          sensorNames[id] = displayName;
+          Serial.println("Sensor name override added: " + OneWireScheduler::formatId(id) + " -> " + displayName);
         }
       }
       Serial.println("Sensor names loaded: " + String(static_cast<unsigned long>(sensorNames.size())));
+#ifdef LOW_POWER_MODE
+      cachedHasSensorNames = !sensorNames.empty();
+#endif
     }
     else
     {
@@ -177,6 +335,25 @@ void parseConfigJSON(String jsonPayload)
     }
   }
 
+  if (!doc["PublishMode"].isNull())
+  {
+    String mode = doc["PublishMode"].as<String>();
+    if (PublishBatcher::parseMode(mode, publishMode))
+    {
+      Serial.println("Publish mode set to: " + mode);
+    }
+    else
+    {
+      Serial.println("Invalid publish mode: " + mode);
+    }
+  }
+
+  if (!doc["LegacyTopics"].isNull())
+  {
+    legacyTopics = doc["LegacyTopics"].as<bool>();
+    Serial.println("Legacy topics " + String(legacyTopics ? "enabled" : "disabled"));
+  }
+
   if (!doc["Brightness"].isNull())
   {
     int newBrightness = doc["Brightness"];
@@ -192,6 +369,8 @@ void parseConfigJSON(String jsonPayload)
       Serial.println("Invalid brightness value: " + String(newBrightness));
     }
   }
+
+  rebuildSensorTopics();
 }
 
 void mqttCallback(String &topic, String &payload)
@@ -204,11 +383,16 @@ void mqttCallback(String &topic, String &payload)
     return;
   }
 
-  if (topic == mqtt_OTAtopic)
+  if (topic == mqtt_OTAtopic || topic == mqtt_OTADeviceTopic)
   {
-    if (otaInProgress || !otaEnable)
+    if (payload == "")
     {
-      if (otaInProgress)
+      return; // Retained trigger cleared by the coordinator
+    }
+    // After a failed update (-1) a new trigger retries it
+    if (otaInProgress == 1 || !otaEnable)
+    {
+      if (otaInProgress == 1)
         Serial.println("OTA in progress, ignoring message");
       if (!otaEnable)
         Serial.println("OTA disabled, ignoring message");
@@ -228,11 +412,15 @@ void mqttCallback(String &topic, String &payload)
       const char *firmwareUrl = firmwareUrlStr.c_str();
       Serial.println("New firmware available, starting OTA Update from " + String(firmwareUrl));
       otaInProgress = true;
-      bool result = AzureOTAUpdater::UpdateFirmwareFromUrl(firmwareUrl);
+      // Fetches a delta against this version when CI built one
+      bool result = StreamingOTAUpdater::UpdateFirmwareFromUrl(firmwareUrl, version);
       if (result)
       {
         Serial.println("OTA Update successful initiated, waiting to be finished");
       }
+#ifndef LOW_POWER_MODE
+      eventLoop.signal(otaTask); // Reports the new state right away
+#endif
     }
     else
     {
@@ -245,22 +433,83 @@ void mqttCallback(String &topic, String &payload)
   }
 }
 
+void createMQTTClient()
+{
+  String mqttClientID = "ESP32TemperatureSensor2Client_" + chipID;
+  mqttClientLib = new MQTTClientLib(mqtt_broker, mqtt_port, mqttClientID, wifiClient, mqttCallback);
+  // MQTT 5: topic aliases shorten the repeated publishes, and readings expire
+  // after three publish periods, so the broker does not hand the last value
+  // of a silent node to the display as if it were current
+  mqttClientLib->setProtocol(MQTTProtocol::V5);
+  mqttClientLib->setMessageExpiry(baseTopic + "/#", MAX_READINGS * READING_INTERVAL * 3 / 1000);
+  mqttClientLib->setTimestampSource([]() -> uint32_t
+                                    { return timeClient.isTimeSet() ? timeClient.getEpochTime() : 0; });
+}
+
 void connectToMQTT(bool cleanSession)
 {
   Serial.print("WiFi Status: ");
   Serial.println(WiFi.status() == WL_CONNECTED ? "Connected" : "Disconnected");
 
-  if (WiFi.status() != WL_CONNECTED)
+  // The client replays its subscriptions after every reconnect by itself
+  mqttClientLib->subscribe({mqtt_ConfigTopic, mqtt_OTAtopic, mqtt_OTADeviceTopic});
+  Serial.println(mqttClientLib->connect(cleanSession) ? "### MQTT Client is connected and subscribed to topics"
+                                                      : "### MQTT Client not connected yet, retrying in the background");
+  Serial.println("Config Topic: " + mqtt_ConfigTopic);
+  Serial.println("OTA Topic: " + mqtt_OTAtopic + ", " + mqtt_OTADeviceTopic);
+}
+
+// {"version": "0.0.123", "board": "esp32-c6", "state": "idle", "uptime": 3600}
+void publishOTAStatus()
+{
+  JsonDocument status;
+  status["version"] = version;
+  status["board"] = BOARDCONFIG;
+  status["state"] = otaInProgress == 1 ? "updating" : otaInProgress < 0 ? "failed" : "idle";
+#ifndef LOW_POWER_MODE
+  // Battery nodes restart their clock with every deep sleep; without uptime
+  // the coordinator does not count restarts
+  status["uptime"] = millis() / 1000;
+#endif
+  char json[128];
+  size_t length = serializeJson(status, json, sizeof(json));
+  mqttClientLib->publish(mqtt_OTAStatusTopic.c_str(), json, length, true, 1);
+  publishedOTAState = otaInProgress;
+}
+
+// Polls the update task and reports its state changes
+void checkOTAUpdate()
+{
+  otaInProgress = StreamingOTAUpdater::CheckUpdateStatus();
+
+  if (otaInProgress < 0)
   {
-    Serial.println("WiFi not connected, attempting to reconnect...");
-    wifiLib.connect();
+    blinkLed(RED, true);
   }
+  if (otaInProgress != publishedOTAState)
+  {
+    publishOTAStatus();
+  }
+}
 
-  mqttClientLib->connect(cleanSession);
-  mqttClientLib->subscribe({mqtt_ConfigTopic, mqtt_OTAtopic});
-  Serial.println("### MQTT Client is connected and subscribed to topics");
-  Serial.println("Config Topic: " + mqtt_ConfigTopic);
-  Serial.println("OTA Topic: " + mqtt_OTAtopic);
+// Once per boot, how long the node took to each startup stage:
+// {"reset": "brownout", "wifi": "cached", "stagesMs": {"setup": 48, "wifi": 391, ...}, "publishedMs": 5012}
+void publishBootTimeline()
+{
+  JsonDocument doc;
+  doc["reset"] = BootTimeline::resetReason();
+  doc["wifi"] = wifiFast.result();
+  JsonObject stages = doc["stagesMs"].to<JsonObject>();
+  for (size_t i = 0; i < bootTimeline.size(); i++)
+  {
+    stages[bootTimeline.stage(i)] = bootTimeline.atMs(i);
+  }
+  doc["publishedMs"] = (uint32_t)(esp_timer_get_time() / 1000);
+  char json[256];
+  size_t length = serializeJson(doc, json, sizeof(json));
+  Serial.println("Boot: " + String(json));
+  mqttClientLib->publish(("meta/TemperaturSensor2/" + location + "/" + sensorName + "/boot").c_str(), json, length, true, 1);
+  bootTimelinePublished = true;
 }
 
 bool tryInitializeSensor(SensorType type)
@@ -308,13 +557,25 @@ bool tryInitializeSensor(SensorType type)
 
   sensorType = type;
   sensor = std::move(candidate);
-  readings.clear();
+#ifdef LOW_POWER_MODE
+  // Keep what was aggregated before deep sleep, it's the same sensor
+  cachedSensorType = static_cast<int>(type);
+#else
+  aggregator.clear();
+#endif
   Serial.println("Using sensor type " + String(toString(sensorType)));
   return true;
 }
 
 bool initializeSensor()
 {
+#ifdef LOW_POWER_MODE
+  // Skip probing after deep sleep
+  if (cachedSensorType >= 0 && tryInitializeSensor(static_cast<SensorType>(cachedSensorType)))
+  {
+    return true;
+  }
+#endif
   for (SensorType type : candidates)
   {
     if (tryInitializeSensor(type))
@@ -327,21 +588,117 @@ bool initializeSensor()
   return false;
 }
 
-String getSensorDisplayName(uint64_t sensorId)
+// Time base of the outlier filters; millis() restarts after deep sleep, the RTC clock does not
+uint32_t filterTimeMs()
 {
-  String idKey = sensor->formatSensorId(sensorId);
-  idKey.toUpperCase();
-  std::string lookupKey(idKey.c_str());
-  auto it = sensorNames.find(lookupKey);
-  if (it != sensorNames.end()) {
-    return it->second;
+#ifdef LOW_POWER_MODE
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  return (uint32_t)(now.tv_sec * 1000ULL + now.tv_usec / 1000);
+#else
+  return millis();
+#endif
+}
+
+SensorFilters *findSensorFilters(uint64_t sensorId)
+{
+  for (size_t i = 0; i < sensorFilterCount; i++)
+  {
+    if (sensorFilters[i].sensorId == sensorId)
+    {
+      return &sensorFilters[i];
+    }
+  }
+  return nullptr;
+}
+
+// Returns the filters of a sensor, creating them on first use; nullptr if the table is full
+SensorFilters *getSensorFilters(uint64_t sensorId)
+{
+  SensorFilters *existing = findSensorFilters(sensorId);
+  if (existing)
+  {
+    return existing;
+  }
+  if (sensorFilterCount == SensorAggregator::MaxSensors)
+  {
+    return nullptr;
+  }
+  SensorFilters &filters = sensorFilters[sensorFilterCount++];
+  filters.sensorId = sensorId;
+  filters.temperature.reset();
+  filters.humidity.reset();
+  return &filters;
+}
+
+// Passes a reading through the sensor's filters. Returns false if the temperature was rejected;
+// a rejected humidity is set to NAN so only the temperature is used.
+bool filterReading(const SensorData &reading, float &temperature, float &humidity)
+{
+  SensorFilters *filters = getSensorFilters(reading.sensorId);
+  if (!filters)
+  {
+    return false;
+  }
+  uint32_t now = filterTimeMs();
+  SensorHealth previousHealth = filters->temperature.health();
+  bool accepted = false;
+  if (reading.success)
+  {
+    accepted = filters->temperature.add(SensorFilter::toFixed(reading.temperature), now, temperatureFilterConfig);
+  }
+  else
+  {
+    filters->temperature.addError(temperatureFilterConfig);
+  }
+  if (filters->temperature.health() != previousHealth)
+  {
+    Serial.printf("Sensor %s: %s -> %s\n", getSensorDisplayName(reading.sensorId).c_str(),
+                  SensorFilter::healthName(previousHealth), SensorFilter::healthName(filters->temperature.health()));
+    sensorHealthChanged = true;
+  }
+  temperature = SensorFilter::fromFixed(filters->temperature.value());
+
+  humidity = NAN;
+  if (reading.success && !isnan(reading.humidity) &&
+      filters->humidity.add(SensorFilter::toFixed(reading.humidity), now, humidityFilterConfig))
+  {
+    humidity = SensorFilter::fromFixed(filters->humidity.value());
+  }
+  return accepted;
+}
+
+// {"<sensor>": {"temperature": "ok", "humidity": "spike", "rejected": 3, "errors": 0}, ...}
+void publishSensorHealth()
+{
+  JsonDocument health;
+  for (size_t i = 0; i < sensorFilterCount; i++)
+  {
+    const SensorFilters &filters = sensorFilters[i];
+    JsonObject entry = health[getSensorDisplayName(filters.sensorId)].to<JsonObject>();
+    entry["temperature"] = SensorFilter::healthName(filters.temperature.health());
+    if (filters.humidity.windowCount > 0)
+    {
+      entry["humidity"] = SensorFilter::healthName(filters.humidity.health());
+    }
+    entry["rejected"] = filters.temperature.rejected + filters.humidity.rejected;
+    entry["errors"] = filters.temperature.errors;
+  }
+  String healthJson;
+  serializeJson(health, healthJson);
+  if (mqttClientLib->publish(healthTopic, healthJson, true, 1))
+  {
+    sensorHealthChanged = false;
   }
-  return idKey;
 }
 
 void readSensorData()
 {
-  if (sensorName == "" && sensorNames.empty())
+  bool hasSensorNames = !sensorNames.empty();
+#ifdef LOW_POWER_MODE
+  hasSensorNames = hasSensorNames || cachedHasSensorNames;
+#endif
+  if (sensorName == "" && !hasSensorNames)
   {
     Serial.println("Sensor name not set, skipping sensor reading");
     blinkLed(RED, true);
@@ -355,7 +712,7 @@ void readSensorData()
     return;
   }
 
-  if (readings.size() >= MAX_READINGS)
+  if (aggregator.cycles >= MAX_READINGS)
   {
     Serial.println("Maximum readings reached, skipping sensor reading");
     blinkLed(RED, true);
@@ -370,7 +727,7 @@ void readSensorData()
     return;
   }
 
-  std::vector<SensorData> successfulReadings;
+  bool anySuccess = false;
   for (size_t i = 0; i < sensorReadings.size(); ++i)
   {
     const auto &reading = sensorReadings[i];
@@ -411,7 +768,17 @@ void readSensorData()
                       getSensorDisplayName(reading.sensorId).c_str(),
                       reading.temperature);
       }
-      successfulReadings.push_back(reading);
+      float temperature, humidity;
+      if (!filterReading(reading, temperature, humidity))
+      {
+        Serial.println("Reading of " + getSensorDisplayName(reading.sensorId) + " held back by the outlier filter");
+        continue;
+      }
+      if (!aggregator.add(reading.sensorId, temperature, humidity, reading.pressure))
+      {
+        Serial.println("Too many sensors, reading of " + getSensorDisplayName(reading.sensorId) + " dropped");
+      }
+      anySuccess = true;
     }
     else
     {
@@ -419,15 +786,20 @@ void readSensorData()
       Serial.printf("Sensor reading[%u] (id: %s): failed\n",
                     static_cast<unsigned>(i),
                     formattedId.c_str());
+      float temperature, humidity;
+      if (findSensorFilters(reading.sensorId))
+      {
+        filterReading(reading, temperature, humidity);
+      }
     }
   }
 
-  if (!successfulReadings.empty())
+  if (anySuccess)
   {
-    readings.push_back(successfulReadings);
+    aggregator.cycles++;
+    bootTimeline.mark("firstReading");
   }
 
-  lastReadingTime = millis();
   if (blinkCount < MAX_BLINK_COUNT)
   {
     blinkCount++;
@@ -441,8 +813,7 @@ void readSensorData()
 
 void publishSensorData()
 {
-  String sensorDisplayName = "";
-  if (readings.empty())
+  if (aggregator.cycles == 0)
   {
     Serial.println("No sensor data to publish");
     return;
@@ -454,62 +825,31 @@ void publishSensorData()
     return;
   }
 
-  struct Aggregate
-  {
-    float temperatureSum = 0.0f;
-    float humiditySum = 0.0f;
-    float pressureSum = 0.0f;
-    size_t temperatureCount = 0;
-    size_t humidityCount = 0;
-    size_t pressureCount = 0;
-  };
-  std::unordered_map<uint64_t, Aggregate> aggregates;
-
-  for (const auto &batch : readings)
-  {
-    for (const auto &reading : batch)
-    {
-      Aggregate &agg = aggregates[reading.sensorId];
-      agg.temperatureSum += reading.temperature;
-      agg.temperatureCount++;
-      if (!isnan(reading.humidity))
-      {
-        agg.humiditySum += reading.humidity;
-        agg.humidityCount++;
-      }
-      if (!isnan(reading.pressure))
-      {
-        agg.pressureSum += reading.pressure;
-        agg.pressureCount++;
-      }
-    }
-  }
-
-  if (aggregates.empty())
+  if (aggregator.empty())
   {
     Serial.println("No successful sensor data to publish");
-    readings.clear();
+    aggregator.clear();
     return;
   }
 
-  if (!(sensorNames.size() == aggregates.size() || (aggregates.size() == 1 && sensorName != "")))
+  if (!(sensorNames.size() == aggregator.sensorCount || (aggregator.sensorCount == 1 && sensorName != "")))
   {
     Serial.println("Warning: Not all sensors have a configured name.");
     Serial.println("Sensor names configured: " + String(static_cast<unsigned long>(sensorNames.size())));
-    Serial.println("Sensors detected: " + String(static_cast<unsigned long>(aggregates.size())));
+    Serial.println("Sensors detected: " + String(static_cast<unsigned long>(aggregator.sensorCount)));
     Serial.println("SensorName : '" + sensorName + "'");
   }
 
-  for (const auto &entry : aggregates)
+  for (size_t i = 0; i < aggregator.sensorCount; i++)
   {
-    const uint64_t id = entry.first;
-    const Aggregate &agg = entry.second;
-    float avgTemperature = agg.temperatureSum / static_cast<float>(agg.temperatureCount);
-    float avgHumidity = agg.humidityCount > 0 ? (agg.humiditySum / static_cast<float>(agg.humidityCount)) : NAN;
-    float avgPressure = agg.pressureCount > 0 ? (agg.pressureSum / static_cast<float>(agg.pressureCount)) : NAN;
-
-    const bool hasHumidity = agg.humidityCount > 0;
-    const bool hasPressure = agg.pressureCount > 0;
+    const SensorAggregate &agg = aggregator.sensors[i];
+    const uint64_t id = agg.sensorId;
+    float avgTemperature = agg.temperature.mean;
+    float avgHumidity = agg.humidity.count > 0 ? agg.humidity.mean : NAN;
+    float avgPressure = agg.pressure.count > 0 ? agg.pressure.mean : NAN;
+
+    const bool hasHumidity = agg.humidity.count > 0;
+    const bool hasPressure = agg.pressure.count > 0;
     if (hasHumidity && hasPressure)
     {
       Serial.printf("Average sensor (id: %s): %.2f°C, %.2f%%, %.2f hPa\n",
@@ -538,6 +878,12 @@ void publishSensorData()
                     getSensorDisplayName(id).c_str(),
                     avgTemperature);
     }
+    Serial.printf("Temperature spread (id: %s): variance %.4f, min %.2f°C, max %.2f°C, %u readings\n",
+                  getSensorDisplayName(id).c_str(),
+                  agg.temperature.variance(),
+                  agg.temperature.min,
+                  agg.temperature.max,
+                  static_cast<unsigned>(agg.temperature.count));
 
     if (sendMQTTMessages)
     {
@@ -549,28 +895,26 @@ void publishSensorData()
       dtostrf(avgHumidity, 1, 2, humString);
       dtostrf(avgPressure, 1, 2, pressureString);
 
-      if (sensorName != "")
-      {
-        sensorDisplayName = sensorName;
-      }
-      else
-      {
-        sensorDisplayName = getSensorDisplayName(id);
-      }
-      String temperatureTopic = baseTopic + "/temperatur/" + location + "/" + sensorDisplayName;
-      String humidityTopic = baseTopic + "/luftfeuchtigkeit/" + location + "/" + sensorDisplayName;
-      String pressureTopic = baseTopic + "/luftdruck/" + location + "/" + sensorDisplayName;
-
-      mqttSuccess = mqttClientLib->publish(temperatureTopic.c_str(), String(tempString), true, 2);
-      mqttSuccess ? blinkLed(GREEN) : blinkLed(RED, true);
+      const SensorTopics &topics = getSensorTopics(id);
+      publishBatcher.add(topics.temperature, "temperatur", topics.publishName, tempString);
       if (!isnan(avgHumidity))
       {
-        mqttClientLib->publish(humidityTopic.c_str(), String(humString), true, 2);
+        publishBatcher.add(topics.humidity, "luftfeuchtigkeit", topics.publishName, humString);
       }
       if (!isnan(avgPressure))
       {
-        mqttClientLib->publish(pressureTopic.c_str(), String(pressureString), true, 2);
+        publishBatcher.add(topics.pressure, "luftdruck", topics.publishName, pressureString);
       }
+
+      JsonDocument statistics;
+      statistics["mean"] = serialized(String(tempString));
+      statistics["variance"] = serialized(String(agg.temperature.variance(), 4));
+      statistics["min"] = serialized(String(agg.temperature.min, 2));
+      statistics["max"] = serialized(String(agg.temperature.max, 2));
+      statistics["count"] = agg.temperature.count;
+      char statisticsJson[PublishBatcher::MaxPayload + 1];
+      serializeJson(statistics, statisticsJson, sizeof(statisticsJson));
+      publishBatcher.add(topics.statistics, "temperaturstatistik", topics.publishName, statisticsJson);
     }
     else
     {
@@ -578,13 +922,227 @@ void publishSensorData()
     }
   }
 
+  if (!publishBatcher.empty())
+  {
+    if (documentTopic == "")
+    {
+      String nodeName = sensorName != "" ? sensorName : chipID;
+      documentTopic = baseTopic + "/sensorknoten/" + location + "/" + nodeName;
+      publishStatsTopic = "meta/TemperaturSensor2/" + location + "/" + nodeName + "/publish";
+      healthTopic = "meta/TemperaturSensor2/" + location + "/" + nodeName + "/health";
+    }
+    mqttSuccess = publishBatcher.flush(*mqttClientLib, publishMode, location, documentTopic, legacyTopics);
+    mqttSuccess ? blinkLed(GREEN) : blinkLed(RED, true);
+    Serial.printf("Published %u messages (%s) in %lu ms, longest %lu ms\n",
+                  static_cast<unsigned>(publishBatcher.lastMessages), PublishBatcher::modeName(publishMode),
+                  static_cast<unsigned long>(publishBatcher.lastStallMs), static_cast<unsigned long>(publishBatcher.maxStallMs));
+
+    JsonDocument stall;
+    stall["mode"] = PublishBatcher::modeName(publishMode);
+    stall["messages"] = publishBatcher.lastMessages;
+    stall["stallMs"] = publishBatcher.lastStallMs;
+    stall["maxStallMs"] = publishBatcher.maxStallMs;
+    char stallJson[128];
+    size_t stallLength = serializeJson(stall, stallJson, sizeof(stallJson));
+    mqttClientLib->publish(publishStatsTopic.c_str(), stallJson, stallLength, false, 0);
+
+    if (sensorHealthChanged)
+    {
+      publishSensorHealth();
+    }
+  }
+
   Serial.println("Version: " + String(version));
 
-  readings.clear();
+  aggregator.clear();
+}
+
+#ifdef LOW_POWER_MODE
+// Adds the time since the last call to one of the powerStats buckets
+void accountTime(uint64_t &bucket)
+{
+  int64_t now = esp_timer_get_time();
+  bucket += now - accountedUntilUs;
+  accountedUntilUs = now;
+}
+
+void wifiOff()
+{
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+}
+
+// Gives the retained config message time to arrive after subscribing
+void waitForConfig()
+{
+  unsigned long start = millis();
+  while (millis() - start < CONFIG_WAIT_TIME)
+  {
+    mqttClientLib->loop();
+    delay(10);
+  }
+}
+
+void publishPowerStats()
+{
+  accountTime(powerStats.radioUs);
+
+  JsonDocument doc;
+  doc["wakeToPublishMs"] = (esp_timer_get_time() - cycleStartUs) / 1000;
+  doc["averageCurrentMa"] = serialized(String(powerStats.averageCurrentMa(), 3));
+  doc["activeMs"] = powerStats.activeUs / 1000;
+  doc["radioMs"] = powerStats.radioUs / 1000;
+  doc["lightSleepMs"] = powerStats.lightSleepUs / 1000;
+  doc["deepSleepMs"] = powerStats.deepSleepUs / 1000;
+  doc["deepSleepWakeMs"] = deepSleepWakeUs / 1000;
+  doc["wakeups"] = powerStats.wakeups;
+  String json;
+  serializeJson(doc, json);
+  Serial.println("Power: " + json);
+  mqttClientLib->publish(("meta/TemperaturSensor2/" + location + "/" + sensorName + "/power").c_str(), json, true, 2);
+
+  powerStats.clear();
+}
+
+// Switches WiFi on, publishes the aggregates and the power metrics in one go and switches it off again
+void publishBurst()
+{
+  accountTime(powerStats.activeUs);
+  if (wifiFast.connectOrScan(wifiLib))
+  {
+    connectToMQTT(false);
+    waitForConfig();
+    publishSensorData();
+    publishPowerStats();
+    publishOTAStatus();
+  }
+  else
+  {
+    Serial.println("WiFi not connected, keeping readings for the next attempt");
+  }
+
+  if (otaInProgress != 1)
+  {
+    wifiOff();
+  }
+  accountTime(powerStats.radioUs);
+}
+
+void sleepUntilNextReading()
+{
+  int64_t sleepUs = READING_INTERVAL * 1000LL - (esp_timer_get_time() - cycleStartUs);
+  if (sleepUs < 100000)
+  {
+    sleepUs = 100000;
+  }
+  accountTime(powerStats.activeUs);
+  esp_sleep_enable_timer_wakeup(sleepUs);
+
+  // Deep sleep only pays off when the sleep current it saves outweighs the boot
+  // that ends it; the first pause after power-on deep sleeps to measure that boot
+  if (deepSleepWakeUs == 0 || sleepUs >= (int64_t)deepSleepBreakEvenUs(deepSleepWakeUs))
+  {
+    // Continues in setup(), aggregates are kept in RTC memory
+    powerStats.deepSleepUs += sleepUs;
+    Serial.printf("Deep sleep for %lld ms\n", sleepUs / 1000);
+    Serial.flush();
+    esp_deep_sleep_start();
+  }
+
+  Serial.flush();
+  esp_light_sleep_start();
+  accountTime(powerStats.lightSleepUs);
+  powerStats.wakeups++;
+  cycleStartUs = esp_timer_get_time();
+}
+
+void lowPowerCycle()
+{
+  readSensorData();
+  if (aggregator.cycles >= MAX_READINGS)
+  {
+    publishBurst();
+  }
+  if (otaInProgress == 1)
+  {
+    return; // Stay awake until the update has finished
+  }
+  sleepUntilNextReading();
+}
+#endif
+
+#ifndef LOW_POWER_MODE
+// Never blocks: sampling goes on while WiFi or the broker are away,
+// the client reconnects step by step
+void pollMQTT()
+{
+  bool mqttConnected = mqttClientLib->loop();
+  if (!mqttConnected && mqttWasConnected)
+  {
+    // Log detailed information about the disconnection
+    int lastErr = mqttClientLib->lastError();
+    Serial.print("MQTT loop() returned false! Last Error Code: ");
+    Serial.println(lastErr);
+    Serial.print("WiFi Status: ");
+    Serial.println(WiFi.status() == WL_CONNECTED ? "Connected" : "Disconnected");
+    Serial.print("WiFi RSSI: ");
+    Serial.println(WiFi.RSSI());
+    Serial.print("Free Heap: ");
+    Serial.println(ESP.getFreeHeap());
+    Serial.print("Uptime: ");
+    Serial.println(millis() / 1000);
+  }
+  mqttWasConnected = mqttConnected;
+  if (mqttConnected && !bootTimelinePublished)
+  {
+    bootTimeline.mark("mqtt");
+    if (bootTimeline.has("firstReading"))
+    {
+      publishBootTimeline();
+    }
+  }
 }
 
+void startTasks()
+{
+  // The update downloads in its own task: sampling and publishing go on
+  otaTask = eventLoop.every("ota", OTA_POLL_INTERVAL, checkOTAUpdate);
+  eventLoop.every("reading", READING_INTERVAL, []()
+                  {
+                    readSensorData();
+                    if (aggregator.cycles >= MAX_READINGS)
+                    {
+                      publishSensorData();
+                    } }, true);
+  eventLoop.every("mqtt", MQTT_POLL_INTERVAL, pollMQTT, true);
+  eventLoop.every("otaStatus", OTA_STATUS_INTERVAL, publishOTAStatus);
+  eventLoop.every("ntp", NTP_UPDATE_INTERVAL, []()
+                  { timeClient.update(); });
+
+  telemetry.begin(mqttClientLib, "meta/TemperaturSensor2/" + chipID + "/telemetry");
+  telemetry.addSection("eventLoop", [](JsonObject section)
+                       {
+                         // Shares of the interval since the last report
+                         float periodUs = eventLoop.statsPeriodUs();
+                         section["idle"] = serialized(String(100.0f * eventLoop.idleUs() / periodUs, 1));
+                         JsonObject tasks = section["tasks"].to<JsonObject>();
+                         for (EventLoop::TaskId id = 0; id < eventLoop.taskCount(); id++)
+                         {
+                           const EventLoopTaskStats &stats = eventLoop.stats(id);
+                           JsonObject task = tasks[stats.name].to<JsonObject>();
+                           task["runs"] = stats.runs;
+                           task["eventRuns"] = stats.eventRuns;
+                           task["busy"] = serialized(String(100.0f * stats.busyUs / periodUs, 1));
+                           task["maxRunMs"] = stats.maxRunUs / 1000.0f;
+                           task["maxLateMs"] = stats.maxLateMs;
+                         }
+                         eventLoop.resetStats(); });
+}
+#endif
+
 void setup()
 {
+  bootTimeline.mark("setup");
   // WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 0); //disable brownout detector
   Serial.begin(115200);
   Serial.print("TemperatureSensor2 version ");
@@ -600,71 +1158,91 @@ void setup()
   Serial.print("ESP32 Chip ID: ");
   Serial.println(chipID);
   mqtt_ConfigTopic.replace("{ID}", chipID);
+  mqtt_OTADeviceTopic.replace("{ID}", chipID);
+  mqtt_OTAStatusTopic.replace("{ID}", chipID);
 
-  // Connect to WiFi
+#ifdef LOW_POWER_MODE
+  cycleStartUs = accountedUntilUs = esp_timer_get_time();
+  if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER)
+  {
+    // Woken from deep sleep: WiFi stays off until the next publish
+    powerStats.wakeups++;
+    sensorName = cachedSensorName;
+    location = cachedLocation;
+    initializeSensor();
+    createMQTTClient();
+
+    // Everything up to here is what a light sleep saves, averaged over wakeups
+    uint32_t wakeUs = esp_timer_get_time() + POWER_BOOTLOADER_US;
+    deepSleepWakeUs = deepSleepWakeUs == 0 ? wakeUs : (3 * deepSleepWakeUs + wakeUs) / 4;
+    return;
+  }
+  // Power-on or reset: RTC memory holds whatever was there before
+  powerStats.clear();
+  deepSleepWakeUs = 0;
+  cachedSensorType = -1;
+  cachedSensorName[0] = '\0';
+  cachedLocation[0] = '\0';
+  cachedHasSensorNames = false;
+#endif
+
+  // Connect to WiFi: access point and address of the last boot first, scan only if that fails
   Serial.print("Connecting to WiFi ");
-  wifiLib.scanAndSelectNetwork();
-  wifiLib.connect();
-  String ssid = wifiLib.getSSID();
+  wifiFast.connectOrScan(wifiLib);
+  bootTimeline.mark("wifi");
 
   timeClient.begin();
   timeClient.setTimeOffset(0); // Set your time offset from UTC in seconds
   timeClient.update();
+  bootTimeline.mark("ntp");
 
-  readings.clear();
-  readings.reserve(MAX_READINGS);
+  aggregator.clear();
 
   initializeSensor();
+  bootTimeline.mark("sensor");
 
   // Set up MQTT
-  String mqttClientID = "ESP32TemperatureSensor2Client_" + chipID;
-  mqttClientLib = new MQTTClientLib(mqtt_broker, mqtt_port, mqttClientID, wifiClient, mqttCallback);
+  createMQTTClient();
+#ifndef LOW_POWER_MODE
+  // Readings during a broker outage are sent afterwards; battery nodes keep
+  // their aggregates in RTC memory instead and publish them on the next wake
+  mqttClientLib->beginQueue(32768, "/mqttqueue.bin");
+#endif
   connectToMQTT(true);
+  if (mqttClientLib->connected())
+  {
+    bootTimeline.mark("mqtt");
+  }
+#ifdef LOW_POWER_MODE
+  waitForConfig();
+#endif
   mqttClientLib->publish(("meta/TemperaturSensor2/" + location + "/" + sensorName + "/version").c_str(), String(version), true, 2);
+  publishOTAStatus();
+#ifdef LOW_POWER_MODE
+  // The clock restarts with the first deep sleep, so the timeline goes out
+  // now and ends before the first reading
+  publishBootTimeline();
+  wifiOff();
+  accountTime(powerStats.radioUs);
+#else
+  startTasks();
+#endif
 }
 
 void loop()
 {
-  otaInProgress = AzureOTAUpdater::CheckUpdateStatus();
-
-  if (otaInProgress < 0)
+#ifdef LOW_POWER_MODE
+  checkOTAUpdate();
+  if (otaInProgress == 1)
   {
-    blinkLed(RED, true);
-  }
-
-  if (otaInProgress != 1)
-  {
-    timeClient.update();
-
-    if (millis() - lastReadingTime >= READING_INTERVAL)
-    {
-      readSensorData();
-    }
-
-    if (readings.size() >= MAX_READINGS)
-    {
-      publishSensorData();
-    }
-
-    bool mqttConnected = mqttClientLib->loop();
-    if (!mqttConnected)
-    {
-      // Log detailed information about the disconnection
-      int lastErr = mqttClientLib->lastError();
-      Serial.print("MQTT loop() returned false! Last Error Code: ");
-      Serial.println(lastErr);
-      Serial.print("WiFi Status: ");
-      Serial.println(WiFi.status() == WL_CONNECTED ? "Connected" : "Disconnected");
-      Serial.print("WiFi RSSI: ");
-      Serial.println(WiFi.RSSI());
-      Serial.print("Free Heap: ");
-      Serial.println(ESP.getFreeHeap());
-      Serial.print("Uptime: ");
-      Serial.println(millis() / 1000);
-
-      Serial.println("MQTT Client not connected, reconnecting in loop...");
-      connectToMQTT(false);
-    }
+    mqttClientLib->loop();
+    delay(500);
+    return;
   }
-  delay(500);
+  lowPowerCycle();
+#else
+  telemetry.loop();
+  // Sleeps until the next task is due or an event arrives
+  eventLoop.run();
+#endif
 }
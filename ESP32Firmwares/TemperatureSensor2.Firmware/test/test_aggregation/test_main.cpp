@@ -0,0 +1,133 @@
+// Host tests of the per-sensor aggregation and the power estimate: pio test -e native
+
+#include <unity.h>
+#include <math.h>
+
+#include "SensorAggregator.h"
+#include "PowerStats.h"
+
+static SensorAggregator aggregator;
+
+void setUp()
+{
+    aggregator.clear();
+}
+
+void tearDown()
+{
+}
+
+void test_mean_variance_min_max()
+{
+    const float values[] = {20.0f, 21.0f, 22.0f, 23.0f, 24.0f};
+    for (float value : values)
+    {
+        aggregator.add(1, value, NAN, NAN);
+    }
+
+    const RunningStats &temperature = aggregator.sensors[0].temperature;
+    TEST_ASSERT_EQUAL_UINT32(5, temperature.count);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 22.0f, temperature.mean);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 2.5f, temperature.variance());
+    TEST_ASSERT_EQUAL_FLOAT(20.0f, temperature.min);
+    TEST_ASSERT_EQUAL_FLOAT(24.0f, temperature.max);
+}
+
+void test_single_reading_has_no_variance()
+{
+    aggregator.add(1, 21.5f, NAN, NAN);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, aggregator.sensors[0].temperature.variance());
+}
+
+void test_variance_is_stable_for_large_offsets()
+{
+    // The naive sum-of-squares formula loses all precision in float here
+    for (int i = 0; i < 1000; i++)
+    {
+        aggregator.add(1, 1000.0f + (i % 2 ? 0.1f : -0.1f), NAN, NAN);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.01f, aggregator.sensors[0].temperature.variance());
+}
+
+void test_sensors_are_kept_apart()
+{
+    aggregator.add(0x28FF000000000001ULL, 20.0f, NAN, NAN);
+    aggregator.add(0x28FF000000000002ULL, 30.0f, NAN, NAN);
+    aggregator.add(0x28FF000000000001ULL, 22.0f, NAN, NAN);
+
+    TEST_ASSERT_EQUAL_UINT32(2, aggregator.sensorCount);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 21.0f, aggregator.sensors[0].temperature.mean);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 30.0f, aggregator.sensors[1].temperature.mean);
+}
+
+void test_missing_humidity_and_pressure_are_skipped()
+{
+    aggregator.add(1, 20.0f, 50.0f, NAN);
+    aggregator.add(1, 20.0f, NAN, NAN);
+
+    TEST_ASSERT_EQUAL_UINT32(2, aggregator.sensors[0].temperature.count);
+    TEST_ASSERT_EQUAL_UINT32(1, aggregator.sensors[0].humidity.count);
+    TEST_ASSERT_EQUAL_UINT32(0, aggregator.sensors[0].pressure.count);
+}
+
+void test_full_table_drops_new_sensors()
+{
+    for (uint64_t id = 0; id < SensorAggregator::MaxSensors; id++)
+    {
+        TEST_ASSERT_TRUE(aggregator.add(id, 20.0f, NAN, NAN));
+    }
+    TEST_ASSERT_FALSE(aggregator.add(SensorAggregator::MaxSensors, 20.0f, NAN, NAN));
+    TEST_ASSERT_TRUE(aggregator.add(0, 21.0f, NAN, NAN));
+    TEST_ASSERT_EQUAL_UINT32(1, aggregator.overflow);
+}
+
+void test_clear_starts_over()
+{
+    aggregator.add(1, 20.0f, NAN, NAN);
+    aggregator.cycles = 3;
+    aggregator.clear();
+
+    TEST_ASSERT_TRUE(aggregator.empty());
+    TEST_ASSERT_EQUAL_UINT16(0, aggregator.cycles);
+}
+
+void test_average_current_is_time_weighted()
+{
+    PowerStats stats;
+    stats.clear();
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, stats.averageCurrentMa());
+
+    stats.radioUs = 1000000;
+    stats.deepSleepUs = 299000000;
+    float expected = (1.0f * POWER_RADIO_MA + 299.0f * POWER_DEEP_SLEEP_MA) / 300.0f;
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, expected, stats.averageCurrentMa());
+}
+
+void test_deep_sleep_break_even_follows_the_wake_cost()
+{
+    // At the break-even both ways need the same charge
+    uint32_t wakeCostUs = 300000;
+    uint64_t breakEvenUs = deepSleepBreakEvenUs(wakeCostUs);
+    double lightCharge = breakEvenUs * (double)POWER_LIGHT_SLEEP_MA;
+    double deepCharge = breakEvenUs * (double)POWER_DEEP_SLEEP_MA + wakeCostUs * (double)POWER_ACTIVE_MA;
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f * lightCharge, lightCharge, deepCharge);
+
+    // A 30 s reading interval is below it with the nominal currents: light sleep
+    TEST_ASSERT_TRUE(breakEvenUs > 30000000);
+    TEST_ASSERT_TRUE(deepSleepBreakEvenUs(2 * wakeCostUs) > breakEvenUs);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_mean_variance_min_max);
+    RUN_TEST(test_single_reading_has_no_variance);
+    RUN_TEST(test_variance_is_stable_for_large_offsets);
+    RUN_TEST(test_sensors_are_kept_apart);
+    RUN_TEST(test_missing_humidity_and_pressure_are_skipped);
+    RUN_TEST(test_full_table_drops_new_sensors);
+    RUN_TEST(test_clear_starts_over);
+    RUN_TEST(test_average_current_is_time_weighted);
+    RUN_TEST(test_deep_sleep_break_even_follows_the_wake_cost);
+    return UNITY_END();
+}
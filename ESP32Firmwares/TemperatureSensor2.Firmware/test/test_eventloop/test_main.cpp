@@ -0,0 +1,369 @@
+// Host tests of the shared cooperative scheduler (SharedLibs/EventLoop): pio test -e native
+
+#include <unity.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "EventLoop.h"
+
+// Simulated clock: wait() lets the time pass instead of blocking
+class FakePlatform : public EventLoopPlatform
+{
+public:
+    uint64_t timeUs = 0;
+    uint32_t waits = 0;
+    uint32_t lastWaitMs = 0;
+    uint32_t wakes = 0;
+    bool woken = false;
+
+    uint64_t nowUs() override { return timeUs; }
+
+    void wait(uint32_t timeoutMs) override
+    {
+        waits++;
+        lastWaitMs = timeoutMs;
+        if (woken)
+        {
+            woken = false;
+            return;
+        }
+        timeUs += timeoutMs * 1000ULL;
+    }
+
+    void wake() override
+    {
+        wakes++;
+        woken = true;
+    }
+
+    void advanceMs(uint64_t ms) { timeUs += ms * 1000; }
+};
+
+// Real clock and a blocking wait, for signals from another thread
+class ThreadPlatform : public EventLoopPlatform
+{
+public:
+    uint64_t nowUs() override
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void wait(uint32_t timeoutMs) override
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return woken; });
+        woken = false;
+    }
+
+    void wake() override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        woken = true;
+        condition.notify_one();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool woken = false;
+};
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_periodic_task_runs_at_its_deadlines()
+{
+    FakePlatform platform;
+    EventLoop loop(platform);
+    std::vector<uint64_t> runsMs;
+    loop.every("reading", 5000, [&] { runsMs.push_back(platform.timeUs / 1000); });
+
+    for (int i = 0; i < 4; i++)
+    {
+        loop.run(60000);
+    }
+
+    // Slept straight to each deadline, never polled in between
+    TEST_ASSERT_EQUAL(3, runsMs.size());
+    TEST_ASSERT_EQUAL_UINT64(5000, runsMs[0]);
+    TEST_ASSERT_EQUAL_UINT64(10000, runsMs[1]);
+    TEST_ASSERT_EQUAL_UINT64(15000, runsMs[2]);
+    TEST_ASSERT_EQUAL(4, platform.waits);
+    TEST_ASSERT_EQUAL_UINT32(5000, platform.lastWaitMs);
+}
+
+void test_run_now_and_one_shot()
+{
+    FakePlatform platform;
+    EventLoop loop(platform);
+    int periodic = 0;
+    int once = 0;
+    loop.every("mqtt", 250, [&] { periodic++; }, true);
+    EventLoop::TaskId timeout = loop.after("timeout", 1000, [&] { once++; });
+
+    TEST_ASSERT_EQUAL_UINT32(250, loop.runOnce());
+    TEST_ASSERT_EQUAL(1, periodic);
+
+    platform.advanceMs(2000);
+    loop.runOnce();
+    TEST_ASSERT_EQUAL(1, once);
+    TEST_ASSERT_FALSE(loop.scheduled(timeout));
+    platform.advanceMs(2000);
+    loop.runOnce();
+    TEST_ASSERT_EQUAL(1, once);
+
+    loop.schedule(timeout, 100);
+    TEST_ASSERT_TRUE(loop.scheduled(timeout));
+    platform.advanceMs(100);
+    loop.runOnce();
+    TEST_ASSERT_EQUAL(2, once);
+}
+
+void test_signal_runs_event_task_and_wakes_the_wait()
+{
+    FakePlatform platform;
+    EventLoop loop(platform);
+    int frames = 0;
+    EventLoop::TaskId can = loop.onEvent("can", [&] { frames++; });
+    loop.every("poll", 20000, [] {});
+
+    loop.signal(can);
+    loop.signal(can);
+    TEST_ASSERT_EQUAL(2, platform.wakes);
+    loop.run();
+    // Coalesced into one run
+    TEST_ASSERT_EQUAL(1, frames);
+    TEST_ASSERT_EQUAL(1, loop.stats(can).eventRuns);
+
+    // A signal during the sleep ends it early
+    platform.woken = true;
+    loop.run(60000);
+    TEST_ASSERT_EQUAL_UINT64(0, platform.timeUs);
+    TEST_ASSERT_EQUAL(1, frames);
+}
+
+static int isrWakes = 0;
+
+void test_signal_uses_the_isr_safe_wake()
+{
+    FakePlatform platform;
+    platform.isrSafeWake = [](EventLoopPlatform &woken) { isrWakes++; };
+    EventLoop loop(platform);
+    int frames = 0;
+    EventLoop::TaskId can = loop.onEvent("can", [&] { frames++; });
+
+    isrWakes = 0;
+    loop.signal(can);
+    // The plain function instead of the virtual wake()
+    TEST_ASSERT_EQUAL(1, isrWakes);
+    TEST_ASSERT_EQUAL(0, platform.wakes);
+    loop.runOnce();
+    TEST_ASSERT_EQUAL(1, frames);
+}
+
+void test_overrun_is_not_caught_up()
+{
+    FakePlatform platform;
+    EventLoop loop(platform);
+    int runs = 0;
+    EventLoop::TaskId task = loop.every("status", 1000, [&] { runs++; });
+
+    platform.advanceMs(3500);
+    TEST_ASSERT_EQUAL_UINT32(1000, loop.runOnce());
+    TEST_ASSERT_EQUAL(1, runs);
+    TEST_ASSERT_EQUAL_UINT32(2500, loop.stats(task).maxLateMs);
+
+    // Back on a regular period after the late run
+    platform.advanceMs(1000);
+    loop.runOnce();
+    TEST_ASSERT_EQUAL(2, runs);
+    TEST_ASSERT_EQUAL_UINT32(2500, loop.stats(task).maxLateMs);
+}
+
+void test_periodic_task_keeps_its_phase()
+{
+    FakePlatform platform;
+    EventLoop loop(platform);
+    int runs = 0;
+    loop.every("reading", 100, [&] { runs++; });
+
+    // Slightly late each time: the next deadline stays on the 100 ms grid
+    platform.advanceMs(130);
+    TEST_ASSERT_EQUAL_UINT32(70, loop.runOnce());
+    platform.advanceMs(70);
+    TEST_ASSERT_EQUAL_UINT32(100, loop.runOnce());
+    TEST_ASSERT_EQUAL(2, runs);
+}
+
+void test_callback_may_cancel_or_reschedule_itself()
+{
+    FakePlatform platform;
+    EventLoop loop(platform);
+    EventLoop::TaskId self = EventLoop::InvalidTask;
+    int runs = 0;
+    self = loop.every("retry", 100, [&]
+                      {
+                          runs++;
+                          if (runs == 2)
+                          {
+                              loop.setPeriod(self, 1000);
+                              loop.schedule(self, 1000);
+                          }
+                          if (runs == 3)
+                          {
+                              loop.cancel(self);
+                          } });
+
+    platform.advanceMs(100);
+    loop.runOnce();
+    platform.advanceMs(100);
+    TEST_ASSERT_EQUAL_UINT32(1000, loop.runOnce());
+    platform.advanceMs(999);
+    loop.runOnce();
+    TEST_ASSERT_EQUAL(2, runs);
+    platform.advanceMs(1);
+    TEST_ASSERT_EQUAL_UINT32(EventLoop::NoDeadline, loop.runOnce());
+    TEST_ASSERT_EQUAL(3, runs);
+    TEST_ASSERT_FALSE(loop.scheduled(self));
+}
+
+void test_deadlines_beyond_one_wheel_revolution()
+{
+    FakePlatform platform;
+    EventLoop loop(platform);
+    const uint32_t revolutionMs = EventLoop::WheelSlots * EventLoop::WheelTickMs;
+    std::vector<int> order;
+    // Same slot, different rounds
+    loop.after("far", 3 * revolutionMs + 20, [&] { order.push_back(3); });
+    loop.after("near", revolutionMs + 20, [&] { order.push_back(1); });
+    loop.after("ntp", 60000, [&] { order.push_back(60); });
+
+    uint32_t untilNext = loop.runOnce();
+    TEST_ASSERT_EQUAL_UINT32(revolutionMs + 20, untilNext);
+    while (order.size() < 3)
+    {
+        platform.advanceMs(untilNext);
+        untilNext = loop.runOnce();
+    }
+    TEST_ASSERT_EQUAL(1, order[0]);
+    TEST_ASSERT_EQUAL(3, order[1]);
+    TEST_ASSERT_EQUAL(60, order[2]);
+    // Each one exactly on time
+    TEST_ASSERT_EQUAL_UINT64(60000, platform.timeUs / 1000);
+    TEST_ASSERT_EQUAL_UINT32(EventLoop::NoDeadline, untilNext);
+}
+
+void test_due_tasks_run_earliest_deadline_first()
+{
+    FakePlatform platform;
+    EventLoop loop(platform);
+    std::vector<int> order;
+    loop.after("c", 300, [&] { order.push_back(3); });
+    loop.after("a", 100, [&] { order.push_back(1); });
+    loop.after("b", 200 + EventLoop::WheelSlots * EventLoop::WheelTickMs, [&] { order.push_back(2); });
+
+    platform.advanceMs(10000);
+    loop.runOnce();
+    TEST_ASSERT_EQUAL(3, order.size());
+    TEST_ASSERT_EQUAL(1, order[0]);
+    TEST_ASSERT_EQUAL(3, order[1]);
+    TEST_ASSERT_EQUAL(2, order[2]);
+}
+
+void test_runtime_statistics()
+{
+    FakePlatform platform;
+    EventLoop loop(platform);
+    EventLoop::TaskId busy = loop.every("publish", 1000, [&] { platform.timeUs += 30000; });
+
+    for (int i = 0; i < 3; i++)
+    {
+        loop.run(60000);
+    }
+
+    const EventLoopTaskStats &stats = loop.stats(busy);
+    TEST_ASSERT_EQUAL_STRING("publish", stats.name);
+    TEST_ASSERT_EQUAL(2, stats.runs);
+    TEST_ASSERT_EQUAL_UINT64(60000, stats.busyUs);
+    TEST_ASSERT_EQUAL_UINT32(30000, stats.maxRunUs);
+    TEST_ASSERT_EQUAL_UINT64(platform.timeUs - stats.busyUs, loop.idleUs());
+
+    loop.resetStats();
+    TEST_ASSERT_EQUAL_STRING("publish", loop.stats(busy).name);
+    TEST_ASSERT_EQUAL(0, loop.stats(busy).runs);
+    TEST_ASSERT_EQUAL_UINT64(0, loop.idleUs());
+    TEST_ASSERT_EQUAL_UINT64(0, loop.statsPeriodUs());
+}
+
+void test_task_table_is_bounded()
+{
+    FakePlatform platform;
+    EventLoop loop(platform);
+    for (size_t i = 0; i < EventLoop::MaxTasks; i++)
+    {
+        TEST_ASSERT_NOT_EQUAL(EventLoop::InvalidTask, loop.onEvent("task", [] {}));
+    }
+    TEST_ASSERT_EQUAL(EventLoop::InvalidTask, loop.every("one more", 100, [] {}));
+    TEST_ASSERT_EQUAL(EventLoop::MaxTasks, loop.taskCount());
+
+    loop.signal(EventLoop::MaxTasks - 1);
+    loop.signal(EventLoop::InvalidTask);
+    TEST_ASSERT_EQUAL_UINT32(EventLoop::NoDeadline, loop.runOnce());
+    TEST_ASSERT_EQUAL(1, loop.stats(EventLoop::MaxTasks - 1).eventRuns);
+}
+
+void test_signal_from_another_thread()
+{
+    ThreadPlatform platform;
+    EventLoop loop(platform);
+    std::atomic<bool> done{false};
+    int received = 0;
+    EventLoop::TaskId uart = loop.onEvent("uart", [&] { received++; });
+
+    uint64_t start = platform.nowUs();
+    std::thread producer([&]
+                         {
+                             for (int i = 0; i < 5; i++)
+                             {
+                                 std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                                 done = i == 4;
+                                 loop.signal(uart);
+                             } });
+    // Each wait would last 2 s without the wakeups
+    while (!done || loop.runOnce() != EventLoop::NoDeadline)
+    {
+        loop.run(2000);
+    }
+    producer.join();
+    TEST_ASSERT_TRUE(received >= 1);
+    TEST_ASSERT_TRUE(received <= 5);
+    TEST_ASSERT_TRUE(platform.nowUs() - start < 1000000);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_periodic_task_runs_at_its_deadlines);
+    RUN_TEST(test_run_now_and_one_shot);
+    RUN_TEST(test_signal_runs_event_task_and_wakes_the_wait);
+    RUN_TEST(test_signal_uses_the_isr_safe_wake);
+    RUN_TEST(test_overrun_is_not_caught_up);
+    RUN_TEST(test_periodic_task_keeps_its_phase);
+    RUN_TEST(test_callback_may_cancel_or_reschedule_itself);
+    RUN_TEST(test_deadlines_beyond_one_wheel_revolution);
+    RUN_TEST(test_due_tasks_run_earliest_deadline_first);
+    RUN_TEST(test_runtime_statistics);
+    RUN_TEST(test_task_table_is_bounded);
+    RUN_TEST(test_signal_from_another_thread);
+    return UNITY_END();
+}
@@ -0,0 +1,101 @@
+// Host tests of the shared latency histogram (SharedLibs/LatencyHistogram): pio test -e native
+
+#include <unity.h>
+
+#include "LatencyHistogram.h"
+
+static LatencyHistogram histogram;
+
+void setUp()
+{
+    histogram.clear();
+}
+
+void tearDown()
+{
+}
+
+void test_empty_histogram()
+{
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.count());
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.meanUs());
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.maxUs());
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.percentileUs(50));
+}
+
+void test_bucket_bounds_are_inclusive()
+{
+    histogram.add(0);
+    histogram.add(100);
+    histogram.add(101);
+    histogram.add(5000000);
+    histogram.add(5000001);
+    histogram.add(0xFFFFFFFF);
+
+    TEST_ASSERT_EQUAL_UINT32(2, histogram.bucket(0));
+    TEST_ASSERT_EQUAL_UINT32(1, histogram.bucket(1));
+    TEST_ASSERT_EQUAL_UINT32(1, histogram.bucket(LatencyHistogram::BucketCount - 2));
+    TEST_ASSERT_EQUAL_UINT32(2, histogram.bucket(LatencyHistogram::BucketCount - 1));
+    TEST_ASSERT_EQUAL_UINT32(6, histogram.count());
+    TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFF, histogram.maxUs());
+}
+
+void test_percentiles_of_loop_periods()
+{
+    // 90 passes of 10 ms, 9 of 250 ms, one stall of 1.2 s
+    for (int i = 0; i < 90; i++)
+    {
+        histogram.add(10000);
+    }
+    for (int i = 0; i < 9; i++)
+    {
+        histogram.add(250000);
+    }
+    histogram.add(1200000);
+
+    TEST_ASSERT_EQUAL_UINT32(10000, histogram.percentileUs(50));
+    TEST_ASSERT_EQUAL_UINT32(10000, histogram.percentileUs(90));
+    TEST_ASSERT_EQUAL_UINT32(500000, histogram.percentileUs(95));
+    TEST_ASSERT_EQUAL_UINT32(500000, histogram.percentileUs(99));
+    TEST_ASSERT_EQUAL_UINT32(1200000, histogram.percentileUs(100));
+    TEST_ASSERT_EQUAL_UINT32(1200000, histogram.maxUs());
+    TEST_ASSERT_EQUAL_UINT32((90 * 10000 + 9 * 250000 + 1200000) / 100, histogram.meanUs());
+}
+
+void test_percentile_is_capped_at_the_largest_value()
+{
+    histogram.add(1200);
+    histogram.add(1300);
+    // Bucket bound 2000 µs, but nothing above 1300 µs was seen
+    TEST_ASSERT_EQUAL_UINT32(1300, histogram.percentileUs(50));
+    TEST_ASSERT_EQUAL_UINT32(1300, histogram.percentileUs(0));
+
+    histogram.add(9000000);
+    TEST_ASSERT_EQUAL_UINT32(9000000, histogram.percentileUs(100));
+}
+
+void test_clear_starts_a_new_interval()
+{
+    histogram.add(700);
+    histogram.add(70000);
+    histogram.clear();
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.count());
+    for (size_t i = 0; i < LatencyHistogram::BucketCount; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(0, histogram.bucket(i));
+    }
+    histogram.add(300);
+    TEST_ASSERT_EQUAL_UINT32(300, histogram.maxUs());
+    TEST_ASSERT_EQUAL_UINT32(300, histogram.meanUs());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_histogram);
+    RUN_TEST(test_bucket_bounds_are_inclusive);
+    RUN_TEST(test_percentiles_of_loop_periods);
+    RUN_TEST(test_percentile_is_capped_at_the_largest_value);
+    RUN_TEST(test_clear_starts_a_new_interval);
+    return UNITY_END();
+}
@@ -0,0 +1,679 @@
+// Host tests of the shared MQTT 5 codec and session (SharedLibs/MQTT5): pio test -e native
+//
+// test_broker_* run against a local mosquitto (localhost:1883, or the host
+// in MQTT5_TEST_BROKER) and are ignored when none is reachable. With
+// MQTT5_TEST_BROKER set (CI starts a mosquitto for them) they fail instead.
+
+#include <unity.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "MQTT5Codec.h"
+#include "MQTT5Session.h"
+
+// In-memory broker side: records what the session writes and answers
+// CONNECT, SUBSCRIBE and QoS 1 publishes like a broker would
+class FakeTransport : public MQTT5Transport
+{
+public:
+    std::vector<std::vector<uint8_t>> written;
+    std::vector<uint8_t> incoming;
+    uint32_t clockMs = 0;
+    bool open = true;
+    bool answer = true;
+    uint16_t topicAliasMaximum = 10;
+    // PUBACKs held back and released one per idle() call, like a broker on a slow link
+    bool deferPubacks = false;
+    std::vector<std::vector<uint8_t>> deferred;
+    uint8_t pubackReason = 0x00;
+
+    int read(uint8_t *data, size_t length) override
+    {
+        if (!open)
+        {
+            return -1;
+        }
+        size_t count = incoming.size() < length ? incoming.size() : length;
+        memcpy(data, incoming.data(), count);
+        incoming.erase(incoming.begin(), incoming.begin() + count);
+        return (int)count;
+    }
+
+    bool write(const uint8_t *data, size_t length) override
+    {
+        written.push_back(std::vector<uint8_t>(data, data + length));
+        if (!answer)
+        {
+            return open;
+        }
+        MQTT5PacketType type = (MQTT5PacketType)(data[0] >> 4);
+        uint8_t headerLength = length > 127 + 2 ? 3 : 2;
+        if (type == MQTT5PacketType::Connect)
+        {
+            const uint8_t connack[] = {0x20, 0x06, 0x00, 0x00, 0x03, 0x22, (uint8_t)(topicAliasMaximum >> 8),
+                                       (uint8_t)topicAliasMaximum};
+            incoming.insert(incoming.end(), connack, connack + sizeof(connack));
+        }
+        else if (type == MQTT5PacketType::Subscribe)
+        {
+            const uint8_t suback[] = {0x90, 0x04, data[2], data[3], 0x00, 0x00};
+            incoming.insert(incoming.end(), suback, suback + sizeof(suback));
+        }
+        else if (type == MQTT5PacketType::Publish && ((data[0] >> 1) & 0x03) == 1)
+        {
+            // Packet id follows the topic
+            size_t topicLength = data[headerLength] << 8 | data[headerLength + 1];
+            size_t idOffset = headerLength + 2 + topicLength;
+            std::vector<uint8_t> puback = {0x40, 0x02, data[idOffset], data[idOffset + 1]};
+            if (pubackReason != 0x00)
+            {
+                puback[1] = 0x03;
+                puback.push_back(pubackReason);
+            }
+            if (deferPubacks)
+            {
+                deferred.push_back(puback);
+            }
+            else
+            {
+                incoming.insert(incoming.end(), puback.begin(), puback.end());
+            }
+        }
+        return open;
+    }
+
+    bool connected() override { return open; }
+    uint32_t nowMs() override { return clockMs; }
+    void idle() override
+    {
+        clockMs += 10;
+        if (!deferred.empty())
+        {
+            incoming.insert(incoming.end(), deferred.front().begin(), deferred.front().end());
+            deferred.erase(deferred.begin());
+        }
+    }
+
+    // Body of the nth packet the session sent
+    MQTT5Codec::Publish sentPublish(size_t index)
+    {
+        const std::vector<uint8_t> &packet = written[index];
+        MQTT5PacketType type;
+        uint8_t flags, headerLength;
+        uint32_t remainingLength;
+        bool malformed;
+        MQTT5Codec::Publish publish = {};
+        TEST_ASSERT_TRUE(MQTT5Codec::parseFixedHeader(packet.data(), packet.size(), type, flags, remainingLength,
+                                                      headerLength, malformed));
+        TEST_ASSERT_EQUAL(MQTT5PacketType::Publish, type);
+        TEST_ASSERT_TRUE(MQTT5Codec::parsePublish(flags, packet.data() + headerLength, remainingLength, publish));
+        return publish;
+    }
+};
+
+static FakeTransport transport;
+static std::string receivedTopic;
+static std::string receivedPayload;
+
+static void onMessage(const char *topic, const uint8_t *payload, size_t length, const MQTT5Codec::Publish &)
+{
+    receivedTopic = topic;
+    receivedPayload.assign((const char *)payload, length);
+}
+
+void setUp()
+{
+    transport = FakeTransport();
+    receivedTopic.clear();
+    receivedPayload.clear();
+}
+
+void tearDown()
+{
+}
+
+void test_varint_round_trip()
+{
+    const uint32_t values[] = {0, 127, 128, 16383, 16384, 2097151, 2097152, 268435455};
+    const uint8_t sizes[] = {1, 1, 2, 2, 3, 3, 4, 4};
+    for (int i = 0; i < 8; i++)
+    {
+        uint8_t encoded[4];
+        uint32_t decoded;
+        TEST_ASSERT_EQUAL_UINT8(sizes[i], MQTT5Codec::encodeVarInt(values[i], encoded));
+        TEST_ASSERT_EQUAL_INT(sizes[i], MQTT5Codec::decodeVarInt(encoded, sizes[i], decoded));
+        TEST_ASSERT_EQUAL_UINT32(values[i], decoded);
+    }
+
+    const uint8_t incomplete[] = {0x80, 0x80};
+    const uint8_t malformed[] = {0x80, 0x80, 0x80, 0x80, 0x01};
+    uint32_t value;
+    TEST_ASSERT_EQUAL_INT(0, MQTT5Codec::decodeVarInt(incomplete, sizeof(incomplete), value));
+    TEST_ASSERT_EQUAL_INT(-1, MQTT5Codec::decodeVarInt(malformed, sizeof(malformed), value));
+}
+
+void test_connect_packet_bytes()
+{
+    uint8_t buffer[64];
+    size_t length = MQTT5Codec::encodeConnect(buffer, sizeof(buffer), "ts1", 60, true, 0, 4096);
+    const uint8_t expected[] = {0x10, 0x15,                               // CONNECT, remaining length 21
+                                0x00, 0x04, 'M', 'Q', 'T', 'T', 0x05,     // Protocol name, version 5
+                                0x02, 0x00, 0x3C,                         // Clean start, keep alive 60 s
+                                0x05, 0x27, 0x00, 0x00, 0x10, 0x00,       // Maximum Packet Size 4096
+                                0x00, 0x03, 't', 's', '1'};
+    TEST_ASSERT_EQUAL_size_t(sizeof(expected), length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+
+    TEST_ASSERT_EQUAL_size_t(0, MQTT5Codec::encodeConnect(buffer, 16, "ts1", 60, true, 0, 4096));
+}
+
+void test_publish_properties_round_trip()
+{
+    const MQTT5UserProperty properties[] = {{"ts", "1760000000"}, {"unit", "C"}};
+    MQTT5PublishProperties publishProperties;
+    publishProperties.topicAlias = 3;
+    publishProperties.messageExpirySeconds = 900;
+    publishProperties.userProperties = properties;
+    publishProperties.userPropertyCount = 2;
+
+    uint8_t buffer[128];
+    size_t length = MQTT5Codec::encodePublish(buffer, sizeof(buffer), "daten/temperatur/Sensor1",
+                                              (const uint8_t *)"21.50", 5, 1, true, 7, publishProperties);
+    TEST_ASSERT_GREATER_THAN(0, length);
+
+    MQTT5PacketType type;
+    uint8_t flags, headerLength;
+    uint32_t remainingLength;
+    bool malformed;
+    TEST_ASSERT_TRUE(MQTT5Codec::parseFixedHeader(buffer, length, type, flags, remainingLength, headerLength, malformed));
+    TEST_ASSERT_EQUAL_size_t(length, headerLength + remainingLength);
+
+    MQTT5Codec::Publish publish;
+    TEST_ASSERT_TRUE(MQTT5Codec::parsePublish(flags, buffer + headerLength, remainingLength, publish));
+    TEST_ASSERT_EQUAL_STRING_LEN("daten/temperatur/Sensor1", publish.topic, publish.topicLength);
+    TEST_ASSERT_EQUAL_UINT8(1, publish.qos);
+    TEST_ASSERT_TRUE(publish.retain);
+    TEST_ASSERT_EQUAL_UINT16(7, publish.packetId);
+    TEST_ASSERT_EQUAL_UINT16(3, publish.topicAlias);
+    TEST_ASSERT_EQUAL_UINT32(900, publish.messageExpirySeconds);
+    TEST_ASSERT_EQUAL_STRING_LEN("21.50", (const char *)publish.payload, publish.payloadLength);
+
+    const char *value;
+    uint16_t valueLength;
+    TEST_ASSERT_TRUE(MQTT5Codec::findUserProperty(publish.properties, publish.propertiesLength, "unit", value, valueLength));
+    TEST_ASSERT_EQUAL_STRING_LEN("C", value, valueLength);
+    TEST_ASSERT_TRUE(MQTT5Codec::findUserProperty(publish.properties, publish.propertiesLength, "ts", value, valueLength));
+    TEST_ASSERT_EQUAL_STRING_LEN("1760000000", value, valueLength);
+    TEST_ASSERT_FALSE(MQTT5Codec::findUserProperty(publish.properties, publish.propertiesLength, "x", value, valueLength));
+}
+
+void test_connack_properties()
+{
+    // Session present, success, Topic Alias Maximum 10, Server Keep Alive 30, Maximum QoS 1, Reason String "ok"
+    const uint8_t body[] = {0x01, 0x00, 0x0D, 0x22, 0x00, 0x0A, 0x13, 0x00, 0x1E, 0x24, 0x01,
+                            0x1F, 0x00, 0x02, 'o', 'k'};
+    MQTT5Codec::Connack connack;
+    TEST_ASSERT_TRUE(MQTT5Codec::parseConnack(body, sizeof(body), connack));
+    TEST_ASSERT_TRUE(connack.sessionPresent);
+    TEST_ASSERT_EQUAL_UINT8(0, connack.reasonCode);
+    TEST_ASSERT_EQUAL_UINT16(10, connack.topicAliasMaximum);
+    TEST_ASSERT_EQUAL_UINT16(30, connack.serverKeepAlive);
+    TEST_ASSERT_EQUAL_UINT8(1, connack.maximumQos);
+    TEST_ASSERT_TRUE(connack.retainAvailable);
+
+    const uint8_t truncated[] = {0x00, 0x00, 0x03, 0x22, 0x00};
+    TEST_ASSERT_FALSE(MQTT5Codec::parseConnack(truncated, sizeof(truncated), connack));
+}
+
+void test_alias_replaces_topic_after_first_publish()
+{
+    MQTT5Session session(512);
+    session.begin(&transport, onMessage);
+    TEST_ASSERT_TRUE(session.connect("ts1", true, 0));
+
+    const char *topic = "daten/temperatur/Wohnzimmer";
+    TEST_ASSERT_TRUE(session.publish(topic, (const uint8_t *)"21.5", 4, true, 0));
+    TEST_ASSERT_TRUE(session.publish(topic, (const uint8_t *)"21.6", 4, true, 0));
+
+    MQTT5Codec::Publish first = transport.sentPublish(1);
+    TEST_ASSERT_EQUAL_STRING_LEN(topic, first.topic, first.topicLength);
+    TEST_ASSERT_EQUAL_UINT16(1, first.topicAlias);
+
+    MQTT5Codec::Publish second = transport.sentPublish(2);
+    TEST_ASSERT_EQUAL_UINT16(0, second.topicLength);
+    TEST_ASSERT_EQUAL_UINT16(1, second.topicAlias);
+    TEST_ASSERT_TRUE(transport.written[2].size() < transport.written[1].size());
+
+    TEST_ASSERT_EQUAL_UINT32(1, session.stats().aliasedPublishes);
+    TEST_ASSERT_EQUAL_UINT32(strlen(topic), session.stats().bytesSaved);
+}
+
+void test_aliases_reset_on_reconnect()
+{
+    MQTT5Session session(512);
+    session.begin(&transport, onMessage);
+    TEST_ASSERT_TRUE(session.connect("ts1", true, 0));
+    TEST_ASSERT_TRUE(session.publish("a/b", (const uint8_t *)"1", 1, false, 0));
+    TEST_ASSERT_EQUAL_size_t(1, session.aliasCount());
+
+    TEST_ASSERT_TRUE(session.connect("ts1", true, 0));
+    TEST_ASSERT_EQUAL_size_t(0, session.aliasCount());
+    TEST_ASSERT_TRUE(session.publish("a/b", (const uint8_t *)"2", 1, false, 0));
+    MQTT5Codec::Publish publish = transport.sentPublish(transport.written.size() - 1);
+    TEST_ASSERT_EQUAL_STRING_LEN("a/b", publish.topic, publish.topicLength);
+    TEST_ASSERT_EQUAL_UINT16(1, publish.topicAlias);
+}
+
+void test_full_alias_table_sends_topics()
+{
+    transport.topicAliasMaximum = 1;
+    MQTT5Session session(512);
+    session.begin(&transport, onMessage);
+    TEST_ASSERT_TRUE(session.connect("ts1", true, 0));
+    TEST_ASSERT_TRUE(session.publish("a", (const uint8_t *)"1", 1, false, 0));
+    TEST_ASSERT_TRUE(session.publish("b", (const uint8_t *)"1", 1, false, 0));
+    TEST_ASSERT_TRUE(session.publish("b", (const uint8_t *)"2", 1, false, 0));
+
+    for (size_t i = 2; i <= 3; i++)
+    {
+        MQTT5Codec::Publish publish = transport.sentPublish(i);
+        TEST_ASSERT_EQUAL_STRING_LEN("b", publish.topic, publish.topicLength);
+        TEST_ASSERT_EQUAL_UINT16(0, publish.topicAlias);
+    }
+}
+
+void test_no_alias_when_broker_allows_none()
+{
+    transport.topicAliasMaximum = 0;
+    MQTT5Session session(512);
+    session.begin(&transport, onMessage);
+    TEST_ASSERT_TRUE(session.connect("ts1", true, 0));
+    TEST_ASSERT_TRUE(session.publish("a", (const uint8_t *)"1", 1, false, 0));
+    TEST_ASSERT_TRUE(session.publish("a", (const uint8_t *)"1", 1, false, 0));
+    TEST_ASSERT_EQUAL_UINT16(0, transport.sentPublish(2).topicAlias);
+    TEST_ASSERT_EQUAL_UINT16(1, transport.sentPublish(2).topicLength);
+}
+
+void test_qos1_waits_for_puback()
+{
+    MQTT5Session session(512);
+    session.begin(&transport, onMessage);
+    session.setTimeout(100);
+    TEST_ASSERT_TRUE(session.connect("ts1", true, 0));
+    TEST_ASSERT_TRUE(session.publish("a", (const uint8_t *)"1", 1, false, 1));
+
+    transport.answer = false;
+    TEST_ASSERT_FALSE(session.publish("a", (const uint8_t *)"1", 1, false, 1));
+    TEST_ASSERT_EQUAL(MQTT5Session::Error::Timeout, session.lastError());
+    TEST_ASSERT_FALSE(session.connected());
+}
+
+void test_pipelined_qos1_publishes_do_not_wait()
+{
+    MQTT5Session session(512);
+    session.begin(&transport, onMessage);
+    TEST_ASSERT_TRUE(session.connect("ts1", true, 0));
+    transport.deferPubacks = true;
+
+    session.beginPipeline();
+    for (int i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_TRUE(session.publish("daten/temperatur/M1/Aussen", (const uint8_t *)"4.5", 3, true, 1));
+    }
+    // All five went out back to back, no time spent waiting
+    TEST_ASSERT_EQUAL_size_t(6, transport.written.size());
+    TEST_ASSERT_EQUAL_size_t(5, session.inFlightCount());
+    TEST_ASSERT_EQUAL_UINT32(0, transport.clockMs);
+
+    TEST_ASSERT_TRUE(session.endPipeline());
+    TEST_ASSERT_EQUAL_size_t(0, session.inFlightCount());
+    TEST_ASSERT_TRUE(session.connected());
+}
+
+void test_pipeline_window_is_bounded()
+{
+    MQTT5Session session(512);
+    session.begin(&transport, onMessage);
+    TEST_ASSERT_TRUE(session.connect("ts1", true, 0));
+    transport.deferPubacks = true;
+
+    session.beginPipeline();
+    for (int i = 0; i < 40; i++)
+    {
+        TEST_ASSERT_TRUE(session.publish("a", (const uint8_t *)"1", 1, false, 1));
+        TEST_ASSERT_TRUE(session.inFlightCount() < MQTT5Session::MaxInFlight);
+    }
+    TEST_ASSERT_TRUE(session.endPipeline());
+    TEST_ASSERT_TRUE(transport.deferred.empty());
+}
+
+void test_pipeline_reports_refused_and_missing_pubacks()
+{
+    MQTT5Session session(512);
+    session.begin(&transport, onMessage);
+    session.setTimeout(100);
+    TEST_ASSERT_TRUE(session.connect("ts1", true, 0));
+
+    // 0x87: not authorized
+    transport.pubackReason = 0x87;
+    session.beginPipeline();
+    TEST_ASSERT_TRUE(session.publish("a", (const uint8_t *)"1", 1, false, 1));
+    TEST_ASSERT_TRUE(session.publish("b", (const uint8_t *)"1", 1, false, 1));
+    TEST_ASSERT_FALSE(session.endPipeline());
+    TEST_ASSERT_EQUAL_UINT8(0x87, session.lastReasonCode());
+    TEST_ASSERT_TRUE(session.connected());
+
+    // A later pipeline starts clean
+    transport.pubackReason = 0x00;
+    session.beginPipeline();
+    TEST_ASSERT_TRUE(session.publish("a", (const uint8_t *)"2", 1, false, 1));
+    TEST_ASSERT_TRUE(session.endPipeline());
+
+    transport.answer = false;
+    session.beginPipeline();
+    TEST_ASSERT_TRUE(session.publish("a", (const uint8_t *)"3", 1, false, 1));
+    TEST_ASSERT_FALSE(session.endPipeline());
+    TEST_ASSERT_EQUAL(MQTT5Session::Error::Timeout, session.lastError());
+    TEST_ASSERT_FALSE(session.connected());
+}
+
+void test_incoming_publish_is_delivered_and_acknowledged()
+{
+    MQTT5Session session(512);
+    session.begin(&transport, onMessage);
+    TEST_ASSERT_TRUE(session.connect("ts1", true, 0));
+
+    // QoS 1 message, packet id 5, no properties
+    const uint8_t message[] = {0x32, 0x0C, 0x00, 0x05, 'c', 'm', 'd', '/', 'x', 0x00, 0x05, 0x00, 'o', 'n'};
+    transport.incoming.insert(transport.incoming.end(), message, message + sizeof(message));
+    size_t sent = transport.written.size();
+    TEST_ASSERT_TRUE(session.loop());
+
+    TEST_ASSERT_EQUAL_STRING("cmd/x", receivedTopic.c_str());
+    TEST_ASSERT_EQUAL_STRING("on", receivedPayload.c_str());
+    TEST_ASSERT_EQUAL_size_t(sent + 1, transport.written.size());
+    const uint8_t puback[] = {0x40, 0x02, 0x00, 0x05};
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(puback, transport.written.back().data(), sizeof(puback));
+}
+
+void test_packet_split_across_reads()
+{
+    MQTT5Session session(512);
+    session.begin(&transport, onMessage);
+    TEST_ASSERT_TRUE(session.connect("ts1", true, 0));
+
+    const uint8_t message[] = {0x30, 0x08, 0x00, 0x03, 'a', '/', 'b', 0x00, 'h', 'i'};
+    transport.incoming.assign(message, message + 4);
+    TEST_ASSERT_TRUE(session.loop());
+    TEST_ASSERT_TRUE(receivedTopic.empty());
+    transport.incoming.assign(message + 4, message + sizeof(message));
+    TEST_ASSERT_TRUE(session.loop());
+    TEST_ASSERT_EQUAL_STRING("a/b", receivedTopic.c_str());
+    TEST_ASSERT_EQUAL_STRING("hi", receivedPayload.c_str());
+}
+
+void test_keep_alive_ping_and_timeout()
+{
+    MQTT5Session session(512);
+    session.begin(&transport, onMessage);
+    session.setKeepAlive(10);
+    TEST_ASSERT_TRUE(session.connect("ts1", true, 0));
+    size_t sent = transport.written.size();
+
+    transport.clockMs += 10000;
+    TEST_ASSERT_TRUE(session.loop());
+    TEST_ASSERT_EQUAL_size_t(sent + 1, transport.written.size());
+    TEST_ASSERT_EQUAL_HEX8(0xC0, transport.written.back()[0]);
+
+    transport.clockMs += 5000;
+    TEST_ASSERT_FALSE(session.loop());
+    TEST_ASSERT_EQUAL(MQTT5Session::Error::PingTimeout, session.lastError());
+}
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+// The session over a plain TCP socket to a real broker
+class SocketTransport : public MQTT5Transport
+{
+public:
+    ~SocketTransport() { close(); }
+
+    bool open(const char *host, int port)
+    {
+        struct addrinfo hints = {};
+        struct addrinfo *result = nullptr;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &result) != 0)
+        {
+            return false;
+        }
+        for (struct addrinfo *address = result; address && fd < 0; address = address->ai_next)
+        {
+            fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (fd >= 0 && ::connect(fd, address->ai_addr, address->ai_addrlen) < 0)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(result);
+        if (fd >= 0)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        }
+        return fd >= 0;
+    }
+
+    void close()
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    int read(uint8_t *data, size_t length) override
+    {
+        ssize_t count = recv(fd, data, length, 0);
+        if (count > 0)
+        {
+            return (int)count;
+        }
+        return count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+
+    bool write(const uint8_t *data, size_t length) override
+    {
+        while (length > 0)
+        {
+            ssize_t count = send(fd, data, length, 0);
+            if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                usleep(1000);
+                continue;
+            }
+            if (count <= 0)
+            {
+                return false;
+            }
+            data += count;
+            length -= count;
+        }
+        return true;
+    }
+
+    bool connected() override { return fd >= 0; }
+
+    uint32_t nowMs() override
+    {
+        struct timeval now;
+        gettimeofday(&now, nullptr);
+        return (uint32_t)(now.tv_sec * 1000 + now.tv_usec / 1000);
+    }
+
+    void idle() override { usleep(1000); }
+
+private:
+    int fd = -1;
+};
+
+static const char *brokerHost()
+{
+    const char *host = getenv("MQTT5_TEST_BROKER");
+    return host && *host ? host : "localhost";
+}
+
+struct BrokerMessage
+{
+    std::string topic;
+    std::string payload;
+    std::string timestamp;
+    bool retained;
+};
+
+static void requireBroker()
+{
+    SocketTransport probe;
+    if (probe.open(brokerHost(), 1883))
+    {
+        return;
+    }
+    const char *host = getenv("MQTT5_TEST_BROKER");
+    if (host && *host)
+    {
+        TEST_FAIL_MESSAGE("MQTT5_TEST_BROKER not reachable on port 1883");
+    }
+    TEST_IGNORE_MESSAGE("no MQTT broker on port 1883");
+}
+
+// Connected session with a unique client id
+static void openBroker(SocketTransport &socket, MQTT5Session &session, std::vector<BrokerMessage> &messages,
+                       const char *name)
+{
+    TEST_ASSERT_TRUE(socket.open(brokerHost(), 1883));
+    session.begin(&socket, [&messages](const char *topic, const uint8_t *payload, size_t length,
+                                       const MQTT5Codec::Publish &publish) {
+        BrokerMessage message = {topic, std::string((const char *)payload, length), "", publish.retain};
+        const char *value;
+        uint16_t valueLength;
+        if (MQTT5Codec::findUserProperty(publish.properties, publish.propertiesLength, "ts", value, valueLength))
+        {
+            message.timestamp.assign(value, valueLength);
+        }
+        messages.push_back(message);
+    });
+    session.setTimeout(2000);
+    std::string clientId = std::string("mqtt5test-") + name + "-" + std::to_string(getpid());
+    TEST_ASSERT_TRUE_MESSAGE(session.connect(clientId.c_str(), true, 0), "broker refused MQTT 5 CONNECT");
+}
+
+static void pump(MQTT5Session &session, uint32_t ms)
+{
+    for (uint32_t waited = 0; waited < ms; waited += 10)
+    {
+        TEST_ASSERT_TRUE(session.loop());
+        usleep(10000);
+    }
+}
+
+static std::string testTopic(const char *leaf)
+{
+    return "test/mqtt5/" + std::to_string(getpid()) + "/" + leaf;
+}
+
+void test_broker_alias_and_user_property()
+{
+    requireBroker();
+    SocketTransport socket;
+    MQTT5Session session(4096);
+    std::vector<BrokerMessage> messages;
+    openBroker(socket, session, messages, "alias");
+    TEST_ASSERT_GREATER_THAN_MESSAGE(0, session.connack().topicAliasMaximum, "broker allows no topic aliases");
+
+    std::string topic = testTopic("temperatur");
+    TEST_ASSERT_TRUE(session.subscribe(topic.c_str(), 1));
+    const MQTT5UserProperty timestamp[] = {{"ts", "1760000000"}};
+    TEST_ASSERT_TRUE(session.publish(topic.c_str(), (const uint8_t *)"21.50", 5, false, 1, 0, timestamp, 1));
+    TEST_ASSERT_TRUE(session.publish(topic.c_str(), (const uint8_t *)"21.75", 5, false, 1, 0, timestamp, 1));
+    TEST_ASSERT_EQUAL_UINT32(1, session.stats().aliasedPublishes);
+    pump(session, 300);
+
+    // The broker resolved the alias: both arrive under the full topic
+    TEST_ASSERT_EQUAL_size_t(2, messages.size());
+    for (const BrokerMessage &message : messages)
+    {
+        TEST_ASSERT_EQUAL_STRING(topic.c_str(), message.topic.c_str());
+        TEST_ASSERT_EQUAL_STRING("1760000000", message.timestamp.c_str());
+    }
+    TEST_ASSERT_EQUAL_STRING("21.50", messages[0].payload.c_str());
+    TEST_ASSERT_EQUAL_STRING("21.75", messages[1].payload.c_str());
+    session.disconnect();
+}
+
+void test_broker_expired_retained_message_is_dropped()
+{
+    requireBroker();
+    SocketTransport publisherSocket;
+    MQTT5Session publisher(4096);
+    std::vector<BrokerMessage> ignored;
+    openBroker(publisherSocket, publisher, ignored, "publisher");
+    std::string fresh = testTopic("fresh");
+    std::string stale = testTopic("stale");
+    TEST_ASSERT_TRUE(publisher.publish(fresh.c_str(), (const uint8_t *)"1", 1, true, 1, 60));
+    TEST_ASSERT_TRUE(publisher.publish(stale.c_str(), (const uint8_t *)"1", 1, true, 1, 1));
+    publisher.disconnect();
+    sleep(3);
+
+    SocketTransport subscriberSocket;
+    MQTT5Session subscriber(4096);
+    std::vector<BrokerMessage> messages;
+    openBroker(subscriberSocket, subscriber, messages, "subscriber");
+    TEST_ASSERT_TRUE(subscriber.subscribe(testTopic("#").c_str(), 1));
+    pump(subscriber, 300);
+
+    TEST_ASSERT_EQUAL_size_t(1, messages.size());
+    TEST_ASSERT_EQUAL_STRING(fresh.c_str(), messages[0].topic.c_str());
+    TEST_ASSERT_TRUE(messages[0].retained);
+
+    // Clean up the retained message
+    TEST_ASSERT_TRUE(subscriber.publish(fresh.c_str(), nullptr, 0, true, 1));
+    subscriber.disconnect();
+}
+#endif
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_varint_round_trip);
+    RUN_TEST(test_connect_packet_bytes);
+    RUN_TEST(test_publish_properties_round_trip);
+    RUN_TEST(test_connack_properties);
+    RUN_TEST(test_alias_replaces_topic_after_first_publish);
+    RUN_TEST(test_aliases_reset_on_reconnect);
+    RUN_TEST(test_full_alias_table_sends_topics);
+    RUN_TEST(test_no_alias_when_broker_allows_none);
+    RUN_TEST(test_qos1_waits_for_puback);
+    RUN_TEST(test_pipelined_qos1_publishes_do_not_wait);
+    RUN_TEST(test_pipeline_window_is_bounded);
+    RUN_TEST(test_pipeline_reports_refused_and_missing_pubacks);
+    RUN_TEST(test_incoming_publish_is_delivered_and_acknowledged);
+    RUN_TEST(test_packet_split_across_reads);
+    RUN_TEST(test_keep_alive_ping_and_timeout);
+#ifndef _WIN32
+    RUN_TEST(test_broker_alias_and_user_property);
+    RUN_TEST(test_broker_expired_retained_message_is_dropped);
+#endif
+    return UNITY_END();
+}
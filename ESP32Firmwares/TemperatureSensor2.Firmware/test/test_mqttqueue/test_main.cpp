@@ -0,0 +1,316 @@
+// Host tests of the shared MQTT offline queue (SharedLibs/MQTTPublishQueue): pio test -e native
+
+#include <unity.h>
+#include <string.h>
+#include <vector>
+
+#include "MQTTPublishQueue.h"
+
+// Storage in a vector whose ring position survives a "reboot" (a new queue on the same storage)
+class TestStorage : public MQTTQueueStorage
+{
+public:
+    explicit TestStorage(uint32_t capacity) : bytes(capacity) {}
+
+    uint32_t capacity() const override { return (uint32_t)bytes.size(); }
+    bool read(uint32_t offset, void *data, uint32_t length) override
+    {
+        memcpy(data, bytes.data() + offset, length);
+        return true;
+    }
+    bool write(uint32_t offset, const void *data, uint32_t length) override
+    {
+        memcpy(bytes.data() + offset, data, length);
+        return true;
+    }
+    bool loadState(MQTTQueueState &loaded) override
+    {
+        loaded = state;
+        return saved;
+    }
+    void saveState(const MQTTQueueState &current) override
+    {
+        state = current;
+        saved = true;
+    }
+
+    std::vector<uint8_t> bytes;
+    MQTTQueueState state = {};
+    bool saved = false;
+};
+
+// Records are an 8 byte header, the topic and the payload
+static const uint32_t HeaderSize = 8;
+
+static char buffer[128];
+
+static void assertNext(MQTTPublishQueue &queue, const char *topic, const char *payload)
+{
+    MQTTPublishQueue::Message message;
+    TEST_ASSERT_TRUE(queue.peek(message, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING(topic, message.topic);
+    TEST_ASSERT_EQUAL_STRING(payload, message.payload);
+    TEST_ASSERT_EQUAL_UINT16(strlen(payload), message.payloadLength);
+    queue.pop();
+}
+
+static bool push(MQTTPublishQueue &queue, const char *topic, const char *payload, bool coalesce = false)
+{
+    return queue.push(topic, payload, strlen(payload), coalesce, 1, coalesce);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_messages_come_out_in_order()
+{
+    TestStorage storage(256);
+    MQTTPublishQueue queue;
+    queue.begin(&storage, MQTTQueueDropPolicy::DropOldest);
+
+    TEST_ASSERT_TRUE(queue.empty());
+    TEST_ASSERT_TRUE(queue.push("data/a", "1", 1, true, 2, false));
+    TEST_ASSERT_TRUE(push(queue, "data/b", "22"));
+    TEST_ASSERT_EQUAL_UINT32(2, queue.stats().depth);
+    TEST_ASSERT_EQUAL_UINT32(2 * HeaderSize + 7 + 8, queue.bytesUsed());
+
+    MQTTPublishQueue::Message message;
+    TEST_ASSERT_TRUE(queue.peek(message, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING("data/a", message.topic);
+    TEST_ASSERT_TRUE(message.retained);
+    TEST_ASSERT_EQUAL_UINT8(2, message.qos);
+    queue.pop();
+    assertNext(queue, "data/b", "22");
+
+    TEST_ASSERT_TRUE(queue.empty());
+    TEST_ASSERT_FALSE(queue.peek(message, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_UINT32(2, queue.stats().queued);
+    TEST_ASSERT_EQUAL_UINT32(2, queue.stats().drained);
+    TEST_ASSERT_EQUAL_UINT32(2, queue.stats().maxDepth);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.bytesUsed());
+}
+
+void test_records_wrap_around_the_end_of_the_ring()
+{
+    // 20 byte records in a 64 byte ring
+    TestStorage storage(64);
+    MQTTPublishQueue queue;
+    queue.begin(&storage, MQTTQueueDropPolicy::DropNewest);
+
+    TEST_ASSERT_TRUE(push(queue, "t/1", "aaaaaaaaa"));
+    TEST_ASSERT_TRUE(push(queue, "t/2", "bbbbbbbbb"));
+    TEST_ASSERT_TRUE(push(queue, "t/3", "ccccccccc"));
+    assertNext(queue, "t/1", "aaaaaaaaa");
+    assertNext(queue, "t/2", "bbbbbbbbb");
+
+    // The first one fills bytes 60-63 and 0-15, the second one 16-35
+    TEST_ASSERT_TRUE(push(queue, "t/4", "ddddddddd"));
+    TEST_ASSERT_TRUE(push(queue, "t/5", "eeeeeeeee"));
+    TEST_ASSERT_EQUAL_UINT32(60, queue.bytesUsed());
+
+    assertNext(queue, "t/3", "ccccccccc");
+    assertNext(queue, "t/4", "ddddddddd");
+    assertNext(queue, "t/5", "eeeeeeeee");
+    TEST_ASSERT_TRUE(queue.empty());
+    TEST_ASSERT_EQUAL_UINT32(0, queue.stats().dropped);
+}
+
+void test_state_messages_are_coalesced()
+{
+    TestStorage storage(256);
+    MQTTPublishQueue queue;
+    queue.begin(&storage, MQTTQueueDropPolicy::DropOldest);
+
+    TEST_ASSERT_TRUE(push(queue, "meta/x/state", "on", true));
+    TEST_ASSERT_TRUE(push(queue, "data/x", "1"));
+    TEST_ASSERT_TRUE(push(queue, "meta/x/state", "off", true));
+    TEST_ASSERT_TRUE(push(queue, "meta/y/state", "on", true));
+
+    TEST_ASSERT_EQUAL_UINT32(3, queue.stats().depth);
+    TEST_ASSERT_EQUAL_UINT32(1, queue.stats().coalesced);
+    assertNext(queue, "data/x", "1");
+    assertNext(queue, "meta/x/state", "off");
+    assertNext(queue, "meta/y/state", "on");
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+void test_samples_keep_every_message()
+{
+    TestStorage storage(256);
+    MQTTPublishQueue queue;
+    queue.begin(&storage, MQTTQueueDropPolicy::DropOldest);
+
+    TEST_ASSERT_TRUE(push(queue, "data/x", "1"));
+    TEST_ASSERT_TRUE(push(queue, "data/x", "2"));
+    TEST_ASSERT_EQUAL_UINT32(2, queue.stats().depth);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.stats().coalesced);
+    assertNext(queue, "data/x", "1");
+    assertNext(queue, "data/x", "2");
+}
+
+void test_drop_oldest_makes_room()
+{
+    TestStorage storage(64);
+    MQTTPublishQueue queue;
+    queue.begin(&storage, MQTTQueueDropPolicy::DropOldest);
+
+    TEST_ASSERT_TRUE(push(queue, "t/1", "aaaaaaaaa"));
+    TEST_ASSERT_TRUE(push(queue, "t/2", "bbbbbbbbb"));
+    TEST_ASSERT_TRUE(push(queue, "t/3", "ccccccccc"));
+    TEST_ASSERT_TRUE(push(queue, "t/4", "ddddddddd"));
+
+    TEST_ASSERT_EQUAL_UINT32(1, queue.stats().dropped);
+    TEST_ASSERT_EQUAL_UINT32(3, queue.stats().depth);
+    assertNext(queue, "t/2", "bbbbbbbbb");
+    assertNext(queue, "t/3", "ccccccccc");
+    assertNext(queue, "t/4", "ddddddddd");
+}
+
+void test_drop_newest_rejects_the_new_message()
+{
+    TestStorage storage(64);
+    MQTTPublishQueue queue;
+    queue.begin(&storage, MQTTQueueDropPolicy::DropNewest);
+
+    TEST_ASSERT_TRUE(push(queue, "t/1", "aaaaaaaaa"));
+    TEST_ASSERT_TRUE(push(queue, "t/2", "bbbbbbbbb"));
+    TEST_ASSERT_TRUE(push(queue, "t/3", "ccccccccc"));
+    TEST_ASSERT_FALSE(push(queue, "t/4", "ddddddddd"));
+
+    TEST_ASSERT_EQUAL_UINT32(1, queue.stats().dropped);
+    TEST_ASSERT_EQUAL_UINT32(3, queue.stats().depth);
+    assertNext(queue, "t/1", "aaaaaaaaa");
+    assertNext(queue, "t/2", "bbbbbbbbb");
+    assertNext(queue, "t/3", "ccccccccc");
+}
+
+void test_drop_newest_keeps_the_value_it_would_coalesce()
+{
+    TestStorage storage(64);
+    MQTTPublishQueue queue;
+    queue.begin(&storage, MQTTQueueDropPolicy::DropNewest);
+
+    TEST_ASSERT_TRUE(push(queue, "m/1", "aaaaaaaaa", true));
+    TEST_ASSERT_TRUE(push(queue, "t/2", "bbbbbbbbb"));
+    TEST_ASSERT_TRUE(push(queue, "t/3", "ccccccccc"));
+    TEST_ASSERT_FALSE(push(queue, "m/1", "zzzzzzzzz", true));
+
+    TEST_ASSERT_EQUAL_UINT32(0, queue.stats().coalesced);
+    TEST_ASSERT_EQUAL_UINT32(1, queue.stats().dropped);
+    TEST_ASSERT_EQUAL_UINT32(3, queue.stats().depth);
+    assertNext(queue, "m/1", "aaaaaaaaa");
+}
+
+void test_drop_newest_reuses_the_space_of_coalesced_records()
+{
+    TestStorage storage(64);
+    MQTTPublishQueue queue;
+    queue.begin(&storage, MQTTQueueDropPolicy::DropNewest);
+
+    TEST_ASSERT_TRUE(push(queue, "m/1", "aaaaaaaaa", true));
+    TEST_ASSERT_TRUE(push(queue, "m/1", "bbbbbbbbb", true));
+    TEST_ASSERT_TRUE(push(queue, "t/3", "ccccccccc"));
+    // The dead first record is at the head and gives its bytes back
+    TEST_ASSERT_TRUE(push(queue, "t/4", "ddddddddd"));
+
+    TEST_ASSERT_EQUAL_UINT32(0, queue.stats().dropped);
+    assertNext(queue, "m/1", "bbbbbbbbb");
+    assertNext(queue, "t/3", "ccccccccc");
+    assertNext(queue, "t/4", "ddddddddd");
+}
+
+void test_too_large_message_is_dropped()
+{
+    TestStorage storage(32);
+    MQTTPublishQueue queue;
+    queue.begin(&storage, MQTTQueueDropPolicy::DropOldest);
+
+    TEST_ASSERT_TRUE(push(queue, "t/1", "a"));
+    TEST_ASSERT_FALSE(push(queue, "t/2", "this payload does not fit"));
+    TEST_ASSERT_EQUAL_UINT32(1, queue.stats().dropped);
+    assertNext(queue, "t/1", "a");
+}
+
+void test_queue_is_reloaded_from_storage()
+{
+    TestStorage storage(64);
+    {
+        MQTTPublishQueue queue;
+        queue.begin(&storage, MQTTQueueDropPolicy::DropOldest);
+        TEST_ASSERT_TRUE(push(queue, "t/1", "aaaaaaaaa"));
+        TEST_ASSERT_TRUE(push(queue, "t/2", "bbbbbbbbb"));
+        TEST_ASSERT_TRUE(push(queue, "t/3", "ccccccccc"));
+        assertNext(queue, "t/1", "aaaaaaaaa");
+        TEST_ASSERT_TRUE(push(queue, "t/4", "ddddddddd"));
+    }
+
+    // After the reboot the wrapped ring continues where it stopped
+    MQTTPublishQueue queue;
+    queue.begin(&storage, MQTTQueueDropPolicy::DropOldest);
+    TEST_ASSERT_EQUAL_UINT32(3, queue.stats().depth);
+    TEST_ASSERT_EQUAL_UINT32(60, queue.bytesUsed());
+    assertNext(queue, "t/2", "bbbbbbbbb");
+    assertNext(queue, "t/3", "ccccccccc");
+    assertNext(queue, "t/4", "ddddddddd");
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+void test_damaged_storage_starts_over()
+{
+    TestStorage storage(64);
+    {
+        MQTTPublishQueue queue;
+        queue.begin(&storage, MQTTQueueDropPolicy::DropOldest);
+        TEST_ASSERT_TRUE(push(queue, "t/1", "aaaaaaaaa"));
+        TEST_ASSERT_TRUE(push(queue, "t/2", "bbbbbbbbb"));
+    }
+    // Power lost while the first header was written
+    storage.bytes[0] ^= 0xFF;
+
+    MQTTPublishQueue queue;
+    queue.begin(&storage, MQTTQueueDropPolicy::DropOldest);
+    MQTTPublishQueue::Message message;
+    TEST_ASSERT_FALSE(queue.peek(message, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_UINT32(2, queue.stats().dropped);
+    TEST_ASSERT_TRUE(queue.empty());
+
+    TEST_ASSERT_TRUE(push(queue, "t/3", "ccccccccc"));
+    assertNext(queue, "t/3", "ccccccccc");
+}
+
+void test_invalid_stored_state_is_ignored()
+{
+    TestStorage storage(64);
+    storage.saved = true;
+    storage.state.magic = 0x12345678;
+    storage.state.live = 5;
+    storage.state.records = 5;
+
+    MQTTPublishQueue queue;
+    queue.begin(&storage, MQTTQueueDropPolicy::DropOldest);
+    TEST_ASSERT_TRUE(queue.empty());
+    TEST_ASSERT_EQUAL_UINT32(0, queue.bytesUsed());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_messages_come_out_in_order);
+    RUN_TEST(test_records_wrap_around_the_end_of_the_ring);
+    RUN_TEST(test_state_messages_are_coalesced);
+    RUN_TEST(test_samples_keep_every_message);
+    RUN_TEST(test_drop_oldest_makes_room);
+    RUN_TEST(test_drop_newest_rejects_the_new_message);
+    RUN_TEST(test_drop_newest_keeps_the_value_it_would_coalesce);
+    RUN_TEST(test_drop_newest_reuses_the_space_of_coalesced_records);
+    RUN_TEST(test_too_large_message_is_dropped);
+    RUN_TEST(test_queue_is_reloaded_from_storage);
+    RUN_TEST(test_damaged_storage_starts_over);
+    RUN_TEST(test_invalid_stored_state_is_ignored);
+    return UNITY_END();
+}
@@ -0,0 +1,166 @@
+// Host tests of the shared MQTT topic router (SharedLibs/MQTTRouter): pio test -e native
+
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+
+#include "MQTTRouter.h"
+
+static MQTTRouter router;
+static std::string called;
+
+static MQTTHandler handler(const char *name)
+{
+    return [name](const char *topic, const MQTTPayload &payload)
+    {
+        called = name;
+    };
+}
+
+static bool dispatch(const char *topic)
+{
+    called.clear();
+    MQTTPayload payload = {"1", 1};
+    return router.dispatch(topic, payload);
+}
+
+void setUp()
+{
+    router = MQTTRouter();
+    called.clear();
+}
+
+void tearDown()
+{
+}
+
+void test_single_level_wildcard()
+{
+    TEST_ASSERT_TRUE(MQTTRouter::matches("a/+/c", "a/b/c"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("a/+/c", "a//c"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("a/+/c", "a/b/d"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("a/+/c", "a/b/x/c"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("a/+/c", "a/b/c/d"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("+", "a"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("+", "a/b"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("+/+", "a/b"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("a/+", "a/"));
+}
+
+void test_multi_level_wildcard()
+{
+    TEST_ASSERT_TRUE(MQTTRouter::matches("a/#", "a/b"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("a/#", "a/b/c/d"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("a/#", "a"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("a/#", "ab"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("a/#", "b/a"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("#", "a/b/c"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("a/+/#", "a/b/c"));
+    TEST_ASSERT_TRUE(MQTTRouter::matches("a/+/#", "a/b"));
+}
+
+void test_exact_filter_matches_only_itself()
+{
+    TEST_ASSERT_TRUE(MQTTRouter::matches("a/b", "a/b"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("a/b", "a/b/c"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("a/b", "a"));
+    TEST_ASSERT_FALSE(MQTTRouter::matches("a/b", "a/c"));
+}
+
+void test_overlapping_filters()
+{
+    TEST_ASSERT_TRUE(MQTTRouter::overlaps("a/+", "a/b"));
+    TEST_ASSERT_TRUE(MQTTRouter::overlaps("a/#", "a"));
+    TEST_ASSERT_TRUE(MQTTRouter::overlaps("+/b", "a/+"));
+    TEST_ASSERT_FALSE(MQTTRouter::overlaps("a/+", "b/+"));
+    TEST_ASSERT_FALSE(MQTTRouter::overlaps("a/+", "a/b/c"));
+}
+
+void test_dispatch_prefers_the_exact_topic()
+{
+    TEST_ASSERT_EQUAL(MQTTRouter::AddResult::Added, router.add("config/+/location", handler("wildcard")));
+    TEST_ASSERT_EQUAL(MQTTRouter::AddResult::Overlapping, router.add("config/node1/location", handler("exact")));
+    TEST_ASSERT_EQUAL_STRING("config/+/location", router.conflict());
+
+    TEST_ASSERT_TRUE(dispatch("config/node1/location"));
+    TEST_ASSERT_EQUAL_STRING("exact", called.c_str());
+    TEST_ASSERT_TRUE(dispatch("config/node2/location"));
+    TEST_ASSERT_EQUAL_STRING("wildcard", called.c_str());
+    TEST_ASSERT_FALSE(dispatch("config/node2/name"));
+    TEST_ASSERT_TRUE(called.empty());
+}
+
+void test_older_wildcard_wins()
+{
+    router.add("data/#", handler("all"));
+    TEST_ASSERT_EQUAL(MQTTRouter::AddResult::Overlapping, router.add("data/+/temp", handler("temp")));
+
+    TEST_ASSERT_TRUE(dispatch("data/x/temp"));
+    TEST_ASSERT_EQUAL_STRING("all", called.c_str());
+}
+
+void test_duplicate_filter_is_refused()
+{
+    TEST_ASSERT_EQUAL(MQTTRouter::AddResult::Added, router.add("a/b", handler("first")));
+    TEST_ASSERT_EQUAL(MQTTRouter::AddResult::Duplicate, router.add("a/b", handler("second")));
+    TEST_ASSERT_EQUAL(MQTTRouter::AddResult::Added, router.add("a/+/c", handler("first")));
+    TEST_ASSERT_EQUAL(MQTTRouter::AddResult::Duplicate, router.add("a/+/c", handler("second")));
+    TEST_ASSERT_EQUAL(2, router.size());
+
+    dispatch("a/b");
+    TEST_ASSERT_EQUAL_STRING("first", called.c_str());
+}
+
+void test_removed_filter_no_longer_dispatches()
+{
+    router.add("a/b", handler("exact"));
+    router.add("a/#", handler("wildcard"));
+    TEST_ASSERT_TRUE(router.remove("a/b"));
+    TEST_ASSERT_FALSE(router.remove("a/b"));
+
+    dispatch("a/b");
+    TEST_ASSERT_EQUAL_STRING("wildcard", called.c_str());
+    TEST_ASSERT_TRUE(router.remove("a/#"));
+    TEST_ASSERT_FALSE(dispatch("a/b"));
+}
+
+void test_many_exact_topics_are_found()
+{
+    char topic[32];
+    for (int i = 0; i < 50; i++)
+    {
+        snprintf(topic, sizeof(topic), "sensor/%d/value", i);
+        TEST_ASSERT_EQUAL(MQTTRouter::AddResult::Added, router.add(topic, handler("sensor")));
+    }
+    for (int i = 0; i < 50; i++)
+    {
+        snprintf(topic, sizeof(topic), "sensor/%d/value", i);
+        TEST_ASSERT_TRUE(dispatch(topic));
+    }
+    TEST_ASSERT_FALSE(dispatch("sensor/50/value"));
+}
+
+void test_payload_parsing()
+{
+    MQTTPayload number = {"21.5 and more", 4};
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 21.5f, number.toFloat());
+    TEST_ASSERT_EQUAL_INT32(21, number.toInt());
+    TEST_ASSERT_TRUE(number.equals("21.5"));
+    TEST_ASSERT_FALSE(number.equals("21.5 and"));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_level_wildcard);
+    RUN_TEST(test_multi_level_wildcard);
+    RUN_TEST(test_exact_filter_matches_only_itself);
+    RUN_TEST(test_overlapping_filters);
+    RUN_TEST(test_dispatch_prefers_the_exact_topic);
+    RUN_TEST(test_older_wildcard_wins);
+    RUN_TEST(test_duplicate_filter_is_refused);
+    RUN_TEST(test_removed_filter_no_longer_dispatches);
+    RUN_TEST(test_many_exact_topics_are_found);
+    RUN_TEST(test_payload_parsing);
+    return UNITY_END();
+}
@@ -0,0 +1,330 @@
+// Host tests of the shared OTA image decoder (SharedLibs/OTAImage): pio test -e native
+//
+// The compressed vectors were produced by OTATools/otaimage.py, so these
+// tests also pin the decoder to the CI tool's bit format.
+
+#include <unity.h>
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "HeatshrinkDecoder.h"
+#include "OTAImageDecoder.h"
+
+static const char Text[] = "The quick brown fox jumps over the lazy dog. "
+                           "The quick brown fox jumps over the lazy dog. "
+                           "The quick brown fox jumps over the lazy dog. "
+                           "The quick brown fox jumps over the lazy dog. ";
+
+// Text compressed with window 12, lookahead 5 (the tool's defaults)
+static const uint8_t TextW12L5[] = {
+    0xAA, 0x5A, 0x2C, 0xB2, 0x0B, 0x8D, 0xD6, 0xD3, 0x63, 0xB5, 0xC8, 0x2C, 0x57, 0x2B, 0x7D, 0xDE,
+    0xDD, 0x20, 0xB3, 0x5B, 0xEF, 0x12, 0x0B, 0x55, 0xD6, 0xDB, 0x70, 0xB9, 0xC8, 0x2D, 0xF7, 0x6B,
+    0x2D, 0xCA, 0x41, 0x74, 0x00, 0xF0, 0xAD, 0x96, 0x1B, 0xD5, 0xE6, 0x41, 0x64, 0xB7, 0xD9, 0xE5,
+    0xD2, 0x00, 0x16, 0x7C, 0x05, 0x9F, 0x01, 0x67, 0xC0, 0x59, 0xF0, 0x16, 0x18};
+
+// Text compressed with window 8, lookahead 4
+static const uint8_t TextW8L4[] = {
+    0xAA, 0x5A, 0x2C, 0xB2, 0x0B, 0x8D, 0xD6, 0xD3, 0x63, 0xB5, 0xC8, 0x2C, 0x57, 0x2B, 0x7D, 0xDE,
+    0xDD, 0x20, 0xB3, 0x5B, 0xEF, 0x12, 0x0B, 0x55, 0xD6, 0xDB, 0x70, 0xB9, 0xC8, 0x2D, 0xF7, 0x6B,
+    0x2D, 0xCA, 0x41, 0x74, 0x0F, 0x15, 0xB2, 0xC3, 0x7A, 0xBC, 0xC8, 0x2C, 0x96, 0xFB, 0x3C, 0xBA,
+    0x40, 0x2C, 0xF1, 0x67, 0x8B, 0x3C, 0x59, 0xE2, 0xCF, 0x16, 0x78, 0xB3, 0xC5, 0x9E, 0x2C, 0x60};
+
+// Patch turning 64 zero bytes into Text plus its first 16 bytes, compressed
+// with window 12, lookahead 5: (diff 16, extra 164, seek -16), (diff 16,
+// extra 0, seek 0)
+static const uint8_t TextDeltaW12L5[] = {
+    0x88, 0x69, 0x20, 0x31, 0xFA, 0xA5, 0xA2, 0xCB, 0x20, 0xB8, 0xDD, 0x6D, 0x36, 0x3B, 0x5C, 0x82,
+    0xC5, 0x72, 0xB7, 0xDD, 0xED, 0xD2, 0x0B, 0x35, 0xBE, 0xF1, 0x20, 0xB5, 0x5D, 0x6D, 0xB7, 0x0B,
+    0x9C, 0x82, 0xDF, 0x76, 0xB2, 0xDC, 0xA4, 0x17, 0x40, 0x0F, 0x0A, 0xD9, 0x61, 0xBD, 0x5E, 0x64,
+    0x16, 0x4B, 0x7D, 0x9E, 0x5D, 0x20, 0x01, 0x67, 0xC0, 0x59, 0xF0, 0x16, 0x7C, 0x05, 0x9F, 0x01,
+    0x61, 0xA2, 0x10, 0x08, 0x00, 0x0B, 0xDE};
+
+// Running image in memory, records what the decoder writes
+class FakeImageIO : public OTAImageIO
+{
+public:
+    std::vector<uint8_t> source;
+    std::vector<uint8_t> target;
+    bool sourceMatches = true;
+    uint32_t verifiedSize = 0;
+    uint8_t verifiedHash[32] = {};
+
+    bool readSource(uint32_t offset, uint8_t *data, size_t length) override
+    {
+        if (offset + length > source.size())
+        {
+            return false;
+        }
+        memcpy(data, source.data() + offset, length);
+        return true;
+    }
+
+    bool verifySource(uint32_t size, const uint8_t sha256[32]) override
+    {
+        verifiedSize = size;
+        memcpy(verifiedHash, sha256, sizeof(verifiedHash));
+        return sourceMatches;
+    }
+
+    bool writeTarget(const uint8_t *data, size_t length) override
+    {
+        target.insert(target.end(), data, data + length);
+        return true;
+    }
+};
+
+static FakeImageIO io;
+static OTAImageDecoder decoder;
+
+static std::vector<uint8_t> header(uint8_t kind, uint8_t compression, uint32_t targetSize, uint32_t sourceSize = 0,
+                                   uint8_t windowBits = 12, uint8_t lookaheadBits = 5)
+{
+    std::vector<uint8_t> bytes = {'O', 'T', 'A', 'I', 1, kind, compression, windowBits, lookaheadBits, 0, 0, 0};
+    for (uint32_t value : {targetSize, sourceSize})
+    {
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            bytes.push_back((uint8_t)(value >> shift));
+        }
+    }
+    for (uint8_t i = 0; i < 32; i++)
+    {
+        bytes.push_back(i);
+    }
+    return bytes;
+}
+
+static void appendVarint(std::vector<uint8_t> &bytes, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        bytes.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((uint8_t)value);
+}
+
+static void appendTriple(std::vector<uint8_t> &bytes, uint32_t diffLength, uint32_t extraLength, int32_t seek)
+{
+    appendVarint(bytes, diffLength);
+    appendVarint(bytes, extraLength);
+    appendVarint(bytes, seek >= 0 ? (uint32_t)seek << 1 : ((uint32_t)-seek << 1) - 1);
+}
+
+// Feeds in slices of 1, 2, 3 ... bytes to cross every internal boundary
+static bool feedInSlices(const std::vector<uint8_t> &bytes)
+{
+    size_t slice = 1;
+    for (size_t position = 0; position < bytes.size(); position += slice, slice++)
+    {
+        size_t length = bytes.size() - position < slice ? bytes.size() - position : slice;
+        if (!decoder.write(bytes.data() + position, length))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string targetText()
+{
+    return std::string(io.target.begin(), io.target.end());
+}
+
+void setUp()
+{
+    io = FakeImageIO();
+    for (int i = 0; i < 256; i++)
+    {
+        io.source.push_back((uint8_t)(i * 7));
+    }
+    decoder.begin(&io);
+}
+
+void tearDown()
+{
+}
+
+void test_heatshrink_decodes_tool_output()
+{
+    HeatshrinkDecoder heatshrink;
+    std::string out;
+    auto sink = [&out](const uint8_t *data, size_t length)
+    {
+        out.append((const char *)data, length);
+        return true;
+    };
+
+    TEST_ASSERT_TRUE(heatshrink.begin(12, 5));
+    TEST_ASSERT_TRUE(heatshrink.feed(TextW12L5, sizeof(TextW12L5), sink));
+    TEST_ASSERT_EQUAL_STRING(Text, out.c_str());
+
+    // Byte by byte with another window, back-references span the feeds
+    out.clear();
+    TEST_ASSERT_TRUE(heatshrink.begin(8, 4));
+    for (size_t i = 0; i < sizeof(TextW8L4); i++)
+    {
+        TEST_ASSERT_TRUE(heatshrink.feed(TextW8L4 + i, 1, sink));
+    }
+    TEST_ASSERT_EQUAL_STRING(Text, out.c_str());
+}
+
+void test_heatshrink_rejects_invalid_parameters()
+{
+    HeatshrinkDecoder heatshrink;
+    auto sink = [](const uint8_t *, size_t)
+    { return true; };
+
+    TEST_ASSERT_FALSE(heatshrink.begin(3, 2));
+    TEST_ASSERT_FALSE(heatshrink.begin(16, 5));
+    TEST_ASSERT_FALSE(heatshrink.begin(8, 8));
+    TEST_ASSERT_FALSE(heatshrink.feed(TextW12L5, sizeof(TextW12L5), sink));
+}
+
+void test_plain_image_is_passed_through()
+{
+    std::vector<uint8_t> image = {0xE9, 0x03, 0x02, 0x20, 'O', 'T', 'A', 'I'};
+
+    TEST_ASSERT_TRUE(feedInSlices(image));
+    TEST_ASSERT_EQUAL(OTAImageKind::Plain, decoder.kind());
+    TEST_ASSERT_TRUE(decoder.finished());
+    TEST_ASSERT_EQUAL_UINT32(0, decoder.targetSize());
+    TEST_ASSERT_EQUAL_size_t(image.size(), io.target.size());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(image.data(), io.target.data(), image.size());
+}
+
+void test_compressed_image_is_decompressed()
+{
+    std::vector<uint8_t> artifact = header(1, 1, strlen(Text));
+    artifact.insert(artifact.end(), TextW12L5, TextW12L5 + sizeof(TextW12L5));
+
+    TEST_ASSERT_TRUE(feedInSlices(artifact));
+    TEST_ASSERT_EQUAL(OTAImageKind::Compressed, decoder.kind());
+    TEST_ASSERT_TRUE(decoder.finished());
+    TEST_ASSERT_EQUAL_STRING(Text, targetText().c_str());
+}
+
+void test_truncated_image_is_not_finished()
+{
+    std::vector<uint8_t> artifact = header(1, 1, strlen(Text));
+    artifact.insert(artifact.end(), TextW12L5, TextW12L5 + sizeof(TextW12L5) - 8);
+
+    TEST_ASSERT_TRUE(decoder.write(artifact.data(), artifact.size()));
+    TEST_ASSERT_FALSE(decoder.finished());
+    TEST_ASSERT_TRUE(decoder.written() < strlen(Text));
+}
+
+void test_image_larger_than_announced_is_refused()
+{
+    std::vector<uint8_t> artifact = header(1, 1, 20);
+    artifact.insert(artifact.end(), TextW12L5, TextW12L5 + sizeof(TextW12L5));
+
+    TEST_ASSERT_FALSE(decoder.write(artifact.data(), artifact.size()));
+    TEST_ASSERT_FALSE(decoder.finished());
+    TEST_ASSERT_EQUAL_STRING("image larger than announced", decoder.error());
+}
+
+void test_delta_is_applied_to_running_image()
+{
+    // New image: source[0..100) with two bytes changed, 3 inserted bytes,
+    // then source[150..200) unchanged
+    std::vector<uint8_t> expected(io.source.begin(), io.source.begin() + 100);
+    expected[10] += 4;
+    expected[11] += 4;
+    expected.insert(expected.end(), {0xAA, 0xBB, 0xCC});
+    expected.insert(expected.end(), io.source.begin() + 150, io.source.begin() + 200);
+
+    std::vector<uint8_t> artifact = header(2, 0, expected.size(), io.source.size());
+    appendTriple(artifact, 100, 3, 50);
+    for (size_t i = 0; i < 100; i++)
+    {
+        artifact.push_back(i == 10 || i == 11 ? 4 : 0);
+    }
+    artifact.insert(artifact.end(), {0xAA, 0xBB, 0xCC});
+    appendTriple(artifact, 50, 0, 0);
+    artifact.insert(artifact.end(), 50, 0);
+
+    TEST_ASSERT_TRUE(feedInSlices(artifact));
+    TEST_ASSERT_EQUAL(OTAImageKind::Delta, decoder.kind());
+    TEST_ASSERT_TRUE(decoder.finished());
+    TEST_ASSERT_EQUAL_UINT32(io.source.size(), io.verifiedSize);
+    TEST_ASSERT_EQUAL_HEX8(31, io.verifiedHash[31]);
+    TEST_ASSERT_EQUAL_size_t(expected.size(), io.target.size());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected.data(), io.target.data(), expected.size());
+}
+
+void test_compressed_delta_with_backward_seek()
+{
+    io.source.assign(64, 0);
+    std::vector<uint8_t> artifact = header(2, 1, strlen(Text) + 16, io.source.size());
+    artifact.insert(artifact.end(), TextDeltaW12L5, TextDeltaW12L5 + sizeof(TextDeltaW12L5));
+
+    TEST_ASSERT_TRUE(feedInSlices(artifact));
+    TEST_ASSERT_TRUE(decoder.finished());
+    TEST_ASSERT_EQUAL_STRING((std::string(Text) + std::string(Text, 16)).c_str(), targetText().c_str());
+}
+
+void test_delta_for_other_image_writes_nothing()
+{
+    io.sourceMatches = false;
+    std::vector<uint8_t> artifact = header(2, 0, 10, io.source.size());
+    appendTriple(artifact, 10, 0, 0);
+    artifact.insert(artifact.end(), 10, 0);
+
+    TEST_ASSERT_FALSE(decoder.write(artifact.data(), artifact.size()));
+    TEST_ASSERT_EQUAL_STRING("delta does not match the running image", decoder.error());
+    TEST_ASSERT_EQUAL_size_t(0, io.target.size());
+    // Stays failed
+    TEST_ASSERT_FALSE(decoder.write(artifact.data(), 1));
+}
+
+void test_delta_outside_running_image_is_refused()
+{
+    std::vector<uint8_t> reading = header(2, 0, 300, io.source.size());
+    appendTriple(reading, 300, 0, 0);
+    TEST_ASSERT_FALSE(decoder.write(reading.data(), reading.size()));
+    TEST_ASSERT_EQUAL_STRING("patch reads past the running image", decoder.error());
+
+    decoder.begin(&io);
+    std::vector<uint8_t> seeking = header(2, 0, 20, io.source.size());
+    appendTriple(seeking, 10, 0, -11);
+    TEST_ASSERT_FALSE(decoder.write(seeking.data(), seeking.size()));
+    TEST_ASSERT_EQUAL_STRING("patch seeks outside the running image", decoder.error());
+}
+
+void test_unknown_format_is_refused()
+{
+    std::vector<uint8_t> artifact = header(1, 1, 10);
+    artifact[0] = 'X';
+    TEST_ASSERT_FALSE(decoder.write(artifact.data(), artifact.size()));
+    TEST_ASSERT_EQUAL_STRING("unknown image format", decoder.error());
+
+    decoder.begin(&io);
+    artifact = header(3, 1, 10);
+    TEST_ASSERT_FALSE(decoder.write(artifact.data(), artifact.size()));
+    TEST_ASSERT_EQUAL_STRING("unknown image kind", decoder.error());
+
+    decoder.begin(&io);
+    artifact = header(1, 1, 10, 0, 16, 5);
+    TEST_ASSERT_FALSE(decoder.write(artifact.data(), artifact.size()));
+    TEST_ASSERT_EQUAL_STRING("invalid heatshrink parameters", decoder.error());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_heatshrink_decodes_tool_output);
+    RUN_TEST(test_heatshrink_rejects_invalid_parameters);
+    RUN_TEST(test_plain_image_is_passed_through);
+    RUN_TEST(test_compressed_image_is_decompressed);
+    RUN_TEST(test_truncated_image_is_not_finished);
+    RUN_TEST(test_image_larger_than_announced_is_refused);
+    RUN_TEST(test_delta_is_applied_to_running_image);
+    RUN_TEST(test_compressed_delta_with_backward_seek);
+    RUN_TEST(test_delta_for_other_image_writes_nothing);
+    RUN_TEST(test_delta_outside_running_image_is_refused);
+    RUN_TEST(test_unknown_format_is_refused);
+    return UNITY_END();
+}
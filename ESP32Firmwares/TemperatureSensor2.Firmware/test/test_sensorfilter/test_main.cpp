@@ -0,0 +1,163 @@
+// Host tests of the shared outlier and fault filter (SharedLibs/SensorFilter): pio test -e native
+
+#include <unity.h>
+
+#include "SensorFilter.h"
+
+// Hundredths of °C, 2 K per minute, stuck after 10 minutes, failed after 3 bad readings
+static const SensorFilterConfig config = {-4000, 12500, 200, 600000, 3};
+static SensorFilter filter;
+
+void setUp()
+{
+    filter.reset();
+}
+
+void tearDown()
+{
+}
+
+// Feeds values 10 s apart starting at *nowMs
+static void feed(const int32_t *values, int count, uint32_t &nowMs)
+{
+    for (int i = 0; i < count; i++)
+    {
+        filter.add(values[i], nowMs, config);
+        nowMs += 10000;
+    }
+}
+
+void test_median_of_window()
+{
+    const int32_t values[] = {5, 1, 4, 2, 3};
+    TEST_ASSERT_EQUAL_INT32(3, SensorFilter::median(values, 5));
+    TEST_ASSERT_EQUAL_INT32(4, SensorFilter::median(values, 3));
+    TEST_ASSERT_EQUAL_INT32(1, SensorFilter::median(values, 2));
+}
+
+void test_warmup_until_half_window()
+{
+    uint32_t now = 0;
+    TEST_ASSERT_FALSE(filter.add(2000, now, config));
+    TEST_ASSERT_FALSE(filter.add(2001, now += 10000, config));
+    TEST_ASSERT_EQUAL(SensorHealth::Warmup, filter.health());
+    TEST_ASSERT_TRUE(filter.add(2002, now += 10000, config));
+    TEST_ASSERT_EQUAL(SensorHealth::Ok, filter.health());
+    TEST_ASSERT_EQUAL_INT32(2001, filter.value());
+}
+
+void test_single_spike_never_reaches_output()
+{
+    uint32_t now = 0;
+    const int32_t values[] = {2000, 2001, 2002, 2001, 8500, 2002, 2001};
+    for (int32_t value : values)
+    {
+        filter.add(value, now, config);
+        TEST_ASSERT_TRUE(filter.value() < 2100);
+        now += 10000;
+    }
+    TEST_ASSERT_EQUAL(SensorHealth::Ok, filter.health());
+}
+
+void test_out_of_range_is_rejected()
+{
+    uint32_t now = 0;
+    const int32_t values[] = {2000, 2000, 2001};
+    feed(values, 3, now);
+    TEST_ASSERT_FALSE(filter.add(SensorFilter::toFixed(-127.0f), now, config));
+    TEST_ASSERT_EQUAL(SensorHealth::Spike, filter.health());
+    TEST_ASSERT_EQUAL_UINT32(1, filter.rejected);
+    TEST_ASSERT_EQUAL_INT32(2000, filter.value());
+}
+
+void test_rate_limit_rejects_fast_change_then_follows()
+{
+    uint32_t now = 0;
+    const int32_t steady[] = {2000, 2000, 2000};
+    feed(steady, 3, now);
+
+    // A real step of 5 K: the median jumps after three readings, faster than 2 K/min
+    const int32_t step[] = {2500, 2500, 2500};
+    feed(step, 3, now);
+    TEST_ASSERT_EQUAL(SensorHealth::Spike, filter.health());
+    TEST_ASSERT_EQUAL_INT32(2000, filter.value());
+
+    // Allowed change grows with the time since the last accepted value
+    now += 150000;
+    TEST_ASSERT_TRUE(filter.add(2500, now, config));
+    TEST_ASSERT_EQUAL_INT32(2500, filter.value());
+}
+
+void test_repeated_failures_mark_failed()
+{
+    uint32_t now = 0;
+    const int32_t values[] = {2000, 2000, 2001};
+    feed(values, 3, now);
+    filter.addError(config);
+    filter.addError(config);
+    TEST_ASSERT_EQUAL(SensorHealth::Ok, filter.health());
+    filter.addError(config);
+    TEST_ASSERT_EQUAL(SensorHealth::Failed, filter.health());
+    TEST_ASSERT_EQUAL_UINT32(3, filter.errors);
+
+    TEST_ASSERT_TRUE(filter.add(2001, now, config));
+    TEST_ASSERT_EQUAL(SensorHealth::Ok, filter.health());
+}
+
+void test_unchanged_value_marks_stuck()
+{
+    uint32_t now = 0;
+    for (int i = 0; i < 60; i++)
+    {
+        filter.add(2000, now, config);
+        now += 10000;
+    }
+    TEST_ASSERT_EQUAL(SensorHealth::Ok, filter.health());
+    filter.add(2000, now, config);
+    TEST_ASSERT_EQUAL(SensorHealth::Stuck, filter.health());
+
+    TEST_ASSERT_TRUE(filter.add(2001, now + 10000, config));
+    TEST_ASSERT_EQUAL(SensorHealth::Ok, filter.health());
+}
+
+void test_stable_value_stays_published_when_stuck()
+{
+    uint32_t now = 0;
+    for (int i = 0; i < 61; i++)
+    {
+        filter.add(2000, now, config);
+        now += 10000;
+    }
+    TEST_ASSERT_EQUAL(SensorHealth::Stuck, filter.health());
+
+    // Still accepted on every reading, only the health says stuck
+    for (int i = 0; i < 10; i++)
+    {
+        TEST_ASSERT_TRUE(filter.add(2000, now, config));
+        TEST_ASSERT_EQUAL(SensorHealth::Stuck, filter.health());
+        TEST_ASSERT_EQUAL_INT32(2000, filter.value());
+        now += 10000;
+    }
+}
+
+void test_fixed_point_rounding()
+{
+    TEST_ASSERT_EQUAL_INT32(2137, SensorFilter::toFixed(21.37f));
+    TEST_ASSERT_EQUAL_INT32(-563, SensorFilter::toFixed(-5.625f));
+    TEST_ASSERT_EQUAL_FLOAT(21.37f, SensorFilter::fromFixed(2137));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_median_of_window);
+    RUN_TEST(test_warmup_until_half_window);
+    RUN_TEST(test_single_spike_never_reaches_output);
+    RUN_TEST(test_out_of_range_is_rejected);
+    RUN_TEST(test_rate_limit_rejects_fast_change_then_follows);
+    RUN_TEST(test_repeated_failures_mark_failed);
+    RUN_TEST(test_unchanged_value_marks_stuck);
+    RUN_TEST(test_stable_value_stays_published_when_stuck);
+    RUN_TEST(test_fixed_point_rounding);
+    return UNITY_END();
+}
@@ -16,6 +16,7 @@
 // Shared libaries
 #include "AzureOTAUpdater.h"
 #include "WifiLib.h"
+#include "WiFiFastConnect.h"
 
 const char* version = TEMPSENSORFW_VERSION;
 String chipID = "";
@@ -23,6 +24,7 @@ String chipID = "";
 // WiFi credentials are read from environment variables and used during compile-time (see platformio.ini)
 // Set WIFI_PASSWORDS as environment variables on your dev-system following the pattern: WIFI_PASSWORDS="ssid1;password1|ssid2;password2"
 WifiLib wifiLib(WIFI_PASSWORDS);
+WiFiFastConnect wifiFast(WIFI_PASSWORDS);
 WiFiClient wifiClient;
 WiFiUDP ntpUDP;
 NTPClient timeClient(ntpUDP);
@@ -178,9 +180,9 @@ void connectToWiFi() {
   
     // Connect to WiFi
   Serial.print("Connecting to WiFi ");
-  wifiLib.scanAndSelectNetwork();
-  wifiLib.connect();
-  String ssid = wifiLib.getSSID();
+  // Access point and address of the last boot first, scan only if that fails
+  wifiFast.connectOrScan(wifiLib);
+  String ssid = WiFi.SSID();
 
   timeClient.begin();
   timeClient.setTimeOffset(0); // Set your time offset from UTC in seconds
@@ -40,12 +40,18 @@ var coolingFlowDeadbandKelvin = double.Parse(configuration["CoolingFlowDeadbandK
 var pulseSecondsPerKelvin = double.Parse(configuration["PulseSecondsPerKelvin"] ?? "5.0", System.Globalization.CultureInfo.InvariantCulture);
 var minPulseSeconds = int.Parse(configuration["MinPulseSeconds"] ?? "2");
 var maxPulseSeconds = int.Parse(configuration["MaxPulseSeconds"] ?? "20");
+// Setpoint mode: the MixerController regulates locally (PI controller), the
+// RulesEngine only enables it and sends the target instead of pulses
+var localMixerControl = bool.Parse(configuration["LocalMixerControl"] ?? "false");
+var fbhzMixerSetpointTopic = fbhzMixerCommandTopic + "/setpoint";
 
 Console.WriteLine($" ### Configuration: MQTT Broker={mqttBroker}:{mqttPort}, Health Check Port={healthCheckPort}");
 Console.WriteLine($" ### FA_Status topic: {faStatusTopic}");
 Console.WriteLine($" ### Mixer command topics: {string.Join(", ", mixerCommandTopics)}");
 Console.WriteLine($" ### Max status age: {maxStatusAgeMinutes} min, evaluation interval: {evaluationIntervalSeconds} s");
-Console.WriteLine($" ### Flow regulation: target {coolingFlowTargetTemperature}°C ±{coolingFlowDeadbandKelvin}K, {pulseSecondsPerKelvin} s/K ({minPulseSeconds}-{maxPulseSeconds} s) -> {fbhzMixerCommandTopic}");
+Console.WriteLine(localMixerControl
+    ? $" ### Flow regulation: local PI control, target {coolingFlowTargetTemperature}°C -> {fbhzMixerSetpointTopic}"
+    : $" ### Flow regulation: target {coolingFlowTargetTemperature}°C ±{coolingFlowDeadbandKelvin}K, {pulseSecondsPerKelvin} s/K ({minPulseSeconds}-{maxPulseSeconds} s) -> {fbhzMixerCommandTopic}");
 Console.WriteLine($" ### Config topic: {configTopic} (retained JSON, overrides CoolingFlowTargetTemperature at runtime)");
 
 // FA_Status 4 = Warmwasserladung der Hoval Belaria — fixed by the heat pump, not configuration
@@ -63,6 +69,7 @@ DateTimeOffset lastFbhzPumpTime = DateTimeOffset.MinValue;
 double? lastFbhzFlowTemp = null;
 DateTimeOffset lastFbhzFlowTempTime = DateTimeOffset.MinValue;
 MixerPosition? lastPublishedPosition = null;
+string? lastPublishedSetpoint = null;
 var evaluationLock = new object();
 
 // Start health check HTTP server in background
@@ -93,7 +100,14 @@ var initialPublishTimer = new Timer(_ => EvaluateAndPublish("startup", force: tr
 var evaluationTimer = new Timer(_ =>
 {
     EvaluateAndPublish("periodic evaluation");
-    EvaluateCoolingPulse();
+    if (localMixerControl)
+    {
+        EvaluateCoolingSetpoint();
+    }
+    else
+    {
+        EvaluateCoolingPulse();
+    }
 }, null, evaluationIntervalSeconds * 1000, evaluationIntervalSeconds * 1000);
 
 Thread.Sleep(Timeout.Infinite);
@@ -218,6 +232,47 @@ void EvaluateCoolingPulse()
     }
 }
 
+void EvaluateCoolingSetpoint()
+{
+    try
+    {
+        string payload;
+        lock (evaluationLock)
+        {
+            var enabled = coolingRule.AllowsRegulation(
+                lastPublishedPosition,
+                lastFbhzPumpRunning, Age(lastFbhzPumpTime, DateTimeOffset.UtcNow));
+            payload = System.Text.Json.JsonSerializer.Serialize(new
+            {
+                Enabled = enabled,
+                Setpoint = coolingFlowTargetTemperature,
+                MinOpenPercent = 0,
+                MaxOpenPercent = 100
+            });
+            if (payload == lastPublishedSetpoint)
+            {
+                return;
+            }
+            lastPublishedSetpoint = payload;
+        }
+
+        // Retained: the firmware keeps regulating on the last setpoint while
+        // the RulesEngine or the broker is away, and gets it back after a reboot
+        Console.WriteLine($"Cooling setpoint '{payload}'");
+        mqttClient.PublishAsync(fbhzMixerSetpointTopic, payload, MqttQualityOfServiceLevel.AtLeastOnce, true)
+            .GetAwaiter().GetResult();
+        RulesEngineHealthCheck.UpdateLastEvaluation();
+    }
+    catch (Exception ex)
+    {
+        lock (evaluationLock)
+        {
+            lastPublishedSetpoint = null;
+        }
+        Console.WriteLine($"Error publishing cooling setpoint: {ex.Message}");
+    }
+}
+
 void ApplyConfig(string payload)
 {
     try
@@ -57,19 +57,8 @@ public class CoolingFlowTemperatureRule
         double? flowTemperature, TimeSpan flowTemperatureAge,
         double targetTemperature)
     {
-        // The base rule owns the mixer whenever it does not say "open"
-        if (basePosition != MixerPosition.Open)
-        {
-            return null;
-        }
-
-        if (pumpStatusAge > maxInputAge || flowTemperatureAge > maxInputAge)
-        {
-            return null;
-        }
-
-        // Without circulation the sensor reads standing water, not the circuit
-        if (pumpRunning != true)
+        if (!AllowsRegulation(basePosition, pumpRunning, pumpStatusAge)
+            || flowTemperatureAge > maxInputAge)
         {
             return null;
         }
@@ -91,4 +80,27 @@ public class CoolingFlowTemperatureRule
         // Open = more cold buffer water (lowers flow temp), close = less
         return new MixerPulse(error > 0 ? PulseDirection.Open : PulseDirection.Close, seconds);
     }
+
+    /// <summary>
+    /// Supervisor gate, shared by the pulse mode above and the local PI
+    /// controller of the MixerController firmware (setpoint mode): the
+    /// firmware regulates on its own flow sensor, so only the base command
+    /// and the circuit pump decide whether regulation is allowed at all.
+    /// </summary>
+    public bool AllowsRegulation(MixerPosition? basePosition, bool? pumpRunning, TimeSpan pumpStatusAge)
+    {
+        // The base rule owns the mixer whenever it does not say "open"
+        if (basePosition != MixerPosition.Open)
+        {
+            return false;
+        }
+
+        if (pumpStatusAge > maxInputAge)
+        {
+            return false;
+        }
+
+        // Without circulation the sensor reads standing water, not the circuit
+        return pumpRunning == true;
+    }
 }
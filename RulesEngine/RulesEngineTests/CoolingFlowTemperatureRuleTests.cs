@@ -133,4 +133,19 @@ public class CoolingFlowTemperatureRuleTests
         pulse!.Direction.Should().Be(PulseDirection.Close);
         pulse.Seconds.Should().Be(14); // 2,8 K * 5 s/K
     }
+
+    [Fact]
+    public void AllowsRegulation_OnlyWithOpenBaseAndRunningPump()
+    {
+        var rule = CreateRule();
+
+        // Setpoint mode: the firmware measures the flow itself, the gate
+        // ignores the RulesEngine's flow temperature
+        rule.AllowsRegulation(MixerPosition.Open, true, Fresh).Should().BeTrue();
+        rule.AllowsRegulation(MixerPosition.Closed, true, Fresh).Should().BeFalse();
+        rule.AllowsRegulation(null, true, Fresh).Should().BeFalse();
+        rule.AllowsRegulation(MixerPosition.Open, false, Fresh).Should().BeFalse();
+        rule.AllowsRegulation(MixerPosition.Open, null, Fresh).Should().BeFalse();
+        rule.AllowsRegulation(MixerPosition.Open, true, Stale).Should().BeFalse();
+    }
 }
@@ -97,4 +97,14 @@
             MeasurementType = MeasurementType.Volume;
         }
     }
+    
+    public record InfluxPressureRecord : InfluxRecord
+    {
+        public required string SubCategory { get; init; }
+        public required decimal Value_Bar { get; init; } // in bar
+        public InfluxPressureRecord()
+        {
+            MeasurementType = MeasurementType.Pressure;
+        }
+    }
 }
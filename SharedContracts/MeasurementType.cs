@@ -9,6 +9,7 @@
         Temperature,
         Status,
         Counter,
-        Volume
+        Volume,
+        Pressure
     }
 }
@@ -7,13 +7,17 @@ namespace SharedContracts
     /// Target is always the last commanded full-travel position ("open" or
     /// "closed") — while the step controller holds an intermediate position,
     /// Position is "partial" but Target keeps the base command.
-    /// OpenPercent (100 = fully open) is the firmware's travel-time estimate;
-    /// absent while no reference run has established the position.
+    /// OpenPercent (100 = fully open) is the firmware's position estimate
+    /// (travel time, corrected by temperatures); absent while no reference run
+    /// has established the position. OpenPercentStdDev is its uncertainty,
+    /// MeasuredOpenPercent the last position derived from the temperatures.
     /// </summary>
     public record MixerStatusData(
         string Position,
         string Target,
         bool Moving,
         string Timestamp,
-        int? OpenPercent = null);
+        int? OpenPercent = null,
+        int? OpenPercentStdDev = null,
+        int? MeasuredOpenPercent = null);
 }
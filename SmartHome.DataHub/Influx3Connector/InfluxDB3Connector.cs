@@ -314,6 +314,25 @@ namespace Influx3Connector
             pointsEnqueuedByTable.AddOrUpdate("volume_values", 1, (_, c) => c + 1);
         }
 
+        public void WritePressureValue(InfluxPressureRecord record, DateTimeOffset timestamp)
+        {
+            var point = PointData.Measurement("pressure_values")
+                .SetTag("measurement_id", record.MeasurementId)
+                .SetTag("category", record.Category.ToString())
+                .SetTag("sub_category", record.SubCategory)
+                .SetTag("sensor_type", record.SensorType)
+                .SetTag("location", record.Location)
+                .SetTag("device", record.Device)
+                .SetTag("measurement", record.Measurement)
+                .SetField("value_bar", Convert.ToDouble(record.Value_Bar))
+                .SetTimestamp(timestamp);
+            lock (pointsBatch)
+            {
+                pointsBatch.Add(point);
+            }
+            pointsEnqueuedByTable.AddOrUpdate("pressure_values", 1, (_, c) => c + 1);
+        }
+
         public void WritePointDataToInfluxDb(
             string measurement,
             IEnumerable<(string Key, string Value)> tags,
@@ -701,6 +701,21 @@ void WriteCangatewayDataToDB(InfluxDB3Connector influx3Connector, string payload
                 },
                 DateTimeOffset.UtcNow);
             break;
+        case "Druck":
+            influx3Connector.WritePressureValue(
+                new InfluxPressureRecord
+                {
+                    MeasurementId = measurementId,
+                    Category = MeasurementCategory.Heizung,
+                    SubCategory = subCategory,
+                    SensorType = "CanGateway",
+                    Location = location,
+                    Device = "Waermepumpe",
+                    Measurement = meassurement,
+                    Value_Bar = Decimal.Parse(payload, NumberStyles.Float, CultureInfo.InvariantCulture),
+                },
+                DateTimeOffset.UtcNow);
+            break;
     }
 }
 